@@ -3,6 +3,32 @@ layout(binding = 2) uniform sampler2DShadow shadowDepthSampler;
 layout(binding = 3) uniform sampler2D cloudShadowTexture;
 layout(binding = 4) uniform sampler2D ssaoTexture;
 
+#if POINT_LIGHTS_ENABLED
+struct PointLight
+{
+    vec3 position;
+    float radius;
+    vec3 color;
+    float falloff;
+};
+
+layout(std430, binding = 0) readonly buffer PointLightBuffer
+{
+    PointLight pointLights[];
+};
+
+// x = offset into lightIndices, y = light count
+layout(std430, binding = 1) readonly buffer LightClusterBuffer
+{
+    uvec2 lightClusters[];
+};
+
+layout(std430, binding = 2) readonly buffer LightIndexBuffer
+{
+    uint lightIndices[];
+};
+#endif
+
 float getSunShadow(sampler2DShadow tex, vec3 shadowCoord)
 {
 #if SHADOWS_ENABLED
@@ -105,12 +131,15 @@ vec4 lighting(vec4 color, vec3 normal, vec3 shadowCoord, vec3 worldPosition,
 
     // point lights
 #if POINT_LIGHTS_ENABLED
-    uint partitionX = uint((float(gl_FragCoord.x) * invResolution.x) * LIGHT_SPLITS);
-    uint partitionY = uint((1.f - (float(gl_FragCoord.y) * invResolution.y)) * LIGHT_SPLITS);
-    uint pointLightCount = lightPartitions[partitionX][partitionY].pointLightCount;
-    for (uint i=0; i<pointLightCount; ++i)
+    float viewDepth = -(cameraView * vec4(worldPosition, 1.0)).z;
+    uint clusterX = min(uint(gl_FragCoord.x * invResolution.x * CLUSTER_TILES_X), uint(CLUSTER_TILES_X - 1));
+    uint clusterY = min(uint(gl_FragCoord.y * invResolution.y * CLUSTER_TILES_Y), uint(CLUSTER_TILES_Y - 1));
+    uint clusterZ = uint(clamp(log(max(viewDepth, 0.0001)) * clusterDepthScale - clusterDepthBias,
+                0.0, float(CLUSTER_SLICES - 1)));
+    uvec2 cluster = lightClusters[(clusterZ * uint(CLUSTER_TILES_Y) + clusterY) * uint(CLUSTER_TILES_X) + clusterX];
+    for (uint i=0; i<cluster.y; ++i)
     {
-        PointLight light = lightPartitions[partitionX][partitionY].pointLights[i];
+        PointLight light = pointLights[lightIndices[cluster.x + i]];
         vec3 lightDiff = light.position - worldPosition;
         float distance = length(lightDiff);
         vec3 lightDirection = lightDiff / distance;
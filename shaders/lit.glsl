@@ -8,8 +8,22 @@ layout(location = 2) in vec4 attrTangent;
 layout(location = 3) in vec2 attrTexCoord;
 layout(location = 4) in vec3 attrColor;
 
+#if defined INSTANCED
+struct Instance
+{
+    mat4 worldMatrix;
+    mat3 normalMatrix;
+};
+layout(std430, binding = 3) readonly buffer InstanceBuffer
+{
+    Instance instances[];
+};
+layout(location = 12) uniform uint instanceOffset;
+layout(location = 13) uniform vec2 instanceFadeDistance;
+#else
 layout(location = 0) uniform mat4 worldMatrix;
 layout(location = 1) uniform mat3 normalMatrix;
+#endif
 layout(location = 8) uniform float windAmount;
 
 layout(location = 0) out vec3 outNormal;
@@ -26,7 +40,21 @@ layout(location = 6) out mat3 outTBN;
 
 void main()
 {
+#if defined INSTANCED
+    mat4 worldMatrix = instances[instanceOffset + gl_InstanceID].worldMatrix;
+    mat3 normalMatrix = instances[instanceOffset + gl_InstanceID].normalMatrix;
+#endif
     outWorldPosition = (worldMatrix * vec4(attrPosition, 1.0)).xyz;
+#if defined INSTANCED
+    if (instanceFadeDistance.y > 0.0)
+    {
+        // shrink the instance towards its origin as it gets close to the fade end distance
+        vec3 origin = worldMatrix[3].xyz;
+        float fade = 1.0 - smoothstep(instanceFadeDistance.x, instanceFadeDistance.y,
+                distance(origin, cameraPosition.xyz));
+        outWorldPosition = origin + (outWorldPosition - origin) * fade;
+    }
+#endif
 #if !defined VEHICLE
     outWorldPosition.x += sin(outWorldPosition.x + outWorldPosition.y * 0.5f + outWorldPosition.z * 0.2f + time * 0.8f) * windAmount * attrTexCoord.y;
 #endif
@@ -51,6 +51,12 @@ void main()
     vec4 texColor = texture(tex, inTexCoord);
     vec4 c = color * texColor;
     outColor = vec4(mix(texture(texBlurBg, inScreenTexCoord).rgb, c.rgb, c.a), texColor.a * uAlpha);
+#elif defined SDF
+    // the distance field is 0.5 on the outline; the edge is blended over about one pixel at any
+    // size the glyph is drawn at
+    float dist = texture(tex, inTexCoord).r;
+    float edgeWidth = max(fwidth(dist) * 0.75, 0.001);
+    outColor = color * vec4(1.0, 1.0, 1.0, smoothstep(0.5 - edgeWidth, 0.5 + edgeWidth, dist));
 #else
     outColor = color * vec4(1.0, 1.0, 1.0, texture(tex, inTexCoord).r);
 #endif
@@ -1,17 +1,3 @@
-struct PointLight
-{
-    vec3 position;
-    float radius;
-    vec3 color;
-    float falloff;
-};
-
-struct LightPartition
-{
-    PointLight pointLights[MAX_POINT_LIGHTS];
-    uint pointLightCount;
-};
-
 layout (std140, binding = 0) uniform WorldInfo
 {
     mat4 orthoProjection;
@@ -24,7 +10,6 @@ layout (std140, binding = 0) uniform WorldInfo
     mat4 cameraView;
     vec3 cameraPosition;
     mat4 shadowViewProjectionBias;
-    LightPartition lightPartitions[LIGHT_SPLITS][LIGHT_SPLITS];
     vec3 fogColor;
     float fogDensity;
     vec2 invResolution;
@@ -32,5 +17,7 @@ layout (std140, binding = 0) uniform WorldInfo
     float cloudShadowStrength;
     vec3 ambientColor;
     float ambientStrength;
+    float clusterDepthScale;
+    float clusterDepthBias;
 };
 
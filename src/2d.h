@@ -234,7 +234,7 @@ namespace ui
     void text(i32 priority, Font* font, const char* s, Vec2 pos, Vec3 color, f32 alpha=1.f,
             f32 scale=1.f, HAlign halign=HAlign::LEFT, VAlign valign=VAlign::TOP)
     {
-        static ShaderHandle shader = getShaderHandle("quad2D", {});
+        static ShaderHandle shader = getShaderHandle("quad2D", { {"SDF"} });
 
         Text text;
         text.font = font;
@@ -0,0 +1,247 @@
+#include "ai_scheduler.h"
+#include "vehicle.h"
+#include "imgui.h"
+#include "game.h"
+
+void AIScheduler::takeSnapshots(Array<OwnedPtr<Vehicle>>& vehicles)
+{
+    snapshots.clear();
+    for (auto& v : vehicles)
+    {
+        snapshots.push({ v->getPosition(), v->isDead() });
+    }
+}
+
+void AIScheduler::runDecisions(u32 taskCount)
+{
+    jobs.clear();
+    if (pending.empty())
+    {
+        return;
+    }
+
+    // keep the decisions of each vehicle together and in the order they were picked
+    for (u32 i=0; i<pending.size(); ++i)
+    {
+        pending[i].order = i;
+    }
+    pending.sort([](auto& a, auto& b) {
+        if (a.vehicle->vehicleIndex != b.vehicle->vehicleIndex)
+        {
+            return a.vehicle->vehicleIndex < b.vehicle->vehicleIndex;
+        }
+        return a.order < b.order;
+    });
+
+    u32 decisionsPerTask = (pending.size() + taskCount - 1) / max(taskCount, 1u);
+    u32 begin = 0;
+    for (u32 i=1; i<=pending.size(); ++i)
+    {
+        if (i == pending.size() || (i - begin >= decisionsPerTask
+                    && pending[i].vehicle != pending[i - 1].vehicle))
+        {
+            jobs.push({ pending.data() + begin, pending.data() + i, &snapshots });
+            begin = i;
+        }
+    }
+
+    auto runJob = [](void* data) -> void* {
+        DecisionJob* job = (DecisionJob*)data;
+        for (PendingDecision* p = job->begin; p != job->end; ++p)
+        {
+            f64 decisionStartTime = getTime();
+            p->vehicle->runAiDecision(p->decision, *job->snapshots);
+            p->cost = getTime() - decisionStartTime;
+        }
+        return nullptr;
+    };
+    if (jobs.size() == 1)
+    {
+        runJob(&jobs[0]);
+    }
+    else
+    {
+        TaskGroup group;
+        for (auto& job : jobs)
+        {
+            g_threadPool.addTask(group, { &job, runJob });
+        }
+        g_threadPool.wait(group);
+    }
+}
+
+void AIScheduler::update(Scene* scene, Array<OwnedPtr<Vehicle>>& vehicles)
+{
+    f64 t = getTime();
+    f64 worldTime = scene->getWorldTime();
+
+    pending.clear();
+    if (scene->getPaths().size() > 0)
+    {
+        for (auto& v : vehicles)
+        {
+            if (v->driver->isPlayer || v->isDead())
+            {
+                continue;
+            }
+            for (u32 i=0; i<NUM_AI_DECISIONS; ++i)
+            {
+                f32 urgency = (f32)(worldTime - v->aiDecisionTimes[i]) / decisionInterval[i];
+                if (urgency >= 1.f)
+                {
+                    pending.push({ v.get(), (AIDecision)i, urgency, 0, 0.0 });
+                }
+            }
+        }
+    }
+    pending.sort([](auto& a, auto& b) { return a.urgency > b.urgency; });
+
+    // pick the most urgent decisions by their expected cost before running any of them, so that
+    // which ones run doesn't depend on how they are split into tasks
+    f64 budget = g_game.config.gameplay.aiBudgetMicroseconds * 0.000001;
+    f64 expectedCost = 0.0;
+    u32 decisionCount = 0;
+    while (decisionCount < pending.size())
+    {
+        f64 cost = averageCost[(u32)pending[decisionCount].decision];
+        if (decisionCount > 0 && expectedCost + cost > budget)
+        {
+            break;
+        }
+        expectedCost += cost;
+        ++decisionCount;
+    }
+    lastPendingCount = pending.size() - decisionCount;
+    pending.resize(decisionCount);
+
+    f32 maxStaleness = 0.f;
+    for (auto& p : pending)
+    {
+        u32 index = (u32)p.decision;
+        maxStaleness = max(maxStaleness, p.urgency * decisionInterval[index]);
+        p.vehicle->aiDecisionTimes[index] = worldTime;
+        ++decisionCounts[index];
+    }
+
+    takeSnapshots(vehicles);
+    u32 taskCount = 1;
+    if (isParallelEnabled)
+    {
+        taskCount = clamp(decisionCount / MIN_DECISIONS_PER_TASK, 1u,
+                max(g_threadPool.getThreadCount(), 1u));
+    }
+    runDecisions(taskCount);
+
+    f64 decisionTime = 0.0;
+    for (auto& p : pending)
+    {
+        u32 index = (u32)p.decision;
+        averageCost[index] = averageCost[index] * 0.9 + p.cost * 0.1;
+        decisionTime += p.cost;
+    }
+
+    lastFrameTime = getTime() - t;
+    lastDecisionTime = decisionTime;
+    lastTaskCount = jobs.size();
+    lastDecisionCount = decisionCount;
+    lastMaxStaleness = maxStaleness;
+    if (decisionTime > budget)
+    {
+        ++framesOverBudget;
+    }
+    frameTimeHistory[historyIndex] = (f32)(decisionTime * 1000000.0);
+    historyIndex = (historyIndex + 1) % HISTORY_SIZE;
+}
+
+bool AIScheduler::checkDeterminism(Scene* scene, Array<OwnedPtr<Vehicle>>& vehicles)
+{
+    if (scene->getPaths().empty())
+    {
+        return false;
+    }
+
+    Array<AIDecisionState> initialStates;
+    for (auto& v : vehicles)
+    {
+        initialStates.push(v->getAiDecisionState());
+    }
+    takeSnapshots(vehicles);
+
+    auto makeAllDecisions = [&](u32 taskCount) -> u64 {
+        pending.clear();
+        for (u32 i=0; i<vehicles.size(); ++i)
+        {
+            Vehicle* v = vehicles[i].get();
+            v->setAiDecisionState(initialStates[i]);
+            if (v->driver->isPlayer || v->isDead())
+            {
+                continue;
+            }
+            for (u32 d=0; d<NUM_AI_DECISIONS; ++d)
+            {
+                pending.push({ v, (AIDecision)d, 1.f, 0, 0.0 });
+            }
+        }
+        runDecisions(taskCount);
+
+        u64 hash = HASH_SEED;
+        for (auto& v : vehicles)
+        {
+            hash = v->hashAiDecisionState(hash);
+        }
+        return hash;
+    };
+    u64 serialHash = makeAllDecisions(1);
+    u32 taskCount = max(g_threadPool.getThreadCount(), 1u);
+    u64 parallelHash = makeAllDecisions(taskCount);
+    pending.clear();
+
+    bool matches = serialHash == parallelHash;
+    if (matches)
+    {
+        println("AI decisions match: %016llx", (unsigned long long)serialHash);
+    }
+    else
+    {
+        error("AI decisions differ: 1 task %016llx, %u tasks %016llx",
+                (unsigned long long)serialHash, taskCount, (unsigned long long)parallelHash);
+    }
+    return matches;
+}
+
+void AIScheduler::reset()
+{
+    pending.clear();
+    lastFrameTime = 0.0;
+    lastDecisionTime = 0.0;
+    lastTaskCount = 0;
+    lastDecisionCount = 0;
+    lastPendingCount = 0;
+    lastMaxStaleness = 0.f;
+    framesOverBudget = 0;
+    for (u32 i=0; i<NUM_AI_DECISIONS; ++i)
+    {
+        decisionCounts[i] = 0;
+    }
+    for (u32 i=0; i<HISTORY_SIZE; ++i)
+    {
+        frameTimeHistory[i] = 0.f;
+    }
+    historyIndex = 0;
+}
+
+void AIScheduler::showDebugInfo()
+{
+    ImGui::SliderFloat("AI Budget (us)", &g_game.config.gameplay.aiBudgetMicroseconds,
+            25.f, 2000.f);
+    ImGui::Checkbox("Make AI Decisions On Worker Threads", &isParallelEnabled);
+    ImGui::Text("AI Decisions: %u made in %.1fus (%.1fus on %u tasks), %u deferred, oldest %.0fms",
+            lastDecisionCount, lastDecisionTime * 1000000.0, lastFrameTime * 1000000.0,
+            lastTaskCount, lastPendingCount, lastMaxStaleness * 1000.f);
+    ImGui::Text("AI Frames Over Budget: %u", framesOverBudget);
+    ImGui::Text("AI Decisions Made: %u path, %u obstacles, %u target, %u items",
+            decisionCounts[(u32)AIDecision::PATH], decisionCounts[(u32)AIDecision::OBSTACLES],
+            decisionCounts[(u32)AIDecision::TARGET], decisionCounts[(u32)AIDecision::ITEMS]);
+    ImGui::PlotLines("AI Time (us)", frameTimeHistory, HISTORY_SIZE, historyIndex, nullptr,
+            0.f, g_game.config.gameplay.aiBudgetMicroseconds * 2.f, ImVec2(0, 60));
+}
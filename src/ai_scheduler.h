@@ -0,0 +1,91 @@
+#pragma once
+
+#include "misc.h"
+
+// the AI decisions that are too expensive to make for every driver on every frame
+enum struct AIDecision : u32
+{
+    PATH,
+    OBSTACLES,
+    TARGET,
+    ITEMS,
+};
+
+const u32 NUM_AI_DECISIONS = 4;
+
+// what the decisions may know about the other vehicles, taken before any of the frame's
+// decisions are made so that they can run in any order
+struct AIVehicleSnapshot
+{
+    Vec3 position;
+    bool isDead;
+};
+
+// Spreads the AI decisions of all the drivers over frames. Each decision is due again a fixed
+// interval after it was last made, and the most overdue decisions run first until the frame's
+// budget is used up. The remaining ones wait for the next frame and only get more urgent, so a
+// burst of work turns into slightly older decisions rather than a long frame. Steering toward the
+// current decisions still happens every frame in Vehicle::updateAiInput().
+//
+// A decision only writes to its own vehicle and only reads the snapshot of the others, so the
+// decisions of different vehicles run on the worker threads. The decisions of one vehicle always
+// run on the same task in order of urgency, which makes the results the same for any number of
+// tasks. The scene queries happen after the physics results have been fetched and before the next
+// step is started, while PhysX allows any number of threads to read the scene.
+class AIScheduler
+{
+    static constexpr u32 HISTORY_SIZE = 120;
+    static constexpr u32 MIN_DECISIONS_PER_TASK = 4;
+
+    struct PendingDecision
+    {
+        class Vehicle* vehicle;
+        AIDecision decision;
+        f32 urgency;
+        u32 order;
+        f64 cost;
+    };
+
+    struct DecisionJob
+    {
+        PendingDecision* begin;
+        PendingDecision* end;
+        Array<AIVehicleSnapshot> const* snapshots;
+    };
+
+    Array<PendingDecision> pending;
+    Array<DecisionJob> jobs;
+    Array<AIVehicleSnapshot> snapshots;
+    // moving average of how long each kind of decision takes, used to tell whether the next one
+    // fits in what is left of the budget
+    f64 averageCost[NUM_AI_DECISIONS] = { 20e-6, 20e-6, 20e-6, 20e-6 };
+
+    void takeSnapshots(Array<OwnedPtr<class Vehicle>>& vehicles);
+    // runs every pending decision and stores how long each one took
+    void runDecisions(u32 taskCount);
+
+public:
+    // how often each decision is made when there is time for it
+    f32 decisionInterval[NUM_AI_DECISIONS] = { 0.25f, 0.1f, 0.2f, 0.2f };
+    bool isParallelEnabled = true;
+
+    // telemetry for the last frame, shown in the debug overlay
+    f64 lastFrameTime = 0.0;
+    f64 lastDecisionTime = 0.0;
+    u32 lastTaskCount = 0;
+    u32 lastDecisionCount = 0;
+    u32 lastPendingCount = 0;
+    f32 lastMaxStaleness = 0.f;
+    u32 framesOverBudget = 0;
+    u32 decisionCounts[NUM_AI_DECISIONS] = {};
+    f32 frameTimeHistory[HISTORY_SIZE] = {};
+    u32 historyIndex = 0;
+
+    // at least one decision is made every frame that has any due, even if it goes over budget
+    void update(class Scene* scene, Array<OwnedPtr<class Vehicle>>& vehicles);
+    // makes every decision for every AI driver on one task and then on all the workers and checks
+    // that the results match
+    bool checkDeterminism(class Scene* scene, Array<OwnedPtr<class Vehicle>>& vehicles);
+    void reset();
+    void showDebugInfo();
+};
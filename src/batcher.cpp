@@ -4,6 +4,29 @@ void Batcher::end(bool keepMeshData)
 {
     for (auto& itemsForThisMaterial : materialMap)
     {
+        // repeated meshes keep their own vertices and are drawn with one instanced call
+        Map<Mesh*, u32> meshCounts;
+        for (auto& item : itemsForThisMaterial.value)
+        {
+            ++meshCounts[item.mesh];
+        }
+        Array<BatchableItem> itemsToMerge;
+        for (auto& item : itemsForThisMaterial.value)
+        {
+            if (*meshCounts.get(item.mesh) >= MIN_INSTANCED_MESH_COUNT)
+            {
+                instances.add(itemsForThisMaterial.key, item.transform, item.mesh);
+            }
+            else
+            {
+                itemsToMerge.push(item);
+            }
+        }
+        if (itemsToMerge.empty())
+        {
+            continue;
+        }
+
         Mesh bigBatchedMesh;
         bigBatchedMesh.name = tmpStr("%s Batch", itemsForThisMaterial.key->name.data());
         bigBatchedMesh.numVertices = 0;
@@ -14,7 +37,7 @@ void Batcher::end(bool keepMeshData)
         bigBatchedMesh.calculateVertexFormat();
 
         u32 vertexElementCount = 0;
-        for (auto& item : itemsForThisMaterial.value)
+        for (auto& item : itemsToMerge)
         {
             vertexElementCount += item.mesh->numVertices * (bigBatchedMesh.stride / sizeof(f32));
             bigBatchedMesh.numVertices += item.mesh->numVertices;
@@ -26,7 +49,7 @@ void Batcher::end(bool keepMeshData)
         u32 vertexElementIndex = 0;
         u32 indicesCopied = 0;
         u32 verticesCopied = 0;
-        for (auto& item : itemsForThisMaterial.value)
+        for (auto& item : itemsToMerge)
         {
             for (u32 i=0; i<item.mesh->numIndices; ++i)
             {
@@ -85,6 +108,10 @@ void Batcher::end(bool keepMeshData)
             verticesCopied += item.mesh->numVertices;
         }
 
+        // the source meshes are optimized on their own, but reordering the whole batch lets
+        // neighboring items share cache entries; welding is skipped since transformed copies
+        // rarely have identical vertices
+        bigBatchedMesh.optimize(false);
         bigBatchedMesh.createVAO();
 
         if (!keepMeshData)
@@ -98,4 +125,8 @@ void Batcher::end(bool keepMeshData)
         batches.push({ itemsForThisMaterial.key, move(bigBatchedMesh) });
     }
     materialMap.clear();
+
+    // the instances don't move until the batches are rebuilt, so they are only uploaded once
+    instances.build();
+    instances.upload();
 }
@@ -3,6 +3,11 @@
 #include "renderer.h"
 #include "model.h"
 #include "material.h"
+#include "instancing.h"
+
+// meshes that are repeated at least this many times with the same material are drawn instanced
+// instead of being merged into the batch of the material
+const u32 MIN_INSTANCED_MESH_COUNT = 4;
 
 class Batcher
 {
@@ -21,6 +26,7 @@ public:
     };
 
     Array<Batch> batches;
+    InstanceGrouper instances;
 
     ~Batcher()
     {
@@ -37,6 +43,7 @@ public:
             batch.mesh.destroy();
         }
         materialMap.clear();
+        instances.clear();
     }
 
     void add(Material* material, Mat4 const& transform, Mesh* mesh)
@@ -52,6 +59,7 @@ public:
         {
             batch.material->draw(rw, transform, &batch.mesh);
         }
+        instances.render(rw);
     }
 
     Batcher() {}
@@ -9,6 +9,9 @@
 #include <new>
 #include <initializer_list>
 #include "template_magic.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof(x[0]))
 
@@ -23,5 +26,17 @@ typedef long long          i64;
 typedef float              f32;
 typedef double             f64;
 
+// the index of the lowest set bit, which is undefined when no bit is set
+inline u32 countTrailingZeros(u32 value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return (u32)index;
+#else
+    return (u32)__builtin_ctz(value);
+#endif
+}
+
 #define FORCE_INLINE __attribute__((always_inline))
 #define FORCE_FLATTEN __attribute__((flatten))
@@ -26,6 +26,7 @@ struct Config
         bool fullscreen = false;
         bool vsync = true;
         bool shadowsEnabled = true;
+        bool staticShadowCacheEnabled = true;
         ConfigLevel ssaoQuality = ConfigLevel::HIGH;
         bool bloomEnabled = true;
         bool sharpenEnabled = false;
@@ -35,7 +36,10 @@ struct Config
         bool highQualityTerrainEnabled = true;
         bool highQualityTrackEnabled = true;
         u32 anisotropicFilteringLevel = 4;
+        u32 textureMemoryBudgetMB = 1024;
         bool cloudShadowsEnabled = true;
+        // how many pixels a mesh level of detail may deviate from the full mesh on screen
+        f32 lodPixelError = 1.f;
 
         void serialize(Serializer& s)
         {
@@ -49,6 +53,7 @@ struct Config
             s.field(fullscreen);
             s.field(vsync);
             s.field(shadowsEnabled);
+            s.field(staticShadowCacheEnabled);
             s.field(ssaoQuality);
             s.field(bloomEnabled);
             s.field(sharpenEnabled);
@@ -58,7 +63,9 @@ struct Config
             s.field(highQualityTerrainEnabled);
             s.field(highQualityTrackEnabled);
             s.field(anisotropicFilteringLevel);
+            s.field(textureMemoryBudgetMB);
             s.field(cloudShadowsEnabled);
+            s.field(lodPixelError);
         }
     } graphics;
 
@@ -85,6 +92,13 @@ struct Config
         bool forceFeedbackEnabled = true;
         bool thirdPersonCameraEnabled = false;
         u32 aiDriverCameraCount = 0;
+        // physics steps per second, independent of the frame rate; only frame rates below this
+        // need steps that block the main thread
+        u32 physicsTickRate = 60;
+        // when a frame needs more steps than this to catch up the remaining time is dropped
+        u32 maxPhysicsSubsteps = 8;
+        // time all AI decisions may take per frame, summed over all threads
+        f32 aiBudgetMicroseconds = 300.f;
 
         void serialize(Serializer& s)
         {
@@ -93,6 +107,9 @@ struct Config
             s.field(forceFeedbackEnabled);
             s.field(thirdPersonCameraEnabled);
             s.field(aiDriverCameraCount);
+            s.field(physicsTickRate);
+            s.field(maxPhysicsSubsteps);
+            s.field(aiBudgetMicroseconds);
         }
     } gameplay;
 
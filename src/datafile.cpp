@@ -27,23 +27,323 @@ DataFile::Value DataFile::load(const char* filename)
     return val;
 }
 
-void DataFile::save(DataFile::Value const& val, const char* filename)
+// every FileWriter hands its chunks to the same thread, which is started by the first one
+static SDL_SpinLock writerThreadLock = 0;
+static SDL_Thread* writerThread = nullptr;
+static SDL_mutex* writerMtx = nullptr;
+static SDL_cond* writerCond = nullptr;
+static Array<FileWriter*> activeWriters;
+
+FileWriter::FileWriter(const char* filename)
+{
+    this->filename.write(filename);
+    tmpFilename.writef("%s.tmp", filename);
+    file = SDL_RWFromFile(tmpFilename.data(), "wb");
+    if (!file)
+    {
+        error("Failed to open file for writing: %s", tmpFilename.data());
+        return;
+    }
+    for (auto& chunk : chunks)
+    {
+        chunk = new u8[CHUNK_SIZE];
+    }
+
+    SDL_AtomicLock(&writerThreadLock);
+    if (!writerThread)
+    {
+        writerMtx = SDL_CreateMutex();
+        writerCond = SDL_CreateCond();
+        writerThread = SDL_CreateThread(writerThreadFunc, "file writer", nullptr);
+    }
+    SDL_AtomicUnlock(&writerThreadLock);
+
+    SDL_LockMutex(writerMtx);
+    activeWriters.push(this);
+    SDL_UnlockMutex(writerMtx);
+}
+
+FileWriter::~FileWriter()
+{
+    if (file)
+    {
+        finish();
+    }
+    for (auto& chunk : chunks)
+    {
+        delete[] chunk;
+    }
+}
+
+i32 FileWriter::writerThreadFunc(void* data)
+{
+    SDL_LockMutex(writerMtx);
+    for (;;)
+    {
+        FileWriter* writer = nullptr;
+        for (FileWriter* w : activeWriters)
+        {
+            if (w->writtenChunks != w->submittedChunks)
+            {
+                writer = w;
+                break;
+            }
+        }
+        if (!writer)
+        {
+            SDL_CondWait(writerCond, writerMtx);
+            continue;
+        }
+
+        u32 index = writer->writtenChunks % CHUNK_COUNT;
+        u32 size = writer->chunkSizes[index];
+        SDL_UnlockMutex(writerMtx);
+
+        bool written = SDL_RWwrite(writer->file, writer->chunks[index], 1, size) == size;
+
+        SDL_LockMutex(writerMtx);
+        if (!written)
+        {
+            writer->failed = true;
+        }
+        ++writer->writtenChunks;
+        SDL_CondBroadcast(writerCond);
+    }
+    return 0;
+}
+
+void FileWriter::submitChunk()
+{
+    chunkSizes[submittedChunks % CHUNK_COUNT] = chunkPos;
+    chunkPos = 0;
+
+    SDL_LockMutex(writerMtx);
+    ++submittedChunks;
+    SDL_CondBroadcast(writerCond);
+    // wait until the next chunk is free
+    while (submittedChunks - writtenChunks >= CHUNK_COUNT)
+    {
+        SDL_CondWait(writerCond, writerMtx);
+    }
+    SDL_UnlockMutex(writerMtx);
+}
+
+void FileWriter::writeBytes(void const* data, size_t len)
+{
+    if (!file)
+    {
+        return;
+    }
+    u8 const* src = (u8 const*)data;
+    while (len > 0)
+    {
+        u32 count = (u32)min((size_t)(CHUNK_SIZE - chunkPos), len);
+        memcpy(chunks[submittedChunks % CHUNK_COUNT] + chunkPos, src, count);
+        chunkPos += count;
+        src += count;
+        len -= count;
+        if (chunkPos == CHUNK_SIZE)
+        {
+            submitChunk();
+        }
+    }
+}
+
+bool FileWriter::finish()
+{
+    if (!file)
+    {
+        return false;
+    }
+    if (chunkPos > 0)
+    {
+        submitChunk();
+    }
+
+    SDL_LockMutex(writerMtx);
+    while (writtenChunks != submittedChunks)
+    {
+        SDL_CondWait(writerCond, writerMtx);
+    }
+    for (u32 i=0; i<activeWriters.size(); ++i)
+    {
+        if (activeWriters[i] == this)
+        {
+            activeWriters[i] = activeWriters.back();
+            activeWriters.pop();
+            break;
+        }
+    }
+    SDL_UnlockMutex(writerMtx);
+
+    if (SDL_RWclose(file) != 0)
+    {
+        failed = true;
+    }
+    file = nullptr;
+
+    if (failed)
+    {
+        error("Failed to complete file write: %s", tmpFilename.data());
+        remove(tmpFilename.data());
+        return false;
+    }
+    return replaceFile(tmpFilename.data(), filename.data());
+}
+
+bool DataFile::save(DataFile::Value const& val, const char* filename)
 {
     // text format
     if (path::hasExt(filename, ".txt"))
     {
         StrBuf buf;
         val.debugOutput(buf, 0, false);
-        writeFile(filename, buf.data(), buf.size());
-        return;
+        FileWriter writer(filename);
+        writer.writeBytes(buf.data(), buf.size());
+        return writer.finish();
     }
 
     // binary format
-    u32 magic = MAGIC_NUMBER;
-    Buffer buf(megabytes(20));
-    buf.write(magic);
-    val.write(buf);
-    writeFile(filename, buf.data.get(), buf.pos);
+    FileWriter writer(filename);
+    writer.write((u32)MAGIC_NUMBER);
+    val.write(writer);
+    return writer.finish();
+}
+
+void DataFile::checkRoundTrip()
+{
+    Value root = makeDict();
+    auto& dict = root.dict().val();
+    dict["string"] = "round trip";
+    dict["integer"] = makeInteger(-1234567890123ll);
+    dict["real"] = makeReal(3.25f);
+    dict["bool"] = makeBool(true);
+    dict["vec3"] = makeVec3(Vec3(1.f, -2.f, 0.5f));
+    Value::Array array;
+    for (i64 i=0; i<1000; ++i)
+    {
+        array.push(makeInteger(i * i));
+    }
+    dict["array"] = makeArray(move(array));
+    // large enough to span several of the FileWriter's chunks
+    Value::ByteArray bytes;
+    bytes.resize((u32)megabytes(3) + 17);
+    for (u32 i=0; i<bytes.size(); ++i)
+    {
+        bytes[i] = (u8)(i * 31 + (i >> 8));
+    }
+    dict["bytes"] = makeBytearray(move(bytes));
+    Value nested = makeDict();
+    nested.dict().val()["empty"] = makeArray();
+    dict["nested"] = move(nested);
+
+    createDirectory("../cache");
+    const char* filename = "../cache/round_trip_check.dat";
+    f64 startTime = getTime();
+    if (!save(root, filename))
+    {
+        error("Data file round trip failed: could not write %s", filename);
+        return;
+    }
+    f64 saveTime = getTime() - startTime;
+    Value loaded = load(filename);
+    remove(filename);
+
+    if (loaded.hash() == root.hash())
+    {
+        println("Data file round trip matches (saved in %.2fms)", saveTime * 1000.0);
+    }
+    else
+    {
+        error("Data file round trip mismatch: %016llx != %016llx",
+                (unsigned long long)loaded.hash(), (unsigned long long)root.hash());
+    }
+}
+
+struct BackgroundSave
+{
+    Value value;
+    StrBuf filename;
+    i64 id;
+};
+
+static SDL_mutex* backgroundSaveMtx = nullptr;
+static SDL_cond* backgroundSaveCond = nullptr;
+static SDL_Thread* backgroundSaveThread = nullptr;
+static Array<OwnedPtr<BackgroundSave>> backgroundSaves;
+static bool stopBackgroundSaves = false;
+static Array<i64> failedBackgroundSaves;
+
+static i32 backgroundSaveThreadFunc(void* data)
+{
+    SDL_LockMutex(backgroundSaveMtx);
+    for (;;)
+    {
+        while (backgroundSaves.empty() && !stopBackgroundSaves)
+        {
+            SDL_CondWait(backgroundSaveCond, backgroundSaveMtx);
+        }
+        if (backgroundSaves.empty())
+        {
+            break;
+        }
+        OwnedPtr<BackgroundSave> save = move(backgroundSaves[0]);
+        backgroundSaves.erase(backgroundSaves.begin());
+        SDL_UnlockMutex(backgroundSaveMtx);
+
+        f64 startTime = getTime();
+        if (DataFile::save(save->value, save->filename.data()))
+        {
+            println("Saved %s in %.2fms", save->filename.data(), (getTime() - startTime) * 1000.0);
+            SDL_LockMutex(backgroundSaveMtx);
+        }
+        else
+        {
+            error("Failed to save %s", save->filename.data());
+            SDL_LockMutex(backgroundSaveMtx);
+            failedBackgroundSaves.push(save->id);
+        }
+    }
+    SDL_UnlockMutex(backgroundSaveMtx);
+    return 0;
+}
+
+void DataFile::saveInBackground(Value&& val, const char* filename, i64 id)
+{
+    if (!backgroundSaveMtx)
+    {
+        backgroundSaveMtx = SDL_CreateMutex();
+        backgroundSaveCond = SDL_CreateCond();
+    }
+
+    OwnedPtr<BackgroundSave> save(new BackgroundSave);
+    save->value = move(val);
+    save->filename.write(filename);
+    save->id = id;
+
+    SDL_LockMutex(backgroundSaveMtx);
+    backgroundSaves.push(move(save));
+    if (!backgroundSaveThread)
+    {
+        stopBackgroundSaves = false;
+        backgroundSaveThread = SDL_CreateThread(backgroundSaveThreadFunc, "background save", nullptr);
+    }
+    SDL_CondSignal(backgroundSaveCond);
+    SDL_UnlockMutex(backgroundSaveMtx);
+}
+
+void DataFile::finishBackgroundSaves()
+{
+    if (!backgroundSaveThread)
+    {
+        return;
+    }
+    SDL_LockMutex(backgroundSaveMtx);
+    stopBackgroundSaves = true;
+    SDL_CondSignal(backgroundSaveCond);
+    SDL_UnlockMutex(backgroundSaveMtx);
+    SDL_WaitThread(backgroundSaveThread, nullptr);
+    backgroundSaveThread = nullptr;
 }
 
 // TODO: Add line numbers and more descriptive messages to parser errors
@@ -348,7 +648,7 @@ Value Value::readValue(Buffer& buf)
     return value;
 }
 
-void Value::write(Buffer& buf) const
+void Value::write(FileWriter& buf) const
 {
     buf.write(dataType);
     switch (dataType)
@@ -401,6 +701,59 @@ void Value::write(Buffer& buf) const
     }
 }
 
+u64 Value::hash(u64 hash) const
+{
+    hash = hashValue(hash, dataType);
+    switch (dataType)
+    {
+        case DataType::I64:
+        {
+            hash = hashValue(hash, integer_);
+        } break;
+        case DataType::F32:
+        {
+            hash = hashValue(hash, real_);
+        } break;
+        case DataType::STRING:
+        {
+            hash = hashBytes(hash, str_.data(), str_.size());
+        } break;
+        case DataType::BYTE_ARRAY:
+        {
+            hash = hashValue(hash, (u32)bytearray_.size());
+            hash = hashBytes(hash, bytearray_.data(), bytearray_.size());
+        } break;
+        case DataType::ARRAY:
+        {
+            hash = hashValue(hash, (u32)array_.size());
+            for (u32 i=0; i<array_.size(); ++i)
+            {
+                hash = array_[i].hash(hash);
+            }
+        } break;
+        case DataType::DICT:
+        {
+            // the pairs are hashed separately and summed because the iteration order of the map
+            // depends on how it was filled
+            u64 sum = 0;
+            for (auto& pair : dict_)
+            {
+                u64 pairHash = hashBytes(HASH_SEED, pair.key.data(), pair.key.size());
+                sum += pair.value.hash(pairHash);
+            }
+            hash = hashValue(hash, (u32)dict_.size());
+            hash = hashValue(hash, sum);
+        } break;
+        case DataType::BOOL:
+        {
+            hash = hashValue(hash, bool_);
+        } break;
+        default:
+            break;
+    }
+    return hash;
+}
+
 void Value::debugOutput(StrBuf& buf, u32 indent, bool newline) const
 {
     switch (dataType)
@@ -473,3 +826,17 @@ void Value::debugOutput(StrBuf& buf, u32 indent, bool newline) const
     }
 }
 
+void DataFile::takeFailedSaves(Array<i64>& ids)
+{
+    if (!backgroundSaveMtx)
+    {
+        return;
+    }
+    SDL_LockMutex(backgroundSaveMtx);
+    for (i64 id : failedBackgroundSaves)
+    {
+        ids.push(id);
+    }
+    failedBackgroundSaves.clear();
+    SDL_UnlockMutex(backgroundSaveMtx);
+}
@@ -18,6 +18,47 @@ namespace DataFile
         BOOL,
     };
 
+    // Streams data to a temporary file through a small ring of chunks that are written out by
+    // one long-lived writer thread shared by all writers. finish() renames the temporary file
+    // over the destination, so an interrupted save never leaves a truncated file behind.
+    class FileWriter
+    {
+        static const u32 CHUNK_SIZE = (u32)kilobytes(256);
+        static const u32 CHUNK_COUNT = 4;
+
+        u8* chunks[CHUNK_COUNT] = {};
+        u32 chunkSizes[CHUNK_COUNT] = {};
+        u32 chunkPos = 0;
+        // chunks handed to the writer thread and chunks it has finished writing; both are
+        // guarded by the writer thread's mutex
+        u32 submittedChunks = 0;
+        u32 writtenChunks = 0;
+        bool failed = false;
+
+        StrBuf filename;
+        StrBuf tmpFilename;
+        SDL_RWops* file = nullptr;
+
+        void submitChunk();
+        static i32 writerThreadFunc(void* data);
+
+    public:
+        FileWriter(const char* filename);
+        ~FileWriter();
+
+        void writeBytes(void const* data, size_t len);
+
+        template <typename T>
+        void write(T const& v)
+        {
+            writeBytes(&v, sizeof(T));
+        }
+
+        // returns false if the file could not be written, in which case the destination is
+        // left untouched
+        bool finish();
+    };
+
     template <typename T>
     class OptionalRef
     {
@@ -88,7 +129,9 @@ namespace DataFile
     public:
         static Value readValue(Buffer& buf);
         static Value readValue(const char*& ch, const char* end);
-        void write(Buffer& buf) const;
+        void write(FileWriter& writer) const;
+        // a hash of the contents that doesn't depend on the order of the keys in dicts
+        u64 hash(u64 hash=HASH_SEED) const;
 
         ~Value()
         {
@@ -568,7 +611,20 @@ namespace DataFile
     }
 
     Value load(const char* filename);
-    void save(Value const& val, const char* filename);
+    // returns false if the file could not be written, in which case it is left untouched
+    bool save(Value const& val, const char* filename);
+
+    // serializes and writes the value on a background thread; saves are done in the order
+    // they were requested. The id of a save that fails is returned by takeFailedSaves().
+    void saveInBackground(Value&& val, const char* filename, i64 id=0);
+    // moves the ids of the background saves that failed since the last call into ids
+    void takeFailedSaves(Array<i64>& ids);
+    // blocks until every background save has been written
+    void finishBackgroundSaves();
+
+    // saves a value that has every data type through FileWriter and checks that load reads
+    // the same value back
+    void checkRoundTrip();
 };
 
 #ifndef NDEBUG
@@ -654,6 +710,14 @@ public:
         DataFile::save(toDict(val), filename);
     }
 
+    // the value tree is built here on the calling thread, because val may change as soon as
+    // this returns; only writing it out happens in the background
+    template<typename T>
+    static void toFileInBackground(T& val, const char* filename, i64 id=0)
+    {
+        DataFile::saveInBackground(toDict(val), filename, id);
+    }
+
     template<typename T>
     static void fromFile(T& val, const char* filename)
     {
@@ -2,6 +2,7 @@
 #include "../imgui.h"
 #include "resource_editor.h"
 #include "resource_manager.h"
+#include "../scatter.h"
 
 class MaterialEditor : public ResourceEditor
 {
@@ -111,6 +112,14 @@ public:
                         ImGui::DragFloat("Fresnel Bias", (f32*)&layer.fresnelBias, 0.005f, -1.f, 1.f);
                         ImGui::DragFloat("Fresnel Scale", (f32*)&layer.fresnelScale, 0.005f, 0.f, 1.f);
                         ImGui::DragFloat("Fresnel Power", (f32*)&layer.fresnelPower, 0.009f, 0.f, 200.f);
+                        chooseResource(ResourceType::MODEL, layer.scatterModelGuid, "Scatter Model",
+                                [](Resource* r) {
+                            return ((Model*)r)->modelUsage == ModelUsage::STATIC_PROP;
+                        });
+                        ImGui::DragFloat("Scatter Density", &layer.scatterDensity, 0.01f, 0.f,
+                                MAX_SCATTER_DENSITY);
+                        ImGui::DragFloatRange2("Scatter Scale", &layer.scatterMinScale,
+                                &layer.scatterMaxScale, 0.01f, 0.01f, 10.f);
                         ImGui::TreePop();
                     }
                 }
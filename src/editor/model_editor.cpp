@@ -47,6 +47,17 @@ void ModelEditor::init(Resource* resource)
     physicsScene->addActor(*body);
 #endif
 
+    // models saved before meshes were prepared on import get prepared when they are opened;
+    // meshes that are already prepared are left alone
+    preparedMeshesOnOpen = false;
+    for (auto& mesh : model->meshes)
+    {
+        if (mesh.prepareForSaving())
+        {
+            preparedMeshesOnOpen = true;
+        }
+    }
+
     BoundingBox bb = model->getBoundingbox(Mat4(1.f));
     f32 height = bb.max.z - bb.min.z;
     camera.setCameraDistance(18 + height);
@@ -81,6 +92,12 @@ void ModelEditor::showSceneSelection()
 
 void ModelEditor::onUpdate(Resource* r, ResourceManager* rm, Renderer* renderer, f32 deltaTime, u32 n)
 {
+    if (preparedMeshesOnOpen)
+    {
+        rm->markDirty(r->guid);
+        preparedMeshesOnOpen = false;
+    }
+
     if (ImGui::Begin("Model Editor"))
     {
         ImGui::PushItemWidth(150);
@@ -91,12 +108,12 @@ void ModelEditor::onUpdate(Resource* r, ResourceManager* rm, Renderer* renderer,
         if (ImGui::Button("Load File"))
         {
             const char* path =
-                chooseFile( true, "Model Files", { "*.blend" }, tmpStr("%s/models", ASSET_DIRECTORY));
+                chooseFile( true, "Model Files", { "*.blend", "*.glb" }, tmpStr("%s/models", ASSET_DIRECTORY));
             if (path)
             {
                 model->sourceFilePath = path::relative(path);
                 model->sourceSceneName = "";
-                loadBlenderFile(tmpStr("%s/%s", ASSET_DIRECTORY, model->sourceFilePath.data()));
+                loadModelFile(tmpStr("%s/%s", ASSET_DIRECTORY, model->sourceFilePath.data()));
             }
         }
         showSceneSelection();
@@ -105,7 +122,7 @@ void ModelEditor::onUpdate(Resource* r, ResourceManager* rm, Renderer* renderer,
         {
             if (model->sourceFilePath.size() > 0)
             {
-                loadBlenderFile(tmpStr("%s/%s", ASSET_DIRECTORY, model->sourceFilePath.data()));
+                loadModelFile(tmpStr("%s/%s", ASSET_DIRECTORY, model->sourceFilePath.data()));
             }
         }
 
@@ -117,6 +134,39 @@ void ModelEditor::onUpdate(Resource* r, ResourceManager* rm, Renderer* renderer,
         }
         ImGui::Guid(model->guid);
 
+        if (ImGui::Button("Prepare All Models"))
+        {
+            u32 preparedCount = 0;
+            g_res.iterateResourceType(ResourceType::MODEL, [&](Resource* res){
+                bool changed = false;
+                for (auto& mesh : ((Model*)res)->meshes)
+                {
+                    changed |= mesh.prepareForSaving();
+                }
+                if (changed)
+                {
+                    rm->markDirty(res->guid);
+                    ++preparedCount;
+                }
+            });
+            println("Prepared %u models for saving", preparedCount);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Check Vertex Cache Optimization"))
+        {
+            checkVertexCacheOptimization();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Check Mesh Simplification"))
+        {
+            checkMeshSimplification();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Check glTF Import"))
+        {
+            checkGLBImport();
+        }
+
         ImGui::Checkbox("Show Grid", &showGrid);
         ImGui::Checkbox("Show Floor", &showFloor);
         ImGui::Checkbox("Show Bounds", &showBoundingBox);
@@ -439,7 +489,28 @@ void ModelEditor::onUpdate(Resource* r, ResourceManager* rm, Renderer* renderer,
     debugDraw.draw(rw);
 }
 
-void ModelEditor::loadBlenderFile(const char* filename)
+void ModelEditor::loadModelFile(const char* filename)
+{
+    f64 startTime = getTime();
+    bool loaded = path::hasExt(filename, ".glb") ? loadGLBFile(filename) : loadBlenderFile(filename);
+    if (loaded)
+    {
+        println("Imported %s in %.2fms", filename, (getTime() - startTime) * 1000.0);
+    }
+}
+
+bool ModelEditor::loadGLBFile(const char* filename)
+{
+    DataFile::Value val;
+    if (!importGLB(filename, val))
+    {
+        showError("Failed to import glTF file. See console for details.");
+        return false;
+    }
+    return loadSceneData(move(val));
+}
+
+bool ModelEditor::loadBlenderFile(const char* filename)
 {
     // execute blender with a python script that will output the data in the datafile format
     const char* blenderPath =
@@ -458,27 +529,30 @@ void ModelEditor::loadBlenderFile(const char* filename)
         error("Failed to import blender file:");
         error("%s", r.output);
         showError("Failed to import blender file. See console for details.");
-        return;
+        return false;
     }
 
     const char* outputFile = "blender_output.dat";
-    DataFile::Value val = DataFile::load(outputFile);
+    return loadSceneData(DataFile::load(outputFile));
+}
 
+bool ModelEditor::loadSceneData(DataFile::Value&& val)
+{
     // meshes
     if (!val.dict().hasValue())
     {
-        error("Failed to import blender file: Unexpected data structure.");
-        showError("Failed to import blender file. See console for details.");
-        return;
+        error("Failed to import model file: Unexpected data structure.");
+        showError("Failed to import model file. See console for details.");
+        return false;
     }
 
     // scenes
     if (!val.dict().val()["scenes"].array().hasValue()
             || val.dict().val()["scenes"].array().val().empty())
     {
-        error("Failed to import blender file: No scenes found in file.");
+        error("Failed to import model file: No scenes found in file.");
         showError("The chosen does not contain any scenes.");
-        return;
+        return false;
     }
 
     blenderData = move(val);
@@ -496,6 +570,7 @@ void ModelEditor::loadBlenderFile(const char* filename)
         }
         processBlenderData();
     }
+    return true;
 }
 
 void ModelEditor::processBlenderData()
@@ -557,6 +632,23 @@ void ModelEditor::processBlenderData()
             Mesh mesh;
             Serializer s(meshDict[meshName], true);
             mesh.serialize(s);
+            mesh.prepareForSaving();
+
+            auto& sourceMesh = meshDict[meshName].dict().val();
+            auto& sourceIndices = sourceMesh["indices"].bytearray().val();
+            VertexCacheStats before = analyzeVertexCache((u32*)sourceIndices.data(),
+                    sourceIndices.size() / sizeof(u32), (u32)sourceMesh["numVertices"].integer(0));
+            VertexCacheStats after = analyzeVertexCache(mesh.indices.data(), mesh.numIndices,
+                    mesh.numVertices);
+            println("Mesh %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", mesh.name.data(),
+                    before.acmr, after.acmr, before.atvr, after.atvr);
+            for (u32 i=0; i<mesh.lods.size(); ++i)
+            {
+                println("Mesh %s: LOD %u has %u of %u triangles, error %.4f", mesh.name.data(),
+                        i + 1, mesh.lods[i].indexCount / 3, mesh.numIndices / 3,
+                        mesh.lods[i].error);
+            }
+
             model->meshes.push(move(mesh));
         }
 
@@ -4,6 +4,8 @@
 #include "../datafile.h"
 #include "../util.h"
 #include "../model.h"
+#include "../gltf.h"
+#include "../mesh_optimizer.h"
 #include "../debug_draw.h"
 #include "editor_camera.h"
 #include "resource_editor.h"
@@ -11,7 +13,10 @@
 class ModelEditor : public ResourceEditor
 {
     Model* model;
-    void loadBlenderFile(const char* filename);
+    void loadModelFile(const char* filename);
+    bool loadBlenderFile(const char* filename);
+    bool loadGLBFile(const char* filename);
+    bool loadSceneData(DataFile::Value&& val);
     void processBlenderData();
     DataFile::Value blenderData;
     Array<u32> selectedObjects;
@@ -23,6 +28,10 @@ class ModelEditor : public ResourceEditor
     PxRigidStatic* body = nullptr;
 #endif
 
+    // set when opening the model prepared meshes that were saved before preparation was done
+    // on import, so the model gets saved again
+    bool preparedMeshesOnOpen = false;
+
     bool selectionStateCtrl = false;
     bool selectionStateShift = false;
 
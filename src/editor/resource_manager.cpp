@@ -535,6 +535,14 @@ void ResourceManager::onUpdate(Renderer *renderer, f32 deltaTime)
         markDirty(r.resource->guid);
     }
 
+    // resources whose background save failed are saved again the next time
+    Array<i64> failedSaves;
+    DataFile::takeFailedSaves(failedSaves);
+    for (i64 guid : failedSaves)
+    {
+        markDirty(guid);
+    }
+
     // TODO: fix escape behavior (it only works when a window is focused)
     if (!ImGui::GetIO().WantCaptureKeyboard && g_input.isKeyPressed(KEY_ESCAPE))
     {
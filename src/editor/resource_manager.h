@@ -186,7 +186,7 @@ struct ResourceFolder
                     StrBuf filenameBuf;
                     filenameBuf.writef("%s/%s.dat", buf.data(), guidHex.data());
                     println("Saving resource %s, %s", filenameBuf.data(), res->name.data());
-                    Serializer::toFile(*res, filenameBuf.data());
+                    Serializer::toFileInBackground(*res, filenameBuf.data(), guid);
                 }
             }
         }
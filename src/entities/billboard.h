@@ -8,6 +8,10 @@
 #include "../imgui.h"
 #include "../model.h"
 
+NamedResource<Model> g_billboardModel("billboard");
+NamedMesh g_billboardSignMesh("billboard", "billboard.BillboardSign");
+NamedResource<Texture> g_billboardDefaultTexture("billboard_1");
+
 class Billboard : public PlaceableEntity
 {
     Model* model = nullptr;
@@ -17,9 +21,9 @@ class Billboard : public PlaceableEntity
 public:
     Billboard()
     {
-        model = g_res.getModel("billboard");
+        model = g_billboardModel;
         billboardObject = model->getObjByName("BillboardSign");
-        billboardTextureGuid = g_res.getTexture("billboard_1")->guid;
+        billboardTextureGuid = g_billboardDefaultTexture->guid;
     }
 
     void applyDecal(class Decal& decal) override
@@ -30,6 +34,14 @@ public:
         }
     }
 
+    void gatherCollisionMeshes(Array<CollisionMeshRequest>& requests) override
+    {
+        for (auto& obj : model->objects)
+        {
+            requests.push({ &model->meshes[obj.meshIndex], false });
+        }
+    }
+
     void onCreate(class Scene* scene) override
     {
         updateTransform(scene);
@@ -56,7 +68,7 @@ public:
 
     void onRender(RenderWorld* rw, Scene* scene, f32 deltaTime) override
     {
-        drawSimple(rw, model->getMeshByName("billboard.BillboardSign"),
+        drawSimple(rw, g_billboardSignMesh,
                 g_res.getTexture(billboardTextureGuid), transform);
         if (scene->isBatched)
         {
@@ -66,8 +78,8 @@ public:
         {
             if (obj.isVisible)
             {
-                g_res.getMaterial(obj.materialGuid)->draw(rw, transform * obj.getTransform(),
-                        &model->meshes[obj.meshIndex]);
+                scene->frameInstances.add(g_res.getMaterial(obj.materialGuid),
+                        transform * obj.getTransform(), &model->meshes[obj.meshIndex]);
             }
         }
     }
@@ -89,7 +101,7 @@ public:
         rw->setViewportCamera(0, Vec3(3.f, 1.f, 4.f) * 4.5f,
                 Vec3(0, 0, 3.5f), 1.f, 200.f, 32.f);
         transform = Mat4(1.f);
-        drawSimple(rw, model->getMeshByName("billboard.BillboardSign"),
+        drawSimple(rw, g_billboardSignMesh,
                 g_res.getTexture(billboardTextureGuid), transform);
         for (auto& obj : model->objects)
         {
@@ -4,6 +4,8 @@
 #include "../game.h"
 #include "../vehicle.h"
 #include "../billboard.h"
+
+NamedResource<Texture> g_boosterTexture("booster");
 #include "../imgui.h"
 
 Booster::Booster()
@@ -40,26 +42,43 @@ void Booster::updateTransform(Scene* scene)
         shape->setGeometry(PxBoxGeometry(convert(
                         absolute(max(Vec3(0.01f), scale) * 0.5f))));
     }
-    tex = g_res.getTexture("booster");
+    tex = g_boosterTexture;
     decal.setTexture(tex);
     decal.begin(transform);
     scene->track->applyDecal(decal);
     decal.end();
 }
 
-void Booster::onUpdate(RenderWorld* rw, Scene* scene, f32 deltaTime)
+void Booster::onPhysicsResults(Scene* scene)
 {
-    active = false;
+    // The boost is given once for every physics step, so a vehicle gets the same boost however
+    // many frames the steps are spread over. The vehicles are checked where the step that was
+    // just fetched left them, not in the spatial hash, which only changes once per frame.
+    f32 radius = 2.5f;
+    Vec3 p = transform.position();
+    bool isAnyVehicleNear = false;
+    for (auto& v : scene->getVehicles())
+    {
+        if (lengthSquared(v->getPosition() - p) < square(radius + VEHICLE_CONTACT_MARGIN))
+        {
+            isAnyVehicleNear = true;
+            break;
+        }
+    }
+    if (!isAnyVehicleNear)
+    {
+        return;
+    }
 
     PxOverlapHit hitBuffer[8];
     PxOverlapBuffer hit(hitBuffer, ARRAY_SIZE(hitBuffer));
     PxQueryFilterData filter;
     filter.flags |= PxQueryFlag::eDYNAMIC;
     filter.data = PxFilterData(COLLISION_FLAG_CHASSIS, 0, 0, 0);
-    f32 radius = 2.5f;
     if (scene->getPhysicsScene()->overlap(PxSphereGeometry(radius),
-            PxTransform(convert(transform.position()), PxIdentity), hit, filter))
+            PxTransform(convert(p), PxIdentity), hit, filter))
     {
+        f32 timestep = scene->getPhysicsTimestep();
         for (u32 i=0; i<hit.getNbTouches(); ++i)
         {
             PxActor* actor = hit.getTouch(i).actor;
@@ -67,15 +86,20 @@ void Booster::onUpdate(RenderWorld* rw, Scene* scene, f32 deltaTime)
             if (userData && (userData->entityType == ActorUserData::VEHICLE))
             {
                 Vehicle* vehicle = (Vehicle*)userData->vehicle;
-                vehicle->getRigidBody()->addForce(convert(transform.yAxis()) * 15.f,
-                        PxForceMode::eACCELERATION);
+                vehicle->getRigidBody()->addForce(convert(transform.yAxis()) * 15.f * timestep,
+                        PxForceMode::eVELOCITY_CHANGE);
                 vehicle->setMotionBlur(1.f, 1.5f);
                 active = true;
             }
         }
     }
+}
 
+void Booster::onUpdate(RenderWorld* rw, Scene* scene, f32 deltaTime)
+{
+    // active tells whether any step since the last frame boosted a vehicle
     intensity = smoothMove(intensity, active ? 3.5f : 1.25f, 6.f, deltaTime);
+    active = false;
 }
 
 void Booster::onRender(RenderWorld* rw, Scene* scene, f32 deltaTime)
@@ -88,7 +112,7 @@ void Booster::onPreview(RenderWorld* rw)
 {
     rw->setViewportCamera(0, Vec3(0.f, 0.1f, 20.f), Vec3(0.f), 1.f, 200.f, 50.f);
     Vec3 color = backwards ? Vec3(intensity, 0.f, 0.f) : Vec3(0.f, intensity, 0.f);
-    drawBillboard(rw, g_res.getTexture("booster"), Vec3(0, 0, 2.f),
+    drawBillboard(rw, g_boosterTexture, Vec3(0, 0, 2.f),
                 Vec4(color, 1.f), 8.f, 0.f, false);
 }
 
@@ -16,6 +16,7 @@ public:
     void onCreateEnd(class Scene* scene) override;
     void updateTransform(class Scene* scene) override;
     void onUpdate(RenderWorld* rw, Scene* scene, f32 deltaTime) override;
+    void onPhysicsResults(Scene* scene) override;
     void onRender(RenderWorld* rw, Scene* scene, f32 deltaTime) override;
     void onPreview(RenderWorld* rw) override;
     void onEditModeRender(RenderWorld* rw, class Scene* scene, bool isSelected, u8 selectIndex) override;
@@ -3,6 +3,8 @@
 #include "../scene.h"
 #include "../billboard.h"
 
+NamedResource<Texture> g_flashTexture("flash");
+
 void Flash::onCreate(Scene* scene)
 {
     angle = random(scene->randomSeries, 0.f, 2 * PI);
@@ -32,7 +34,7 @@ void Flash::onRender(RenderWorld* rw, Scene* scene, f32 deltaTime)
 {
     f32 t = 1.f - life;
     f32 tt = t * t;
-    Texture* tex = g_res.getTexture("flash");
+    Texture* tex = g_flashTexture;
     Vec3 color = Vec3(1, 0.5f, 0.f);
     drawBillboard(rw, tex, position,
                 Vec4(color, tt * 0.4f), scale * 1.1f * life * 2.f, angle);
@@ -5,6 +5,9 @@
 #include "../vehicle.h"
 #include "../billboard.h"
 
+NamedResource<Texture> g_glueTexture("icon_glue");
+NamedResource<Texture> g_glueNormalTexture("oil_normal");
+
 Glue* Glue::setup(Vec3 const& pos)
 {
     position = pos;
@@ -42,13 +45,18 @@ void Glue::updateTransform(Scene* scene)
         shape->setGeometry(PxBoxGeometry(convert(
                         absolute(max(Vec3(0.01f), scale) * 0.5f))));
     }
-    decal.setTexture(g_res.getTexture("icon_glue"), g_res.getTexture("oil_normal"));
+    decal.setTexture(g_glueTexture, g_glueNormalTexture);
     decal.setPriority(TransparentDepth::OIL_GLUE);
     decal.begin(transform);
     scene->track->applyDecal(decal);
     decal.end();
 }
 
+void Glue::onUpdate(RenderWorld* rw, Scene* scene, f32 deltaTime)
+{
+    scene->getMotionGrid().setCells(position, scale.y * 0.5f, MotionGrid::HAZARD);
+}
+
 void Glue::onRender(RenderWorld* rw, Scene* scene, f32 deltaTime)
 {
     decal.draw(rw);
@@ -58,7 +66,7 @@ void Glue::onPreview(RenderWorld* rw)
 {
     rw->setViewportCamera(0, Vec3(0.f, 0.1f, 20.f),
             Vec3(0.f), 1.f, 200.f, 50.f);
-    drawBillboard(rw, g_res.getTexture("icon_glue"), Vec3(0, 0, 2.f),
+    drawBillboard(rw, g_glueTexture, Vec3(0, 0, 2.f),
                 Vec4(1.f), 8.f, 0.f, false);
 }
 
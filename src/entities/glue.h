@@ -17,6 +17,7 @@ public:
     Glue* setup(Vec3 const& pos={0,0,0});
     void onCreateEnd(class Scene* scene) override;
     void updateTransform(class Scene* scene) override;
+    void onUpdate(RenderWorld* rw, Scene* scene, f32 deltaTime) override;
     void onRender(RenderWorld* rw, Scene* scene, f32 deltaTime) override;
     void onEditModeRender(RenderWorld* rw, class Scene* scene, bool isSelected, u8 selectIndex) override;
     void onPreview(RenderWorld* rw) override;
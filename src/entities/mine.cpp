@@ -4,6 +4,9 @@
 #include "../billboard.h"
 #include "../vehicle.h"
 
+NamedResource<Sound> g_mineExplosionSounds[] = { "explosion2", "explosion3" };
+NamedResource<Texture> g_mineFlareTexture("flare");
+
 void Mine::onUpdate(RenderWorld* rw, Scene* scene, f32 deltaTime)
 {
     bool activated = false;
@@ -16,7 +19,8 @@ void Mine::onUpdate(RenderWorld* rw, Scene* scene, f32 deltaTime)
     filter.flags = PxQueryFlag::eDYNAMIC;
     filter.data = PxFilterData(COLLISION_FLAG_CHASSIS, 0, 0, 0);
     f32 radius = 1.2f;
-    if (scene->getPhysicsScene()->overlap(PxSphereGeometry(radius),
+    if (scene->isAnyVehicleInRadius(transform.position(), radius + VEHICLE_CONTACT_MARGIN)
+            && scene->getPhysicsScene()->overlap(PxSphereGeometry(radius),
             PxTransform(convert(transform.position()), PxIdentity), hit, filter))
     {
         for (u32 i=0; i<hit.getNbTouches(); ++i)
@@ -43,12 +47,8 @@ void Mine::onUpdate(RenderWorld* rw, Scene* scene, f32 deltaTime)
     {
         scene->createExplosion(transform.position(), Vec3(0.f), 10.f);
         this->destroy();
-        const char* sounds[] = {
-            "explosion2",
-            "explosion3",
-        };
-        u32 index = irandom(scene->randomSeries, 0, ARRAY_SIZE(sounds));
-        g_audio.playSound3D(g_res.getSound(sounds[index]), SoundType::GAME_SFX,
+        u32 index = irandom(scene->randomSeries, 0, ARRAY_SIZE(g_mineExplosionSounds));
+        g_audio.playSound3D(g_mineExplosionSounds[index], SoundType::GAME_SFX,
                 transform.position(), false, 1.f, 0.95f);
 
         PxOverlapHit hitBuffer[8];
@@ -77,6 +77,10 @@ void Mine::onUpdate(RenderWorld* rw, Scene* scene, f32 deltaTime)
             }
         }
     }
+    else
+    {
+        scene->getMotionGrid().setCells(transform.position(), 2.f, MotionGrid::HAZARD);
+    }
 }
 
 void Mine::onRender(RenderWorld* rw, Scene* scene, f32 deltaTime)
@@ -89,6 +93,6 @@ void Mine::onRender(RenderWorld* rw, Scene* scene, f32 deltaTime)
     Vec3 p = transform.position() + Vec3(0,0,0.7f);
     Vec4 color = {2.f,0.02f,0.02f,0.3f};
     f32 t = (sinf(aliveTime * 2.f) + 2.f);
-    drawBillboard(rw, g_res.getTexture("flare"), p, color, t * 0.3f, 0.f, false);
+    drawBillboard(rw, g_mineFlareTexture, p, color, t * 0.3f, 0.f, false);
     rw->addPointLight(p, Vec3(color), 1.5f * t, 2.f);
 }
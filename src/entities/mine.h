@@ -4,6 +4,8 @@
 #include "../entity.h"
 #include "../resources.h"
 
+NamedResource<Model> g_mineModel("mine");
+
 class Mine : public Entity
 {
     Mat4 transform;
@@ -15,7 +17,7 @@ public:
     Mine(Mat4 const& transform, u32 instigator)
         : transform(transform), instigator(instigator)
     {
-        model = g_res.getModel("mine");
+        model = g_mineModel;
         // TODO: add collision mesh so that AI can avoid it
     }
 
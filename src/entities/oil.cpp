@@ -5,6 +5,9 @@
 #include "../vehicle.h"
 #include "../billboard.h"
 
+NamedResource<Texture> g_oilTexture("icon_oil");
+NamedResource<Texture> g_oilNormalTexture("oil_normal");
+
 Oil* Oil::setup(Vec3 const& pos)
 {
     position = pos;
@@ -42,13 +45,18 @@ void Oil::updateTransform(Scene* scene)
         shape->setGeometry(PxBoxGeometry(convert(
                         absolute(max(Vec3(0.01f), scale) * 0.5f))));
     }
-    decal.setTexture(g_res.getTexture("icon_oil"), g_res.getTexture("oil_normal"));
+    decal.setTexture(g_oilTexture, g_oilNormalTexture);
     decal.setPriority(TransparentDepth::OIL_GLUE);
     decal.begin(transform);
     scene->track->applyDecal(decal);
     decal.end();
 }
 
+void Oil::onUpdate(RenderWorld* rw, Scene* scene, f32 deltaTime)
+{
+    scene->getMotionGrid().setCells(position, scale.y * 0.5f, MotionGrid::HAZARD);
+}
+
 void Oil::onRender(RenderWorld* rw, Scene* scene, f32 deltaTime)
 {
     decal.draw(rw);
@@ -57,7 +65,7 @@ void Oil::onRender(RenderWorld* rw, Scene* scene, f32 deltaTime)
 void Oil::onPreview(RenderWorld* rw)
 {
     rw->setViewportCamera(0, Vec3(0.f, 0.1f, 20.f), Vec3(0.f), 1.f, 200.f, 50.f);
-    drawBillboard(rw, g_res.getTexture("icon_oil"), Vec3(0, 0, 2.f),
+    drawBillboard(rw, g_oilTexture, Vec3(0, 0, 2.f),
                 Vec4(1.f), 8.f, 0.f, false);
 }
 
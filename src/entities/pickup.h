@@ -7,6 +7,11 @@
 #include "../scene.h"
 #include "../vehicle.h"
 
+NamedResource<Model> g_moneyPickupModel("money");
+NamedResource<Model> g_fixupPickupModel("wrench");
+NamedResource<Sound> g_moneyPickupSound("pickup_money");
+NamedResource<Sound> g_fixupPickupSound("pickup_fixup");
+
 enum struct PickupType
 {
     MONEY = 0,
@@ -52,22 +57,26 @@ public:
             if (pickupType == PickupType::MONEY)
             {
                 v->addBonus("$$$", PICKUP_BONUS_AMOUNT);
-                g_audio.playSound3D(g_res.getSound("pickup_money"), SoundType::GAME_SFX, position);
+                g_audio.playSound3D(g_moneyPickupSound, SoundType::GAME_SFX, position);
             }
             else
             {
                 v->fixup();
-                g_audio.playSound3D(g_res.getSound("pickup_fixup"), SoundType::GAME_SFX, position);
+                g_audio.playSound3D(g_fixupPickupSound, SoundType::GAME_SFX, position);
             }
             this->destroy();
         }
     }
 
+    void onUpdate(RenderWorld* rw, Scene* scene, f32 deltaTime) override
+    {
+        scene->getMotionGrid().setCells(position, 1.f, pickupType == PickupType::MONEY
+                ? MotionGrid::PICKUP_MONEY : MotionGrid::PICKUP_ARMOR);
+    }
+
     Model* getModel()
     {
-        static Model* money = g_res.getModel("money");
-        static Model* wrench = g_res.getModel("wrench");
-        return pickupType == PickupType::MONEY ? money : wrench;
+        return pickupType == PickupType::MONEY ? g_moneyPickupModel.get() : g_fixupPickupModel.get();
     }
 
     void onRender(RenderWorld* rw, Scene* scene, f32 deltaTime) override
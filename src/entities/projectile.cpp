@@ -4,9 +4,19 @@
 #include "../vehicle.h"
 #include "../billboard.h"
 
+NamedMesh g_projectileBulletMesh("misc", "Bullet");
+NamedMesh g_projectileMissileMesh("weapon_missile", "missile.Missile");
+NamedMesh g_projectileSphereMesh("misc", "Sphere");
+NamedResource<Texture> g_projectileFlareTexture("flare");
+NamedResource<Sound> g_blasterHitSound("blaster_hit");
+NamedResource<Sound> g_ricochetSounds[] = { "richochet1", "richochet2", "richochet3", "richochet4" };
+NamedResource<Sound> g_bulletImpactSounds[] = { "bullet_impact1", "bullet_impact2", "bullet_impact3" };
+NamedResource<Sound> g_missileExplosionSound("explosion1");
+NamedResource<Sound> g_bouncerBounceSound("bouncer_bounce");
+
 void Projectile::onCreate(Scene* scene)
 {
-    bulletMesh = g_res.getModel("misc")->getMeshByName("Bullet");
+    bulletMesh = g_projectileBulletMesh;
     switch(projectileType)
     {
         case BLASTER:
@@ -17,7 +27,7 @@ void Projectile::onCreate(Scene* scene)
             this->velocity -= upVector * 0.7f;
             impactEmitter = ParticleEmitter(&scene->sparks, 5, 5,
                     Vec4(Vec3(0.04f, 1.f, 0.04f) * 2.f, 1.f), 0.5f, 6.f, 10.f);
-            environmentImpactSounds.push("blaster_hit");
+            environmentImpactSounds.push(&g_blasterHitSound);
             break;
         case PHANTOM:
             life = 2.5f;
@@ -28,7 +38,7 @@ void Projectile::onCreate(Scene* scene)
             this->velocity -= upVector * 0.7f;
             impactEmitter = ParticleEmitter(&scene->sparks, 5, 5,
                     Vec4(Vec3(1.f, 0.02f, 0.95f) * 2.f, 1.f), 0.5f, 6.f, 10.f);
-            environmentImpactSounds.push("blaster_hit");
+            environmentImpactSounds.push(&g_blasterHitSound);
             break;
         case BULLET:
         case BULLET_SMALL:
@@ -39,13 +49,14 @@ void Projectile::onCreate(Scene* scene)
             this->velocity -= upVector;
             impactEmitter = ParticleEmitter(&scene->sparks, 1, 1,
                 Vec4(Vec3(1.f, 0.6f, 0.02f) * 2.f, 1.f), 0.5f, 6.f, 10.f);
-            environmentImpactSounds.push("richochet1");
-            environmentImpactSounds.push("richochet2");
-            environmentImpactSounds.push("richochet3");
-            environmentImpactSounds.push("richochet4");
-            vehicleImpactSounds.push("bullet_impact1");
-            vehicleImpactSounds.push("bullet_impact2");
-            vehicleImpactSounds.push("bullet_impact3");
+            for (auto& sound : g_ricochetSounds)
+            {
+                environmentImpactSounds.push(&sound);
+            }
+            for (auto& sound : g_bulletImpactSounds)
+            {
+                vehicleImpactSounds.push(&sound);
+            }
             break;
         case MISSILE:
             life = 4.f;
@@ -55,8 +66,8 @@ void Projectile::onCreate(Scene* scene)
             accel = 14.f;
             maxSpeed = 110.f;
             explosionStrength = 5.f;
-            environmentImpactSounds.push("explosion1");
-            vehicleImpactSounds.push("explosion1");
+            environmentImpactSounds.push(&g_missileExplosionSound);
+            vehicleImpactSounds.push(&g_missileExplosionSound);
             break;
         case HOMING_MISSILE:
             life = 4.25f;
@@ -67,8 +78,8 @@ void Projectile::onCreate(Scene* scene)
             homingSpeed = 85.f;
             maxSpeed = 100.f;
             explosionStrength = 6.f;
-            environmentImpactSounds.push("explosion1");
-            vehicleImpactSounds.push("explosion1");
+            environmentImpactSounds.push(&g_missileExplosionSound);
+            vehicleImpactSounds.push(&g_missileExplosionSound);
             break;
         case BOUNCER:
             life = 4.f;
@@ -78,7 +89,7 @@ void Projectile::onCreate(Scene* scene)
             bounceOffEnvironment = true;
             impactEmitter = ParticleEmitter(&scene->sparks, 5, 5,
                     Vec4(Vec3(0.3f, 0.3f, 1.f) * 2.f, 1.f), 0.5f, 6.f, 10.f);
-            environmentImpactSounds.push("bouncer_bounce");
+            environmentImpactSounds.push(&g_bouncerBounceSound);
             break;
     }
 
@@ -199,7 +210,7 @@ void Projectile::onRender(RenderWorld* rw, Scene* scene, f32 deltaTime)
             Mat4 transform = Mat4::translation(position) * m * Mat4::scaling(Vec3(0.75f));
             drawSimple(rw, bulletMesh, &g_res.white, transform,
                 Vec3(0.2f, 0.9f, 0.2f), Vec3(0.01f, 1.5f, 0.01f));
-            drawBillboard(rw, g_res.getTexture("flare"), position+Vec3(0,0,0.2f),
+            drawBillboard(rw, g_projectileFlareTexture, position+Vec3(0,0,0.2f),
                     {0.01f,1.f,0.01f,0.2f}, 1.5f, 0.f, false);
             rw->addPointLight(position, Vec3(0.2f, 0.9f, 0.2f) * 2.f, 4.f, 2.f);
         } break;
@@ -209,7 +220,7 @@ void Projectile::onRender(RenderWorld* rw, Scene* scene, f32 deltaTime)
             Vec3 emit = Vec3(1.f, 0.5f, 0.01f) * 2.f;
             Mat4 transform = Mat4::translation(position) * m * Mat4::scaling(Vec3(0.35f));
             drawSimple(rw, bulletMesh, &g_res.white, transform, color, emit);
-            drawBillboard(rw, g_res.getTexture("flare"),
+            drawBillboard(rw, g_projectileFlareTexture,
                         position, Vec4(emit, 0.8f), 0.75f, 0.f, false);
             rw->addPointLight(position, color * 2.f, 4.f, 2.f);
         } break;
@@ -219,33 +230,33 @@ void Projectile::onRender(RenderWorld* rw, Scene* scene, f32 deltaTime)
             Vec3 emit = Vec3(1.f, 0.5f, 0.01f) * 2.f;
             Mat4 transform = Mat4::translation(position) * m * Mat4::scaling(Vec3(0.35f));
             drawSimple(rw, bulletMesh, &g_res.white, transform, color, emit);
-            drawBillboard(rw, g_res.getTexture("flare"),
+            drawBillboard(rw, g_projectileFlareTexture,
                         position, Vec4(emit, 0.8f), 0.5f, 0.f, false);
         } break;
         case MISSILE:
         {
-            Mesh* mesh = g_res.getModel("weapon_missile")->getMeshByName("missile.Missile");
+            Mesh* mesh = g_projectileMissileMesh;
             Mat4 transform = Mat4::translation(position) * m;
             drawSimple(rw, mesh, &g_res.white, transform, Vec3(1.f));
-            drawBillboard(rw, g_res.getTexture("flare"), position,
+            drawBillboard(rw, g_projectileFlareTexture, position,
                         Vec4(1.f, 0.5f, 0.03f, 0.8f), 1.8f, 0.f, false);
             rw->addPointLight(position, Vec3(1.f, 0.5f, 0.03f) * 5.f, 5.f, 2.f);
         } break;
         case HOMING_MISSILE:
         {
-            Mesh* mesh = g_res.getModel("weapon_missile")->getMeshByName("missile.Missile");
+            Mesh* mesh = g_projectileMissileMesh;
             Mat4 transform = Mat4::translation(position) * m;
             drawSimple(rw, mesh, &g_res.white, transform, Vec3(1.f));
-            drawBillboard(rw, g_res.getTexture("flare"), position,
+            drawBillboard(rw, g_projectileFlareTexture, position,
                         Vec4(1.f, 0.2f, 0.03f, 0.8f), 1.8f, 0.f, false);
             rw->addPointLight(position, Vec3(1.f, 0.2f, 0.03f) * 5.f, 5.f, 2.f);
         } break;
         case BOUNCER:
         {
-            Mesh* mesh = g_res.getModel("misc")->getMeshByName("Sphere");
+            Mesh* mesh = g_projectileSphereMesh;
             Mat4 transform = Mat4::translation(position) * Mat4::scaling(Vec3(0.4f));
             drawSimple(rw, mesh, &g_res.white, transform, Vec3(1.f), Vec3(0.5f));
-            drawBillboard(rw, g_res.getTexture("flare"), position,
+            drawBillboard(rw, g_projectileFlareTexture, position,
                         Vec4(0.1f, 0.12f, 1.f, 0.8f), 1.75f, 0.f, false);
             rw->addPointLight(position, Vec3(0.1f, 0.15f, 1.f) * 7.f, 6.5f, 2.f);
         } break;
@@ -255,7 +266,7 @@ void Projectile::onRender(RenderWorld* rw, Scene* scene, f32 deltaTime)
             Vec3 emit = Vec3(1.f, 0.01f, 0.95f) * 1.5f;
             Mat4 transform = Mat4::translation(position) * m * Mat4::scaling(Vec3(0.75f));
             drawSimple(rw, bulletMesh, &g_res.white, transform, color, emit);
-            drawBillboard(rw, g_res.getTexture("flare"),
+            drawBillboard(rw, g_projectileFlareTexture,
                     position+Vec3(0,0,0.2f), Vec4(color, 0.4f), 1.5f, 0.f, false);
             rw->addPointLight(position, color * 2.f, 4.f, 2.f);
         } break;
@@ -282,7 +293,7 @@ void Projectile::onHit(Scene* scene, PxSweepHit* hit)
         if (!vehicleImpactSounds.empty())
         {
             u32 index = irandom(scene->randomSeries, 0, vehicleImpactSounds.size());
-            g_audio.playSound3D(g_res.getSound(vehicleImpactSounds[index]),
+            g_audio.playSound3D(vehicleImpactSounds[index]->get(),
                     SoundType::GAME_SFX, hitPos, false, 0.9f,
                     random(scene->randomSeries, 0.75f, 0.9f));
         }
@@ -298,7 +309,7 @@ void Projectile::onHit(Scene* scene, PxSweepHit* hit)
         if (!environmentImpactSounds.empty())
         {
             u32 index = irandom(scene->randomSeries, 0, environmentImpactSounds.size());
-            g_audio.playSound3D(g_res.getSound(environmentImpactSounds[index]),
+            g_audio.playSound3D(environmentImpactSounds[index]->get(),
                     SoundType::GAME_SFX, hitPos, false, 0.9f,
                     random(scene->randomSeries, 0.75f, 0.9f));
         }
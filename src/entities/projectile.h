@@ -67,8 +67,8 @@ private:
     f32 explosionStrength = 0.f;
 
     ParticleEmitter impactEmitter;
-    SmallArray<const char*, 4> environmentImpactSounds;
-    SmallArray<const char*, 4> vehicleImpactSounds;
+    SmallArray<NamedResource<Sound>*, 4> environmentImpactSounds;
+    SmallArray<NamedResource<Sound>*, 4> vehicleImpactSounds;
 
     void onHit(Scene* scene, PxSweepHit* hit);
     void createImpactParticles(Scene* scene, PxSweepHit* hit);
@@ -5,6 +5,11 @@
 #include "../game.h"
 #include "../billboard.h"
 
+NamedResource<Texture> g_finishLineTexture("checkers");
+NamedResource<Texture> g_startLightTexture("flare");
+NamedResource<Sound> g_countdownSound("countdown_a");
+NamedResource<Sound> g_countdownGoSound("countdown_b");
+
 void Start::onCreate(Scene* scene)
 {
     if (!scene->start)
@@ -31,7 +36,7 @@ void Start::onCreateEnd(Scene* scene)
         collisionShape->setLocalPose(PxTransform(convert(obj.position), convert(obj.rotation)));
     }
     scene->getPhysicsScene()->addActor(*actor);
-    finishLineDecal.setTexture(g_res.getTexture("checkers"));
+    finishLineDecal.setTexture(g_finishLineTexture);
     updateTransform(scene);
 }
 
@@ -54,7 +59,7 @@ void Start::onRender(RenderWorld* rw, Scene* scene, f32 deltaTime)
         {
             if (countIndex != 2)
             {
-                g_audio.playSound(g_res.getSound("countdown_b"),
+                g_audio.playSound(g_countdownGoSound,
                         SoundType::GAME_SFX, false, 1.f, 0.5f);
             }
             countIndex = 2;
@@ -63,7 +68,7 @@ void Start::onRender(RenderWorld* rw, Scene* scene, f32 deltaTime)
         {
             if (countIndex != 1)
             {
-                g_audio.playSound(g_res.getSound("countdown_a"),
+                g_audio.playSound(g_countdownSound,
                         SoundType::GAME_SFX, false, 1.f, 0.5f);
             }
             countIndex = 1;
@@ -72,7 +77,7 @@ void Start::onRender(RenderWorld* rw, Scene* scene, f32 deltaTime)
         {
             if (countIndex != 0)
             {
-                g_audio.playSound(g_res.getSound("countdown_a"),
+                g_audio.playSound(g_countdownSound,
                         SoundType::GAME_SFX, false, 1.f, 0.5f);
             }
             countIndex = 0;
@@ -101,7 +106,7 @@ void Start::onRender(RenderWorld* rw, Scene* scene, f32 deltaTime)
             Vec3 p8 = Vec3(-p2.x, -p2.y, p2.z);
             Vec3 positions[] = { p1, p2, p3, p4, p5, p6, p7, p8 };
 
-            Texture* flare = g_res.getTexture("flare");
+            Texture* flare = g_startLightTexture;
             Vec4 col = countIndex == 2
                 ? Vec4(0.01f, 1.f, 0.01f, 0.6f) : Vec4(1.f, 0.01f, 0.01f, 0.6f);
 
@@ -5,6 +5,8 @@
 #include "../resources.h"
 #include "../decal.h"
 
+NamedResource<Model> g_startModel("start");
+
 class Start : public PlaceableEntity
 {
     Model* model;
@@ -16,10 +18,17 @@ public:
     {
         position = Vec3(0, 0, 3);
         rotation = Quat::rotationZ(PI);
-        model = g_res.getModel("start");
+        model = g_startModel;
     }
 
     void updateTransform(class Scene* scene) override;
+    void gatherCollisionMeshes(Array<CollisionMeshRequest>& requests) override
+    {
+        for (auto& obj : model->objects)
+        {
+            requests.push({ &model->meshes[obj.meshIndex], false });
+        }
+    }
     void onCreate(class Scene* scene) override;
     void onCreateEnd(class Scene* scene) override;
     void onRender(RenderWorld* rw, Scene* scene, f32 deltaTime) override;
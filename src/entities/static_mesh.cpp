@@ -14,6 +14,23 @@ void StaticMesh::loadModel()
     }
 }
 
+void StaticMesh::gatherCollisionMeshes(Array<CollisionMeshRequest>& requests)
+{
+    loadModel();
+    if (model->modelUsage != ModelUsage::DYNAMIC_PROP && model->modelUsage != ModelUsage::STATIC_PROP)
+    {
+        return;
+    }
+    bool convex = model->modelUsage == ModelUsage::DYNAMIC_PROP;
+    for (auto& obj : objects)
+    {
+        if (obj.modelObject->isCollider)
+        {
+            requests.push({ &model->meshes[obj.modelObject->meshIndex], convex });
+        }
+    }
+}
+
 void StaticMesh::onCreate(Scene* scene)
 {
     updateTransform(scene);
@@ -69,6 +86,7 @@ void StaticMesh::onCreate(Scene* scene)
 void StaticMesh::updateTransform(Scene* scene)
 {
     transform = Mat4::translation(position) * Mat4(rotation) * Mat4::scaling(scale);
+    previousPose = currentPose = PxTransform(convert(position), convert(rotation));
 
     if (actor)
     {
@@ -113,18 +131,27 @@ void StaticMesh::onRender(RenderWorld* rw, Scene* scene, f32 deltaTime)
     Mat4 t = transform;
     if (model->modelUsage == ModelUsage::DYNAMIC_PROP)
     {
-        t = Mat4(actor->getGlobalPose());
+        t = Mat4(PxMat44(interpolate(previousPose, currentPose, scene->getPhysicsInterpolation())));
     }
     for (auto& o : objects)
     {
         if (o.modelObject->isVisible)
         {
-            g_res.getMaterial(o.modelObject->materialGuid)->draw(rw,
+            scene->frameInstances.add(g_res.getMaterial(o.modelObject->materialGuid),
                     t * o.modelObject->getTransform(), &model->meshes[o.modelObject->meshIndex]);
         }
     }
 }
 
+void StaticMesh::onPhysicsResults(Scene* scene)
+{
+    if (actor && model->modelUsage == ModelUsage::DYNAMIC_PROP)
+    {
+        previousPose = currentPose;
+        currentPose = actor->getGlobalPose();
+    }
+}
+
 void StaticMesh::onBatch(Batcher& batcher)
 {
     if (model->modelUsage == ModelUsage::DYNAMIC_PROP)
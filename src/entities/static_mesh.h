@@ -17,12 +17,18 @@ class StaticMesh : public PlaceableEntity
 
     Array<Object> objects;
 
+    // poses of a dynamic prop after the last two physics steps
+    PxTransform previousPose = PxTransform(PxIdentity);
+    PxTransform currentPose = PxTransform(PxIdentity);
+
     void loadModel();
 
 public:
     void applyDecal(class Decal& decal) override;
+    void gatherCollisionMeshes(Array<CollisionMeshRequest>& requests) override;
     void onCreate(class Scene* scene) override;
     void onRender(RenderWorld* rw, Scene* scene, f32 deltaTime) override;
+    void onPhysicsResults(class Scene* scene) override;
     void onPreview(RenderWorld* rw) override;
     void onEditModeRender(RenderWorld* rw, class Scene* scene, bool isSelected, u8 selectIndex) override;
     void serializeState(Serializer& s) override;
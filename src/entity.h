@@ -93,9 +93,70 @@ enum struct EntityFlags
     DYNAMIC = 1 << 2,
     TRANSIENT = 1 << 3,
     PROP = 1 << 4,
+    HAS_UPDATE = 1 << 5,
+    HAS_RENDER = 1 << 6,
+    HAS_PHYSICS_RESULTS = 1 << 7,
 };
 BITMASK_OPERATORS(EntityFlags);
 
+// Fixed size slots that are carved out of large chunks and reused through a free list, so that
+// entities of the same type sit next to each other in memory instead of all over the heap.
+// Chunks are kept until the game exits. Entities are only created on the main thread.
+class EntityPool
+{
+    static constexpr u32 SLOTS_PER_CHUNK = 128;
+
+    u32 slotSize = 0;
+    Array<u8*> chunks;
+    void* firstFreeSlot = nullptr;
+    u32 allocatedCount = 0;
+
+public:
+    EntityPool() {}
+    EntityPool(u32 slotSize) : slotSize(slotSize) {}
+
+    void* allocate()
+    {
+        if (!firstFreeSlot)
+        {
+            // malloc returns memory aligned for Mat4, and the slot size keeps that alignment
+            u8* chunk = (u8*)malloc(slotSize * SLOTS_PER_CHUNK);
+            chunks.push(chunk);
+            for (u32 i=SLOTS_PER_CHUNK; i>0; --i)
+            {
+                void* slot = chunk + (i - 1) * slotSize;
+                *(void**)slot = firstFreeSlot;
+                firstFreeSlot = slot;
+            }
+        }
+        void* slot = firstFreeSlot;
+        firstFreeSlot = *(void**)slot;
+        ++allocatedCount;
+        return slot;
+    }
+
+    void release(void* slot)
+    {
+        *(void**)slot = firstFreeSlot;
+        firstFreeSlot = slot;
+        --allocatedCount;
+    }
+
+    u32 getSlotSize() const { return slotSize; }
+    u32 getAllocatedCount() const { return allocatedCount; }
+    u32 getChunkCount() const { return chunks.size(); }
+};
+
+// one pool per slot size, so entity types that round up to the same size share a pool;
+// operator new only gets the size, and keying by type would need every entity type to
+// declare its own allocator
+Map<u32, EntityPool> g_entityPools;
+
+inline u32 getEntitySlotSize(size_t size)
+{
+    return (u32)((size + 15) & ~(size_t)15);
+}
+
 #define UNSET_ENTITY_ID 0xF0F0F0F0
 class Entity
 {
@@ -115,6 +176,23 @@ public:
         return (entityFlags & EntityFlags::PERSISTENT) == EntityFlags::PERSISTENT;
     }
 
+    // Entities are allocated from g_entityPools. The destructor is virtual, so delete passes
+    // the size of the most derived type and the slot goes back to the pool it came from.
+    static void* operator new(size_t size)
+    {
+        u32 slotSize = getEntitySlotSize(size);
+        EntityPool* pool = g_entityPools.get(slotSize);
+        if (!pool)
+        {
+            pool = &(g_entityPools[slotSize] = EntityPool(slotSize));
+        }
+        return pool->allocate();
+    }
+    static void operator delete(void* ptr, size_t size)
+    {
+        g_entityPools.get(getEntitySlotSize(size))->release(ptr);
+    }
+
     virtual ~Entity() {}
     virtual void serializeState(Serializer& s) {}
     void serialize(Serializer& s)
@@ -125,10 +203,15 @@ public:
     }
     virtual void onTrigger(ActorUserData* userData) {}
 
+    // lets the scene prepare collision meshes in parallel before onCreate is called
+    virtual void gatherCollisionMeshes(Array<struct CollisionMeshRequest>& requests) {}
     virtual void onCreate(class Scene* scene) {}
     virtual void onCreateEnd(class Scene* scene) {}
     virtual void onUpdate(class RenderWorld* rw, class Scene* scene, f32 deltaTime) {}
     virtual void onRender(class RenderWorld* rw, class Scene* scene, f32 deltaTime) {}
+    // called after the results of every physics step have been fetched, before the next step
+    // is prepared, so changes to the physics scene made here apply to the next step
+    virtual void onPhysicsResults(class Scene* scene) {}
     virtual void onBatch(class Batcher& batcher) {}
 
     virtual void applyDecal(class Decal& decal) {}
@@ -137,6 +220,28 @@ public:
             u8 selectIndex=1) {}
 };
 
+// Entity types that don't override onUpdate, onRender or onPhysicsResults are left out of the
+// loops of the scene. Taking the address of an inherited member function gives a pointer to a member of
+// the class that declares it, so this is known at compile time.
+template <typename T>
+EntityFlags getEntityTickFlags()
+{
+    EntityFlags flags = EntityFlags::NONE;
+    if (!IsSame<decltype(&T::onUpdate), decltype(&Entity::onUpdate)>::value)
+    {
+        flags |= EntityFlags::HAS_UPDATE;
+    }
+    if (!IsSame<decltype(&T::onRender), decltype(&Entity::onRender)>::value)
+    {
+        flags |= EntityFlags::HAS_RENDER;
+    }
+    if (!IsSame<decltype(&T::onPhysicsResults), decltype(&Entity::onPhysicsResults)>::value)
+    {
+        flags |= EntityFlags::HAS_PHYSICS_RESULTS;
+    }
+    return flags;
+}
+
 struct PropPrefabData
 {
     PropCategory category;
@@ -224,6 +329,7 @@ void registerEntity(bool placeable = false)
         [] (u32 entityID) {
             Entity* e = new T();
             e->entityID = entityID;
+            e->entityFlags |= getEntityTickFlags<T>();
             if (g_entities[entityID].isPlaceableInEditor)
             {
                 e->entityFlags |= EntityFlags::PROP;
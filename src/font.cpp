@@ -2,74 +2,343 @@
 #include "renderer.h"
 #include "game.h"
 #include "2d.h"
-#include <stb_rect_pack.h>
 #include <stb_truetype.h>
 
-Font::Font(const char* filename, f32 fontSize, u32 startingChar, u32 numGlyphs)
+FontFace::FontFace(const char* filename, u32 startingChar, u32 numGlyphs)
 {
+    f64 t = getTime();
     this->startingChar = startingChar;
 
-    Buffer fontData = readFileBytes(filename);
-
-    stbtt_fontinfo fontInfo;
+    fontData = readFileBytes(filename);
     stbtt_InitFont(&fontInfo, fontData.data.get(), stbtt_GetFontOffsetForIndex(fontData.data.get(), 0));
 
-    f32 scale = stbtt_ScaleForPixelHeight(&fontInfo, fontSize);
+    scale = stbtt_ScaleForPixelHeight(&fontInfo, SDF_SIZE);
 
     i32 ascent, descent, lineGap;
     stbtt_GetFontVMetrics(&fontInfo, &ascent, &descent, &lineGap);
+    this->ascent = ascent * scale;
+    this->descent = descent * scale;
+    this->lineGap = lineGap * scale;
 
-    stbtt_pack_context c;
-    Array<stbtt_packedchar> charData(numGlyphs);
+    glyphs.resize(numGlyphs);
+    for (u32 g=0; g<numGlyphs; ++g)
+    {
+        i32 advance, leftSideBearing;
+        stbtt_GetCodepointHMetrics(&fontInfo, g + startingChar, &advance, &leftSideBearing);
+        i32 x0, y0, x1, y1;
+        stbtt_GetCodepointBitmapBox(&fontInfo, g + startingChar, scale, scale, &x0, &y0, &x1, &y1);
+
+        // the same box that stbtt_GetGlyphSDF produces
+        GlyphMetrics& glyph = glyphs[g];
+        glyph = {};
+        glyph.advance = advance * scale;
+        if (x0 != x1 && y0 != y1)
+        {
+            glyph.xOff = (f32)(x0 - SDF_PADDING);
+            glyph.yOff = (f32)(y0 - SDF_PADDING);
+            glyph.width = (f32)(x1 - x0 + SDF_PADDING * 2);
+            glyph.height = (f32)(y1 - y0 + SDF_PADDING * 2);
+        }
+    }
 
-    i32 w = 1024, h = 1024;
-    Array<u8> texData(w * h);
+    // Most pairs have no kerning. Every pair is read once here instead of once per size, and the
+    // pairs come out in order, so the table is sorted without sorting it.
+    for (u32 a=0; a<numGlyphs; ++a)
+    {
+        for (u32 b=0; b<numGlyphs; ++b)
+        {
+            i32 kern = stbtt_GetCodepointKernAdvance(&fontInfo, a + startingChar, b + startingChar);
+            if (kern != 0)
+            {
+                kerningPairs.push({ (a << 16) | b, kern * scale });
+                glyphs[a].hasKerning = true;
+            }
+        }
+    }
 
-    const i32 padding = 4;
-    stbtt_PackBegin(&c, texData.data(), w, h, 0, padding, nullptr);
+    stats.kerningPairCount = kerningPairs.size();
+    stats.creationTime = getTime() - t;
+}
 
-    if (!stbtt_PackFontRange(&c, fontData.data.get(), 0, fontSize, startingChar, numGlyphs, charData.data()))
+FontFace::~FontFace()
+{
+    if (pages.size() > 0)
     {
-        // this might mean the atlas is too small
-        FATAL_ERROR("Failed to pack font atlas.");
+        glDeleteTextures(pages.size(), pages.data());
     }
-    stbtt_PackEnd(&c);
+}
 
-    glyphs.resize(numGlyphs);
-    kerningTable.resize(numGlyphs * numGlyphs);
-    for (u32 i=startingChar; i<startingChar+numGlyphs; ++i)
+bool ShelfPacker::allocate(i32 w, i32 h, u32& outPage, i32& outX, i32& outY)
+{
+    if (w > pageSize || h > pageSize)
+    {
+        return false;
+    }
+    if (pageCount > 0 && shelfX + w > pageSize)
+    {
+        shelfX = 0;
+        shelfY += shelfHeight + GAP;
+        shelfHeight = 0;
+    }
+    if (pageCount == 0 || shelfY + h > pageSize)
     {
-        u32 g = i - startingChar;
-        stbtt_packedchar info = charData[g];
+        ++pageCount;
+        shelfX = 0;
+        shelfY = 0;
+        shelfHeight = 0;
+    }
+    outPage = pageCount - 1;
+    outX = shelfX;
+    outY = shelfY;
+    shelfX += w + GAP;
+    shelfHeight = max(shelfHeight, h);
+    return true;
+}
 
-        glyphs[g].x0 = info.x0 / (f32)w;
-        glyphs[g].y0 = info.y0 / (f32)h;
-        glyphs[g].x1 = info.x1 / (f32)w;
-        glyphs[g].y1 = info.y1 / (f32)h;
+u32 ShelfPacker::countPackingErrors(i32 pageSize, Array<Rect> const& rects)
+{
+    u32 errors = 0;
+    for (u32 a=0; a<rects.size(); ++a)
+    {
+        Rect const& ra = rects[a];
+        if (ra.x < 0 || ra.y < 0 || ra.x + ra.w > pageSize || ra.y + ra.h > pageSize)
+        {
+            ++errors;
+        }
+        for (u32 b=a+1; b<rects.size(); ++b)
+        {
+            Rect const& rb = rects[b];
+            if (ra.page == rb.page && ra.x < rb.x + rb.w && rb.x < ra.x + ra.w
+                    && ra.y < rb.y + rb.h && rb.y < ra.y + ra.h)
+            {
+                ++errors;
+            }
+        }
+    }
+    return errors;
+}
 
-        glyphs[g].advance = info.xadvance;
-        glyphs[g].xOff = info.xoff;
-        glyphs[g].yOff = info.yoff;
-        glyphs[g].width = info.xoff2 - info.xoff;
-        glyphs[g].height = info.yoff2 - info.yoff;
+bool ShelfPacker::check()
+{
+    const i32 pageSize = 128;
+    RandomSeries series;
+    ShelfPacker packer(pageSize);
+    Array<Rect> rects;
+    u32 rejectedCount = 0;
+    u32 wrongRejections = 0;
+    for (u32 i=0; i<500; ++i)
+    {
+        // mostly glyph sized, with the odd one that is too wide or too tall for a page
+        i32 w = irandom(series, 1, i % 50 == 0 ? pageSize * 2 : pageSize / 3);
+        i32 h = irandom(series, 1, i % 70 == 0 ? pageSize * 2 : pageSize / 3);
+        Rect r = { 0, 0, 0, w, h };
+        bool fits = w <= pageSize && h <= pageSize;
+        if (packer.allocate(w, h, r.page, r.x, r.y))
+        {
+            if (!fits)
+            {
+                ++wrongRejections;
+            }
+            rects.push(r);
+        }
+        else
+        {
+            ++rejectedCount;
+            if (fits)
+            {
+                ++wrongRejections;
+            }
+        }
+    }
+    // the rectangles go on the page of the one before them or on the next page
+    u32 packingErrors = countPackingErrors(pageSize, rects);
+    u32 pageErrors = 0;
+    for (u32 i=0; i<rects.size(); ++i)
+    {
+        if (rects[i].page >= packer.getPageCount()
+                || (i > 0 && rects[i].page != rects[i - 1].page
+                    && rects[i].page != rects[i - 1].page + 1))
+        {
+            ++pageErrors;
+        }
+    }
+
+    println("Shelf packer: %u rectangles in %u pages of %u, %u too large", rects.size(),
+            packer.getPageCount(), pageSize, rejectedCount);
+    if (packingErrors > 0 || pageErrors > 0 || wrongRejections > 0)
+    {
+        error("Shelf packer check failed: %u rectangles packed wrong, %u on the wrong page, "
+                "%u wrongly accepted or rejected", packingErrors, pageErrors, wrongRejections);
+        return false;
+    }
+    return true;
+}
+
+void FontFace::rasterize(u32 g)
+{
+    f64 t = getTime();
+    GlyphMetrics& glyph = glyphs[g];
+    glyph.isRasterized = true;
+
+    i32 w, h, xOff, yOff;
+    u8* sdf = stbtt_GetCodepointSDF(&fontInfo, scale, g + startingChar, SDF_PADDING, SDF_ON_EDGE,
+            (f32)SDF_ON_EDGE / SDF_PADDING, &w, &h, &xOff, &yOff);
+    if (!sdf)
+    {
+        return;
+    }
 
-        for (u32 c=0; c<numGlyphs; ++c)
+    u32 page;
+    i32 x, y;
+    if (packer.allocate(w, h, page, x, y))
+    {
+        if (page == pages.size())
         {
-            kerningTable[(i-startingChar)*numGlyphs + c] =
-                stbtt_GetCodepointKernAdvance(&fontInfo, i, c+startingChar) * scale;
+            GLuint texture;
+            glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+            glTextureStorage2D(texture, 1, GL_R8, PAGE_SIZE, PAGE_SIZE);
+            glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            u8 zero = 0;
+            glClearTexImage(texture, 0, GL_RED, GL_UNSIGNED_BYTE, &zero);
+            pages.push(texture);
         }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTextureSubImage2D(pages[page], 0, x, y, w, h, GL_RED, GL_UNSIGNED_BYTE, sdf);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        glyph.page = page;
+        glyph.x0 = x / (f32)PAGE_SIZE;
+        glyph.y0 = y / (f32)PAGE_SIZE;
+        glyph.x1 = (x + w) / (f32)PAGE_SIZE;
+        glyph.y1 = (y + h) / (f32)PAGE_SIZE;
+        glyph.xOff = (f32)xOff;
+        glyph.yOff = (f32)yOff;
+        glyph.width = (f32)w;
+        glyph.height = (f32)h;
+        ++stats.rasterizedGlyphCount;
     }
+    else
+    {
+        error("Glyph %u does not fit in a font page.", g + startingChar);
+    }
+    stbtt_FreeSDF(sdf, nullptr);
+    stats.rasterizationTime += getTime() - t;
+}
 
-    // set the line height based on the height of an uppercase character
-    auto &f = glyphs['M'-startingChar];
-    height = f.height;
-    lineHeight = ((ascent - descent) + lineGap) * scale;
+GlyphMetrics const& FontFace::getRasterizedGlyph(char c)
+{
+    u32 g = (u32)(c - startingChar);
+    if (!glyphs[g].isRasterized)
+    {
+        rasterize(g);
+    }
+    return glyphs[g];
+}
+
+f32 FontFace::getKerning(char a, char b) const
+{
+    u32 ga = (u32)(a - startingChar);
+    u32 gb = (u32)(b - startingChar);
+    if (ga >= glyphs.size() || gb >= glyphs.size() || !glyphs[ga].hasKerning)
+    {
+        return 0.f;
+    }
 
-    textureAtlas = Texture(filename, w, h, texData.data(), (u32)texData.size(),
-            TextureType::GRAYSCALE, false);
+    u32 pair = (ga << 16) | gb;
+    i32 lo = 0;
+    i32 hi = (i32)kerningPairs.size() - 1;
+    while (lo <= hi)
+    {
+        i32 mid = (lo + hi) / 2;
+        if (kerningPairs[mid].pair < pair)
+        {
+            lo = mid + 1;
+        }
+        else if (kerningPairs[mid].pair > pair)
+        {
+            hi = mid - 1;
+        }
+        else
+        {
+            return kerningPairs[mid].advance;
+        }
+    }
+    return 0.f;
 }
 
-Vec2 Font::stringDimensions(const char* str, bool onlyFirstLine) const
+size_t FontFace::getMemoryUsage() const
+{
+    return fontData.size + glyphs.size() * sizeof(GlyphMetrics)
+        + kerningPairs.size() * sizeof(KerningPair) + pages.size() * PAGE_SIZE * PAGE_SIZE;
+}
+
+bool FontFace::check()
+{
+    u32 kerningErrors = 0;
+    for (u32 a=0; a<glyphs.size(); ++a)
+    {
+        for (u32 b=0; b<glyphs.size(); ++b)
+        {
+            f32 expected = stbtt_GetCodepointKernAdvance(&fontInfo, a + startingChar,
+                    b + startingChar) * scale;
+            if (getKerning((char)(a + startingChar), (char)(b + startingChar)) != expected)
+            {
+                ++kerningErrors;
+            }
+        }
+    }
+
+    // the boxes in the metrics are the ones the rasterized glyphs get, so the whole face is
+    // packed the way it would be if every glyph were drawn
+    ShelfPacker boxPacker(PAGE_SIZE);
+    Array<ShelfPacker::Rect> boxes;
+    u32 packingErrors = 0;
+    for (auto& glyph : glyphs)
+    {
+        if (glyph.width > 0.f)
+        {
+            ShelfPacker::Rect r = { 0, 0, 0, (i32)glyph.width, (i32)glyph.height };
+            if (boxPacker.allocate(r.w, r.h, r.page, r.x, r.y))
+            {
+                boxes.push(r);
+            }
+            else
+            {
+                ++packingErrors;
+            }
+        }
+    }
+    packingErrors += ShelfPacker::countPackingErrors(PAGE_SIZE, boxes);
+
+    println("Font face: %u glyphs in %u pages (%u with every glyph), %u kerning pairs, %.1fkb, "
+            "created in %.2fms, rasterized in %.2fms", glyphs.size(), pages.size(),
+            boxPacker.getPageCount(), kerningPairs.size(),
+            getMemoryUsage() / 1024.0, stats.creationTime * 1000.0,
+            stats.rasterizationTime * 1000.0);
+    if (kerningErrors > 0 || packingErrors > 0)
+    {
+        error("Font face check failed: %u kerning pairs differ, %u glyphs packed wrong",
+                kerningErrors, packingErrors);
+        return false;
+    }
+    return true;
+}
+
+Font::Font(FontFace* face, f32 fontSize)
+{
+    this->face = face;
+    this->faceScale = fontSize / FontFace::SDF_SIZE;
+
+    // set the line height based on the height of an uppercase character
+    height = (face->getGlyph('M').height - FontFace::SDF_PADDING * 2) * faceScale;
+    lineHeight = ((face->ascent - face->descent) + face->lineGap) * faceScale;
+}
+
+Vec2 Font::measure(const char* str, bool onlyFirstLine) const
 {
     f32 maxWidth = 0;
     f32 currentWidth = 0;
@@ -95,8 +364,11 @@ Vec2 Font::stringDimensions(const char* str, bool onlyFirstLine) const
             continue;
         }
 
-        GlyphMetrics const& g = glyphs[*str-startingChar];
-        currentWidth += g.advance;
+        // characters the face doesn't have take no space
+        if (face->isValidChar(*str))
+        {
+            currentWidth += face->getGlyph(*str).advance * faceScale;
+        }
 
         if (!*(str+1))
         {
@@ -106,7 +378,7 @@ Vec2 Font::stringDimensions(const char* str, bool onlyFirstLine) const
 
         if (*(str+1) != '\n')
         {
-            currentWidth += kerningTable[(*str - startingChar)*glyphs.size() + (*(str+1) - startingChar)];
+            currentWidth += face->getKerning(*str, *(str+1)) * faceScale;
         }
         ++str;
     }
@@ -114,16 +386,27 @@ Vec2 Font::stringDimensions(const char* str, bool onlyFirstLine) const
     return { max(currentWidth, maxWidth), currentHeight };
 }
 
-void Font::draw(const char* text, Vec2 pos, Vec3 color, f32 alpha, f32 scale,
-        HAlign halign, VAlign valign, Mat4 const& transform, Vec2 scissorPos, Vec2 scissorSize)
+Vec2 Font::stringDimensions(const char* str, bool onlyFirstLine) const
+{
+    if (onlyFirstLine)
+    {
+        return measure(str, true);
+    }
+    return g_textLayoutCache.get(*this, str).dimensions;
+}
+
+void Font::layout(const char* text, f32 scale, HAlign halign, VAlign valign, TextLayout& out) const
 {
-    char* str = (char*)text;
-    Vec2 p = pos;
-    f32 startX = p.x;
+    f32 glyphScale = faceScale * scale;
+    const char* str = text;
+    Vec2 p(0.f);
+
+    out.glyphs.clear();
+    out.dimensions = measure(text, false) * scale;
 
     if (halign != HAlign::LEFT)
     {
-        f32 lineWidth = stringDimensions(str, true).x * scale;
+        f32 lineWidth = measure(str, true).x * scale;
         if (halign == HAlign::CENTER)
         {
             p.x -= lineWidth * 0.5f;
@@ -137,7 +420,7 @@ void Font::draw(const char* text, Vec2 pos, Vec3 color, f32 alpha, f32 scale,
     p.y += height * scale;
     if (valign != VAlign::TOP)
     {
-        f32 stringHeight = stringDimensions(str).y * scale;
+        f32 stringHeight = out.dimensions.y;
         if (valign == VAlign::BOTTOM)
         {
             p.y -= stringHeight;
@@ -148,26 +431,24 @@ void Font::draw(const char* text, Vec2 pos, Vec3 color, f32 alpha, f32 scale,
         }
     }
 
-    glBindTextureUnit(1, textureAtlas.handle);
-
     while (*str)
     {
         if (*str == '\n')
         {
             ++str;
-            f32 nextLineWidth = stringDimensions(str, true).x * scale;
+            f32 nextLineWidth = measure(str, true).x * scale;
 
             if (halign == HAlign::CENTER)
             {
-                p.x = startX - nextLineWidth * 0.5f;
+                p.x = -nextLineWidth * 0.5f;
             }
             else if (halign == HAlign::LEFT)
             {
-                p.x = startX;
+                p.x = 0.f;
             }
             else
             {
-                p.x = startX - nextLineWidth;
+                p.x = -nextLineWidth;
             }
 
             p.y += lineHeight * scale;
@@ -175,12 +456,47 @@ void Font::draw(const char* text, Vec2 pos, Vec3 color, f32 alpha, f32 scale,
             continue;
         }
 
-        auto &g = glyphs[(u32)(*str - startingChar)];
+        // the metrics of the face are the same before and after the glyph is rasterized
+        if (face->isValidChar(*str))
+        {
+            auto &g = face->getGlyph(*str);
+            if (g.width > 0.f)
+            {
+                out.glyphs.push({
+                    p + Vec2(g.xOff, g.yOff) * glyphScale,
+                    Vec2(g.width, g.height) * glyphScale,
+                    *str
+                });
+            }
+
+            p.x += g.advance * glyphScale;
+        }
+
+        // kerning
+        if (*(str+1) && *(str+1) != '\n')
+        {
+            p.x += face->getKerning(*str, *(str+1)) * glyphScale;
+        }
+
+        ++str;
+    }
+}
+
+void Font::draw(const char* text, Vec2 pos, Vec3 color, f32 alpha, f32 scale,
+        HAlign halign, VAlign valign, Mat4 const& transform, Vec2 scissorPos, Vec2 scissorSize)
+{
+    TextLayout const& layout = g_textLayoutCache.get(*this, text, scale, halign, valign);
+    Vec4 col(color, alpha);
+    u32 boundPage = UINT32_MAX;
+
+    for (auto& glyph : layout.glyphs)
+    {
+        auto &g = face->getRasterizedGlyph(glyph.c);
 
-        f32 x0 = floorf(p.x + g.xOff * scale);
-        f32 y0 = floorf(p.y + g.yOff * scale);
-        f32 x1 = floorf(x0 + g.width * scale);
-        f32 y1 = floorf(y0 + g.height * scale);
+        f32 x0 = floorf(pos.x + glyph.offset.x);
+        f32 y0 = floorf(pos.y + glyph.offset.y);
+        f32 x1 = x0 + glyph.size.x;
+        f32 y1 = y0 + glyph.size.y;
 
         Vec2 p1 = { x0, y0 };
         Vec2 p2 = { x1, y1 };
@@ -191,23 +507,166 @@ void Font::draw(const char* text, Vec2 pos, Vec3 color, f32 alpha, f32 scale,
         q.points[1] = { { p2.x, p1.y }, { t2.x, t1.y } };
         q.points[2] = { { p1.x, p2.y }, { t1.x, t2.y } };
         q.points[3] = { p2, t2 };
-        if (ui::transformQuad(q, transform, scissorPos, scissorSize))
+        if (g.x0 != g.x1 && ui::transformQuad(q, transform, scissorPos, scissorSize))
         {
-            Vec4 col(color, alpha);
+            if (g.page != boundPage)
+            {
+                glBindTextureUnit(1, face->getPage(g.page));
+                boundPage = g.page;
+            }
             glUniform4fv(0, 4, (GLfloat*)&q.points);
             glUniform4fv(4, 1, (GLfloat*)&col);
             glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
         }
+    }
+}
 
-        p.x += g.advance * scale;
+static bool isSameLayout(TextLayout const& layout, FontFace* face, f32 glyphScale,
+        HAlign halign, VAlign valign, const char* text)
+{
+    return layout.face == face && layout.glyphScale == glyphScale && layout.halign == halign
+        && layout.valign == valign && strcmp(layout.text.data(), text) == 0;
+}
 
-        // kerning
-        if (*(str+1) && *(str+1) != '\n')
+TextLayout const& TextLayoutCache::get(Font const& font, const char* text, f32 scale,
+        HAlign halign, VAlign valign)
+{
+    FontFace* face = font.getFace();
+    f32 glyphScale = font.getFaceScale() * scale;
+    size_t length = strlen(text);
+
+    u64 key = hashBytes(HASH_SEED, text, length);
+    key = hashValue(key, face);
+    key = hashValue(key, glyphScale);
+    key = hashValue(key, halign);
+    key = hashValue(key, valign);
+
+    OwnedPtr<TextLayout>& layout = layouts[key];
+    if (layout && isSameLayout(*layout, face, glyphScale, halign, valign, text))
+    {
+        ++stats.hits;
+    }
+    else
+    {
+        // a different string with the same hash just takes over the entry
+        if (!layout)
         {
-            p.x += kerningTable[(*str - startingChar) * glyphs.size() +
-                (*(str+1) - startingChar)] * scale;
+            layout.reset(new TextLayout);
         }
+        layout->face = face;
+        layout->glyphScale = glyphScale;
+        layout->halign = halign;
+        layout->valign = valign;
+        layout->text.resize((u32)length + 1);
+        memcpy(layout->text.data(), text, length + 1);
+        font.layout(text, scale, halign, valign, *layout);
+        ++stats.misses;
+    }
+    layout->lastUsedFrame = currentFrame;
+    return *layout;
+}
 
-        ++str;
+void TextLayoutCache::endFrame()
+{
+    evictedKeys.clear();
+    for (auto& layout : layouts)
+    {
+        if (layout.value->lastUsedFrame + EVICTION_DELAY < currentFrame)
+        {
+            evictedKeys.push(layout.key);
+        }
+    }
+    for (u64 key : evictedKeys)
+    {
+        layouts.erase(key);
+    }
+    stats.evictions = evictedKeys.size();
+
+    lastFrameStats = stats;
+    stats = {};
+    ++currentFrame;
+}
+
+void TextLayoutCache::benchmark(Font const& font, u32 frameCount)
+{
+    const char* labels[] = {
+        "CHAMPIONSHIP", "QUICK RACE", "LOAD GAME", "SETTINGS", "TRACK EDITOR", "EXIT",
+        "LAP", "POSITION", "ARMOR", "BOOST", "BEST LAP", "LAST LAP",
+        "Player 1", "Driver 2", "Driver 3", "Driver 4", "Driver 5", "Driver 6", "Driver 7",
+    };
+    const u32 labelCount = ARRAY_SIZE(labels);
+    const u32 positionCount = 8;
+    HAlign haligns[] = { HAlign::LEFT, HAlign::CENTER, HAlign::RIGHT };
+
+    Array<Str32> strings;
+    auto fillFrame = [&](u32 frame) {
+        strings.clear();
+        for (u32 i=0; i<labelCount; ++i)
+        {
+            strings.push(labels[i]);
+        }
+        // what a race HUD shows: most of it changes a few times a race, the timer every frame
+        strings.push(Str32::format("%u/%u", frame / 600 + 1, 4));
+        strings.push(Str32::format("%u/%u", (frame / 97) % positionCount + 1, positionCount));
+        strings.push(Str32::format("%u", 100 - (frame / 40) % 100));
+        strings.push(Str32::format("$%u", (frame / 150) * 250));
+        strings.push(Str32::format("%u:%05.2f", frame / 3600, (frame % 3600) / 60.f));
+        strings.push("1:02.50");
+    };
+
+    TextLayoutCache cache;
+    TextLayout uncached;
+    f64 uncachedTime = 0.0;
+    f64 cachedTime = 0.0;
+    u32 glyphCount = 0;
+    u32 mismatches = 0;
+    for (u32 frame=0; frame<frameCount; ++frame)
+    {
+        fillFrame(frame);
+
+        f64 t = getTime();
+        for (u32 i=0; i<strings.size(); ++i)
+        {
+            font.layout(strings[i].data(), 1.f, haligns[i % 3], VAlign::TOP, uncached);
+            glyphCount += uncached.glyphs.size();
+        }
+        uncachedTime += getTime() - t;
+
+        t = getTime();
+        for (u32 i=0; i<strings.size(); ++i)
+        {
+            cache.get(font, strings[i].data(), 1.f, haligns[i % 3], VAlign::TOP);
+        }
+        cache.endFrame();
+        cachedTime += getTime() - t;
+
+        for (u32 i=0; i<strings.size(); ++i)
+        {
+            TextLayout const& cached =
+                cache.get(font, strings[i].data(), 1.f, haligns[i % 3], VAlign::TOP);
+            font.layout(strings[i].data(), 1.f, haligns[i % 3], VAlign::TOP, uncached);
+            bool isMatch = cached.glyphs.size() == uncached.glyphs.size()
+                && cached.dimensions == uncached.dimensions;
+            for (u32 j=0; isMatch && j<cached.glyphs.size(); ++j)
+            {
+                isMatch = cached.glyphs[j].offset == uncached.glyphs[j].offset
+                    && cached.glyphs[j].size == uncached.glyphs[j].size
+                    && cached.glyphs[j].c == uncached.glyphs[j].c;
+            }
+            mismatches += isMatch ? 0 : 1;
+        }
+    }
+
+    println("Text layout of %u strings (%u glyphs) for %u frames: uncached %.4fms, "
+            "cached %.4fms per frame, %u layouts cached", strings.size(),
+            glyphCount / max(frameCount, 1u), frameCount, uncachedTime * 1000.0 / max(frameCount, 1u),
+            cachedTime * 1000.0 / max(frameCount, 1u), cache.size());
+    if (mismatches > 0)
+    {
+        error("Cached text layouts differ from the uncached ones in %u cases", mismatches);
+    }
+    else
+    {
+        println("    all cached layouts match");
     }
 }
@@ -2,6 +2,8 @@
 
 #include "math.h"
 #include "texture.h"
+#include "misc.h"
+#include <stb_truetype.h>
 
 enum struct HAlign
 {
@@ -23,27 +25,193 @@ struct GlyphMetrics
     f32 advance;
     f32 xOff, yOff;
     f32 width, height;
+    u32 page;
+    bool isRasterized;
+    bool hasKerning;
 };
 
+// Packs rectangles into square pages in rows, or shelves, as tall as the tallest rectangle in
+// them, starting a new page when the current one is full. It only hands out the positions, so
+// the pages themselves are created by the owner and it can be checked without the renderer.
+class ShelfPacker
+{
+    i32 pageSize;
+    u32 pageCount = 0;
+    i32 shelfX = 0;
+    i32 shelfY = 0;
+    i32 shelfHeight = 0;
+
+public:
+    // one pixel between rectangles keeps filtering from reaching into the neighbors
+    static constexpr i32 GAP = 1;
+
+    struct Rect
+    {
+        u32 page;
+        i32 x, y, w, h;
+    };
+
+    ShelfPacker(i32 pageSize) : pageSize(pageSize) {}
+
+    // fails if the rectangle is larger than a page; the page can be one past the last one
+    bool allocate(i32 w, i32 h, u32& outPage, i32& outX, i32& outY);
+    u32 getPageCount() const { return pageCount; }
+
+    // counts the rectangles that reach outside of their page or overlap another one
+    static u32 countPackingErrors(i32 pageSize, Array<Rect> const& rects);
+    // packs rectangles of random sizes, some too large for a page, and checks where they went
+    static bool check();
+};
+
+// The glyphs of one font file as signed distance fields, which are rasterized once at SDF_SIZE
+// pixels and drawn at any size. Glyphs are rasterized the first time they are drawn and packed
+// into pages that are added as they fill up. Only the metrics and the kerning are read up
+// front, and the kerning only keeps the pairs that aren't zero.
+class FontFace
+{
+public:
+    static constexpr f32 SDF_SIZE = 48.f;
+    // how far outside of the outline the distance field reaches, in pixels at SDF_SIZE
+    static constexpr i32 SDF_PADDING = 6;
+    static constexpr u8 SDF_ON_EDGE = 128;
+    static constexpr i32 PAGE_SIZE = 512;
+
+    struct KerningPair
+    {
+        u32 pair;
+        f32 advance;
+    };
+
+    struct Stats
+    {
+        f64 creationTime = 0.0;
+        f64 rasterizationTime = 0.0;
+        u32 rasterizedGlyphCount = 0;
+        u32 kerningPairCount = 0;
+    };
+
+private:
+    Buffer fontData;
+    stbtt_fontinfo fontInfo;
+    f32 scale;
+    u32 startingChar;
+    Array<GlyphMetrics> glyphs;
+    // sorted by pair, which is the first character in the high bits and the second in the low
+    Array<KerningPair> kerningPairs;
+    Array<GLuint> pages;
+    ShelfPacker packer = ShelfPacker(PAGE_SIZE);
+    Stats stats;
+
+    void rasterize(u32 g);
+
+public:
+    f32 ascent, descent, lineGap;
+
+    FontFace(const char* filename, u32 startingChar=32, u32 numGlyphs=95);
+    ~FontFace();
+
+    // the metrics in pixels at SDF_SIZE
+    GlyphMetrics const& getGlyph(char c) const { return glyphs[(u32)(c - startingChar)]; }
+    // rasterizes the glyph if it hasn't been yet, which needs the render thread
+    GlyphMetrics const& getRasterizedGlyph(char c);
+    f32 getKerning(char a, char b) const;
+    GLuint getPage(u32 index) const { return pages[index]; }
+    bool isValidChar(char c) const { return (u32)(c - startingChar) < glyphs.size(); }
+    size_t getMemoryUsage() const;
+    Stats const& getStats() const { return stats; }
+
+    // compares the sparse kerning table with the kerning of every pair read from the font and
+    // checks that the boxes of all the glyphs pack without overlapping; doesn't rasterize
+    bool check();
+};
+
+struct TextLayoutGlyph
+{
+    // the top left corner of the quad relative to the position the text is drawn at, before it
+    // is rounded to whole pixels
+    Vec2 offset;
+    Vec2 size;
+    char c;
+};
+
+struct TextLayout
+{
+    FontFace* face;
+    f32 glyphScale;
+    HAlign halign;
+    VAlign valign;
+    Array<char> text;
+    // only the glyphs that have something to draw
+    Array<TextLayoutGlyph> glyphs;
+    Vec2 dimensions;
+    u64 lastUsedFrame = 0;
+};
+
+// A font face at one size, which only holds the scale, so any number of sizes can share the
+// glyphs of the face.
 class Font
 {
-    Texture textureAtlas;
+    FontFace* face = nullptr;
+    // from pixels at FontFace::SDF_SIZE to pixels at the size of this font
+    f32 faceScale = 1.f;
     f32 height;
     f32 lineHeight;
-    u32 startingChar;
-    Array<GlyphMetrics> glyphs;
-    Array<f32> kerningTable;
+
+    Vec2 measure(const char* str, bool onlyFirstLine) const;
 
 public:
     Font() {}
-    Font(const char* filename, f32 height, u32 startingChar=32, u32 numGlyphs=95);
+    Font(FontFace* face, f32 height);
 
+    // the whole string is measured through the layout cache, the first line is measured directly
     Vec2 stringDimensions(const char* str, bool onlyFirstLine=false) const;
+    // places the glyphs of the string without looking at the cache and without rasterizing
+    void layout(const char* text, f32 scale, HAlign halign, VAlign valign, TextLayout& out) const;
 
     f32 getHeight() const { return height; }
     f32 getLineHeight() const { return lineHeight; }
+    FontFace* getFace() const { return face; }
+    f32 getFaceScale() const { return faceScale; }
 
     void draw(const char* text, Vec2 pos, Vec3 color, f32 alpha=1.f, f32 scale=1.f,
             HAlign halign=HAlign::LEFT, VAlign valign=VAlign::TOP, Mat4 const& t=Mat4(1.f),
             Vec2 scissorPos={0,0}, Vec2 scissorSize={INFINITY, INFINITY});
 };
+
+// Keeps the layouts of the strings that were drawn or measured recently, so text that doesn't
+// change from one frame to the next is only laid out once. Layouts are keyed by the face, the
+// scale the glyphs end up at, the alignment and the string, so fonts of the same size share
+// them, and are dropped once they have gone unused for EVICTION_DELAY frames.
+class TextLayoutCache
+{
+public:
+    static constexpr u32 EVICTION_DELAY = 120;
+
+    struct Stats
+    {
+        u32 hits = 0;
+        u32 misses = 0;
+        u32 evictions = 0;
+    };
+
+private:
+    Map<u64, OwnedPtr<TextLayout>, 256> layouts;
+    Array<u64> evictedKeys;
+    u64 currentFrame = 0;
+    Stats stats;
+    Stats lastFrameStats;
+
+public:
+    TextLayout const& get(Font const& font, const char* text, f32 scale=1.f,
+            HAlign halign=HAlign::LEFT, VAlign valign=VAlign::TOP);
+    // drops the layouts that haven't been used in a while; called once at the end of every frame
+    void endFrame();
+    void clear() { layouts.clear(); }
+
+    u32 size() const { return layouts.size(); }
+    Stats const& getLastFrameStats() const { return lastFrameStats; }
+
+    // lays out the strings of a race HUD and a menu for a number of frames, with and without
+    // the cache, and checks that the cached layouts match; doesn't need the renderer
+    static void benchmark(Font const& font, u32 frameCount);
+} g_textLayoutCache;
@@ -43,8 +43,7 @@ void Game::initPhysX()
     */
     physx.cooking = PxCreateCooking(PX_PHYSICS_VERSION, *physx.foundation, cookingParams);
 
-    const u32 PHYSICS_THREADS = 0;
-    physx.dispatcher = PxDefaultCpuDispatcherCreate(PHYSICS_THREADS);
+    physx.dispatcher = &g_physicsDispatcher;
 
     PxInitVehicleSDK(*physx.physics);
     PxVehicleSetBasisVectors(PxVec3(0, 0, 1), PxVec3(1, 0, 0));
@@ -235,6 +234,7 @@ void Game::run()
         checkDebugKeys();
         ImGui::Render();
         renderer->render(deltaTime);
+        g_textLayoutCache.endFrame();
         if (currentScene)
         {
             currentScene->onEndUpdate();
@@ -246,6 +246,9 @@ void Game::run()
 
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
+        // streamed textures can get new handles, so this happens after everything is drawn
+        g_textureStreamer.update();
+
         cpuTime = getTime() - frameStartTime;
         if (!isTimedBlockTrackingPaused)
         {
@@ -299,6 +302,7 @@ void Game::run()
     }
 
     g_audio.close();
+    DataFile::finishBackgroundSaves();
     g_threadPool.signalCompletion();
     g_threadPool.join();
 
@@ -441,6 +445,58 @@ void Game::checkDebugKeys()
         ImGui::Text("Frame Temp-Memory Usage: %.3fkb", g_tmpMem.pos / 1024.f);
         ImGui::Text("Resolution: %ix%i", g_game.config.graphics.resolutionX, g_game.config.graphics.resolutionY);
         ImGui::Text("Time Dilation: %f", g_game.timeDilation);
+        LightGrid const& lightGrid = renderer->getRenderWorld()->getLightGrid(0);
+        ImGui::Text("Point Lights: %u (%u dropped), Light Indices: %u (%u dropped)",
+                lightGrid.lights.size(), lightGrid.droppedLightCount,
+                lightGrid.lightIndices.size(), lightGrid.droppedIndexCount);
+        if (ImGui::Button("Check Light Grid"))
+        {
+            LightGrid::check();
+        }
+        ShadowPassStats const& shadowStats = renderer->getRenderWorld()->getShadowStats(0);
+        ImGui::Text("Shadow Pass: %u dynamic items, %u static items%s, %.3fms GPU",
+                shadowStats.dynamicItemCount, shadowStats.staticItemCount,
+                shadowStats.staticCacheUsed ? " (cached)" : "", shadowStats.gpuTime);
+        ImGui::Checkbox("Static Shadow Cache", &config.graphics.staticShadowCacheEnabled);
+        ImGui::SliderFloat("LOD Pixel Error", &config.graphics.lodPixelError, 0.f, 8.f);
+        TextureStreamingStats const& textureStats = g_textureStreamer.getStats();
+        ImGui::Text("Texture Streaming: %.1f/%.1fmb resident, %u textures",
+                textureStats.residentBytes / (f64)megabytes(1),
+                textureStats.budgetBytes / (f64)megabytes(1), textureStats.streamedTextureCount);
+        ImGui::Text("Pending Uploads: %u, Pending Readbacks: %u, Uploaded: %u, Evicted: %u",
+                textureStats.pendingUploadCount, textureStats.pendingReadbackCount,
+                textureStats.uploadCount, textureStats.evictionCount);
+        if (ImGui::Button("Benchmark Resource Lookups"))
+        {
+            g_res.benchmarkLookups();
+        }
+        if (ImGui::Button("Check Data File Round Trip"))
+        {
+            DataFile::checkRoundTrip();
+        }
+        g_res.showFontDebugInfo();
+        ImGui::Text("GUI Layout: %u widgets, %u sized, %u reused, %.3fms",
+                gui::layoutStats.widgetCount, gui::layoutStats.computedCount,
+                gui::layoutStats.restoredCount, gui::layoutStats.sizeTime * 1000.0);
+        if (ImGui::Button("Check Retained GUI Layout"))
+        {
+            gui::checkRetainedLayout();
+        }
+        if (currentScene)
+        {
+            ScatterStats const& scatterStats = currentScene->scatter.getStats();
+            ImGui::Text("Scatter: %u cells, %u instances, %u generated, %.3fms max per cell",
+                    scatterStats.cellCount, scatterStats.instanceCount,
+                    scatterStats.cellsGeneratedLastFrame, scatterStats.maxCellGenerationTime * 1000.0);
+            ImGui::Text("Scatter Draws: %u, %u evicted, %u instances uploaded",
+                    scatterStats.drawCount, scatterStats.cellsEvictedLastFrame,
+                    scatterStats.instancesUploadedLastFrame);
+            if (currentScene->terrain && ImGui::Button("Check Scatter"))
+            {
+                ScatterSystem::check(currentScene->terrain, currentScene->track,
+                        (u32)currentScene->guid);
+            }
+        }
         // TODO: count draw calls
         //ImGui::Text("Renderables: %i", renderer->getRenderablesCount());
 
@@ -457,7 +513,7 @@ void Game::checkDebugKeys()
         ImGui::Checkbox("Debug Camera", &isDebugCameraEnabled);
         ImGui::Checkbox("Physics Visualization", &isPhysicsDebugVisualizationEnabled);
         ImGui::Checkbox("Track Graph Visualization", &isTrackGraphDebugVisualizationEnabled);
-        //ImGui::Checkbox("Motion Grid Visualization", &isMotionGridDebugVisualizationEnabled);
+        ImGui::Checkbox("Motion Grid Visualization", &isMotionGridDebugVisualizationEnabled);
         ImGui::Checkbox("Path Visualization", &isPathVisualizationEnabled);
 
         if (currentScene)
@@ -47,7 +47,7 @@ public:
         PxDefaultAllocator allocator;
         PxFoundation* foundation;
         PxPhysics* physics;
-        PxDefaultCpuDispatcher* dispatcher;
+        PxCpuDispatcher* dispatcher;
         PxPvd* pvd;
         PxCooking* cooking;
         struct
@@ -0,0 +1,1128 @@
+#include "gltf.h"
+
+const u32 GLB_MAGIC = 0x46546C67; // "glTF"
+const u32 GLB_CHUNK_JSON = 0x4E4F534A;
+const u32 GLB_CHUNK_BIN = 0x004E4942;
+
+enum GLTFComponentType
+{
+    GLTF_BYTE = 5120,
+    GLTF_UNSIGNED_BYTE = 5121,
+    GLTF_SHORT = 5122,
+    GLTF_UNSIGNED_SHORT = 5123,
+    GLTF_UNSIGNED_INT = 5125,
+    GLTF_FLOAT = 5126,
+};
+
+const u32 GLTF_MODE_TRIANGLES = 4;
+
+namespace
+{
+    using Value = DataFile::Value;
+
+    // Just enough JSON to read the glTF header chunk. Strings are truncated to the size of
+    // Value::String, which is fine for names but means URIs can't be used.
+    struct JSONParser
+    {
+        const char* ch;
+        const char* end;
+        bool failed = false;
+
+        void eatSpace()
+        {
+            while (ch != end && isspace(*ch))
+            {
+                ++ch;
+            }
+        }
+
+        bool fail(const char* message)
+        {
+            if (!failed)
+            {
+                error("Failed to parse glTF JSON: %s", message);
+            }
+            failed = true;
+            ch = end;
+            return false;
+        }
+
+        bool readLiteral(const char* literal)
+        {
+            size_t len = strlen(literal);
+            if ((size_t)(end - ch) < len || strncmp(ch, literal, len) != 0)
+            {
+                return fail("Invalid literal");
+            }
+            ch += len;
+            return true;
+        }
+
+        Value::String readString()
+        {
+            char buf[Value::String::MAX_SIZE + 1];
+            u32 len = 0;
+            ++ch;
+            while (ch != end && *ch != '"')
+            {
+                char c = *ch++;
+                if (c == '\\')
+                {
+                    if (ch == end)
+                    {
+                        break;
+                    }
+                    c = *ch++;
+                    switch (c)
+                    {
+                        case 'n': c = '\n'; break;
+                        case 't': c = '\t'; break;
+                        case 'r': c = '\r'; break;
+                        case 'b': c = '\b'; break;
+                        case 'f': c = '\f'; break;
+                        case 'u':
+                        {
+                            // non-ASCII characters are replaced
+                            char hex[5] = {};
+                            for (u32 i=0; i<4 && ch != end; ++i)
+                            {
+                                hex[i] = *ch++;
+                            }
+                            u32 codePoint = (u32)strtoul(hex, nullptr, 16);
+                            c = codePoint < 128 ? (char)codePoint : '?';
+                        } break;
+                        default: break;
+                    }
+                }
+                if (len < Value::String::MAX_SIZE)
+                {
+                    buf[len++] = c;
+                }
+            }
+            if (ch == end)
+            {
+                fail("String has no terminating quotation");
+                return {};
+            }
+            ++ch;
+            buf[len] = 0;
+            return Value::String(buf);
+        }
+
+        Value readValue()
+        {
+            eatSpace();
+            if (ch == end)
+            {
+                fail("Unexpected end of data");
+                return Value();
+            }
+
+            if (*ch == '{')
+            {
+                Value val = DataFile::makeDict();
+                auto& dict = val.dict().val();
+                ++ch;
+                eatSpace();
+                if (ch != end && *ch == '}')
+                {
+                    ++ch;
+                    return val;
+                }
+                while (ch != end)
+                {
+                    eatSpace();
+                    if (ch == end || *ch != '"')
+                    {
+                        fail("Expected key");
+                        break;
+                    }
+                    Value::String key = readString();
+                    eatSpace();
+                    if (ch == end || *ch != ':')
+                    {
+                        fail("Expected ':'");
+                        break;
+                    }
+                    ++ch;
+                    dict[key] = readValue();
+                    eatSpace();
+                    if (ch != end && *ch == ',')
+                    {
+                        ++ch;
+                        continue;
+                    }
+                    if (ch != end && *ch == '}')
+                    {
+                        ++ch;
+                        return val;
+                    }
+                    fail("Expected ',' or '}'");
+                }
+                return Value();
+            }
+            else if (*ch == '[')
+            {
+                Value val = DataFile::makeArray();
+                auto& array = val.array().val();
+                ++ch;
+                eatSpace();
+                if (ch != end && *ch == ']')
+                {
+                    ++ch;
+                    return val;
+                }
+                while (ch != end)
+                {
+                    array.push(readValue());
+                    eatSpace();
+                    if (ch != end && *ch == ',')
+                    {
+                        ++ch;
+                        continue;
+                    }
+                    if (ch != end && *ch == ']')
+                    {
+                        ++ch;
+                        return val;
+                    }
+                    fail("Expected ',' or ']'");
+                }
+                return Value();
+            }
+            else if (*ch == '"')
+            {
+                // makeString() is ambiguous for Str64 arguments, so assign instead
+                Value val;
+                val = readString();
+                return val;
+            }
+            else if (*ch == 't')
+            {
+                return readLiteral("true") ? DataFile::makeBool(true) : Value();
+            }
+            else if (*ch == 'f')
+            {
+                return readLiteral("false") ? DataFile::makeBool(false) : Value();
+            }
+            else if (*ch == 'n')
+            {
+                readLiteral("null");
+                return Value();
+            }
+            else if (isdigit(*ch) || *ch == '-')
+            {
+                char buf[64];
+                u32 len = 0;
+                bool isReal = false;
+                while (ch != end && (isdigit(*ch) || *ch == '-' || *ch == '+'
+                            || *ch == '.' || *ch == 'e' || *ch == 'E'))
+                {
+                    if (*ch == '.' || *ch == 'e' || *ch == 'E')
+                    {
+                        isReal = true;
+                    }
+                    if (len < sizeof(buf) - 1)
+                    {
+                        buf[len++] = *ch;
+                    }
+                    ++ch;
+                }
+                buf[len] = 0;
+                return isReal ? DataFile::makeReal((f32)strtod(buf, nullptr))
+                              : DataFile::makeInteger(strtoll(buf, nullptr, 10));
+            }
+
+            fail("Unexpected character");
+            return Value();
+        }
+    };
+
+    f32 getNumber(Value* val, f32 defaultVal)
+    {
+        if (!val)
+        {
+            return defaultVal;
+        }
+        if (auto real = val->real())
+        {
+            return real.val();
+        }
+        if (auto integer = val->integer())
+        {
+            return (f32)integer.val();
+        }
+        return defaultVal;
+    }
+
+    i64 getInteger(Value* val, i64 defaultVal)
+    {
+        if (!val)
+        {
+            return defaultVal;
+        }
+        return val->integer(defaultVal);
+    }
+
+    Value::Array* getArray(Value::Dict& dict, const char* key)
+    {
+        Value* val = dict.get(key);
+        return val && val->array().hasValue() ? &val->array().val() : nullptr;
+    }
+
+    Value::Dict* getDict(Value* val)
+    {
+        return val && val->dict().hasValue() ? &val->dict().val() : nullptr;
+    }
+
+    // glTF is Y-up with +Z forward, the game is Z-up
+    Vec3 toZUp(Vec3 const& v)
+    {
+        return Vec3(v.x, -v.z, v.y);
+    }
+
+    struct Accessor
+    {
+        u8 const* data = nullptr;
+        u32 count = 0;
+        u32 stride = 0;
+        u32 componentType = 0;
+        u32 componentCount = 0;
+        bool normalized = false;
+
+        f32 getFloat(u32 index, u32 component) const
+        {
+            if (component >= componentCount)
+            {
+                return 0.f;
+            }
+            u8 const* p = data + (size_t)index * stride;
+            switch (componentType)
+            {
+                case GLTF_FLOAT:
+                    return ((f32 const*)p)[component];
+                case GLTF_UNSIGNED_BYTE:
+                    return normalized ? p[component] / 255.f : (f32)p[component];
+                case GLTF_BYTE:
+                    return normalized ? max(((signed char const*)p)[component] / 127.f, -1.f)
+                                      : (f32)((signed char const*)p)[component];
+                case GLTF_UNSIGNED_SHORT:
+                    return normalized ? ((u16 const*)p)[component] / 65535.f
+                                      : (f32)((u16 const*)p)[component];
+                case GLTF_SHORT:
+                    return normalized ? max(((i16 const*)p)[component] / 32767.f, -1.f)
+                                      : (f32)((i16 const*)p)[component];
+                case GLTF_UNSIGNED_INT:
+                    return (f32)((u32 const*)p)[component];
+            }
+            return 0.f;
+        }
+
+        Vec3 getVec3(u32 index) const
+        {
+            return Vec3(getFloat(index, 0), getFloat(index, 1), getFloat(index, 2));
+        }
+
+        u32 getIndex(u32 index) const
+        {
+            u8 const* p = data + (size_t)index * stride;
+            switch (componentType)
+            {
+                case GLTF_UNSIGNED_BYTE: return *p;
+                case GLTF_UNSIGNED_SHORT: return *(u16 const*)p;
+                case GLTF_UNSIGNED_INT: return *(u32 const*)p;
+            }
+            return 0;
+        }
+    };
+
+    struct GLBFile
+    {
+        const char* filename;
+        Value::Dict* json = nullptr;
+        u8 const* bin = nullptr;
+        u32 binSize = 0;
+
+        bool getAccessor(i64 accessorIndex, Accessor& accessor)
+        {
+            Value::Array* accessors = getArray(*json, "accessors");
+            Value::Array* bufferViews = getArray(*json, "bufferViews");
+            if (!accessors || accessorIndex < 0 || accessorIndex >= (i64)accessors->size())
+            {
+                error("%s: Invalid accessor index %i", filename, (i32)accessorIndex);
+                return false;
+            }
+            Value::Dict* a = getDict(&(*accessors)[(u32)accessorIndex]);
+            if (!a)
+            {
+                return false;
+            }
+            if (a->get("sparse"))
+            {
+                error("%s: Sparse accessors are not supported", filename);
+                return false;
+            }
+            i64 bufferViewIndex = getInteger(a->get("bufferView"), -1);
+            if (!bufferViews || bufferViewIndex < 0 || bufferViewIndex >= (i64)bufferViews->size())
+            {
+                error("%s: Accessor %i has no buffer view", filename, (i32)accessorIndex);
+                return false;
+            }
+            Value::Dict* view = getDict(&(*bufferViews)[(u32)bufferViewIndex]);
+            if (!view)
+            {
+                return false;
+            }
+            if (getInteger(view->get("buffer"), 0) != 0 || !bin)
+            {
+                error("%s: Only the embedded binary buffer is supported", filename);
+                return false;
+            }
+
+            accessor.componentType = (u32)getInteger(a->get("componentType"), 0);
+            accessor.count = (u32)getInteger(a->get("count"), 0);
+            if (Value* normalized = a->get("normalized"))
+            {
+                auto b = normalized->boolean();
+                accessor.normalized = b.hasValue() && b.val();
+            }
+
+            Value* typeVal = a->get("type");
+            Value::String type = typeVal ? typeVal->string("") : "";
+            if (type == "SCALAR") accessor.componentCount = 1;
+            else if (type == "VEC2") accessor.componentCount = 2;
+            else if (type == "VEC3") accessor.componentCount = 3;
+            else if (type == "VEC4") accessor.componentCount = 4;
+            else if (type == "MAT4") accessor.componentCount = 16;
+            else
+            {
+                error("%s: Unsupported accessor type: %s", filename, type.data());
+                return false;
+            }
+
+            u32 componentSize = 0;
+            switch (accessor.componentType)
+            {
+                case GLTF_BYTE:
+                case GLTF_UNSIGNED_BYTE:
+                    componentSize = 1;
+                    break;
+                case GLTF_SHORT:
+                case GLTF_UNSIGNED_SHORT:
+                    componentSize = 2;
+                    break;
+                case GLTF_UNSIGNED_INT:
+                case GLTF_FLOAT:
+                    componentSize = 4;
+                    break;
+                default:
+                    error("%s: Unsupported component type: %u", filename, accessor.componentType);
+                    return false;
+            }
+
+            u32 elementSize = componentSize * accessor.componentCount;
+            u64 offset = (u64)getInteger(view->get("byteOffset"), 0)
+                + (u64)getInteger(a->get("byteOffset"), 0);
+            u64 viewEnd = (u64)getInteger(view->get("byteOffset"), 0)
+                + (u64)getInteger(view->get("byteLength"), 0);
+            accessor.stride = (u32)getInteger(view->get("byteStride"), elementSize);
+            u64 accessorEnd = accessor.count == 0 ? offset
+                : offset + (u64)(accessor.count - 1) * accessor.stride + elementSize;
+            if (accessorEnd > viewEnd || viewEnd > binSize)
+            {
+                error("%s: Accessor %i is out of bounds", filename, (i32)accessorIndex);
+                return false;
+            }
+            accessor.data = bin + offset;
+            return true;
+        }
+    };
+
+    bool buildMesh(GLBFile& file, Value::Dict& primitive, Value::String const& name, Value& output)
+    {
+        if (getInteger(primitive.get("mode"), GLTF_MODE_TRIANGLES) != GLTF_MODE_TRIANGLES)
+        {
+            println("%s: Skipping primitive of %s that does not use triangles", file.filename,
+                    name.data());
+            return false;
+        }
+        Value::Dict* attributes = getDict(primitive.get("attributes"));
+        if (!attributes || !attributes->get("POSITION"))
+        {
+            error("%s: Primitive of %s has no positions", file.filename, name.data());
+            return false;
+        }
+
+        Accessor positions;
+        if (!file.getAccessor(getInteger(attributes->get("POSITION"), -1), positions))
+        {
+            return false;
+        }
+        u32 vertexCount = positions.count;
+
+        auto optionalAccessor = [&](const char* attributeName, Accessor& accessor) {
+            Value* val = attributes->get(attributeName);
+            if (!val)
+            {
+                return false;
+            }
+            if (!file.getAccessor(getInteger(val, -1), accessor) || accessor.count != vertexCount)
+            {
+                error("%s: Ignoring invalid %s attribute of %s", file.filename, attributeName,
+                        name.data());
+                return false;
+            }
+            return true;
+        };
+        Accessor normals, tangents, texCoords, colors;
+        bool hasNormals = optionalAccessor("NORMAL", normals);
+        bool hasTangents = optionalAccessor("TANGENT", tangents);
+        bool hasTexCoords = optionalAccessor("TEXCOORD_0", texCoords);
+        bool hasColors = optionalAccessor("COLOR_0", colors);
+
+        Array<u32> indices;
+        if (Value* indicesVal = primitive.get("indices"))
+        {
+            Accessor indexAccessor;
+            if (!file.getAccessor(getInteger(indicesVal, -1), indexAccessor))
+            {
+                return false;
+            }
+            indices.resize(indexAccessor.count);
+            for (u32 i=0; i<indexAccessor.count; ++i)
+            {
+                indices[i] = indexAccessor.getIndex(i);
+                if (indices[i] >= vertexCount)
+                {
+                    error("%s: Index out of range in %s", file.filename, name.data());
+                    return false;
+                }
+            }
+        }
+        else
+        {
+            indices.resize(vertexCount);
+            for (u32 i=0; i<vertexCount; ++i)
+            {
+                indices[i] = i;
+            }
+        }
+        indices.resize(indices.size() - indices.size() % 3);
+
+        Array<Vec3> p;
+        Array<Vec3> n;
+        Array<Vec4> t;
+        Array<Vec2> uv;
+        Array<Vec3> color;
+        p.resize(vertexCount);
+        n.resize(vertexCount);
+        t.resize(vertexCount);
+        uv.resize(vertexCount);
+        color.resize(vertexCount);
+        BoundingBox aabb = { Vec3(FLT_MAX), Vec3(-FLT_MAX) };
+        for (u32 i=0; i<vertexCount; ++i)
+        {
+            p[i] = toZUp(positions.getVec3(i));
+            aabb.min = min(aabb.min, p[i]);
+            aabb.max = max(aabb.max, p[i]);
+            n[i] = hasNormals ? toZUp(normals.getVec3(i)) : Vec3(0.f);
+            t[i] = hasTangents
+                ? Vec4(toZUp(tangents.getVec3(i)), tangents.getFloat(i, 3))
+                : Vec4(0.f);
+            // glTF and the game both have the texture origin at the top left
+            uv[i] = hasTexCoords ? Vec2(texCoords.getFloat(i, 0), texCoords.getFloat(i, 1)) : Vec2(0.f);
+            color[i] = hasColors
+                ? Vec3(colors.getFloat(i, 0), colors.getFloat(i, 1), colors.getFloat(i, 2))
+                : Vec3(1.f);
+        }
+        if (vertexCount == 0)
+        {
+            aabb = { Vec3(0.f), Vec3(0.f) };
+        }
+
+        if (!hasNormals || !hasTangents)
+        {
+            // accumulate area weighted face normals and texture space tangents
+            Array<Vec3> bitangents;
+            bitangents.resize(vertexCount);
+            for (auto& b : bitangents)
+            {
+                b = Vec3(0.f);
+            }
+            for (u32 i=0; i<indices.size(); i+=3)
+            {
+                u32 i0 = indices[i], i1 = indices[i+1], i2 = indices[i+2];
+                Vec3 e1 = p[i1] - p[i0];
+                Vec3 e2 = p[i2] - p[i0];
+                Vec2 d1 = uv[i1] - uv[i0];
+                Vec2 d2 = uv[i2] - uv[i0];
+                Vec3 faceNormal = cross(e1, e2);
+                f32 det = d1.x * d2.y - d2.x * d1.y;
+                f32 r = fabsf(det) > 0.000001f ? 1.f / det : 0.f;
+                Vec3 faceTangent = (e1 * d2.y - e2 * d1.y) * r;
+                Vec3 faceBitangent = (e2 * d1.x - e1 * d2.x) * r;
+                u32 triangle[] = { i0, i1, i2 };
+                for (u32 v : triangle)
+                {
+                    if (!hasNormals)
+                    {
+                        n[v] += faceNormal;
+                    }
+                    if (!hasTangents)
+                    {
+                        t[v] += Vec4(faceTangent, 0.f);
+                        bitangents[v] += faceBitangent;
+                    }
+                }
+            }
+            for (u32 i=0; i<vertexCount; ++i)
+            {
+                if (!hasNormals)
+                {
+                    n[i] = lengthSquared(n[i]) > 0.f ? normalize(n[i]) : Vec3(0, 0, 1);
+                }
+                if (!hasTangents)
+                {
+                    // Gram-Schmidt orthogonalize against the normal
+                    Vec3 tangent = t[i].xyz - n[i] * dot(n[i], t[i].xyz);
+                    if (lengthSquared(tangent) < 0.000001f)
+                    {
+                        tangent = cross(n[i], fabsf(n[i].z) < 0.9f ? Vec3(0, 0, 1) : Vec3(1, 0, 0));
+                    }
+                    tangent = normalize(tangent);
+                    f32 sign = dot(cross(n[i], tangent), bitangents[i]) < 0.f ? -1.f : 1.f;
+                    t[i] = Vec4(tangent, sign);
+                }
+            }
+        }
+
+        // same vertex layout as blender_exporter.py: position, normal, tangent, uv, color
+        Array<f32> vertices;
+        vertices.reserve(vertexCount * 15);
+        for (u32 i=0; i<vertexCount; ++i)
+        {
+            f32 v[] = {
+                p[i].x, p[i].y, p[i].z,
+                n[i].x, n[i].y, n[i].z,
+                t[i].x, t[i].y, t[i].z, t[i].w,
+                uv[i].x, uv[i].y,
+                color[i].x, color[i].y, color[i].z,
+            };
+            for (f32 f : v)
+            {
+                vertices.push(f);
+            }
+        }
+
+        output = DataFile::makeDict();
+        auto& dict = output.dict().val();
+        dict["name"] = name;
+        dict["numColors"] = DataFile::makeInteger(1);
+        dict["numTexCoords"] = DataFile::makeInteger(1);
+        dict["vertices"] = DataFile::makeBytearray(Value::ByteArray((u8*)vertices.begin(),
+                    (u8*)vertices.end()));
+        dict["numVertices"] = DataFile::makeInteger(vertexCount);
+        dict["indices"] = DataFile::makeBytearray(Value::ByteArray((u8*)indices.begin(),
+                    (u8*)indices.end()));
+        dict["numIndices"] = DataFile::makeInteger(indices.size());
+        Value aabbVal = DataFile::makeDict();
+        aabbVal.dict().val()["min"] = DataFile::makeVec3(aabb.min);
+        aabbVal.dict().val()["max"] = DataFile::makeVec3(aabb.max);
+        dict["aabb"] = move(aabbVal);
+        dict["hasTangents"] = DataFile::makeBool(true);
+        return true;
+    }
+
+    Mat4 getLocalTransform(Value::Dict& node)
+    {
+        if (Value::Array* matrix = getArray(node, "matrix"))
+        {
+            if (matrix->size() == 16)
+            {
+                f32 m[16];
+                for (u32 i=0; i<16; ++i)
+                {
+                    m[i] = getNumber(&(*matrix)[i], 0.f);
+                }
+                // glTF matrices are column major, same as Mat4
+                return Mat4(m);
+            }
+        }
+
+        Vec3 translation(0.f);
+        Quat rotation(1.f, 0.f, 0.f, 0.f);
+        Vec3 scale(1.f);
+        if (Value::Array* t = getArray(node, "translation"))
+        {
+            for (u32 i=0; i<min(t->size(), 3u); ++i)
+            {
+                translation[i] = getNumber(&(*t)[i], 0.f);
+            }
+        }
+        if (Value::Array* r = getArray(node, "rotation"))
+        {
+            if (r->size() == 4)
+            {
+                // stored as x, y, z, w
+                rotation = Quat(getNumber(&(*r)[3], 1.f), getNumber(&(*r)[0], 0.f),
+                        getNumber(&(*r)[1], 0.f), getNumber(&(*r)[2], 0.f));
+            }
+        }
+        if (Value::Array* s = getArray(node, "scale"))
+        {
+            for (u32 i=0; i<min(s->size(), 3u); ++i)
+            {
+                scale[i] = getNumber(&(*s)[i], 1.f);
+            }
+        }
+        return Mat4::translation(translation) * Mat4(rotation) * Mat4::scaling(scale);
+    }
+
+    struct SceneBuilder
+    {
+        GLBFile& file;
+        Value::Array& nodes;
+        Value::Dict& meshes;
+        // names of the meshes created for every glTF mesh, one per primitive
+        Array<Array<Value::String>>& meshPrimitives;
+        Value::Array& objects;
+        Mat4 toGame;
+        Mat4 fromGame;
+
+        void addNode(i64 nodeIndex, Mat4 const& parentTransform, u32 depth)
+        {
+            if (nodeIndex < 0 || nodeIndex >= (i64)nodes.size() || depth > 64)
+            {
+                error("%s: Invalid node index %i", file.filename, (i32)nodeIndex);
+                return;
+            }
+            Value::Dict* node = getDict(&nodes[(u32)nodeIndex]);
+            if (!node)
+            {
+                return;
+            }
+            Mat4 transform = parentTransform * getLocalTransform(*node);
+
+            i64 meshIndex = getInteger(node->get("mesh"), -1);
+            if (meshIndex >= 0 && meshIndex < (i64)meshPrimitives.size())
+            {
+                Value* nameVal = node->get("name");
+                Value::String nodeName = nameVal ? nameVal->string("")
+                    : Value::String::format("Node%i", (i32)nodeIndex);
+                Mat4 matrix = toGame * transform * fromGame;
+                auto& primitiveNames = meshPrimitives[(u32)meshIndex];
+                for (u32 i=0; i<primitiveNames.size(); ++i)
+                {
+                    Value::String name = primitiveNames.size() > 1
+                        ? Value::String::format("%s_mat%u", nodeName.data(), i) : nodeName;
+
+                    auto& meshDict = meshes[primitiveNames[i]].dict().val();
+                    auto& aabb = meshDict["aabb"].dict().val();
+                    Vec3 size = aabb["max"].vec3().val() - aabb["min"].vec3().val();
+
+                    Value obj = DataFile::makeDict();
+                    auto& dict = obj.dict().val();
+                    dict["type"] = "MESH";
+                    dict["name"] = name;
+                    dict["data_name"] = primitiveNames[i];
+                    dict["collection_indexes"] = DataFile::makeArray();
+                    dict["matrix"] = DataFile::makeBytearray(
+                            Value::ByteArray((u8*)matrix.f, (u8*)(matrix.f + 16)));
+                    dict["bounds"] = DataFile::makeVec3(size * matrix.scale());
+                    objects.push(move(obj));
+                }
+            }
+
+            if (Value::Array* children = getArray(*node, "children"))
+            {
+                for (auto& child : *children)
+                {
+                    addNode(getInteger(&child, -1), transform, depth + 1);
+                }
+            }
+        }
+    };
+}
+
+bool importGLB(const char* filename, DataFile::Value& output)
+{
+    if (!fileExists(filename))
+    {
+        error("%s: File does not exist", filename);
+        return false;
+    }
+    Buffer buf = readFileBytes(filename);
+    u8 const* data = buf.data.get();
+    size_t size = buf.size;
+
+    struct Header
+    {
+        u32 magic;
+        u32 version;
+        u32 length;
+    };
+    Header header;
+    if (size < sizeof(Header) + 8)
+    {
+        error("%s: File is too small to be a glTF binary", filename);
+        return false;
+    }
+    memcpy(&header, data, sizeof(Header));
+    if (header.magic != GLB_MAGIC || header.version != 2 || header.length > size)
+    {
+        error("%s: Not a glTF 2.0 binary file", filename);
+        return false;
+    }
+
+    GLBFile file;
+    file.filename = filename;
+    const char* jsonBegin = nullptr;
+    const char* jsonEnd = nullptr;
+    size_t offset = sizeof(Header);
+    while (offset + 8 <= header.length)
+    {
+        u32 chunkLength, chunkType;
+        memcpy(&chunkLength, data + offset, 4);
+        memcpy(&chunkType, data + offset + 4, 4);
+        offset += 8;
+        if (offset + chunkLength > header.length)
+        {
+            error("%s: Chunk extends past the end of the file", filename);
+            return false;
+        }
+        if (chunkType == GLB_CHUNK_JSON && !jsonBegin)
+        {
+            jsonBegin = (const char*)data + offset;
+            jsonEnd = jsonBegin + chunkLength;
+        }
+        else if (chunkType == GLB_CHUNK_BIN && !file.bin)
+        {
+            file.bin = data + offset;
+            file.binSize = chunkLength;
+        }
+        offset += align(chunkLength, 4);
+    }
+    if (!jsonBegin)
+    {
+        error("%s: No JSON chunk found", filename);
+        return false;
+    }
+
+    JSONParser parser = { jsonBegin, jsonEnd };
+    Value json = parser.readValue();
+    if (parser.failed || !json.dict().hasValue())
+    {
+        error("%s: Invalid JSON chunk", filename);
+        return false;
+    }
+    file.json = &json.dict().val();
+
+    // meshes: one mesh per primitive, named like the blender exporter names meshes with
+    // multiple materials
+    Value meshesVal = DataFile::makeDict();
+    auto& meshes = meshesVal.dict().val();
+    Array<Array<Value::String>> meshPrimitives;
+    if (Value::Array* gltfMeshes = getArray(*file.json, "meshes"))
+    {
+        for (u32 meshIndex=0; meshIndex<gltfMeshes->size(); ++meshIndex)
+        {
+            meshPrimitives.push({});
+            Value::Dict* mesh = getDict(&(*gltfMeshes)[meshIndex]);
+            Value::Array* primitives = mesh ? getArray(*mesh, "primitives") : nullptr;
+            if (!primitives)
+            {
+                continue;
+            }
+            Value* nameVal = mesh->get("name");
+            Value::String meshName = nameVal ? nameVal->string("")
+                : Value::String::format("Mesh%u", meshIndex);
+            if (meshName.empty() || meshes.get(meshName))
+            {
+                meshName = Value::String::format("%s%u", meshName.data(), meshIndex);
+            }
+            for (u32 i=0; i<primitives->size(); ++i)
+            {
+                Value::Dict* primitive = getDict(&(*primitives)[i]);
+                Value::String name = primitives->size() > 1
+                    ? Value::String::format("%s_mat%u", meshName.data(), i) : meshName;
+                Value meshData;
+                if (primitive && buildMesh(file, *primitive, name, meshData))
+                {
+                    meshes[name] = move(meshData);
+                    meshPrimitives.back().push(name);
+                }
+            }
+        }
+    }
+
+    // scenes
+    Value scenesVal = DataFile::makeArray();
+    auto& scenes = scenesVal.array().val();
+    Value::Array emptyArray;
+    Value::Array* nodes = getArray(*file.json, "nodes");
+    if (Value::Array* gltfScenes = getArray(*file.json, "scenes"))
+    {
+        for (u32 sceneIndex=0; sceneIndex<gltfScenes->size(); ++sceneIndex)
+        {
+            Value::Dict* scene = getDict(&(*gltfScenes)[sceneIndex]);
+            if (!scene)
+            {
+                continue;
+            }
+            Value objectsVal = DataFile::makeArray();
+            SceneBuilder builder = {
+                file, nodes ? *nodes : emptyArray, meshes, meshPrimitives,
+                objectsVal.array().val(),
+                Mat4(Vec3(1, 0, 0), Vec3(0, 0, 1), Vec3(0, -1, 0)),
+                Mat4(Vec3(1, 0, 0), Vec3(0, 0, -1), Vec3(0, 1, 0)),
+            };
+            if (Value::Array* rootNodes = getArray(*scene, "nodes"))
+            {
+                for (auto& nodeIndex : *rootNodes)
+                {
+                    builder.addNode(getInteger(&nodeIndex, -1), Mat4(1.f), 0);
+                }
+            }
+
+            Value* nameVal = scene->get("name");
+            Value sceneVal = DataFile::makeDict();
+            auto& dict = sceneVal.dict().val();
+            dict["type"] = "scene";
+            dict["name"] = nameVal ? nameVal->string("")
+                : Value::String::format("Scene%u", sceneIndex);
+            dict["objects"] = move(objectsVal);
+            dict["collections"] = DataFile::makeArray();
+            scenes.push(move(sceneVal));
+        }
+    }
+
+    output = DataFile::makeDict();
+    output.dict().val()["meshes"] = move(meshesVal);
+    output.dict().val()["scenes"] = move(scenesVal);
+    return true;
+}
+
+// a cube with one primitive per material that is used by a node and by the child of that node
+const char* GLB_CHECK_FILENAME = "models/gltf_check.glb";
+
+struct GLBCheckObject
+{
+    const char* name;
+    const char* dataName;
+    Vec3 position;
+};
+
+static bool checkImportedMeshes(const char* source, DataFile::Value& data)
+{
+    auto meshes = data.dict().val()["meshes"].dict();
+    if (!meshes.hasValue())
+    {
+        error("%s import has no meshes", source);
+        return false;
+    }
+
+    bool passed = true;
+    for (auto& mesh : meshes.val())
+    {
+        auto& dict = mesh.value.dict().val();
+        u32 numVertices = (u32)dict["numVertices"].integer(0);
+        u32 numIndices = (u32)dict["numIndices"].integer(0);
+        auto& vertices = dict["vertices"].bytearray().val();
+        auto& indices = dict["indices"].bytearray().val();
+
+        // position, normal, tangent, uv and color; see Mesh::calculateVertexFormat()
+        u32 expectedStride = 15 * sizeof(f32);
+        if (dict["numColors"].integer(0) != 1 || dict["numTexCoords"].integer(0) != 1
+                || !dict["hasTangents"].boolean(false)
+                || numVertices == 0 || vertices.size() != numVertices * expectedStride)
+        {
+            error("%s import of mesh %s has the wrong vertex format", source, mesh.key.data());
+            passed = false;
+            continue;
+        }
+        if (numIndices % 3 != 0 || indices.size() != numIndices * sizeof(u32))
+        {
+            error("%s import of mesh %s has %u indices", source, mesh.key.data(), numIndices);
+            passed = false;
+            continue;
+        }
+        u32 const* indexData = (u32 const*)indices.data();
+        for (u32 i=0; i<numIndices; ++i)
+        {
+            if (indexData[i] >= numVertices)
+            {
+                error("%s import of mesh %s has out of range index %u", source,
+                        mesh.key.data(), indexData[i]);
+                passed = false;
+                break;
+            }
+        }
+    }
+    return passed;
+}
+
+static DataFile::Value* findImportedObject(DataFile::Value& data, const char* name)
+{
+    auto& scenes = data.dict().val()["scenes"].array().val();
+    if (scenes.empty())
+    {
+        return nullptr;
+    }
+    for (auto& object : scenes[0].dict().val()["objects"].array().val())
+    {
+        if (object.dict().val()["name"].string("") == name)
+        {
+            return &object;
+        }
+    }
+    return nullptr;
+}
+
+static u32 getImportedObjectCount(DataFile::Value& data)
+{
+    auto& scenes = data.dict().val()["scenes"].array().val();
+    return scenes.empty() ? 0 : scenes[0].dict().val()["objects"].array().val().size();
+}
+
+void checkGLBImport()
+{
+    const char* filename = tmpStr("%s/%s", ASSET_DIRECTORY, GLB_CHECK_FILENAME);
+    DataFile::Value gltfData;
+    f64 startTime = getTime();
+    if (!importGLB(filename, gltfData))
+    {
+        error("glTF import check failed: could not import %s", filename);
+        return;
+    }
+    f64 importTime = getTime() - startTime;
+
+    bool passed = checkImportedMeshes("glTF", gltfData);
+
+    // both primitives of the cube cover three faces
+    const char* meshNames[] = { "Cube_mat0", "Cube_mat1" };
+    auto& meshes = gltfData.dict().val()["meshes"].dict().val();
+    if (meshes.size() != ARRAY_SIZE(meshNames))
+    {
+        error("glTF import has %u meshes instead of %u", meshes.size(), (u32)ARRAY_SIZE(meshNames));
+        passed = false;
+    }
+    for (const char* meshName : meshNames)
+    {
+        DataFile::Value* mesh = meshes.get(meshName);
+        if (!mesh || mesh->dict().val()["numIndices"].integer(0) != 6 * 3)
+        {
+            error("glTF import of mesh %s is missing or doesn't have 6 triangles", meshName);
+            passed = false;
+        }
+    }
+
+    // glTF is Y-up, so the translation of Box along +Y becomes +Z
+    GLBCheckObject objects[] = {
+        { "Box_mat0", "Cube_mat0", Vec3(0, 0, 1) },
+        { "Box_mat1", "Cube_mat1", Vec3(0, 0, 1) },
+        { "Box2_mat0", "Cube_mat0", Vec3(3, 0, 1) },
+        { "Box2_mat1", "Cube_mat1", Vec3(3, 0, 1) },
+    };
+    if (getImportedObjectCount(gltfData) != ARRAY_SIZE(objects))
+    {
+        error("glTF import has %u objects instead of %u", getImportedObjectCount(gltfData),
+                (u32)ARRAY_SIZE(objects));
+        passed = false;
+    }
+    for (auto& expected : objects)
+    {
+        DataFile::Value* object = findImportedObject(gltfData, expected.name);
+        if (!object)
+        {
+            error("glTF import is missing object %s", expected.name);
+            passed = false;
+            continue;
+        }
+        auto& dict = object->dict().val();
+        Vec3 position = dict["matrix"].convertBytes<Mat4>().val().position();
+        if (dict["data_name"].string("") != expected.dataName
+                || lengthSquared(position - expected.position) > 0.0001f)
+        {
+            error("glTF import of object %s uses %s at (%.2f, %.2f, %.2f)", expected.name,
+                    dict["data_name"].string("").data(), position.x, position.y, position.z);
+            passed = false;
+        }
+    }
+
+    // the same file through blender_exporter.py, which is what Blender files are imported with
+    const char* blenderOutputFile = "blender_output.dat";
+    if (fileExists(blenderOutputFile))
+    {
+        deleteFile(blenderOutputFile);
+    }
+    const char* blenderPath =
+#if _WIN32
+    "\"C:/Program Files/Blender Foundation/Blender 2.81/blender.exe\"";
+#else
+    "blender";
+#endif
+    const char* command = tmpStr("%s -b --factory-startup --python-expr "
+            "\"import bpy; bpy.ops.wm.read_factory_settings(use_empty=True); "
+            "bpy.ops.import_scene.gltf(filepath='%s')\" -P ../blender_exporter.py",
+            blenderPath, filename);
+    CommandResult r = runShellCommand(command);
+    if (r.exitCode != 0 || !fileExists(blenderOutputFile))
+    {
+        println("glTF import check: Blender is not available, skipped the comparison");
+    }
+    else
+    {
+        DataFile::Value blenderData = DataFile::load(blenderOutputFile);
+        if (!blenderData.dict().hasValue() || !checkImportedMeshes("Blender", blenderData))
+        {
+            passed = false;
+        }
+        else
+        {
+            auto& blenderMeshes = blenderData.dict().val()["meshes"].dict().val();
+            if (blenderMeshes.size() != meshes.size())
+            {
+                error("glTF import has %u meshes, Blender import has %u", meshes.size(),
+                        blenderMeshes.size());
+                passed = false;
+            }
+            // the vertex counts differ because each glTF primitive keeps all vertices of the
+            // shared attributes until Mesh::optimize() drops the unused ones
+            for (auto& mesh : meshes)
+            {
+                DataFile::Value* blenderMesh = blenderMeshes.get(mesh.key);
+                i64 numIndices = mesh.value.dict().val()["numIndices"].integer(0);
+                if (!blenderMesh || blenderMesh->dict().val()["numIndices"].integer(0) != numIndices)
+                {
+                    error("Blender import of mesh %s is missing or has a different triangle count",
+                            mesh.key.data());
+                    passed = false;
+                }
+            }
+            if (getImportedObjectCount(blenderData) != getImportedObjectCount(gltfData))
+            {
+                error("glTF import has %u objects, Blender import has %u",
+                        getImportedObjectCount(gltfData), getImportedObjectCount(blenderData));
+                passed = false;
+            }
+            for (auto& expected : objects)
+            {
+                DataFile::Value* object = findImportedObject(blenderData, expected.name);
+                Vec3 position = object
+                    ? object->dict().val()["matrix"].convertBytes<Mat4>().val().position() : Vec3(0.f);
+                if (!object || lengthSquared(position - expected.position) > 0.0001f)
+                {
+                    error("Blender import of object %s is missing or at (%.2f, %.2f, %.2f)",
+                            expected.name, position.x, position.y, position.z);
+                    passed = false;
+                }
+            }
+        }
+    }
+
+    if (passed)
+    {
+        println("glTF import check passed: %u meshes, %u objects (imported in %.2fms)",
+                meshes.size(), getImportedObjectCount(gltfData), importTime * 1000.0);
+    }
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "datafile.h"
+
+// Reads a glTF 2.0 binary file (.glb) into the same structure that blender_exporter.py writes
+// to blender_output.dat (a dict with "meshes" and "scenes"), so both can be turned into a
+// Model the same way. Coordinates are converted from glTF's Y-up to the game's Z-up.
+bool importGLB(const char* filename, DataFile::Value& output);
+
+// Imports the glTF file checked into the assets and checks its meshes, vertex format and object
+// transforms. When Blender is installed, the same file is also imported through Blender and
+// blender_exporter.py and both results are compared.
+void checkGLBImport();
@@ -1,4 +1,5 @@
 #include "gui.h"
+#include "widgets.h"
 
 namespace gui
 {
@@ -42,7 +43,20 @@ namespace gui
         ctx.actualScreenSize = actualScreenSize;
 
         root->desiredSize = { (f32)w, (f32)h };
-        root->computeSize(Constraints());
+        f64 sizeStartTime = getTime();
+        if (activeLayout)
+        {
+            root->hashLayout(0, 0);
+        }
+        root->updateSize(Constraints());
+        layoutStats.widgetCount = widgetCount;
+        layoutStats.computedCount = activeLayout ? activeLayout->computedCount : widgetCount;
+        layoutStats.restoredCount = activeLayout ? activeLayout->restoredCount : 0;
+        if (activeLayout)
+        {
+            activeLayout->endFrame();
+        }
+        layoutStats.sizeTime = getTime() - sizeStartTime;
         root->layout(ctx);
 
         Widget** activeInputCapture =
@@ -105,6 +119,117 @@ namespace gui
         root->render(ctx, rtx);
     }
 
+    LayoutRecord const* RetainedLayout::findPrevious(u32 id) const
+    {
+        if (previousLookup.empty())
+        {
+            return nullptr;
+        }
+        for (u32 i = id & lookupMask; previousLookup[i]; i = (i + 1) & lookupMask)
+        {
+            LayoutRecord const& record = previous[previousLookup[i] - 1];
+            if (record.id == id)
+            {
+                return &record;
+            }
+        }
+        return nullptr;
+    }
+
+    void RetainedLayout::endFrame()
+    {
+        swap(previous, current);
+        current.clear();
+        computedCount = 0;
+        restoredCount = 0;
+
+        u32 lookupSize = 64;
+        while (lookupSize < previous.size() * 2)
+        {
+            lookupSize *= 2;
+        }
+        lookupMask = lookupSize - 1;
+        previousLookup.resize(lookupSize);
+        for (u32 i=0; i<lookupSize; ++i)
+        {
+            previousLookup[i] = 0;
+        }
+        for (u32 r=0; r<previous.size(); ++r)
+        {
+            // ids of widgets that were sized twice keep their first record
+            u32 i = previous[r].id & lookupMask;
+            while (previousLookup[i] && previous[previousLookup[i] - 1].id != previous[r].id)
+            {
+                i = (i + 1) & lookupMask;
+            }
+            if (!previousLookup[i])
+            {
+                previousLookup[i] = r + 1;
+            }
+        }
+    }
+
+    void Widget::hashLayout(u32 parentId, u32 indexInParent)
+    {
+        layoutId = (u32)hashValue(hashValue(HASH_SEED, parentId), indexInParent);
+        u64 h = hashLayoutInputs(HASH_SEED);
+        u32 childIndex = 0;
+        layoutSubtreeSize = 1;
+        for (Widget* child = childFirst; child; child = child->neighbor)
+        {
+            child->hashLayout(layoutId, childIndex++);
+            h = hashValue(h, child->layoutHash);
+            layoutSubtreeSize += child->layoutSubtreeSize;
+        }
+        layoutHash = hashValue(h, childIndex);
+    }
+
+    void Widget::updateSize(Constraints const& constraints)
+    {
+        if (!activeLayout)
+        {
+            computeSize(constraints);
+            return;
+        }
+
+        LayoutRecord const* previous = activeLayout->findPrevious(layoutId);
+        // only a subtree that had every widget sized last frame has its records line up with
+        // the widgets
+        if (previous && previous->hash == layoutHash && previous->constraints == constraints
+                && previous->subtreeSize == layoutSubtreeSize)
+        {
+            restoreLayout(previous);
+            return;
+        }
+
+        u32 recordIndex = activeLayout->current.size();
+        activeLayout->current.push({ layoutId, 0, layoutHash, constraints });
+        computeSize(constraints);
+        ++activeLayout->computedCount;
+
+        LayoutRecord& record = activeLayout->current[recordIndex];
+        record.subtreeSize = activeLayout->current.size() - recordIndex;
+        record.computedSize = computedSize;
+        record.desiredSize = desiredSize;
+    }
+
+    LayoutRecord const* Widget::restoreLayout(LayoutRecord const* record)
+    {
+        // the hash covers the shape of the subtree, so the records are in the order of the
+        // widgets
+        activeLayout->current.push(*record);
+        computedSize = record->computedSize;
+        desiredSize = record->desiredSize;
+        ++activeLayout->restoredCount;
+
+        LayoutRecord const* next = record + 1;
+        for (Widget* child = childFirst; child; child = child->neighbor)
+        {
+            next = child->restoreLayout(next);
+        }
+        return next;
+    }
+
     void Widget::computeSize(Constraints const& constraints)
     {
         Vec2 maxDim(0, 0);
@@ -127,7 +252,7 @@ namespace gui
 
             for (Widget* child = childFirst; child; child = child->neighbor)
             {
-                child->computeSize(childConstraints);
+                child->updateSize(childConstraints);
                 maxDim = max(maxDim, child->computedSize);
             }
         }
@@ -376,21 +501,25 @@ namespace gui
 
     void Widget::pushID(const char* id)
     {
-        for (WidgetStateNode* child = stateNode->childFirst;
-            child; child = child->neighbor)
+        const u32 lookupMask = ARRAY_SIZE(widgetStateNodeLookup) - 1;
+        u32 nameHash = mapHash(id);
+        u32 parentIndex = (u32)(stateNode - widgetStateNodeStorage.data());
+        u32 i = (parentIndex * 2654435761u ^ nameHash) & lookupMask;
+        for (; widgetStateNodeLookup[i]; i = (i + 1) & lookupMask)
         {
-            if (strcmp(id, child->name.data()) == 0)
+            WidgetStateNode* node = &widgetStateNodeStorage[widgetStateNodeLookup[i] - 1];
+            if (node->nameHash == nameHash && node->parent == stateNode
+                    && strncmp(id, node->name.data(), Str32::MAX_SIZE) == 0)
             {
-                stateNode = child;
+                stateNode = node;
                 return;
             }
         }
 
-        widgetStateNodeStorage.push(WidgetStateNode{ Str32(id) });
+        widgetStateNodeStorage.push(WidgetStateNode{ Str32(id), nameHash });
         WidgetStateNode* newNode = &widgetStateNodeStorage.back();
-#ifndef NDEBUG
         newNode->parent = stateNode;
-#endif
+        widgetStateNodeLookup[i] = (u16)widgetStateNodeStorage.size();
 
         if (!stateNode->childFirst)
         {
@@ -405,6 +534,135 @@ namespace gui
         stateNode = newNode;
     }
 
+    static void collectLayout(Widget* w, Array<Vec2>& out)
+    {
+        out.push(w->computedSize);
+        out.push(w->computedPosition);
+        for (Widget* child = w->childFirst; child; child = child->neighbor)
+        {
+            collectLayout(child, out);
+        }
+    }
+
+    bool checkRetainedLayout()
+    {
+        const u32 frames = 9;
+        const u32 itemCount = 100;
+        const u32 tileCount = 16;
+        const FontDescription font = { "font", 20 };
+
+        // a long list of labels and values next to a grid of tiles and a fixed size panel; one
+        // value changes on frame 3, the grid gets wider on frame 5 and the screen is smaller on
+        // frame 6 only, which doesn't change the constraints the panel gives its contents but
+        // does narrow the Sized widget in it, since that is clamped to the screen
+        auto buildTree = [&](Widget* parent, u32 frame) {
+            auto columns = parent->add(Row(40))->size(0, 0);
+            auto list = columns->add(Column(8))->size(0, 0);
+            for (u32 i=0; i<itemCount; ++i)
+            {
+                auto item = list->add(Row(20, HAlign::LEFT, VAlign::CENTER))->size(0, 0);
+                item->add(Text(font, tmpStr("Item %u", i)));
+                item->add(Text(font, tmpStr("%u", (i == 7 && frame >= 3) ? 1000 : i)));
+            }
+            auto grid = columns->add(Grid(4, 10))->size(frame >= 5 ? 440.f : 400.f, 0.f);
+            for (u32 i=0; i<tileCount; ++i)
+            {
+                grid->add(Border(Insets(2), COLOR_OUTLINE_NOT_SELECTED))->size(0, 0)
+                    ->add(Container(Insets(8)))->size(0, 0)
+                    ->add(Text(font, tmpStr("%u", i)));
+            }
+            auto panel = columns->add(Container(Insets(8)))->size(600, 400);
+            auto sized = panel->add(Sized(Constraints(0.f, 1800.f, 0.f, 200.f)))->size(0, 0);
+            sized->add(Text(font, "Sized"));
+            sized->add(Container(Insets(4)))->size(10000, 40);
+        };
+
+        GuiContext ctx = {};
+        ctx.referenceScreenSize = Vec2(1920, 1080);
+        ctx.actualScreenSize = Vec2(1920, 1080);
+
+        RetainedLayout* savedLayout = activeLayout;
+        u32 savedWidgetCount = widgetCount;
+        Vec2 savedScreenSize = root->desiredSize;
+
+        RetainedLayout layout;
+        Array<Vec2> results[2];
+        f64 times[2] = { 0.0, 0.0 };
+        u32 unchangedFrameCount = 0;
+        u32 mismatches = 0;
+        u32 testWidgetCount = 0;
+        for (u32 frame=0; frame<frames; ++frame)
+        {
+            bool isUnchanged = frame > 0 && frame != 3 && frame != 5 && frame != 6 && frame != 7;
+            for (u32 pass=0; pass<2; ++pass)
+            {
+                activeLayout = pass == 0 ? &layout : nullptr;
+                widgetCount = 0;
+
+                Widget* testRoot = widgetBuffer.write<Widget>(Widget("Layout Check"));
+                testRoot->root = testRoot;
+                testRoot->stateNode = &widgetStateNodeStorage[1];
+                testRoot->desiredSize = frame == 6 ? Vec2(1600, 900) : Vec2(1920, 1080);
+                root->desiredSize = testRoot->desiredSize;
+                buildTree(testRoot, frame);
+                testWidgetCount = widgetCount + 1;
+
+                f64 t = getTime();
+                if (activeLayout)
+                {
+                    testRoot->hashLayout(0, 0);
+                }
+                testRoot->updateSize(Constraints());
+                if (isUnchanged)
+                {
+                    times[pass] += getTime() - t;
+                }
+                testRoot->layout(ctx);
+
+                results[pass].clear();
+                collectLayout(testRoot, results[pass]);
+
+                if (pass == 0)
+                {
+                    if (layout.computedCount + layout.restoredCount != testWidgetCount
+                            || (isUnchanged && layout.computedCount > 0)
+                            || (frame == 3 && layout.computedCount > 5))
+                    {
+                        error("Retained GUI layout on frame %u: %u widgets computed, %u reused, "
+                                "out of %u", frame, layout.computedCount, layout.restoredCount,
+                                testWidgetCount);
+                        ++mismatches;
+                    }
+                    layout.endFrame();
+                }
+            }
+            unchangedFrameCount += isUnchanged ? 1 : 0;
+
+            for (u32 i=0; i<results[0].size(); ++i)
+            {
+                if (results[0][i] != results[1][i])
+                {
+                    error("Retained GUI layout differs from the computed layout on frame %u", frame);
+                    ++mismatches;
+                    break;
+                }
+            }
+        }
+
+        activeLayout = savedLayout;
+        widgetCount = savedWidgetCount;
+        root->desiredSize = savedScreenSize;
+
+        println("Retained GUI layout: %u widgets, sized in %.4fms, reused in %.4fms when unchanged",
+                testWidgetCount, times[1] * 1000.0 / unchangedFrameCount,
+                times[0] * 1000.0 / unchangedFrameCount);
+        if (mismatches == 0)
+        {
+            println("    all frames match the computed layout");
+        }
+        return mismatches == 0;
+    }
+
     Widget* findAncestorByStateNode(Widget* w, WidgetStateNode* state)
     {
         for (Widget* child = w->childFirst; child; child = child->neighbor)
@@ -6,6 +6,7 @@
 #include "font.h"
 #include "input.h"
 #include "renderer.h"
+#include "util.h"
 
 namespace gui
 {
@@ -81,17 +82,56 @@ namespace gui
     struct WidgetStateNode
     {
         Str32 name;
+        u32 nameHash = 0;
         // TODO: Use u16 offset into widgetStateNodeStorage instead of pointers
         WidgetStateNode* childFirst = nullptr;
         WidgetStateNode* childLast = nullptr;
         WidgetStateNode* neighbor = nullptr;
         void* state = nullptr;
-#ifndef NDEBUG
         WidgetStateNode* parent = nullptr;
-#endif
     };
     //static_assert(sizeof(WidgetStateNode) == 64);
 
+    // what a widget sized to in the previous frame, and what it was sized from
+    struct LayoutRecord
+    {
+        u32 id;
+        // the number of records of the subtree, which follow this one
+        u32 subtreeSize;
+        u64 hash;
+        Constraints constraints;
+        Vec2 computedSize;
+        Vec2 desiredSize;
+    };
+
+    // The sizes of the widget tree of the previous frame, in the order the widgets were sized.
+    // The tree is built again every frame, but a subtree whose layout inputs hash the same as
+    // last frame and that gets the same constraints copies its sizes from here instead of
+    // computing them. Positions are still computed every frame, because layout() also runs the
+    // animations.
+    struct RetainedLayout
+    {
+        Array<LayoutRecord> previous;
+        Array<LayoutRecord> current;
+        // indices + 1 into previous, by id
+        Array<u32> previousLookup;
+        u32 lookupMask = 0;
+        u32 computedCount = 0;
+        u32 restoredCount = 0;
+
+        LayoutRecord const* findPrevious(u32 id) const;
+        // makes the sizes of this frame the ones the next frame can reuse
+        void endFrame();
+    };
+
+    struct LayoutStats
+    {
+        u32 widgetCount = 0;
+        u32 computedCount = 0;
+        u32 restoredCount = 0;
+        f64 sizeTime = 0.0;
+    };
+
     struct GuiContext
     {
         f32 deltaTime;
@@ -127,6 +167,12 @@ namespace gui
     // free the state memory when the stack is popped.
     Buffer widgetStateBuffer;
     SmallArray<WidgetStateNode, 1024> widgetStateNodeStorage;
+    // indices + 1 into widgetStateNodeStorage, by parent and name hash
+    u16 widgetStateNodeLookup[2048] = {};
+    RetainedLayout retainedLayout;
+    // the layout that Widget::updateSize() reuses sizes from, or null to compute every size
+    RetainedLayout* activeLayout = &retainedLayout;
+    LayoutStats layoutStats;
     Widget* root = nullptr;
     Widget* nullWidget = nullptr;
     SmallArray<Widget*, 64> inputCaptureWidgets;
@@ -147,6 +193,13 @@ namespace gui
 #endif
         WidgetStateNode* stateNode = nullptr;
 
+        // the same for the widget in the same place of the tree every frame
+        u32 layoutId = 0;
+        // the layout inputs of the widget and of everything under it
+        u64 layoutHash = 0;
+        // the number of widgets in the subtree, including this one
+        u32 layoutSubtreeSize = 1;
+
         Vec2 computedSize = { 0, 0 };
         // 0 = size to content; INFINITY = take up as much space as possible
         Vec2 desiredSize = { INFINITY, INFINITY };
@@ -185,6 +238,15 @@ namespace gui
         Widget* addFlags(u32 flags) { this->flags |= flags; return this; }
         Widget* findSelectedWidget(WidgetStateNode* stateNode);
 
+        // hashes everything computeSize() reads apart from the children and the constraints;
+        // widgets that size themselves differently from the default start with their own tag
+        virtual u64 hashLayoutInputs(u64 h) const { return hashValue(h, desiredSize); }
+        void hashLayout(u32 parentId, u32 indexInParent);
+        // computes the size of the widget, or copies it and the sizes under it from the previous
+        // frame when nothing they depend on has changed; widgets size their children with this
+        void updateSize(Constraints const& constraints);
+        LayoutRecord const* restoreLayout(LayoutRecord const* record);
+
         virtual void computeSize(Constraints const& constraints);
         virtual bool handleInputCaptureEvent(GuiContext const& gtx, InputCaptureContext& ctx,
                 InputEvent const& ev, Widget* selectedWidget);
@@ -246,6 +308,18 @@ namespace gui
         f32 maxDistY = FLT_MIN;
     };
 
+    template <size_t N>
+    inline u64 hashLayoutTag(u64 h, const char (&tag)[N])
+    {
+        return hashBytes(h, tag, N);
+    }
+
+    inline bool operator == (Constraints const& lhs, Constraints const& rhs)
+    {
+        return lhs.minWidth == rhs.minWidth && lhs.maxWidth == rhs.maxWidth
+            && lhs.minHeight == rhs.minHeight && lhs.maxHeight == rhs.maxHeight;
+    }
+
     void init()
     {
         widgetBuffer.resize(megabytes(1), 16);
@@ -323,6 +397,10 @@ namespace gui
         return &newState->state;
     }
 
+    // sizes fixed widget trees that change over a few frames with and without the retained
+    // layout and checks that the sizes match; doesn't render anything
+    bool checkRetainedLayout();
+
     Widget* findAncestorByStateNode(Widget* w, WidgetStateNode* state);
     Widget* findAncestorByFlags(Widget* w, u32 matchFlags, u32 unmatchFlags);
     //Widget* findParent(Widget* w, u32 flags);
@@ -0,0 +1,155 @@
+#include "instancing.h"
+#include "renderer.h"
+
+InstanceGrouper& InstanceGrouper::operator = (InstanceGrouper&& other)
+{
+    destroy();
+    items = move(other.items);
+    groups = move(other.groups);
+    instances = move(other.instances);
+    instanceBuffer = other.instanceBuffer;
+    instanceBufferCapacity = other.instanceBufferCapacity;
+    other.instanceBuffer = 0;
+    other.instanceBufferCapacity = 0;
+    return *this;
+}
+
+void InstanceGrouper::build()
+{
+    items.sort([](Item const& a, Item const& b) {
+        if (a.material != b.material)
+        {
+            return (uintptr_t)a.material < (uintptr_t)b.material;
+        }
+        return (uintptr_t)a.mesh < (uintptr_t)b.mesh;
+    });
+
+    groups.clear();
+    instances.clear();
+    instances.reserve(items.size());
+    for (auto& item : items)
+    {
+        if (groups.empty() || groups.back().material != item.material
+                || groups.back().mesh != item.mesh)
+        {
+            groups.push({ item.material, item.mesh, instances.size(), 0 });
+        }
+        ++groups.back().instanceCount;
+        instances.push(makeInstanceData(item.transform));
+    }
+    items.clear();
+}
+
+void InstanceGrouper::check()
+{
+    // build() only compares the addresses of materials and meshes, so these are never used
+    const u32 materialCount = 3;
+    const u32 meshCount = 5;
+    static u8 fakeMaterials[materialCount];
+    static u8 fakeMeshes[meshCount];
+
+    // the pair of every draw is stored in the translation, so the instances can be traced back
+    InstanceGrouper grouper;
+    u32 expectedCounts[materialCount][meshCount] = {};
+    const u32 drawCount = 1000;
+    RandomSeries series;
+    for (u32 i=0; i<drawCount; ++i)
+    {
+        u32 materialIndex = irandom(series, 0, materialCount);
+        u32 meshIndex = (i * 7 + materialIndex) % meshCount;
+        Mat4 transform = Mat4::translation(Vec3((f32)materialIndex, (f32)meshIndex, (f32)i))
+            * Mat4::rotationZ((f32)i * 0.1f) * Mat4::scaling(Vec3(1.f + (i % 3)));
+        grouper.add((Material*)(fakeMaterials + materialIndex), transform,
+                (Mesh*)(fakeMeshes + meshIndex));
+        ++expectedCounts[materialIndex][meshIndex];
+    }
+    u32 expectedDrawCount = 0;
+    for (u32 m=0; m<materialCount; ++m)
+    {
+        for (u32 n=0; n<meshCount; ++n)
+        {
+            expectedDrawCount += expectedCounts[m][n] > 0 ? 1 : 0;
+        }
+    }
+
+    grouper.build();
+
+    bool passed = grouper.getDrawCount() == expectedDrawCount
+        && grouper.getInstanceCount() == drawCount;
+    u32 nextInstance = 0;
+    for (auto& group : grouper.getGroups())
+    {
+        u32 materialIndex = (u32)((u8*)group.material - fakeMaterials);
+        u32 meshIndex = (u32)((u8*)group.mesh - fakeMeshes);
+        passed = passed && group.firstInstance == nextInstance
+            && group.instanceCount == expectedCounts[materialIndex][meshIndex];
+        for (u32 i=0; i<group.instanceCount && passed; ++i)
+        {
+            InstanceData const& instance =
+                grouper.getInstances()[group.firstInstance + i];
+            Vec3 position = instance.worldTransform.position();
+            Mat3 normalTransform = inverseTranspose(Mat3(instance.worldTransform));
+            passed = (u32)position.x == materialIndex && (u32)position.y == meshIndex
+                && instance.normalTransform[0] == Vec4(normalTransform[0], 0.f)
+                && instance.normalTransform[1] == Vec4(normalTransform[1], 0.f)
+                && instance.normalTransform[2] == Vec4(normalTransform[2], 0.f);
+        }
+        nextInstance += group.instanceCount;
+    }
+
+    if (passed)
+    {
+        println("Instance grouping: %u draws of %u material and mesh pairs make %u "
+                "instanced draws", drawCount, expectedDrawCount, grouper.getDrawCount());
+    }
+    else
+    {
+        error("Instance grouping mismatch: %u instanced draws for %u pairs, "
+                "%u instances for %u draws", grouper.getDrawCount(), expectedDrawCount,
+                grouper.getInstanceCount(), drawCount);
+    }
+}
+
+void InstanceGrouper::upload()
+{
+    if (instances.empty())
+    {
+        return;
+    }
+    if (instances.size() > instanceBufferCapacity)
+    {
+        destroy();
+        instanceBufferCapacity = max(instances.size(), 64u);
+        glCreateBuffers(1, &instanceBuffer);
+        glNamedBufferData(instanceBuffer, instanceBufferCapacity * sizeof(InstanceData), nullptr,
+                GL_DYNAMIC_DRAW);
+    }
+    else
+    {
+        // orphan the storage so the upload doesn't wait for frames that still read it
+        glInvalidateBufferData(instanceBuffer);
+    }
+    glNamedBufferSubData(instanceBuffer, 0, instances.size() * sizeof(InstanceData),
+            instances.data());
+}
+
+void InstanceGrouper::render(RenderWorld* rw, Vec2 const& fadeDistance)
+{
+    bool isFading = fadeDistance.y > 0.f;
+    for (auto& group : groups)
+    {
+        group.material->drawInstanced(rw, group.mesh, instanceBuffer,
+                isFading ? nullptr : instances.data() + group.firstInstance, group.firstInstance,
+                group.instanceCount, fadeDistance);
+    }
+}
+
+void InstanceGrouper::destroy()
+{
+    if (instanceBuffer)
+    {
+        glDeleteBuffers(1, &instanceBuffer);
+        instanceBuffer = 0;
+        instanceBufferCapacity = 0;
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "math.h"
+#include "gl.h"
+#include "material.h"
+#include "mesh.h"
+
+// Per-instance data read by the INSTANCED variant of lit.glsl. The normal transform is stored
+// as three vec4 columns because that is how std430 lays out a mat3.
+struct InstanceData
+{
+    Mat4 worldTransform;
+    Vec4 normalTransform[3];
+};
+
+static_assert(sizeof(InstanceData) == 112);
+
+inline InstanceData makeInstanceData(Mat4 const& transform)
+{
+    InstanceData instance;
+    instance.worldTransform = transform;
+    Mat3 normalTransform = inverseTranspose(Mat3(transform));
+    for (u32 i=0; i<3; ++i)
+    {
+        instance.normalTransform[i] = Vec4(normalTransform[i], 0.f);
+    }
+    return instance;
+}
+
+// where the INSTANCED variant of lit.glsl expects the instance buffer and the index of the first
+// instance of a draw
+const u32 INSTANCE_BUFFER_BINDING = 3;
+const u32 INSTANCE_OFFSET_LOCATION = 12;
+// instances shrink away between these two distances from the camera (x: start, y: end); a zero
+// end distance disables the fade
+const u32 INSTANCE_FADE_LOCATION = 13;
+
+struct InstanceGroup
+{
+    Material* material;
+    Mesh* mesh;
+    u32 firstInstance;
+    u32 instanceCount;
+};
+
+// Collects draws of meshes and packs the draws of each mesh and material pair next to each other
+// in one instance buffer, so that every pair is drawn with a single instanced draw call.
+class InstanceGrouper
+{
+    struct Item
+    {
+        Material* material;
+        Mesh* mesh;
+        Mat4 transform;
+    };
+    Array<Item> items;
+    Array<InstanceGroup> groups;
+    Array<InstanceData> instances;
+
+    GLuint instanceBuffer = 0;
+    u32 instanceBufferCapacity = 0;
+
+public:
+    InstanceGrouper() {}
+    InstanceGrouper(InstanceGrouper const&) = delete;
+    InstanceGrouper(InstanceGrouper&& other) { *this = move(other); }
+    InstanceGrouper& operator = (InstanceGrouper const&) = delete;
+    InstanceGrouper& operator = (InstanceGrouper&& other);
+    ~InstanceGrouper() { destroy(); }
+
+    void add(Material* material, Mat4 const& transform, Mesh* mesh)
+    {
+        items.push({ material, mesh, transform });
+    }
+
+    void clear()
+    {
+        items.clear();
+        groups.clear();
+        instances.clear();
+    }
+
+    // Sorts the collected draws into groups and fills the instance data. This does not touch GL.
+    void build();
+    void upload();
+    // Submits one instanced draw for every group. Instances that fade out with the distance
+    // always surround the camera, so they are drawn at full detail without looking at each one.
+    void render(class RenderWorld* rw, Vec2 const& fadeDistance=Vec2(0.f));
+    void destroy();
+
+    // builds a made up set of draws and checks the groups and instances that build() makes
+    static void check();
+
+    u32 getDrawCount() const { return groups.size(); }
+    u32 getInstanceCount() const { return instances.size(); }
+    Array<InstanceGroup> const& getGroups() const { return groups; }
+    Array<InstanceData> const& getInstances() const { return instances; }
+};
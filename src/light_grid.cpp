@@ -0,0 +1,318 @@
+#include "light_grid.h"
+
+void LightGrid::computeClusterBounds(Mat4 const& projection, f32 nearPlane, f32 farPlane)
+{
+    boundsProjection = projection;
+    boundsNearPlane = nearPlane;
+    boundsFarPlane = farPlane;
+
+    f32 logDepthRange = logf(farPlane / nearPlane);
+    depthScale = (f32)CLUSTER_SLICES / logDepthRange;
+    depthBias = (f32)CLUSTER_SLICES * logf(nearPlane) / logDepthRange;
+
+    clusterMinX.resize(CLUSTER_COUNT);
+    clusterMinY.resize(CLUSTER_COUNT);
+    clusterMinZ.resize(CLUSTER_COUNT);
+    clusterMaxX.resize(CLUSTER_COUNT);
+    clusterMaxY.resize(CLUSTER_COUNT);
+    clusterMaxZ.resize(CLUSTER_COUNT);
+    clusterLightMask.resize(CLUSTER_COUNT * LIGHT_MASK_WORDS);
+    clusters.resize(CLUSTER_COUNT);
+
+    f32 invProjX = 1.f / projection[0][0];
+    f32 invProjY = 1.f / projection[1][1];
+    for (u32 z=0; z<CLUSTER_SLICES; ++z)
+    {
+        f32 nearDepth = nearPlane * powf(farPlane / nearPlane, (f32)z / CLUSTER_SLICES);
+        f32 farDepth = nearPlane * powf(farPlane / nearPlane, (f32)(z + 1) / CLUSTER_SLICES);
+        for (u32 y=0; y<CLUSTER_TILES_Y; ++y)
+        {
+            f32 ndcMinY = -1.f + 2.f * (f32)y / CLUSTER_TILES_Y;
+            f32 ndcMaxY = -1.f + 2.f * (f32)(y + 1) / CLUSTER_TILES_Y;
+            for (u32 x=0; x<CLUSTER_TILES_X; ++x)
+            {
+                f32 ndcMinX = -1.f + 2.f * (f32)x / CLUSTER_TILES_X;
+                f32 ndcMaxX = -1.f + 2.f * (f32)(x + 1) / CLUSTER_TILES_X;
+
+                u32 i = (z * CLUSTER_TILES_Y + y) * CLUSTER_TILES_X + x;
+                clusterMinX[i] = min(ndcMinX * nearDepth, ndcMinX * farDepth) * invProjX;
+                clusterMaxX[i] = max(ndcMaxX * nearDepth, ndcMaxX * farDepth) * invProjX;
+                clusterMinY[i] = min(ndcMinY * nearDepth, ndcMinY * farDepth) * invProjY;
+                clusterMaxY[i] = max(ndcMaxY * nearDepth, ndcMaxY * farDepth) * invProjY;
+                clusterMinZ[i] = nearDepth;
+                clusterMaxZ[i] = farDepth;
+            }
+        }
+    }
+}
+
+u32 LightGrid::depthToSlice(f32 depth) const
+{
+    f32 slice = logf(depth) * depthScale - depthBias;
+    return (u32)clamp(slice, 0.f, (f32)(CLUSTER_SLICES - 1));
+}
+
+void LightGrid::build(Mat4 const& view, Mat4 const& projection, f32 nearPlane, f32 farPlane,
+        PointLight const* pointLights, u32 pointLightCount)
+{
+    if (nearPlane != boundsNearPlane || farPlane != boundsFarPlane
+            || memcmp(&projection, &boundsProjection, sizeof(Mat4)) != 0)
+    {
+        computeClusterBounds(projection, nearPlane, farPlane);
+    }
+
+    lights.clear();
+    lightIndices.clear();
+    droppedLightCount = 0;
+    droppedIndexCount = 0;
+
+    if (pointLightCount == 0)
+    {
+        memset(clusters.data(), 0, clusters.size() * sizeof(LightCluster));
+        return;
+    }
+
+    memset(clusterLightMask.data(), 0, clusterLightMask.size() * sizeof(u32));
+
+    f32 projX = projection[0][0];
+    f32 projY = projection[1][1];
+    const __m128 zero = _mm_setzero_ps();
+    for (u32 lightIndex=0; lightIndex<pointLightCount; ++lightIndex)
+    {
+        PointLight const& light = pointLights[lightIndex];
+        Vec4 viewPos = view * Vec4(light.position, 1.f);
+        f32 depth = -viewPos.z;
+        f32 radius = light.radius;
+        if (depth + radius < nearPlane || depth - radius > farPlane)
+        {
+            continue;
+        }
+
+        // project the view space bounding box of the sphere; x/z and y/z are monotonic in z,
+        // so the extremes are found at the nearest and farthest depth
+        f32 minDepth = max(depth - radius, nearPlane);
+        f32 maxDepth = min(depth + radius, farPlane);
+        f32 ndcMinX = min((viewPos.x - radius) / minDepth, (viewPos.x - radius) / maxDepth) * projX;
+        f32 ndcMaxX = max((viewPos.x + radius) / minDepth, (viewPos.x + radius) / maxDepth) * projX;
+        f32 ndcMinY = min((viewPos.y - radius) / minDepth, (viewPos.y - radius) / maxDepth) * projY;
+        f32 ndcMaxY = max((viewPos.y + radius) / minDepth, (viewPos.y + radius) / maxDepth) * projY;
+        if (ndcMaxX < -1.f || ndcMinX > 1.f || ndcMaxY < -1.f || ndcMinY > 1.f)
+        {
+            continue;
+        }
+
+        if (lights.size() >= MAX_POINT_LIGHTS)
+        {
+            ++droppedLightCount;
+            continue;
+        }
+        u32 gridLightIndex = lights.size();
+        lights.push(light);
+
+        u32 x0 = (u32)clamp((ndcMinX * 0.5f + 0.5f) * CLUSTER_TILES_X, 0.f, (f32)(CLUSTER_TILES_X - 1));
+        u32 x1 = (u32)clamp((ndcMaxX * 0.5f + 0.5f) * CLUSTER_TILES_X, 0.f, (f32)(CLUSTER_TILES_X - 1));
+        u32 y0 = (u32)clamp((ndcMinY * 0.5f + 0.5f) * CLUSTER_TILES_Y, 0.f, (f32)(CLUSTER_TILES_Y - 1));
+        u32 y1 = (u32)clamp((ndcMaxY * 0.5f + 0.5f) * CLUSTER_TILES_Y, 0.f, (f32)(CLUSTER_TILES_Y - 1));
+        u32 z0 = depthToSlice(minDepth);
+        u32 z1 = depthToSlice(maxDepth);
+
+        u32 maskWord = gridLightIndex / 32;
+        u32 maskBit = 1u << (gridLightIndex % 32);
+        __m128 centerX = _mm_set1_ps(viewPos.x);
+        __m128 centerY = _mm_set1_ps(viewPos.y);
+        __m128 centerZ = _mm_set1_ps(depth);
+        __m128 radiusSquared = _mm_set1_ps(radius * radius);
+        for (u32 z=z0; z<=z1; ++z)
+        {
+            for (u32 y=y0; y<=y1; ++y)
+            {
+                u32 rowStart = (z * CLUSTER_TILES_Y + y) * CLUSTER_TILES_X;
+                for (u32 x=x0 & ~3u; x<=x1; x+=4)
+                {
+                    // sphere vs box for four clusters at once
+                    u32 i = rowStart + x;
+                    __m128 dx = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&clusterMinX[i]), centerX),
+                                           _mm_sub_ps(centerX, _mm_loadu_ps(&clusterMaxX[i])));
+                    __m128 dy = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&clusterMinY[i]), centerY),
+                                           _mm_sub_ps(centerY, _mm_loadu_ps(&clusterMaxY[i])));
+                    __m128 dz = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&clusterMinZ[i]), centerZ),
+                                           _mm_sub_ps(centerZ, _mm_loadu_ps(&clusterMaxZ[i])));
+                    dx = _mm_max_ps(dx, zero);
+                    dy = _mm_max_ps(dy, zero);
+                    dz = _mm_max_ps(dz, zero);
+                    __m128 distanceSquared = _mm_add_ps(_mm_add_ps(
+                                _mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                    u32 hits = (u32)_mm_movemask_ps(_mm_cmple_ps(distanceSquared, radiusSquared));
+                    for (u32 lane=0; lane<4; ++lane)
+                    {
+                        if ((hits & (1u << lane)) && x + lane >= x0 && x + lane <= x1)
+                        {
+                            clusterLightMask[(i + lane) * LIGHT_MASK_WORDS + maskWord] |= maskBit;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // compact the bit masks into per-cluster index lists
+    u32 usedWords = (lights.size() + 31) / 32;
+    for (u32 i=0; i<CLUSTER_COUNT; ++i)
+    {
+        LightCluster& cluster = clusters[i];
+        cluster.offset = lightIndices.size();
+        cluster.count = 0;
+        u32* mask = &clusterLightMask[i * LIGHT_MASK_WORDS];
+        for (u32 word=0; word<usedWords; ++word)
+        {
+            u32 bits = mask[word];
+            while (bits)
+            {
+                u32 bit = countTrailingZeros(bits);
+                bits &= bits - 1;
+                if (lightIndices.size() >= MAX_LIGHT_INDICES)
+                {
+                    ++droppedIndexCount;
+                    continue;
+                }
+                lightIndices.push(word * 32 + bit);
+                ++cluster.count;
+            }
+        }
+    }
+}
+
+static bool clusterHasLight(LightGrid const& grid, u32 clusterIndex, u32 lightIndex)
+{
+    LightCluster const& cluster = grid.clusters[clusterIndex];
+    for (u32 i=0; i<cluster.count; ++i)
+    {
+        if (grid.lightIndices[cluster.offset + i] == lightIndex)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void LightGrid::check()
+{
+    const f32 nearPlane = 0.5f;
+    const f32 farPlane = 500.f;
+    Mat4 view = Mat4::lookAt(Vec3(0, -40, 12), Vec3(0, 40, 0), Vec3(0, 0, 1));
+    Mat4 projection = Mat4::perspective(radians(60.f), 16.f / 9.f, nearPlane, farPlane);
+
+    RandomSeries series;
+    Array<PointLight> pointLights;
+    for (u32 i=0; i<200; ++i)
+    {
+        pointLights.push({
+            Vec3(random(series, -80.f, 80.f), random(series, -60.f, 160.f), random(series, 0.f, 10.f)),
+            random(series, 1.f, 25.f), Vec3(1.f), 1.f
+        });
+    }
+
+    LightGrid grid;
+    grid.build(view, projection, nearPlane, farPlane, pointLights.data(), pointLights.size());
+
+    // every listed light has to overlap the box of its cluster
+    u32 listedCount = 0;
+    u32 overlapCount = 0;
+    u32 extraCount = 0;
+    for (u32 i=0; i<CLUSTER_COUNT; ++i)
+    {
+        for (u32 lightIndex=0; lightIndex<grid.lights.size(); ++lightIndex)
+        {
+            PointLight const& light = grid.lights[lightIndex];
+            Vec4 viewPos = view * Vec4(light.position, 1.f);
+            Vec3 center(viewPos.x, viewPos.y, -viewPos.z);
+            Vec3 closest(clamp(center.x, grid.clusterMinX[i], grid.clusterMaxX[i]),
+                         clamp(center.y, grid.clusterMinY[i], grid.clusterMaxY[i]),
+                         clamp(center.z, grid.clusterMinZ[i], grid.clusterMaxZ[i]));
+            bool overlaps = lengthSquared(closest - center) <= square(light.radius);
+            bool listed = clusterHasLight(grid, i, lightIndex);
+            overlapCount += overlaps ? 1 : 0;
+            listedCount += listed ? 1 : 0;
+            if (listed && !overlaps)
+            {
+                ++extraCount;
+            }
+        }
+    }
+
+    // The cluster boxes are axis aligned around the froxels, so the brute force test above also
+    // finds neighbors that the sphere only touches in the corner of their box. Which clusters
+    // must list a light is checked with points inside the light instead.
+    u32 sampleCount = 0;
+    u32 missingCount = 0;
+    u32 gridLightIndex = 0;
+    for (PointLight const& light : pointLights)
+    {
+        if (gridLightIndex >= grid.lights.size()
+                || memcmp(&grid.lights[gridLightIndex], &light, sizeof(PointLight)) != 0)
+        {
+            continue;
+        }
+        const i32 steps = 4;
+        for (i32 sz=-steps; sz<=steps; ++sz)
+        {
+            for (i32 sy=-steps; sy<=steps; ++sy)
+            {
+                for (i32 sx=-steps; sx<=steps; ++sx)
+                {
+                    // slightly off the lattice so that samples don't land on cluster boundaries
+                    Vec3 offset = Vec3(sx + 0.013f, sy + 0.029f, sz + 0.041f) * (light.radius / steps);
+                    if (lengthSquared(offset) > square(light.radius))
+                    {
+                        continue;
+                    }
+                    Vec4 viewPos = view * Vec4(light.position + offset, 1.f);
+                    f32 depth = -viewPos.z;
+                    if (depth < nearPlane || depth >= farPlane)
+                    {
+                        continue;
+                    }
+                    f32 ndcX = viewPos.x / depth * projection[0][0];
+                    f32 ndcY = viewPos.y / depth * projection[1][1];
+                    if (ndcX < -1.f || ndcX >= 1.f || ndcY < -1.f || ndcY >= 1.f)
+                    {
+                        continue;
+                    }
+                    u32 x = (u32)((ndcX * 0.5f + 0.5f) * CLUSTER_TILES_X);
+                    u32 y = (u32)((ndcY * 0.5f + 0.5f) * CLUSTER_TILES_Y);
+                    u32 slice = (u32)(logf(depth / nearPlane) / logf(farPlane / nearPlane)
+                            * CLUSTER_SLICES);
+                    slice = min(slice, CLUSTER_SLICES - 1);
+                    ++sampleCount;
+                    if (!clusterHasLight(grid, (slice * CLUSTER_TILES_Y + y) * CLUSTER_TILES_X + x,
+                                gridLightIndex))
+                    {
+                        ++missingCount;
+                    }
+                }
+            }
+        }
+        ++gridLightIndex;
+    }
+
+    const u32 iterations = 100;
+    f64 startTime = getTime();
+    for (u32 i=0; i<iterations; ++i)
+    {
+        grid.build(view, projection, nearPlane, farPlane, pointLights.data(), pointLights.size());
+    }
+    f64 buildTime = (getTime() - startTime) / iterations;
+
+    if (extraCount > 0 || missingCount > 0 || grid.droppedLightCount > 0
+            || grid.droppedIndexCount > 0)
+    {
+        error("Light grid check failed: %u listed lights don't overlap their cluster, "
+                "%u of %u sampled points are in clusters that don't list their light, "
+                "%u lights and %u indices dropped", extraCount, missingCount, sampleCount,
+                grid.droppedLightCount, grid.droppedIndexCount);
+        return;
+    }
+    println("Light grid check passed: %u of %u lights visible, %u cluster lights "
+            "(%u box overlaps), %u sampled points, %.3fms per build", grid.lights.size(),
+            pointLights.size(), listedCount, overlapCount, sampleCount, buildTime * 1000.0);
+}
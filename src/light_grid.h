@@ -0,0 +1,74 @@
+#pragma once
+
+#include "misc.h"
+
+const u32 MAX_POINT_LIGHTS = 256;
+const u32 LIGHT_MASK_WORDS = MAX_POINT_LIGHTS / 32;
+const u32 CLUSTER_TILES_X = 16;
+const u32 CLUSTER_TILES_Y = 9;
+const u32 CLUSTER_SLICES = 24;
+const u32 CLUSTER_COUNT = CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES;
+const u32 MAX_LIGHT_INDICES = CLUSTER_COUNT * 16;
+
+static_assert(CLUSTER_TILES_X % 4 == 0, "cluster rows are tested four at a time");
+
+struct PointLight
+{
+    Vec3 position;
+    f32 radius;
+    Vec3 color;
+    f32 falloff;
+};
+
+struct LightCluster
+{
+    u32 offset;
+    u32 count;
+};
+
+// Bins point lights into a view-space froxel grid (exponential depth slices). This has no
+// dependencies on the GL context so it can be exercised on its own.
+class LightGrid
+{
+    // view space bounds of every cluster (depth is positive), stored as separate arrays so
+    // that four neighboring clusters can be tested against a light at once
+    Array<f32> clusterMinX;
+    Array<f32> clusterMinY;
+    Array<f32> clusterMinZ;
+    Array<f32> clusterMaxX;
+    Array<f32> clusterMaxY;
+    Array<f32> clusterMaxZ;
+
+    // one bit per (cluster, light) pair
+    Array<u32> clusterLightMask;
+
+    Mat4 boundsProjection = Mat4(0.f);
+    f32 boundsNearPlane = 0.f;
+    f32 boundsFarPlane = 0.f;
+
+    void computeClusterBounds(Mat4 const& projection, f32 nearPlane, f32 farPlane);
+    u32 depthToSlice(f32 depth) const;
+
+public:
+    // the lights that touch at least one cluster; the index lists refer to this array
+    Array<PointLight> lights;
+    Array<LightCluster> clusters;
+    Array<u32> lightIndices;
+
+    f32 depthScale = 0.f;
+    f32 depthBias = 0.f;
+    u32 droppedLightCount = 0;
+    u32 droppedIndexCount = 0;
+
+    void build(Mat4 const& view, Mat4 const& projection, f32 nearPlane, f32 farPlane,
+            PointLight const* pointLights, u32 pointLightCount);
+
+    LightCluster const& getCluster(u32 x, u32 y, u32 slice) const
+    {
+        return clusters[(slice * CLUSTER_TILES_Y + y) * CLUSTER_TILES_X + x];
+    }
+
+    // Bins a fixed set of lights and checks the cluster lists against a brute force sphere/box
+    // test of every cluster, and against points sampled inside every light, then times builds.
+    static void check();
+};
@@ -5,23 +5,31 @@
 #include "threadpool.cpp"
 #include "scene.cpp"
 #include "renderer.cpp"
+#include "light_grid.cpp"
 #include "batcher.cpp"
+#include "instancing.cpp"
 #include "datafile.cpp"
 #include "resources.cpp"
 #include "material.cpp"
 #include "texture.cpp"
+#include "texture_streamer.cpp"
 #include "vehicle.cpp"
+#include "ai_scheduler.cpp"
 #include "vehicle_data.cpp"
 #include "vehicle_physics.cpp"
 #include "font.cpp"
 #include "track_graph.cpp"
-//#include "motion_grid.cpp"
+#include "motion_grid.cpp"
+#include "spatial_hash.cpp"
 #include "particle_system.cpp"
 #include "audio.cpp"
 #include "driver.cpp"
 #include "mesh.cpp"
+#include "mesh_optimizer.cpp"
+#include "gltf.cpp"
 #include "model.cpp"
 #include "terrain.cpp"
+#include "scatter.cpp"
 #include "track.cpp"
 #include "spline.cpp"
 #include "dynamic_buffer.cpp"
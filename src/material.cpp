@@ -1,5 +1,6 @@
 #include "material.h"
 #include "renderer.h"
+#include "instancing.h"
 
 void Material::loadShaderHandles(SmallArray<ShaderDefine> additionalDefines)
 {
@@ -7,40 +8,119 @@ void Material::loadShaderHandles(SmallArray<ShaderDefine> additionalDefines)
     if (isDepthReadEnabled) { renderFlags |= RenderFlags::DEPTH_READ; }
     if (isDepthWriteEnabled) { renderFlags |= RenderFlags::DEPTH_WRITE; }
 
-    colorShaderHandle = 0;
-    if (isVisible)
+    auto loadLitShaderHandles = [&](SmallArray<ShaderDefine> const& baseDefines,
+            ShaderHandle& color, ShaderHandle& shadow, ShaderHandle& depth) {
+        color = 0;
+        if (isVisible)
+        {
+            SmallArray<ShaderDefine> defines = baseDefines;
+            if (alphaCutoff > 0.f) { defines.push({ "ALPHA_DISCARD" }); }
+            if (normalMapTexture != 0) { defines.push({ "NORMAL_MAP" }); }
+            color = getShaderHandle("lit", defines, renderFlags, -100.f * depthOffset);
+        }
+        shadow = 0;
+        if (castsShadow)
+        {
+            SmallArray<ShaderDefine> defines = baseDefines;
+            defines.push({ "DEPTH_ONLY" });
+            if (shadowAlphaCutoff > 0.f) { defines.push({ "ALPHA_DISCARD" }); }
+            shadow = getShaderHandle("lit", defines, renderFlags);
+        }
+        depth = 0;
+        if (isDepthWriteEnabled)
+        {
+            SmallArray<ShaderDefine> defines = baseDefines;
+            defines.push({ "DEPTH_ONLY" });
+            if (alphaCutoff > 0.f) { defines.push({ "ALPHA_DISCARD" }); }
+            depth = getShaderHandle("lit", defines, renderFlags);
+        }
+    };
+    loadLitShaderHandles(additionalDefines, colorShaderHandle, shadowShaderHandle,
+            depthShaderHandle);
+    SmallArray<ShaderDefine> instancedDefines = additionalDefines;
+    instancedDefines.push({ "INSTANCED" });
+    loadLitShaderHandles(instancedDefines, instancedColorShaderHandle,
+            instancedShadowShaderHandle, instancedDepthShaderHandle);
     {
         SmallArray<ShaderDefine> defines = additionalDefines;
+        defines.push({ "OUT_ID" });
         if (alphaCutoff > 0.f) { defines.push({ "ALPHA_DISCARD" }); }
-        if (normalMapTexture != 0) { defines.push({ "NORMAL_MAP" }); }
-        colorShaderHandle = getShaderHandle("lit", defines, renderFlags, -100.f * depthOffset);
+        pickShaderHandle = getShaderHandle("lit", defines, renderFlags);
     }
-    shadowShaderHandle = 0;
-    if (castsShadow)
+    // NOTE: the handles are looked up when drawing because streamed textures get new handles
+    // when their resident mip levels change
+    cachedColorTexture = colorTexture ? g_res.getTexture(colorTexture) : &g_res.white;
+    cachedNormalTexture = normalMapTexture ? g_res.getTexture(normalMapTexture) : nullptr;
+}
+
+// the range of the element buffer that is drawn in each viewport
+struct MeshLodSelection
+{
+    u32 indexOffset[MAX_VIEWPORTS];
+    u32 indexCount[MAX_VIEWPORTS];
+
+    void setFullDetail(Mesh* mesh)
     {
-        SmallArray<ShaderDefine> defines = additionalDefines;
-        defines.push({ "DEPTH_ONLY" });
-        if (shadowAlphaCutoff > 0.f) { defines.push({ "ALPHA_DISCARD" }); }
-        shadowShaderHandle = getShaderHandle("lit", defines, renderFlags);
+        for (u32 i=0; i<MAX_VIEWPORTS; ++i)
+        {
+            indexOffset[i] = 0;
+            indexCount[i] = mesh->numIndices;
+        }
     }
-    depthShaderHandle = 0;
-    if (isDepthWriteEnabled)
+
+    void select(RenderWorld* rw, Mesh* mesh, f32 const pixelsPerUnit[MAX_VIEWPORTS])
     {
-        SmallArray<ShaderDefine> defines = additionalDefines;
-        defines.push({ "DEPTH_ONLY" });
-        if (alphaCutoff > 0.f) { defines.push({ "ALPHA_DISCARD" }); }
-        depthShaderHandle = getShaderHandle("lit", defines, renderFlags);
+        setFullDetail(mesh);
+        for (u32 i=0; i<rw->getViewportCount(); ++i)
+        {
+            mesh->selectLod(pixelsPerUnit[i], g_game.config.graphics.lodPixelError,
+                    indexOffset[i], indexCount[i]);
+        }
     }
+
+    void draw() const
     {
-        SmallArray<ShaderDefine> defines = additionalDefines;
-        defines.push({ "OUT_ID" });
-        if (alphaCutoff > 0.f) { defines.push({ "ALPHA_DISCARD" }); }
-        pickShaderHandle = getShaderHandle("lit", defines, renderFlags);
+        glDrawElements(GL_TRIANGLES, indexCount[g_currentViewportIndex], GL_UNSIGNED_INT,
+                (void*)((uintptr_t)indexOffset[g_currentViewportIndex] * sizeof(u32)));
+    }
+
+    void drawInstanced(u32 instanceCount) const
+    {
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount[g_currentViewportIndex],
+                GL_UNSIGNED_INT,
+                (void*)((uintptr_t)indexOffset[g_currentViewportIndex] * sizeof(u32)),
+                instanceCount);
+    }
+};
+
+// Raises pixelsPerUnit to the number of pixels that one unit in mesh space covers in each
+// viewport, and returns the largest screen size of the mesh's bounding sphere in any of them.
+static f32 accumulateMeshScreenScale(RenderWorld* rw, Mat4 const& transform, Mesh* mesh,
+        f32 pixelsPerUnit[MAX_VIEWPORTS])
+{
+    Vec3 center = Vec3(transform * Vec4((mesh->aabb.min + mesh->aabb.max) * 0.5f, 1.f));
+    f32 scale = max(max(length(Vec3(transform[0])), length(Vec3(transform[1]))),
+            length(Vec3(transform[2])));
+    f32 radius = max(length(mesh->aabb.max - mesh->aabb.min) * 0.5f * scale, 0.0001f);
+    f32 maxScreenSize = 0.f;
+    for (u32 i=0; i<rw->getViewportCount(); ++i)
+    {
+        f32 screenSize = rw->getProjectedSize(center, radius, i);
+        maxScreenSize = max(maxScreenSize, screenSize);
+        pixelsPerUnit[i] = max(pixelsPerUnit[i], screenSize / (radius * 2.f) * scale);
     }
-    textureColorHandle = colorTexture
-        ? g_res.getTexture(colorTexture)->handle : g_res.white.handle;
-    textureNormalHandle = normalMapTexture
-        ? g_res.getTexture(normalMapTexture)->handle : 0;
+    return maxScreenSize;
+}
+
+// Picks the level of detail of the mesh for every viewport of the render world and returns the
+// largest screen size of the mesh's bounding sphere in any of them.
+static f32 selectMeshLods(RenderWorld* rw, Mat4 const& transform, Mesh* mesh,
+        MeshLodSelection& selection)
+{
+    f32 pixelsPerUnit[MAX_VIEWPORTS] = {};
+    f32 screenSize = accumulateMeshScreenScale(rw, transform, mesh, pixelsPerUnit);
+    selection.select(rw, mesh, pixelsPerUnit);
+    return screenSize;
 }
 
 struct MaterialRenderData
@@ -49,7 +129,7 @@ struct MaterialRenderData
     Material* material = nullptr;
 #endif
     GLuint vao;
-    u32 indexCount;
+    MeshLodSelection lod;
     Mat4 worldTransform;
     Mat3 normalTransform;
     GLuint textureColor;
@@ -62,83 +142,189 @@ struct MaterialRenderData
     f32 alphaCutoff, shadowAlphaCutoff;
     f32 windAmount;
     u32 pickValue;
+    GLuint instanceBuffer;
+    u32 firstInstance;
+    u32 instanceCount;
+    Vec2 fadeDistance;
 };
 
-void Material::draw(RenderWorld* rw, Mat4 const& transform, Mesh* mesh, u8 stencil)
+static MaterialRenderData* createMaterialRenderData(Material* material, Mesh* mesh)
 {
     MaterialRenderData* d = g_tmpMem.bump<MaterialRenderData>();
 #ifndef NDEBUG
-    d->material = this;
+    d->material = material;
 #endif
     d->vao = mesh->vao;
-    d->indexCount = mesh->numIndices;
+    d->textureColor = material->cachedColorTexture->handle;
+    d->textureNormal = material->cachedNormalTexture ? material->cachedNormalTexture->handle : 0;
+    d->color = material->color;
+    d->emission = material->emit * material->emitPower;
+    d->fresnelBias = material->fresnelBias;
+    d->fresnelPower = material->fresnelPower;
+    d->fresnelScale = material->fresnelScale;
+    d->specularPower = material->specularPower;
+    d->specularStrength = material->specularStrength;
+    d->reflectionStrength = material->reflectionStrength;
+    d->reflectionLod = material->reflectionLod;
+    d->reflectionBias = material->reflectionBias;
+    d->alphaCutoff = material->alphaCutoff;
+    d->shadowAlphaCutoff = material->shadowAlphaCutoff;
+    d->windAmount = material->windAmount;
+    return d;
+}
+
+static void requestMaterialScreenSize(Material* material, f32 screenSize)
+{
+    if (material->cachedColorTexture->isStreaming()
+            || (material->cachedNormalTexture && material->cachedNormalTexture->isStreaming()))
+    {
+        material->cachedColorTexture->requestScreenSize(screenSize);
+        if (material->cachedNormalTexture)
+        {
+            material->cachedNormalTexture->requestScreenSize(screenSize);
+        }
+    }
+}
+
+static void bindMaterialColorUniforms(MaterialRenderData* d)
+{
+    glBindTextureUnit(0, d->textureColor);
+    if (d->textureNormal)
+    {
+        // TODO: Perhaps it would be better to just bind the identityNormal texture instead
+        glBindTextureUnit(5, d->textureNormal);
+    }
+    glUniform3fv(2, 1, (GLfloat*)&d->color);
+    glUniform3f(3, d->fresnelBias, d->fresnelScale, d->fresnelPower);
+    glUniform3f(4, d->specularPower, d->specularStrength, 0.f);
+    if (d->alphaCutoff > 0.f) { glUniform1f(5, d->alphaCutoff); }
+    glUniform3fv(6, 1, (GLfloat*)&d->emission);
+    glUniform3f(7, d->reflectionStrength, d->reflectionLod, d->reflectionBias);
+    glUniform1f(8, d->windAmount);
+}
+
+static void bindMaterialDepthUniforms(MaterialRenderData* d)
+{
+    if (d->alphaCutoff > 0.f)
+    {
+        glBindTextureUnit(0, d->textureColor);
+        glUniform1f(5, d->alphaCutoff);
+    }
+    glUniform1f(8, d->windAmount);
+}
+
+static void submitMaterialRenderData(RenderWorld* rw, Material* material, Mesh* mesh,
+        MaterialRenderData* d, ShaderHandle colorShader, ShaderHandle depthShader,
+        ShaderHandle shadowShader, void (*renderColor)(void*), void (*renderDepth)(void*),
+        u8 stencil)
+{
+    if (material->isTransparent || material->depthOffset > 0.f
+            || !material->isDepthWriteEnabled || !material->isDepthReadEnabled)
+    {
+        i32 priority = material->depthOffset > 0.f ? TransparentDepth::FLAT_SPLINE : 0;
+        rw->transparentPass({ colorShader, priority, d, renderColor });
+    }
+    else
+    {
+        rw->depthPrepass(depthShader, { d, renderDepth });
+        rw->opaqueColorPass(colorShader, { d, renderColor, stencil });
+    }
+
+    if (material->castsShadow)
+    {
+        if (rw->isSubmittingStaticShadows())
+        {
+            // the cached static shadow is kept for many frames, so it is drawn at full detail
+            // rather than at the level of detail the camera picked when it was rebuilt
+            MaterialRenderData* shadowData = g_tmpMem.bump<MaterialRenderData>();
+            *shadowData = *d;
+            shadowData->lod.setFullDetail(mesh);
+            d = shadowData;
+        }
+        rw->shadowPass(shadowShader, { d, renderDepth });
+    }
+}
+
+void Material::draw(RenderWorld* rw, Mat4 const& transform, Mesh* mesh, u8 stencil)
+{
+    MaterialRenderData* d = createMaterialRenderData(this, mesh);
+    f32 screenSize = selectMeshLods(rw, transform, mesh, d->lod);
     d->worldTransform = transform;
     d->normalTransform = inverseTranspose(Mat3(transform));
-    d->textureColor = textureColorHandle;
-    d->textureNormal = textureNormalHandle;
-    d->color = color;
-    d->emission = emit * emitPower;
-    d->fresnelBias = fresnelBias;
-    d->fresnelPower = fresnelPower;
-    d->fresnelScale = fresnelScale;
-    d->specularPower = specularPower;
-    d->specularStrength = specularStrength;
-    d->reflectionStrength = reflectionStrength;
-    d->reflectionLod = reflectionLod;
-    d->reflectionBias = reflectionBias;
-    d->alphaCutoff = alphaCutoff;
-    d->shadowAlphaCutoff = shadowAlphaCutoff;
-    d->windAmount = windAmount;
+    requestMaterialScreenSize(this, screenSize);
 
     auto renderColor = [](void* renderData) {
         MaterialRenderData* d = (MaterialRenderData*)renderData;
-        glBindTextureUnit(0, d->textureColor);
-        if (d->textureNormal)
-        {
-            // TODO: Perhaps it would be better to just bind the identityNormal texture instead
-            glBindTextureUnit(5, d->textureNormal);
-        }
+        bindMaterialColorUniforms(d);
         glUniformMatrix4fv(0, 1, GL_FALSE, d->worldTransform.valuePtr());
         glUniformMatrix3fv(1, 1, GL_FALSE, d->normalTransform.valuePtr());
-        glUniform3fv(2, 1, (GLfloat*)&d->color);
-        glUniform3f(3, d->fresnelBias, d->fresnelScale, d->fresnelPower);
-        glUniform3f(4, d->specularPower, d->specularStrength, 0.f);
-        if (d->alphaCutoff > 0.f) { glUniform1f(5, d->alphaCutoff); }
-        glUniform3fv(6, 1, (GLfloat*)&d->emission);
-        glUniform3f(7, d->reflectionStrength, d->reflectionLod, d->reflectionBias);
-        glUniform1f(8, d->windAmount);
         glBindVertexArray(d->vao);
-        glDrawElements(GL_TRIANGLES, d->indexCount, GL_UNSIGNED_INT, 0);
+        d->lod.draw();
     };
 
     auto renderDepth = [](void* renderData) {
         MaterialRenderData* d = (MaterialRenderData*)renderData;
+        bindMaterialDepthUniforms(d);
         glUniformMatrix4fv(0, 1, GL_FALSE, d->worldTransform.valuePtr());
-        if (d->alphaCutoff > 0.f)
-        {
-            glBindTextureUnit(0, d->textureColor);
-            glUniform1f(5, d->alphaCutoff);
-        }
-        glUniform1f(8, d->windAmount);
         glBindVertexArray(d->vao);
-        glDrawElements(GL_TRIANGLES, d->indexCount, GL_UNSIGNED_INT, 0);
+        d->lod.draw();
     };
 
-    if (isTransparent || depthOffset > 0.f || !isDepthWriteEnabled || !isDepthReadEnabled)
+    submitMaterialRenderData(rw, this, mesh, d, colorShaderHandle, depthShaderHandle,
+            shadowShaderHandle, renderColor, renderDepth, stencil);
+}
+
+void Material::drawInstanced(RenderWorld* rw, Mesh* mesh, GLuint instanceBuffer,
+        InstanceData const* instances, u32 firstInstance, u32 instanceCount,
+        Vec2 const& fadeDistance)
+{
+    MaterialRenderData* d = createMaterialRenderData(this, mesh);
+    d->instanceBuffer = instanceBuffer;
+    d->firstInstance = firstInstance;
+    d->instanceCount = instanceCount;
+    d->fadeDistance = fadeDistance;
+
+    if (instances)
     {
-        i32 priority = depthOffset > 0.f ? TransparentDepth::FLAT_SPLINE : 0;
-        rw->transparentPass({ colorShaderHandle, priority, d, renderColor });
+        // the closest instance decides the level of detail and the texture resolution of all
+        f32 pixelsPerUnit[MAX_VIEWPORTS] = {};
+        f32 screenSize = 0.f;
+        for (u32 i=0; i<instanceCount; ++i)
+        {
+            screenSize = max(screenSize, accumulateMeshScreenScale(rw,
+                        instances[i].worldTransform, mesh, pixelsPerUnit));
+        }
+        d->lod.select(rw, mesh, pixelsPerUnit);
+        requestMaterialScreenSize(this, screenSize);
     }
     else
     {
-        rw->depthPrepass(depthShaderHandle, { d, renderDepth });
-        rw->opaqueColorPass(colorShaderHandle, { d, renderColor, stencil });
+        d->lod.setFullDetail(mesh);
+        requestMaterialScreenSize(this, FLT_MAX);
     }
 
-    if (castsShadow)
-    {
-        rw->shadowPass(shadowShaderHandle, { d, renderDepth });
-    }
+    auto renderColor = [](void* renderData) {
+        MaterialRenderData* d = (MaterialRenderData*)renderData;
+        bindMaterialColorUniforms(d);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BUFFER_BINDING, d->instanceBuffer);
+        glUniform1ui(INSTANCE_OFFSET_LOCATION, d->firstInstance);
+        glUniform2fv(INSTANCE_FADE_LOCATION, 1, (GLfloat*)&d->fadeDistance);
+        glBindVertexArray(d->vao);
+        d->lod.drawInstanced(d->instanceCount);
+    };
+
+    auto renderDepth = [](void* renderData) {
+        MaterialRenderData* d = (MaterialRenderData*)renderData;
+        bindMaterialDepthUniforms(d);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BUFFER_BINDING, d->instanceBuffer);
+        glUniform1ui(INSTANCE_OFFSET_LOCATION, d->firstInstance);
+        glUniform2fv(INSTANCE_FADE_LOCATION, 1, (GLfloat*)&d->fadeDistance);
+        glBindVertexArray(d->vao);
+        d->lod.drawInstanced(d->instanceCount);
+    };
+
+    submitMaterialRenderData(rw, this, mesh, d, instancedColorShaderHandle, instancedDepthShaderHandle,
+            instancedShadowShaderHandle, renderColor, renderDepth, 0);
 }
 
 void Material::drawPick(RenderWorld* rw, Mat4 const& transform, Mesh* mesh, u32 pickValue)
@@ -148,9 +334,9 @@ void Material::drawPick(RenderWorld* rw, Mat4 const& transform, Mesh* mesh, u32
     d->material = this;
 #endif
     d->vao = mesh->vao;
-    d->indexCount = mesh->numIndices;
+    d->lod.setFullDetail(mesh);
     d->worldTransform = transform;
-    d->textureColor = textureColorHandle;
+    d->textureColor = cachedColorTexture->handle;
     d->alphaCutoff = alphaCutoff;
     d->windAmount = windAmount;
     d->pickValue = pickValue;
@@ -167,7 +353,7 @@ void Material::drawPick(RenderWorld* rw, Mat4 const& transform, Mesh* mesh, u32
         glUniform1f(8, d->windAmount);
         glUniform1ui(9, d->pickValue);
         glBindVertexArray(d->vao);
-        glDrawElements(GL_TRIANGLES, d->indexCount, GL_UNSIGNED_INT, 0);
+        d->lod.draw();
     };
     rw->pickPass(pickShaderHandle, { d, render });
 }
@@ -178,11 +364,11 @@ void Material::drawHighlight(RenderWorld* rw, Mat4 const& transform, Mesh* mesh,
 #ifndef NDEBUG
     d->material = this;
 #endif
-    d->textureColor = textureColorHandle;
+    d->textureColor = cachedColorTexture->handle;
     d->vao = mesh->vao;
-    d->indexCount = mesh->numIndices;
+    d->lod.setFullDetail(mesh);
     d->worldTransform = transform;
-    d->textureColor = textureColorHandle;
+    d->textureColor = cachedColorTexture->handle;
     d->alphaCutoff = alphaCutoff;
     d->windAmount = windAmount;
 
@@ -196,7 +382,7 @@ void Material::drawHighlight(RenderWorld* rw, Mat4 const& transform, Mesh* mesh,
         }
         glUniform1f(8, d->windAmount);
         glBindVertexArray(d->vao);
-        glDrawElements(GL_TRIANGLES, d->indexCount, GL_UNSIGNED_INT, 0);
+        d->lod.draw();
     };
 
     rw->highlightPass(depthShaderHandle, { d, render, stencil, cameraIndex });
@@ -208,7 +394,7 @@ struct VehicleRenderData
     Material* material = nullptr;
 #endif
     GLuint vao;
-    u32 indexCount;
+    MeshLodSelection lod;
     Mat4 worldTransform;
     Mat3 normalTransform;
     Vec3 color;
@@ -229,7 +415,7 @@ void Material::drawVehicle(class RenderWorld* rw, Mat4 const& transform, struct
     d->material = this;
 #endif
     d->vao = mesh->vao;
-    d->indexCount = mesh->numIndices;
+    selectMeshLods(rw, transform, mesh, d->lod);
     d->worldTransform = transform;
     d->normalTransform = inverseTranspose(Mat3(transform));
     d->color = color;
@@ -265,7 +451,7 @@ void Material::drawVehicle(class RenderWorld* rw, Mat4 const& transform, struct
         glUniform4fv(10, 1, (GLfloat*)&d->shield);
         glUniform4fv(11, 3, (GLfloat*)&d->vinylColor);
         glBindVertexArray(d->vao);
-        glDrawElements(GL_TRIANGLES, d->indexCount, GL_UNSIGNED_INT, 0);
+        d->lod.draw();
     };
 
     auto renderDepth = [](void* renderData) {
@@ -273,7 +459,7 @@ void Material::drawVehicle(class RenderWorld* rw, Mat4 const& transform, struct
         glUniformMatrix4fv(0, 1, GL_FALSE, d->worldTransform.valuePtr());
         glUniformMatrix3fv(1, 1, GL_FALSE, d->normalTransform.valuePtr());
         glBindVertexArray(d->vao);
-        glDrawElements(GL_TRIANGLES, d->indexCount, GL_UNSIGNED_INT, 0);
+        d->lod.draw();
     };
 
     rw->depthPrepass(depthShaderHandle, { d, renderDepth });
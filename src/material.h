@@ -23,6 +23,13 @@ struct TerrainLayer
 
     bool isOffroad = false;
 
+    // model that the scatter system places where this layer is painted, see scatter.h
+    i64 scatterModelGuid = 0;
+    // instances per square meter where the layer is fully painted
+    f32 scatterDensity = 0.f;
+    f32 scatterMinScale = 0.8f;
+    f32 scatterMaxScale = 1.2f;
+
     void serialize(Serializer& s)
     {
         s.field(colorTextureGuid);
@@ -32,6 +39,10 @@ struct TerrainLayer
         s.field(fresnelScale);
         s.field(fresnelPower);
         s.field(isOffroad);
+        s.field(scatterModelGuid);
+        s.field(scatterDensity);
+        s.field(scatterMinScale);
+        s.field(scatterMaxScale);
     }
 };
 
@@ -129,11 +140,21 @@ public:
     ShaderHandle depthShaderHandle = 0;
     ShaderHandle shadowShaderHandle = 0;
     ShaderHandle pickShaderHandle = 0;
-    GLuint textureColorHandle = 0;
-    GLuint textureNormalHandle = 0;
+    // variants that read the transforms from an instance buffer, see drawInstanced()
+    ShaderHandle instancedColorShaderHandle = 0;
+    ShaderHandle instancedDepthShaderHandle = 0;
+    ShaderHandle instancedShadowShaderHandle = 0;
+    struct Texture* cachedColorTexture = nullptr;
+    struct Texture* cachedNormalTexture = nullptr;
 
     void loadShaderHandles(SmallArray<ShaderDefine> additionalDefines={});
     void draw(class RenderWorld* rw, Mat4 const& transform, struct Mesh* mesh, u8 stencil=0);
+    // Draws instanceCount instances of the mesh whose InstanceData starts at firstInstance in
+    // instanceBuffer. The CPU copy of the instance data is used to pick the level of detail;
+    // without it the full detail mesh and textures are used.
+    void drawInstanced(class RenderWorld* rw, struct Mesh* mesh, GLuint instanceBuffer,
+            struct InstanceData const* instances, u32 firstInstance, u32 instanceCount,
+            Vec2 const& fadeDistance=Vec2(0.f));
     void drawPick(class RenderWorld* rw, Mat4 const& transform, struct Mesh* mesh, u32 pickValue);
     void drawHighlight(class RenderWorld* rw, Mat4 const& transform, struct Mesh* mesh,
             u8 stencil, u8 cameraIndex=0);
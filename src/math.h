@@ -1553,3 +1553,10 @@ inline PxTransform convert(Mat4 const& m)
 {
     return PxTransform(convert(m.position()), convert(Quat(Mat3(m.rotation()))));
 }
+
+// blends two poses of a rigid body, taking the shorter way around for the rotation
+inline PxTransform interpolate(PxTransform const& from, PxTransform const& to, f32 t)
+{
+    PxQuat q = from.q.dot(to.q) < 0.f ? -to.q : to.q;
+    return PxTransform(from.p + (to.p - from.p) * t, (from.q * (1.f - t) + q * t).getNormalized());
+}
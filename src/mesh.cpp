@@ -1,6 +1,7 @@
 #include "mesh.h"
 #include "debug_draw.h"
 #include "game.h"
+#include "mesh_optimizer.h"
 
 void Mesh::buildOctree()
 {
@@ -210,8 +211,16 @@ void Mesh::createVAO()
     glNamedBufferData(vbo, vertices.size() * sizeof(vertices[0]), vertices.data(), GL_STATIC_DRAW);
     glVertexArrayVertexBuffer(vao, 0, vbo, 0, stride);
 
+    // the level of detail indices are stored after the full detail indices
     glCreateBuffers(1, &ebo);
-    glNamedBufferData(ebo, indices.size() * sizeof(indices[0]), indices.data(), GL_STATIC_DRAW);
+    glNamedBufferData(ebo, (indices.size() + lodIndices.size()) * sizeof(u32), nullptr,
+            GL_STATIC_DRAW);
+    glNamedBufferSubData(ebo, 0, indices.size() * sizeof(u32), indices.data());
+    if (!lodIndices.empty())
+    {
+        glNamedBufferSubData(ebo, indices.size() * sizeof(u32), lodIndices.size() * sizeof(u32),
+                lodIndices.data());
+    }
     glVertexArrayElementBuffer(vao, ebo);
 
     u32 offset = 0;
@@ -244,6 +253,179 @@ void Mesh::createVAO()
     }
 }
 
+const char* COLLISION_CACHE_DIRECTORY = "../cache/collision";
+// bump this whenever the way collision meshes are cooked changes
+const u32 COLLISION_CACHE_VERSION = 1;
+const u32 COLLISION_CACHE_MAGIC = 0x4C4F4343; // "CCOL"
+
+struct CollisionCacheHeader
+{
+    u32 magic;
+    u32 version;
+    u64 key;
+    u32 size;
+};
+
+u64 Mesh::getCollisionCacheKey(bool convex) const
+{
+    u64 hash = HASH_SEED;
+    hash = hashValue(hash, COLLISION_CACHE_VERSION);
+    hash = hashValue(hash, (u32)PX_PHYSICS_VERSION);
+    hash = hashValue(hash, convex);
+
+    PxCookingParams const& params = g_game.physx.cooking->getParams();
+    hash = hashValue(hash, params.scale.length);
+    hash = hashValue(hash, params.scale.speed);
+    hash = hashValue(hash, (u32)params.midphaseDesc.getType());
+    hash = hashValue(hash, params.meshWeldTolerance);
+    hash = hashValue(hash, params.buildTriangleAdjacencies);
+    hash = hashValue(hash, params.suppressTriangleMeshRemapTable);
+    hash = hashValue(hash, (u32)params.convexMeshCookingType);
+    hash = hashValue(hash, params.gaussMapLimit);
+    hash = hashValue(hash, params.areaTestEpsilon);
+    hash = hashValue(hash, params.planeTolerance);
+
+    // only the positions are used for cooking
+    u8 const* vertexData = (u8 const*)vertices.data();
+    hash = hashValue(hash, numVertices);
+    for (u32 i=0; i<numVertices; ++i)
+    {
+        hash = hashBytes(hash, vertexData + i * stride, sizeof(f32) * 3);
+    }
+    if (!convex)
+    {
+        hash = hashValue(hash, numIndices);
+        hash = hashBytes(hash, indices.data(), numIndices * sizeof(u32));
+    }
+    return hash;
+}
+
+static void getCollisionCachePath(char* path, size_t size, u64 key, bool convex)
+{
+    snprintf(path, size, "%s/%016llx.%s", COLLISION_CACHE_DIRECTORY,
+            (unsigned long long)key, convex ? "cvx" : "tri");
+}
+
+static void createCollisionCacheDirectory()
+{
+    static bool created = false;
+    if (!created)
+    {
+        createDirectory("../cache");
+        createDirectory(COLLISION_CACHE_DIRECTORY);
+        created = true;
+    }
+}
+
+static bool readCollisionCache(const char* path, u64 key, Array<u8>& output)
+{
+    SDL_RWops* file = SDL_RWFromFile(path, "rb");
+    if (!file)
+    {
+        return false;
+    }
+    CollisionCacheHeader header;
+    bool valid = SDL_RWread(file, &header, sizeof(header), 1) == 1
+        && header.magic == COLLISION_CACHE_MAGIC
+        && header.version == COLLISION_CACHE_VERSION
+        && header.key == key
+        && (i64)(sizeof(header) + header.size) == SDL_RWsize(file);
+    if (valid)
+    {
+        output.resize(header.size);
+        valid = SDL_RWread(file, output.data(), header.size, 1) == 1;
+    }
+    SDL_RWclose(file);
+    if (!valid)
+    {
+        output.clear();
+    }
+    return valid;
+}
+
+static void writeCollisionCache(const char* path, u64 key, PxDefaultMemoryOutputStream& stream)
+{
+    // write to a temporary file first so that an interrupted write never leaves a truncated
+    // file behind under the real name
+    char tmpPath[256];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+    SDL_RWops* file = SDL_RWFromFile(tmpPath, "wb");
+    if (!file)
+    {
+        error("Failed to write collision cache file: %s", tmpPath);
+        return;
+    }
+    CollisionCacheHeader header = { COLLISION_CACHE_MAGIC, COLLISION_CACHE_VERSION, key,
+        stream.getSize() };
+    bool written = SDL_RWwrite(file, &header, sizeof(header), 1) == 1
+        && SDL_RWwrite(file, stream.getData(), stream.getSize(), 1) == 1;
+    SDL_RWclose(file);
+    if (!written)
+    {
+        error("Failed to write collision cache file: %s", tmpPath);
+        remove(tmpPath);
+        return;
+    }
+    replaceFile(tmpPath, path);
+}
+
+bool Mesh::prepareCollisionData(bool convex, u64 key, f64* elapsedTime)
+{
+    Array<u8>& output = convex ? cookedConvexCollisionData : cookedCollisionData;
+    f64 startTime = getTime();
+
+    char path[256];
+    getCollisionCachePath(path, sizeof(path), key, convex);
+    bool wasCached = readCollisionCache(path, key, output);
+    if (!wasCached)
+    {
+        PxDefaultMemoryOutputStream writeBuffer;
+        if (convex)
+        {
+            PxConvexMeshDesc convexDesc;
+            convexDesc.points.count  = numVertices;
+            convexDesc.points.stride = stride;
+            convexDesc.points.data   = vertices.data();
+            convexDesc.flags         = PxConvexFlag::eCOMPUTE_CONVEX;
+
+            if (!g_game.physx.cooking->cookConvexMesh(convexDesc, writeBuffer))
+            {
+                FATAL_ERROR("Failed to create convex collision mesh: %s", name.data());
+            }
+        }
+        else
+        {
+            PxTriangleMeshDesc desc;
+            desc.points.count = numVertices;
+            desc.points.stride = stride;
+            desc.points.data = vertices.data();
+            desc.triangles.count = numIndices / 3;
+            desc.triangles.stride = 3 * sizeof(indices[0]);
+            desc.triangles.data = indices.data();
+
+            PxTriangleMeshCookingResult::Enum result;
+            if (!g_game.physx.cooking->cookTriangleMesh(desc, writeBuffer, &result))
+            {
+                FATAL_ERROR("Failed to create collision mesh: %s", name.data());
+            }
+        }
+        writeCollisionCache(path, key, writeBuffer);
+        output.assign(writeBuffer.getData(), writeBuffer.getData() + writeBuffer.getSize());
+    }
+
+    if (elapsedTime)
+    {
+        *elapsedTime = getTime() - startTime;
+    }
+    return wasCached;
+}
+
+static void printCollisionPrepareTime(Mesh const& mesh, bool convex, bool wasCached, f64 time)
+{
+    println("%s collision mesh %s: %s in %.2fms", convex ? "Convex" : "Triangle",
+            mesh.name.data(), wasCached ? "loaded from cache" : "cooked", time * 1000.0);
+}
+
 PxTriangleMesh* Mesh::getCollisionMesh()
 {
     if (collisionMesh)
@@ -251,23 +433,17 @@ PxTriangleMesh* Mesh::getCollisionMesh()
         return collisionMesh;
     }
 
-    PxTriangleMeshDesc desc;
-    desc.points.count = numVertices;
-    desc.points.stride = stride;
-    desc.points.data = vertices.data();
-    desc.triangles.count = numIndices / 3;
-    desc.triangles.stride = 3 * sizeof(indices[0]);
-    desc.triangles.data = indices.data();
-
-    PxDefaultMemoryOutputStream writeBuffer;
-    PxTriangleMeshCookingResult::Enum result;
-    if (!g_game.physx.cooking->cookTriangleMesh(desc, writeBuffer, &result))
+    if (cookedCollisionData.empty())
     {
-        FATAL_ERROR("Failed to create collision mesh: %s", name.data());
+        createCollisionCacheDirectory();
+        f64 time;
+        bool wasCached = prepareCollisionData(false, getCollisionCacheKey(false), &time);
+        printCollisionPrepareTime(*this, false, wasCached, time);
     }
 
-    PxDefaultMemoryInputData readBuffer(writeBuffer.getData(), writeBuffer.getSize());
+    PxDefaultMemoryInputData readBuffer(cookedCollisionData.data(), cookedCollisionData.size());
     collisionMesh = g_game.physx.physics->createTriangleMesh(readBuffer);
+    cookedCollisionData.clear();
     return collisionMesh;
 }
 
@@ -278,23 +454,113 @@ PxConvexMesh* Mesh::getConvexCollisionMesh()
         return convexCollisionMesh;
     }
 
-    PxConvexMeshDesc convexDesc;
-    convexDesc.points.count  = numVertices;
-    convexDesc.points.stride = stride;
-    convexDesc.points.data   = vertices.data();
-    convexDesc.flags         = PxConvexFlag::eCOMPUTE_CONVEX;
-
-    PxDefaultMemoryOutputStream writeBuffer;
-    if (!g_game.physx.cooking->cookConvexMesh(convexDesc, writeBuffer))
+    if (cookedConvexCollisionData.empty())
     {
-        FATAL_ERROR("Failed to create convex collision mesh: %s", name.data());
+        createCollisionCacheDirectory();
+        f64 time;
+        bool wasCached = prepareCollisionData(true, getCollisionCacheKey(true), &time);
+        printCollisionPrepareTime(*this, true, wasCached, time);
     }
 
-    PxDefaultMemoryInputData readBuffer(writeBuffer.getData(), writeBuffer.getSize());
+    PxDefaultMemoryInputData readBuffer(cookedConvexCollisionData.data(),
+            cookedConvexCollisionData.size());
     convexCollisionMesh = g_game.physx.physics->createConvexMesh(readBuffer);
+    cookedConvexCollisionData.clear();
     return convexCollisionMesh;
 }
 
+void prepareCollisionMeshes(Array<CollisionMeshRequest>& requests)
+{
+    struct Job
+    {
+        CollisionMeshRequest request;
+        u64 key;
+        bool wasCached;
+        f64 time;
+    };
+
+    // the same model is usually placed many times, so drop duplicates and meshes that already
+    // have their PhysX mesh
+    requests.sort([](CollisionMeshRequest const& a, CollisionMeshRequest const& b) {
+        return a.mesh != b.mesh ? a.mesh < b.mesh : a.convex < b.convex;
+    });
+    Array<Job> requested;
+    for (u32 i=0; i<requests.size(); ++i)
+    {
+        CollisionMeshRequest const& r = requests[i];
+        if (i > 0 && requests[i-1].mesh == r.mesh && requests[i-1].convex == r.convex)
+        {
+            continue;
+        }
+        bool isReady = r.convex
+            ? (r.mesh->convexCollisionMesh || !r.mesh->cookedConvexCollisionData.empty())
+            : (r.mesh->collisionMesh || !r.mesh->cookedCollisionData.empty());
+        if (!isReady)
+        {
+            requested.push({ r, r.mesh->getCollisionCacheKey(r.convex), false, 0.0 });
+        }
+    }
+    if (requested.empty())
+    {
+        return;
+    }
+
+    // different meshes can have the same geometry, and they would share a cache file, so only
+    // one job per cache key is run and the others copy its result
+    requested.sort([](Job const& a, Job const& b) { return a.key < b.key; });
+    Array<Job> jobs;
+    for (u32 i=0; i<requested.size(); ++i)
+    {
+        if (i == 0 || requested[i-1].key != requested[i].key)
+        {
+            jobs.push(requested[i]);
+        }
+    }
+
+    createCollisionCacheDirectory();
+    f64 startTime = getTime();
+    TaskGroup group;
+    for (auto& job : jobs)
+    {
+        g_threadPool.addTask(group, { &job, [](void* data) -> void* {
+            Job* job = (Job*)data;
+            job->wasCached = job->request.mesh->prepareCollisionData(
+                    job->request.convex, job->key, &job->time);
+            return nullptr;
+        }});
+    }
+    g_threadPool.wait(group);
+
+    u32 jobIndex = 0;
+    for (auto& r : requested)
+    {
+        while (jobs[jobIndex].key != r.key)
+        {
+            ++jobIndex;
+        }
+        Job const& job = jobs[jobIndex];
+        if (job.request.mesh != r.request.mesh)
+        {
+            Array<u8> const& src = job.request.convex
+                ? job.request.mesh->cookedConvexCollisionData
+                : job.request.mesh->cookedCollisionData;
+            Array<u8>& dest = r.request.convex
+                ? r.request.mesh->cookedConvexCollisionData
+                : r.request.mesh->cookedCollisionData;
+            dest.assign(src.data(), src.data() + src.size());
+        }
+    }
+
+    u32 cachedCount = 0;
+    for (auto& job : jobs)
+    {
+        printCollisionPrepareTime(*job.request.mesh, job.request.convex, job.wasCached, job.time);
+        cachedCount += job.wasCached ? 1 : 0;
+    }
+    println("Prepared %u collision meshes (%u from cache, %u shared) in %.2fms", jobs.size(),
+            cachedCount, requested.size() - jobs.size(), (getTime() - startTime) * 1000.0);
+}
+
 void Mesh::destroy()
 {
     if (vao)
@@ -316,6 +582,8 @@ void Mesh::destroy()
         convexCollisionMesh->release();
         convexCollisionMesh = nullptr;
     }
+    cookedCollisionData.clear();
+    cookedConvexCollisionData.clear();
     octree.reset();
 }
 
@@ -353,6 +621,115 @@ void Mesh::calculateVertexFormat()
     }
 }
 
+void Mesh::optimize(bool weld)
+{
+    if (vertices.size() * sizeof(f32) != (size_t)numVertices * stride || indices.size() != numIndices)
+    {
+        return;
+    }
+
+    u8* vertexData = (u8*)vertices.data();
+    if (weld)
+    {
+        numVertices = weldVertices(vertexData, stride, numVertices, indices.data(), numIndices);
+    }
+    optimizeVertexCache(indices.data(), numIndices, numVertices);
+    // the position is the first attribute of every vertex format
+    optimizeOverdraw(indices.data(), numIndices, vertices.data(), numVertices, stride);
+    numVertices = optimizeVertexFetch(vertexData, stride, numVertices, indices.data(), numIndices);
+    vertices.resize(numVertices * stride / sizeof(f32));
+    isOptimized = true;
+
+    // the vertices have moved, so the levels of detail no longer match them
+    lodIndices.clear();
+    lods.clear();
+    hasGeneratedLods = false;
+}
+
+bool Mesh::prepareForSaving()
+{
+    if (isOptimized && hasGeneratedLods)
+    {
+        return false;
+    }
+    if (!isOptimized)
+    {
+        optimize(true);
+        if (!isOptimized)
+        {
+            return false;
+        }
+    }
+    // optimize() drops the levels of detail because they index the old vertex order
+    generateLods();
+
+    // the buffers and the octree still hold the old vertex order and no levels of detail
+    if (vao)
+    {
+        createVAO();
+    }
+    octree.reset();
+    return true;
+}
+
+// meshes with fewer triangles than this don't get levels of detail
+const u32 MIN_LOD_TRIANGLE_COUNT = 256;
+
+void Mesh::generateLods()
+{
+    lodIndices.clear();
+    lods.clear();
+    hasGeneratedLods = true;
+
+    if (vertices.size() * sizeof(f32) != (size_t)numVertices * stride
+            || indices.size() != numIndices || numIndices / 3 < MIN_LOD_TRIANGLE_COUNT)
+    {
+        return;
+    }
+
+    Array<u32> lodBuffer;
+    lodBuffer.resize(numIndices);
+    u32 previousIndexCount = numIndices;
+    for (u32 i=0; i<MAX_MESH_LODS; ++i)
+    {
+        // each level halves the triangle count of the full mesh again
+        u32 targetIndexCount = (numIndices >> (i + 1)) / 3 * 3;
+        f32 error = 0.f;
+        u32 indexCount = simplifyMesh(lodBuffer.data(), indices.data(), numIndices,
+                vertices.data(), numVertices, stride, targetIndexCount, &error);
+
+        // stop when the simplifier is stuck on locked vertices and the level would barely save
+        // any triangles compared to the previous one
+        if (indexCount == 0 || indexCount > previousIndexCount * 4 / 5)
+        {
+            break;
+        }
+        optimizeVertexCache(lodBuffer.data(), indexCount, numVertices);
+
+        lods.push({ numIndices + lodIndices.size(), indexCount, error });
+        for (u32 j=0; j<indexCount; ++j)
+        {
+            lodIndices.push(lodBuffer[j]);
+        }
+        previousIndexCount = indexCount;
+    }
+}
+
+void Mesh::selectLod(f32 pixelsPerUnit, f32 maxPixelError, u32& indexOffset, u32& indexCount) const
+{
+    indexOffset = 0;
+    indexCount = numIndices;
+    for (auto& lod : lods)
+    {
+        if (lod.error * pixelsPerUnit > maxPixelError)
+        {
+            break;
+        }
+        indexOffset = lod.indexOffset;
+        indexCount = lod.indexCount;
+    }
+}
+
 void Mesh::computeBoundingBox()
 {
     // TODO
@@ -20,6 +20,26 @@ struct VertexAttribute
     VertexAttributeType type;
 };
 
+// A reduced level of detail of a mesh. Its indices are stored after the full detail indices in
+// the same element buffer and reference the same vertices.
+struct MeshLod
+{
+    u32 indexOffset;
+    u32 indexCount;
+    // the largest distance the simplified surface deviates from the original in mesh space
+    f32 error;
+
+    void serialize(Serializer& s)
+    {
+        s.field(indexOffset);
+        s.field(indexCount);
+        s.field(error);
+    }
+};
+
+// levels of detail below the full mesh that are generated by Mesh::generateLods()
+const u32 MAX_MESH_LODS = 3;
+
 struct Mesh
 {
     Str64 name;
@@ -38,6 +58,13 @@ struct Mesh
 
     // TODO: remove this property when all meshes have been reimported
     bool hasTangents = false;
+    // whether the index and vertex order have already been optimized, see optimize()
+    bool isOptimized = false;
+
+    // indices of the reduced levels of detail, see generateLods()
+    Array<u32> lodIndices;
+    SmallArray<MeshLod, MAX_MESH_LODS> lods;
+    bool hasGeneratedLods = false;
 
     void serialize(Serializer& s)
     {
@@ -50,6 +77,10 @@ struct Mesh
         s.field(numTexCoords);
         s.field(aabb);
         s.field(hasTangents);
+        s.field(isOptimized);
+        s.field(lodIndices);
+        s.field(lods);
+        s.field(hasGeneratedLods);
 
         if (s.deserialize)
         {
@@ -75,6 +106,17 @@ struct Mesh
     void buildOctree();
     void calculateVertexFormat();
     void computeBoundingBox();
+    // reorders the indices for vertex cache reuse and the vertices for fetch locality
+    void optimize(bool weld);
+    // Optimizes the mesh and generates its levels of detail if that hasn't happened yet, so that
+    // they are stored with the mesh and loading doesn't have to do it. Returns whether the mesh
+    // changed and needs to be saved again.
+    bool prepareForSaving();
+    // simplifies the mesh into up to MAX_MESH_LODS levels of detail that share its vertices
+    void generateLods();
+    // Picks the coarsest level of detail whose error covers less than maxPixelError pixels when
+    // one unit in mesh space covers pixelsPerUnit pixels on screen.
+    void selectLod(f32 pixelsPerUnit, f32 maxPixelError, u32& indexOffset, u32& indexCount) const;
 
     bool intersect(Mat4 const& transform, BoundingBox bb, Array<u32>& output) const;
     void createVAO();
@@ -82,12 +124,32 @@ struct Mesh
     PxTriangleMesh* collisionMesh = nullptr;
     PxConvexMesh* convexCollisionMesh = nullptr;
 
+    // cooked collision streams that were loaded from the cache or cooked ahead of time; they
+    // are freed once the PhysX mesh has been created
+    Array<u8> cookedCollisionData;
+    Array<u8> cookedConvexCollisionData;
+
     PxTriangleMesh* getCollisionMesh();
     PxConvexMesh* getConvexCollisionMesh();
 
+    // Loads the cooked stream from the collision cache, or cooks it and writes it to the cache.
+    // This does not touch any shared state, so it can be called from worker threads.
+    u64 getCollisionCacheKey(bool convex) const;
+    bool prepareCollisionData(bool convex, u64 key, f64* elapsedTime=nullptr);
+
     void destroy();
 };
 
+struct CollisionMeshRequest
+{
+    Mesh* mesh;
+    bool convex;
+};
+
+// Prepares the cooked collision data of the requested meshes in parallel, so that entities
+// only have to create the PhysX meshes when they are created.
+void prepareCollisionMeshes(Array<CollisionMeshRequest>& requests);
+
 #if 0
 void debugPrintMesh(Mesh const& rhs)
 {
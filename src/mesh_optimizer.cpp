@@ -0,0 +1,1231 @@
+#include "mesh_optimizer.h"
+#include "math.h"
+
+VertexCacheStats analyzeVertexCache(u32 const* indices, u32 indexCount, u32 vertexCount,
+        u32 cacheSize)
+{
+    VertexCacheStats stats;
+    if (indexCount < 3 || vertexCount == 0)
+    {
+        return stats;
+    }
+
+    // a vertex is in the cache if fewer than cacheSize misses happened since it was inserted
+    Array<u32> insertTime;
+    insertTime.resize(vertexCount);
+    for (auto& t : insertTime)
+    {
+        t = UINT32_MAX;
+    }
+    u32 misses = 0;
+    u32 uniqueVertices = 0;
+    for (u32 i=0; i<indexCount; ++i)
+    {
+        u32 v = indices[i];
+        if (insertTime[v] == UINT32_MAX)
+        {
+            ++uniqueVertices;
+        }
+        if (insertTime[v] == UINT32_MAX || misses - insertTime[v] >= cacheSize)
+        {
+            insertTime[v] = misses;
+            ++misses;
+        }
+    }
+
+    stats.acmr = (f32)misses / (f32)(indexCount / 3);
+    stats.atvr = (f32)misses / (f32)uniqueVertices;
+    return stats;
+}
+
+u32 weldVertices(u8* vertices, u32 stride, u32 vertexCount, u32* indices, u32 indexCount)
+{
+    if (vertexCount == 0)
+    {
+        return 0;
+    }
+
+    u32 tableSize = 1;
+    while (tableSize < vertexCount * 2)
+    {
+        tableSize *= 2;
+    }
+    Array<u32> table;
+    table.resize(tableSize);
+    for (auto& entry : table)
+    {
+        entry = UINT32_MAX;
+    }
+
+    Array<u32> remap;
+    remap.resize(vertexCount);
+    u32 newVertexCount = 0;
+    for (u32 i=0; i<vertexCount; ++i)
+    {
+        u8* vertex = vertices + (size_t)i * stride;
+        u32 hash = 2166136261u;
+        for (u32 b=0; b<stride; ++b)
+        {
+            hash = (hash ^ vertex[b]) * 16777619u;
+        }
+
+        u32 slot = hash & (tableSize - 1);
+        for (;;)
+        {
+            u32 existing = table[slot];
+            if (existing == UINT32_MAX)
+            {
+                // unique vertices are compacted in place; the destination is never ahead of
+                // the vertex being read
+                if (newVertexCount != i)
+                {
+                    memcpy(vertices + (size_t)newVertexCount * stride, vertex, stride);
+                }
+                table[slot] = newVertexCount;
+                remap[i] = newVertexCount;
+                ++newVertexCount;
+                break;
+            }
+            if (memcmp(vertices + (size_t)existing * stride, vertex, stride) == 0)
+            {
+                remap[i] = existing;
+                break;
+            }
+            slot = (slot + 1) & (tableSize - 1);
+        }
+    }
+
+    for (u32 i=0; i<indexCount; ++i)
+    {
+        indices[i] = remap[indices[i]];
+    }
+    return newVertexCount;
+}
+
+void optimizeVertexCache(u32* indices, u32 indexCount, u32 vertexCount, u32 cacheSize)
+{
+    u32 triangleCount = indexCount / 3;
+    if (triangleCount == 0 || vertexCount == 0)
+    {
+        return;
+    }
+
+    // vertex -> triangle adjacency
+    Array<u32> liveTriangles;
+    liveTriangles.resize(vertexCount);
+    for (auto& count : liveTriangles)
+    {
+        count = 0;
+    }
+    for (u32 i=0; i<triangleCount*3; ++i)
+    {
+        ++liveTriangles[indices[i]];
+    }
+    Array<u32> adjacencyOffset;
+    adjacencyOffset.resize(vertexCount + 1);
+    adjacencyOffset[0] = 0;
+    for (u32 v=0; v<vertexCount; ++v)
+    {
+        adjacencyOffset[v + 1] = adjacencyOffset[v] + liveTriangles[v];
+    }
+    Array<u32> adjacency;
+    adjacency.resize(triangleCount * 3);
+    Array<u32> fill;
+    fill.assign(adjacencyOffset.begin(), adjacencyOffset.begin() + vertexCount);
+    for (u32 t=0; t<triangleCount; ++t)
+    {
+        for (u32 k=0; k<3; ++k)
+        {
+            u32 v = indices[t * 3 + k];
+            adjacency[fill[v]++] = t;
+        }
+    }
+
+    Array<u32> cacheTime;
+    cacheTime.resize(vertexCount);
+    for (auto& t : cacheTime)
+    {
+        t = 0;
+    }
+    Array<bool> isEmitted;
+    isEmitted.resize(triangleCount);
+    for (auto& e : isEmitted)
+    {
+        e = false;
+    }
+
+    Array<u32> output;
+    output.reserve(triangleCount * 3);
+    Array<u32> deadEnd;
+    Array<u32> candidates;
+    u32 time = cacheSize + 1;
+    u32 cursor = 1;
+    i32 fanningVertex = 0;
+
+    while (fanningVertex >= 0)
+    {
+        // emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        u32 f = (u32)fanningVertex;
+        for (u32 a=adjacencyOffset[f]; a<adjacencyOffset[f + 1]; ++a)
+        {
+            u32 t = adjacency[a];
+            if (isEmitted[t])
+            {
+                continue;
+            }
+            for (u32 k=0; k<3; ++k)
+            {
+                u32 v = indices[t * 3 + k];
+                output.push(v);
+                deadEnd.push(v);
+                candidates.push(v);
+                --liveTriangles[v];
+                if (time - cacheTime[v] > cacheSize)
+                {
+                    cacheTime[v] = time;
+                    ++time;
+                }
+            }
+            isEmitted[t] = true;
+        }
+
+        // the next fanning vertex is the one that will still be in the cache after its
+        // remaining triangles are emitted and has been in it the longest
+        fanningVertex = -1;
+        i32 bestPriority = -1;
+        for (u32 v : candidates)
+        {
+            if (liveTriangles[v] == 0)
+            {
+                continue;
+            }
+            i32 priority = 0;
+            if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+            {
+                priority = (i32)(time - cacheTime[v]);
+            }
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                fanningVertex = (i32)v;
+            }
+        }
+
+        if (fanningVertex < 0)
+        {
+            // dead end: go back to a recently used vertex, or continue with the next vertex in
+            // input order that still has triangles
+            while (!deadEnd.empty())
+            {
+                u32 v = deadEnd.back();
+                deadEnd.pop();
+                if (liveTriangles[v] > 0)
+                {
+                    fanningVertex = (i32)v;
+                    break;
+                }
+            }
+            while (fanningVertex < 0 && cursor < vertexCount)
+            {
+                if (liveTriangles[cursor] > 0)
+                {
+                    fanningVertex = (i32)cursor;
+                }
+                ++cursor;
+            }
+        }
+    }
+
+    assert(output.size() == triangleCount * 3);
+    memcpy(indices, output.data(), output.size() * sizeof(u32));
+}
+
+static Vec3 overdrawPosition(f32 const* positions, u32 positionStride, u32 v)
+{
+    f32 const* p = (f32 const*)((u8 const*)positions + (size_t)v * positionStride);
+    return Vec3(p[0], p[1], p[2]);
+}
+
+void optimizeOverdraw(u32* indices, u32 indexCount, f32 const* positions, u32 vertexCount,
+        u32 positionStride, u32 cacheSize, f32 threshold)
+{
+    u32 triangleCount = indexCount / 3;
+    if (triangleCount == 0 || vertexCount == 0)
+    {
+        return;
+    }
+
+    // same FIFO simulation as analyzeVertexCache; adding cacheSize to the miss counter empties
+    // the cache
+    Array<u32> insertTime;
+    insertTime.resize(vertexCount);
+    for (auto& t : insertTime)
+    {
+        t = UINT32_MAX;
+    }
+    u32 misses = 0;
+    auto simulateTriangle = [&](u32 t) {
+        u32 triangleMisses = 0;
+        for (u32 k=0; k<3; ++k)
+        {
+            u32 v = indices[t * 3 + k];
+            if (insertTime[v] == UINT32_MAX || misses - insertTime[v] >= cacheSize)
+            {
+                insertTime[v] = misses;
+                ++misses;
+                ++triangleMisses;
+            }
+        }
+        return triangleMisses;
+    };
+
+    // the cache order restarts wherever a triangle misses on all of its vertices
+    Array<u32> hardStarts;
+    for (u32 t=0; t<triangleCount; ++t)
+    {
+        if (simulateTriangle(t) == 3 || t == 0)
+        {
+            hardStarts.push(t);
+        }
+    }
+    hardStarts.push(triangleCount);
+
+    // split further wherever starting over with an empty cache costs little
+    Array<u32> clusterStarts;
+    for (u32 h=0; h+1<hardStarts.size(); ++h)
+    {
+        u32 start = hardStarts[h];
+        u32 end = hardStarts[h + 1];
+        misses += cacheSize;
+        u32 clusterMisses = 0;
+        for (u32 t=start; t<end; ++t)
+        {
+            clusterMisses += simulateTriangle(t);
+        }
+        f32 clusterThreshold = threshold * (f32)clusterMisses / (f32)(end - start);
+
+        misses += cacheSize;
+        clusterStarts.push(start);
+        u32 runMisses = 0;
+        u32 runTriangles = 0;
+        for (u32 t=start; t<end; ++t)
+        {
+            runMisses += simulateTriangle(t);
+            ++runTriangles;
+            if (t + 1 < end && (f32)runMisses <= clusterThreshold * (f32)runTriangles)
+            {
+                clusterStarts.push(t + 1);
+                misses += cacheSize;
+                runMisses = 0;
+                runTriangles = 0;
+            }
+        }
+    }
+    clusterStarts.push(triangleCount);
+    u32 clusterCount = clusterStarts.size() - 1;
+
+    Vec3 meshCenter(0.f);
+    u32 usedVertexCount = 0;
+    Array<bool> isCounted;
+    isCounted.resize(vertexCount);
+    for (auto& c : isCounted)
+    {
+        c = false;
+    }
+    for (u32 i=0; i<triangleCount*3; ++i)
+    {
+        if (!isCounted[indices[i]])
+        {
+            isCounted[indices[i]] = true;
+            meshCenter = meshCenter + overdrawPosition(positions, positionStride, indices[i]);
+            ++usedVertexCount;
+        }
+    }
+    meshCenter = meshCenter / (f32)usedVertexCount;
+
+    // clusters whose area weighted normal points away from the center are likely to be in
+    // front of the others from any view
+    Array<f32> sortKeys;
+    sortKeys.resize(clusterCount);
+    for (u32 c=0; c<clusterCount; ++c)
+    {
+        Vec3 centroid(0.f);
+        Vec3 normal(0.f);
+        f32 area = 0.f;
+        for (u32 t=clusterStarts[c]; t<clusterStarts[c + 1]; ++t)
+        {
+            Vec3 p0 = overdrawPosition(positions, positionStride, indices[t * 3 + 0]);
+            Vec3 p1 = overdrawPosition(positions, positionStride, indices[t * 3 + 1]);
+            Vec3 p2 = overdrawPosition(positions, positionStride, indices[t * 3 + 2]);
+            Vec3 n = cross(p1 - p0, p2 - p0);
+            f32 triangleArea = length(n);
+            centroid = centroid + (p0 + p1 + p2) * (triangleArea / 3.f);
+            normal = normal + n;
+            area += triangleArea;
+        }
+        f32 normalLength = length(normal);
+        sortKeys[c] = area > 0.f && normalLength > 0.f
+            ? dot(centroid / area - meshCenter, normal / normalLength) : 0.f;
+    }
+
+    // ties keep the cache order
+    Array<u32> clusterOrder;
+    for (u32 c=0; c<clusterCount; ++c)
+    {
+        clusterOrder.push(c);
+    }
+    clusterOrder.sort([&](u32 a, u32 b) {
+        if (sortKeys[a] != sortKeys[b])
+        {
+            return sortKeys[a] > sortKeys[b];
+        }
+        return a < b;
+    });
+
+    Array<u32> output;
+    output.reserve(triangleCount * 3);
+    for (u32 c : clusterOrder)
+    {
+        for (u32 i=clusterStarts[c]*3; i<clusterStarts[c + 1]*3; ++i)
+        {
+            output.push(indices[i]);
+        }
+    }
+    memcpy(indices, output.data(), output.size() * sizeof(u32));
+}
+
+u32 optimizeVertexFetch(u8* vertices, u32 stride, u32 vertexCount, u32* indices, u32 indexCount)
+{
+    Array<u32> remap;
+    remap.resize(vertexCount);
+    for (auto& r : remap)
+    {
+        r = UINT32_MAX;
+    }
+
+    Array<u8> reordered;
+    reordered.resize(vertexCount * stride);
+    u32 newVertexCount = 0;
+    for (u32 i=0; i<indexCount; ++i)
+    {
+        u32 v = indices[i];
+        if (remap[v] == UINT32_MAX)
+        {
+            memcpy(reordered.data() + (size_t)newVertexCount * stride,
+                    vertices + (size_t)v * stride, stride);
+            remap[v] = newVertexCount++;
+        }
+        indices[i] = remap[v];
+    }
+
+    memcpy(vertices, reordered.data(), (size_t)newVertexCount * stride);
+    return newVertexCount;
+}
+
+// plane quadric of the simplifier: the symmetric 4x4 matrix of summed plane equations, weighted
+// by the area of the triangles that contributed them
+struct SimplifyQuadric
+{
+    f64 a2 = 0, b2 = 0, c2 = 0, ab = 0, ac = 0, bc = 0, ad = 0, bd = 0, cd = 0, d2 = 0;
+    f64 weight = 0;
+
+    void addPlane(Vec3 const& n, f64 d, f64 w)
+    {
+        a2 += w * n.x * n.x; b2 += w * n.y * n.y; c2 += w * n.z * n.z;
+        ab += w * n.x * n.y; ac += w * n.x * n.z; bc += w * n.y * n.z;
+        ad += w * n.x * d; bd += w * n.y * d; cd += w * n.z * d;
+        d2 += w * d * d;
+        weight += w;
+    }
+
+    void add(SimplifyQuadric const& q)
+    {
+        a2 += q.a2; b2 += q.b2; c2 += q.c2; ab += q.ab; ac += q.ac; bc += q.bc;
+        ad += q.ad; bd += q.bd; cd += q.cd; d2 += q.d2;
+        weight += q.weight;
+    }
+
+    // summed squared distance of p to all the planes
+    f64 evaluate(Vec3 const& p) const
+    {
+        f64 x = p.x, y = p.y, z = p.z;
+        f64 r = a2 * x * x + b2 * y * y + c2 * z * z
+            + 2.0 * (ab * x * y + ac * x * z + bc * y * z)
+            + 2.0 * (ad * x + bd * y + cd * z) + d2;
+        return r > 0.0 ? r : 0.0;
+    }
+};
+
+struct SimplifyCollapse
+{
+    u32 from;
+    u32 to;
+    f32 error;
+};
+
+static Vec3 simplifyPosition(f32 const* positions, u32 positionStride, u32 v)
+{
+    f32 const* p = (f32 const*)((u8 const*)positions + (size_t)v * positionStride);
+    return Vec3(p[0], p[1], p[2]);
+}
+
+// Marks vertices that must not be moved by the simplifier: vertices that share their position
+// with another vertex (attribute seams) and vertices on open or non-manifold edges.
+static void findLockedVertices(u32 const* indices, u32 indexCount, f32 const* positions,
+        u32 vertexCount, u32 positionStride, Array<u32> const& adjacencyOffset,
+        Array<u32> const& adjacency, Array<bool>& locked)
+{
+    locked.resize(vertexCount);
+    for (auto& l : locked)
+    {
+        l = false;
+    }
+
+    u32 tableSize = 1;
+    while (tableSize < vertexCount * 2)
+    {
+        tableSize *= 2;
+    }
+    Array<u32> table;
+    table.resize(tableSize);
+    for (auto& entry : table)
+    {
+        entry = UINT32_MAX;
+    }
+    for (u32 v=0; v<vertexCount; ++v)
+    {
+        f32 const* p = (f32 const*)((u8 const*)positions + (size_t)v * positionStride);
+        u32 hash = 2166136261u;
+        for (u32 b=0; b<sizeof(f32) * 3; ++b)
+        {
+            hash = (hash ^ ((u8 const*)p)[b]) * 16777619u;
+        }
+        u32 slot = hash & (tableSize - 1);
+        for (;;)
+        {
+            u32 existing = table[slot];
+            if (existing == UINT32_MAX)
+            {
+                table[slot] = v;
+                break;
+            }
+            f32 const* e = (f32 const*)((u8 const*)positions + (size_t)existing * positionStride);
+            if (memcmp(e, p, sizeof(f32) * 3) == 0)
+            {
+                locked[existing] = true;
+                locked[v] = true;
+                break;
+            }
+            slot = (slot + 1) & (tableSize - 1);
+        }
+    }
+
+    // an interior edge of a consistently wound manifold is used exactly once in each direction
+    for (u32 i=0; i<indexCount; ++i)
+    {
+        u32 a = indices[i];
+        u32 b = indices[i - i % 3 + (i + 1) % 3];
+        u32 forward = 0;
+        u32 backward = 0;
+        for (u32 j=adjacencyOffset[a]; j<adjacencyOffset[a + 1]; ++j)
+        {
+            u32 const* tri = indices + adjacency[j] * 3;
+            for (u32 k=0; k<3; ++k)
+            {
+                if (tri[k] == a && tri[(k + 1) % 3] == b) { ++forward; }
+                if (tri[k] == b && tri[(k + 1) % 3] == a) { ++backward; }
+            }
+        }
+        if (forward != 1 || backward != 1)
+        {
+            locked[a] = true;
+            locked[b] = true;
+        }
+    }
+}
+
+static void buildTriangleAdjacency(u32 const* indices, u32 indexCount, u32 vertexCount,
+        Array<u32>& adjacencyOffset, Array<u32>& adjacency)
+{
+    adjacencyOffset.resize(vertexCount + 1);
+    for (auto& offset : adjacencyOffset)
+    {
+        offset = 0;
+    }
+    for (u32 i=0; i<indexCount; ++i)
+    {
+        ++adjacencyOffset[indices[i] + 1];
+    }
+    for (u32 v=0; v<vertexCount; ++v)
+    {
+        adjacencyOffset[v + 1] += adjacencyOffset[v];
+    }
+    adjacency.resize(indexCount);
+    Array<u32> fill;
+    fill.assign(adjacencyOffset.begin(), adjacencyOffset.begin() + vertexCount);
+    for (u32 i=0; i<indexCount; ++i)
+    {
+        adjacency[fill[indices[i]]++] = i / 3;
+    }
+}
+
+u32 simplifyMesh(u32* destination, u32 const* indices, u32 indexCount,
+        f32 const* positions, u32 vertexCount, u32 positionStride, u32 targetIndexCount,
+        f32* resultError)
+{
+    indexCount -= indexCount % 3;
+    memcpy(destination, indices, indexCount * sizeof(u32));
+    if (resultError)
+    {
+        *resultError = 0.f;
+    }
+    if (indexCount <= targetIndexCount || vertexCount == 0)
+    {
+        return indexCount;
+    }
+
+    Array<u32> adjacencyOffset;
+    Array<u32> adjacency;
+    buildTriangleAdjacency(destination, indexCount, vertexCount, adjacencyOffset, adjacency);
+
+    Array<bool> locked;
+    findLockedVertices(destination, indexCount, positions, vertexCount, positionStride,
+            adjacencyOffset, adjacency, locked);
+
+    Array<SimplifyQuadric> quadrics;
+    quadrics.resize(vertexCount);
+    for (u32 i=0; i<indexCount; i+=3)
+    {
+        Vec3 p0 = simplifyPosition(positions, positionStride, destination[i + 0]);
+        Vec3 p1 = simplifyPosition(positions, positionStride, destination[i + 1]);
+        Vec3 p2 = simplifyPosition(positions, positionStride, destination[i + 2]);
+        Vec3 n = cross(p1 - p0, p2 - p0);
+        f32 area = length(n);
+        if (area <= 0.f)
+        {
+            continue;
+        }
+        n = n / area;
+        f64 d = -dot(n, p0);
+        for (u32 k=0; k<3; ++k)
+        {
+            quadrics[destination[i + k]].addPlane(n, d, area * 0.5f);
+        }
+    }
+
+    Array<u32> remap;
+    remap.resize(vertexCount);
+    Array<bool> touched;
+    touched.resize(vertexCount);
+    Array<SimplifyCollapse> collapses;
+    f32 maxError = 0.f;
+
+    // every pass collapses the cheapest edges whose neighbourhoods don't overlap, then the
+    // adjacency is rebuilt for the next pass
+    while (indexCount > targetIndexCount)
+    {
+        collapses.clear();
+        for (u32 i=0; i<indexCount; ++i)
+        {
+            u32 from = destination[i];
+            u32 to = destination[i - i % 3 + (i + 1) % 3];
+            if (locked[from])
+            {
+                continue;
+            }
+            SimplifyQuadric q = quadrics[from];
+            q.add(quadrics[to]);
+            f64 error = q.weight > 0.0
+                ? q.evaluate(simplifyPosition(positions, positionStride, to)) / q.weight : 0.0;
+            collapses.push({ from, to, (f32)sqrt(error) });
+        }
+        if (collapses.empty())
+        {
+            break;
+        }
+        collapses.sort([](SimplifyCollapse const& a, SimplifyCollapse const& b) {
+            return a.error < b.error;
+        });
+
+        for (u32 v=0; v<vertexCount; ++v)
+        {
+            remap[v] = v;
+            touched[v] = false;
+        }
+
+        u32 trianglesToRemove = (indexCount - targetIndexCount) / 3;
+        u32 removedTriangles = 0;
+        u32 collapseCount = 0;
+        for (auto& c : collapses)
+        {
+            if (removedTriangles >= trianglesToRemove)
+            {
+                break;
+            }
+            if (touched[c.from] || touched[c.to])
+            {
+                continue;
+            }
+
+            // reject collapses that would flip or flatten any of the remaining triangles
+            Vec3 target = simplifyPosition(positions, positionStride, c.to);
+            bool isValid = true;
+            u32 collapsedTriangles = 0;
+            for (u32 j=adjacencyOffset[c.from]; j<adjacencyOffset[c.from + 1]; ++j)
+            {
+                u32 const* tri = destination + adjacency[j] * 3;
+                if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+                {
+                    ++collapsedTriangles;
+                    continue;
+                }
+                Vec3 p[3], q[3];
+                for (u32 k=0; k<3; ++k)
+                {
+                    p[k] = simplifyPosition(positions, positionStride, tri[k]);
+                    q[k] = tri[k] == c.from ? target : p[k];
+                }
+                Vec3 before = cross(p[1] - p[0], p[2] - p[0]);
+                Vec3 after = cross(q[1] - q[0], q[2] - q[0]);
+                if (dot(before, after) <= 0.25f * length(before) * length(after))
+                {
+                    isValid = false;
+                    break;
+                }
+            }
+            if (!isValid || collapsedTriangles == 0)
+            {
+                continue;
+            }
+
+            // the endpoints may only share the neighbours opposite to the collapsed edge,
+            // otherwise the collapse would pinch the surface into a non-manifold edge
+            u32 sharedNeighbors = 0;
+            for (u32 j=adjacencyOffset[c.from]; j<adjacencyOffset[c.from + 1] && isValid; ++j)
+            {
+                u32 const* tri = destination + adjacency[j] * 3;
+                for (u32 k=0; k<3; ++k)
+                {
+                    u32 n = tri[k];
+                    if (n == c.from || n == c.to)
+                    {
+                        continue;
+                    }
+                    // count each shared neighbour once, from its first triangle around c.from
+                    bool isFirst = true;
+                    for (u32 m=adjacencyOffset[c.from]; m<j && isFirst; ++m)
+                    {
+                        u32 const* other = destination + adjacency[m] * 3;
+                        isFirst = other[0] != n && other[1] != n && other[2] != n;
+                    }
+                    if (!isFirst)
+                    {
+                        continue;
+                    }
+                    for (u32 m=adjacencyOffset[c.to]; m<adjacencyOffset[c.to + 1]; ++m)
+                    {
+                        u32 const* other = destination + adjacency[m] * 3;
+                        if (other[0] == n || other[1] == n || other[2] == n)
+                        {
+                            ++sharedNeighbors;
+                            break;
+                        }
+                    }
+                }
+            }
+            if (sharedNeighbors != collapsedTriangles)
+            {
+                continue;
+            }
+
+            remap[c.from] = c.to;
+            quadrics[c.to].add(quadrics[c.from]);
+            for (u32 j=adjacencyOffset[c.from]; j<adjacencyOffset[c.from + 1]; ++j)
+            {
+                u32 const* tri = destination + adjacency[j] * 3;
+                touched[tri[0]] = true;
+                touched[tri[1]] = true;
+                touched[tri[2]] = true;
+            }
+            removedTriangles += collapsedTriangles;
+            maxError = max(maxError, c.error);
+            ++collapseCount;
+        }
+
+        if (collapseCount == 0)
+        {
+            break;
+        }
+
+        u32 writeIndex = 0;
+        for (u32 i=0; i<indexCount; i+=3)
+        {
+            u32 a = remap[destination[i + 0]];
+            u32 b = remap[destination[i + 1]];
+            u32 c = remap[destination[i + 2]];
+            if (a != b && b != c && a != c)
+            {
+                destination[writeIndex++] = a;
+                destination[writeIndex++] = b;
+                destination[writeIndex++] = c;
+            }
+        }
+        indexCount = writeIndex;
+        buildTriangleAdjacency(destination, indexCount, vertexCount, adjacencyOffset, adjacency);
+    }
+
+    if (resultError)
+    {
+        *resultError = maxError;
+    }
+    return indexCount;
+}
+
+// a triangle of the check grid by its vertex positions, rotated so that the smallest position
+// comes first (the optimizers may rotate triangles but never flip them)
+struct CheckTriangle
+{
+    u32 v[3];
+
+    bool operator<(CheckTriangle const& other) const
+    {
+        for (u32 i=0; i<3; ++i)
+        {
+            if (v[i] != other.v[i])
+            {
+                return v[i] < other.v[i];
+            }
+        }
+        return false;
+    }
+
+    bool operator==(CheckTriangle const& other) const
+    {
+        return v[0] == other.v[0] && v[1] == other.v[1] && v[2] == other.v[2];
+    }
+};
+
+static void getCheckTriangles(Vec3 const* vertices, u32 const* indices, u32 indexCount,
+        u32 gridSize, Array<CheckTriangle>& output)
+{
+    output.clear();
+    for (u32 i=0; i<indexCount; i+=3)
+    {
+        CheckTriangle t;
+        for (u32 j=0; j<3; ++j)
+        {
+            Vec3 const& p = vertices[indices[i + j]];
+            t.v[j] = (u32)p.y * (gridSize + 1) + (u32)p.x;
+        }
+        while (t.v[0] > t.v[1] || t.v[0] > t.v[2])
+        {
+            u32 first = t.v[0];
+            t.v[0] = t.v[1];
+            t.v[1] = t.v[2];
+            t.v[2] = first;
+        }
+        output.push(t);
+    }
+    output.sort();
+}
+
+void checkVertexCacheOptimization()
+{
+    struct CacheCase
+    {
+        const char* name;
+        u32 indices[9];
+        u32 indexCount;
+        u32 vertexCount;
+        u32 cacheSize;
+        f32 acmr;
+        f32 atvr;
+    };
+    CacheCase cases[] = {
+        { "triangle", { 0, 1, 2 }, 3, 3, 16, 3.f, 1.f },
+        { "quad", { 0, 1, 2, 2, 1, 3 }, 6, 4, 16, 2.f, 1.f },
+        // the third triangle was pushed out of a 3 entry cache by the second one
+        { "evicted", { 0, 1, 2, 3, 4, 5, 0, 1, 2 }, 9, 6, 3, 3.f, 1.5f },
+        { "reused", { 0, 1, 2, 3, 4, 5, 0, 1, 2 }, 9, 6, 16, 2.f, 1.f },
+    };
+    bool failed = false;
+    for (auto& c : cases)
+    {
+        VertexCacheStats stats = analyzeVertexCache(c.indices, c.indexCount, c.vertexCount,
+                c.cacheSize);
+        if (absolute(stats.acmr - c.acmr) > 0.001f || absolute(stats.atvr - c.atvr) > 0.001f)
+        {
+            error("Vertex cache analysis of \"%s\" is off: ACMR %.3f != %.3f, ATVR %.3f != %.3f",
+                    c.name, stats.acmr, c.acmr, stats.atvr, c.atvr);
+            failed = true;
+        }
+    }
+
+    // every triangle of the grid gets its own vertices, like a mesh exported without indices
+    const u32 gridSize = 100;
+    Array<u32> cornerIndices;
+    for (u32 y=0; y<gridSize; ++y)
+    {
+        for (u32 x=0; x<gridSize; ++x)
+        {
+            u32 i = y * (gridSize + 1) + x;
+            u32 quad[] = { i, i + 1, i + gridSize + 2, i, i + gridSize + 2, i + gridSize + 1 };
+            for (u32 corner : quad)
+            {
+                cornerIndices.push(corner);
+            }
+        }
+    }
+    u32 indexCount = cornerIndices.size();
+    u32 triangleCount = indexCount / 3;
+
+    RandomSeries series;
+    Array<u32> triangleOrder;
+    for (u32 i=0; i<triangleCount; ++i)
+    {
+        triangleOrder.push(i);
+    }
+    for (u32 i=triangleCount-1; i>0; --i)
+    {
+        u32 j = xorshift32(series) % (i + 1);
+        u32 tmp = triangleOrder[i];
+        triangleOrder[i] = triangleOrder[j];
+        triangleOrder[j] = tmp;
+    }
+
+    Array<Vec3> vertices;
+    Array<u32> indices;
+    for (u32 triangle : triangleOrder)
+    {
+        for (u32 j=0; j<3; ++j)
+        {
+            u32 corner = cornerIndices[triangle * 3 + j];
+            indices.push(vertices.size());
+            vertices.push(Vec3((f32)(corner % (gridSize + 1)), (f32)(corner / (gridSize + 1)), 0.f));
+        }
+    }
+
+    Array<CheckTriangle> trianglesBefore;
+    getCheckTriangles(vertices.data(), indices.data(), indexCount, gridSize, trianglesBefore);
+
+    f64 startTime = getTime();
+    u32 stride = sizeof(Vec3);
+    u32 vertexCount = weldVertices((u8*)vertices.data(), stride, vertices.size(),
+            indices.data(), indexCount);
+    VertexCacheStats before = analyzeVertexCache(indices.data(), indexCount, vertexCount);
+    optimizeVertexCache(indices.data(), indexCount, vertexCount);
+    optimizeOverdraw(indices.data(), indexCount, (f32*)vertices.data(), vertexCount, stride);
+    vertexCount = optimizeVertexFetch((u8*)vertices.data(), stride, vertexCount,
+            indices.data(), indexCount);
+    f64 optimizeTime = getTime() - startTime;
+    VertexCacheStats after = analyzeVertexCache(indices.data(), indexCount, vertexCount);
+
+    u32 expectedVertexCount = (gridSize + 1) * (gridSize + 1);
+    if (vertexCount != expectedVertexCount)
+    {
+        error("Vertex cache optimization left %u vertices instead of %u", vertexCount,
+                expectedVertexCount);
+        failed = true;
+    }
+    for (u32 i=0; i<indexCount; ++i)
+    {
+        if (indices[i] >= vertexCount)
+        {
+            error("Vertex cache optimization produced out of range index %u", indices[i]);
+            return;
+        }
+    }
+
+    Array<CheckTriangle> trianglesAfter;
+    getCheckTriangles(vertices.data(), indices.data(), indexCount, gridSize, trianglesAfter);
+    for (u32 i=0; i<triangleCount; ++i)
+    {
+        if (!(trianglesBefore[i] == trianglesAfter[i]))
+        {
+            error("Vertex cache optimization changed the triangles of the grid");
+            failed = true;
+            break;
+        }
+    }
+
+    // an ideal order of a big grid transforms each vertex once for every two triangles
+    if (after.acmr > 0.75f || after.acmr >= before.acmr)
+    {
+        error("Vertex cache optimization of the grid reached an ACMR of %.3f (from %.3f)",
+                after.acmr, before.acmr);
+        failed = true;
+    }
+    if (after.atvr > 1.5f)
+    {
+        error("Vertex cache optimization of the grid reached an ATVR of %.3f", after.atvr);
+        failed = true;
+    }
+
+    // two nested boxes whose faces are separate grids, shuffled together; the outer box hides
+    // the inner one from every side, so all of its triangles should be drawn first
+    const u32 faceGridSize = 8;
+    Array<Vec3> boxVertices;
+    Array<u32> boxCornerIndices;
+    for (u32 shell=0; shell<2; ++shell)
+    {
+        f32 halfSize = shell == 0 ? 2.f : 1.f;
+        for (u32 face=0; face<6; ++face)
+        {
+            u32 axis = face / 2;
+            f32 side = (face & 1) ? 1.f : -1.f;
+            u32 firstVertex = boxVertices.size();
+            for (u32 y=0; y<=faceGridSize; ++y)
+            {
+                for (u32 x=0; x<=faceGridSize; ++x)
+                {
+                    f32 u = ((f32)x / faceGridSize * 2.f - 1.f) * halfSize;
+                    f32 w = ((f32)y / faceGridSize * 2.f - 1.f) * halfSize;
+                    f32 p[3];
+                    p[axis] = side * halfSize;
+                    p[(axis + 1) % 3] = u;
+                    p[(axis + 2) % 3] = w * side;
+                    boxVertices.push(Vec3(p[0], p[1], p[2]));
+                }
+            }
+            for (u32 y=0; y<faceGridSize; ++y)
+            {
+                for (u32 x=0; x<faceGridSize; ++x)
+                {
+                    u32 i = firstVertex + y * (faceGridSize + 1) + x;
+                    u32 quad[] = { i, i + 1, i + faceGridSize + 2,
+                        i, i + faceGridSize + 2, i + faceGridSize + 1 };
+                    for (u32 corner : quad)
+                    {
+                        boxCornerIndices.push(corner);
+                    }
+                }
+            }
+        }
+    }
+    u32 boxTriangleCount = boxCornerIndices.size() / 3;
+    u32 outerTriangleCount = boxTriangleCount / 2;
+    Array<u32> boxIndices;
+    boxIndices.reserve(boxCornerIndices.size());
+    for (u32 i=boxTriangleCount-1; i>0; --i)
+    {
+        u32 j = xorshift32(series) % (i + 1);
+        for (u32 k=0; k<3; ++k)
+        {
+            u32 tmp = boxCornerIndices[i * 3 + k];
+            boxCornerIndices[i * 3 + k] = boxCornerIndices[j * 3 + k];
+            boxCornerIndices[j * 3 + k] = tmp;
+        }
+    }
+    for (u32 index : boxCornerIndices)
+    {
+        boxIndices.push(index);
+    }
+    optimizeVertexCache(boxIndices.data(), boxIndices.size(), boxVertices.size());
+    VertexCacheStats boxBefore = analyzeVertexCache(boxIndices.data(), boxIndices.size(),
+            boxVertices.size());
+    optimizeOverdraw(boxIndices.data(), boxIndices.size(), (f32*)boxVertices.data(),
+            boxVertices.size(), sizeof(Vec3));
+    VertexCacheStats boxAfter = analyzeVertexCache(boxIndices.data(), boxIndices.size(),
+            boxVertices.size());
+
+    // the outer box's vertices come first in the vertex buffer
+    u32 outerVertexCount = boxVertices.size() / 2;
+    u32 outerTrianglesDrawn = 0;
+    for (u32 t=0; t<boxTriangleCount; ++t)
+    {
+        if (boxIndices[t * 3] < outerVertexCount)
+        {
+            if (outerTrianglesDrawn != t)
+            {
+                error("Overdraw optimization drew an inner triangle before outer triangle %u", t);
+                failed = true;
+                break;
+            }
+            ++outerTrianglesDrawn;
+        }
+    }
+    if (outerTrianglesDrawn != outerTriangleCount && !failed)
+    {
+        error("Overdraw optimization kept %u of %u outer triangles", outerTrianglesDrawn,
+                outerTriangleCount);
+        failed = true;
+    }
+    if (boxAfter.acmr > boxBefore.acmr * 1.1f)
+    {
+        error("Overdraw optimization raised the ACMR of the boxes from %.3f to %.3f",
+                boxBefore.acmr, boxAfter.acmr);
+        failed = true;
+    }
+
+    if (!failed)
+    {
+        println("Vertex cache optimization of %u triangles: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f in %.2fms",
+                triangleCount, before.acmr, after.acmr, before.atvr, after.atvr,
+                optimizeTime * 1000.0);
+        println("Overdraw optimization of the nested boxes: ACMR %.3f -> %.3f",
+                boxBefore.acmr, boxAfter.acmr);
+    }
+}
+
+// height of the triangles of a simplified heightfield above pos, or FLT_MAX if none covers it
+static f32 getSimplifiedHeight(Vec3 const* vertices, u32 const* indices, u32 indexCount, Vec3 pos)
+{
+    for (u32 i=0; i<indexCount; i+=3)
+    {
+        Vec3 a = vertices[indices[i + 0]];
+        Vec3 b = vertices[indices[i + 1]];
+        Vec3 c = vertices[indices[i + 2]];
+        f32 area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+        if (absolute(area) < 0.000001f)
+        {
+            continue;
+        }
+        f32 u = ((b.x - pos.x) * (c.y - pos.y) - (c.x - pos.x) * (b.y - pos.y)) / area;
+        f32 v = ((c.x - pos.x) * (a.y - pos.y) - (a.x - pos.x) * (c.y - pos.y)) / area;
+        f32 w = 1.f - u - v;
+        const f32 epsilon = -0.0001f;
+        if (u >= epsilon && v >= epsilon && w >= epsilon)
+        {
+            return a.z * u + b.z * v + c.z * w;
+        }
+    }
+    return FLT_MAX;
+}
+
+void checkMeshSimplification()
+{
+    const u32 gridSize = 32;
+    Array<u32> indices;
+    for (u32 y=0; y<gridSize; ++y)
+    {
+        for (u32 x=0; x<gridSize; ++x)
+        {
+            u32 i = y * (gridSize + 1) + x;
+            u32 quad[] = { i, i + 1, i + gridSize + 2, i, i + gridSize + 2, i + gridSize + 1 };
+            for (u32 corner : quad)
+            {
+                indices.push(corner);
+            }
+        }
+    }
+    u32 indexCount = indices.size();
+
+    bool failed = false;
+    Array<u32> simplified;
+    simplified.resize(indexCount);
+
+    // a flat grid loses all of its inner vertices without any error, but the locked border
+    // keeps its outline and area
+    Array<Vec3> flat;
+    for (u32 y=0; y<=gridSize; ++y)
+    {
+        for (u32 x=0; x<=gridSize; ++x)
+        {
+            flat.push(Vec3((f32)x, (f32)y, 0.f));
+        }
+    }
+    u32 flatTarget = indexCount / 4 / 3 * 3;
+    f32 flatError = 0.f;
+    u32 flatCount = simplifyMesh(simplified.data(), indices.data(), indexCount,
+            (f32*)flat.data(), flat.size(), sizeof(Vec3), flatTarget, &flatError);
+    f32 flatArea = 0.f;
+    for (u32 i=0; i<flatCount; i+=3)
+    {
+        Vec3 n = cross(flat[simplified[i + 1]] - flat[simplified[i]],
+                flat[simplified[i + 2]] - flat[simplified[i]]);
+        if (n.z <= 0.f)
+        {
+            error("Mesh simplification flipped a triangle of the flat grid");
+            failed = true;
+            break;
+        }
+        flatArea += n.z * 0.5f;
+    }
+    if (flatCount > flatTarget || flatCount == 0)
+    {
+        error("Mesh simplification left %u of %u indices of the flat grid (target %u)",
+                flatCount, indexCount, flatTarget);
+        failed = true;
+    }
+    if (flatError > 0.0001f)
+    {
+        error("Mesh simplification of the flat grid reported an error of %f", flatError);
+        failed = true;
+    }
+    if (absolute(flatArea - (f32)(gridSize * gridSize)) > 0.01f)
+    {
+        error("Mesh simplification changed the area of the flat grid from %u to %f",
+                gridSize * gridSize, flatArea);
+        failed = true;
+    }
+
+    // hills: halving the triangles again must not lower the error, and both the reported error
+    // and the distance of the simplified surface to every original vertex have to stay small
+    const f32 amplitude = 1.f;
+    Array<Vec3> hills;
+    for (u32 y=0; y<=gridSize; ++y)
+    {
+        for (u32 x=0; x<=gridSize; ++x)
+        {
+            f32 z = sinf(x * 0.3f) * cosf(y * 0.2f) * amplitude;
+            hills.push(Vec3((f32)x, (f32)y, z));
+        }
+    }
+    f32 previousError = 0.f;
+    f32 maxAllowedDeviation[] = { 0.1f, 0.25f };
+    u32 counts[2] = {};
+    f32 errors[2] = {};
+    f32 deviations[2] = {};
+    for (u32 level=0; level<2; ++level)
+    {
+        u32 target = (indexCount >> (level + 1)) / 3 * 3;
+        f32 levelError = 0.f;
+        u32 count = simplifyMesh(simplified.data(), indices.data(), indexCount,
+                (f32*)hills.data(), hills.size(), sizeof(Vec3), target, &levelError);
+        if (count > target || count == 0)
+        {
+            error("Mesh simplification left %u of %u indices of the hills (target %u)",
+                    count, indexCount, target);
+            failed = true;
+        }
+        if (levelError <= 0.f || levelError < previousError
+                || levelError > maxAllowedDeviation[level])
+        {
+            error("Mesh simplification of the hills reported an error of %f after %f",
+                    levelError, previousError);
+            failed = true;
+        }
+
+        f32 maxDeviation = 0.f;
+        for (Vec3 const& p : hills)
+        {
+            f32 z = getSimplifiedHeight(hills.data(), simplified.data(), count, p);
+            if (z == FLT_MAX)
+            {
+                error("Mesh simplification left a hole under %.0f, %.0f", p.x, p.y);
+                failed = true;
+                break;
+            }
+            maxDeviation = max(maxDeviation, absolute(z - p.z));
+        }
+        if (maxDeviation > maxAllowedDeviation[level])
+        {
+            error("Mesh simplification of the hills strays %f from the original vertices "
+                    "at %u indices (allowed %f)", maxDeviation, count, maxAllowedDeviation[level]);
+            failed = true;
+        }
+        counts[level] = count;
+        errors[level] = levelError;
+        deviations[level] = maxDeviation;
+        previousError = levelError;
+    }
+
+    if (!failed)
+    {
+        println("Mesh simplification: flat grid %u -> %u triangles, hills %u -> %u / %u "
+                "triangles with errors %.4f / %.4f and deviations %.4f / %.4f",
+                indexCount / 3, flatCount / 3, indexCount / 3, counts[0] / 3, counts[1] / 3,
+                errors[0], errors[1], deviations[0], deviations[1]);
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "misc.h"
+
+// size of the simulated post-transform vertex cache
+const u32 VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStats
+{
+    // average cache miss ratio: vertices transformed per triangle (0.5 is ideal for big grids)
+    f32 acmr = 0.f;
+    // average transform to vertex ratio: vertices transformed per unique vertex (1.0 is ideal)
+    f32 atvr = 0.f;
+};
+
+// Simulates a FIFO vertex cache over the index buffer.
+VertexCacheStats analyzeVertexCache(u32 const* indices, u32 indexCount, u32 vertexCount,
+        u32 cacheSize=VERTEX_CACHE_SIZE);
+
+// Merges vertices with identical data and rewrites the indices. Returns the new vertex count.
+u32 weldVertices(u8* vertices, u32 stride, u32 vertexCount, u32* indices, u32 indexCount);
+
+// Reorders triangles for post-transform cache reuse using Tipsify (Sander, Nehab, Barczak,
+// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007).
+void optimizeVertexCache(u32* indices, u32 indexCount, u32 vertexCount,
+        u32 cacheSize=VERTEX_CACHE_SIZE);
+
+// Reorders the clusters of a cache optimized index buffer so that triangles facing away from
+// the center of the mesh are drawn first and occlude the ones behind them (the overdraw pass of
+// Tipsify). Clusters are split where the cache order restarts and wherever the ACMR so far is
+// within threshold of the enclosing cluster's, so the ACMR grows by at most about threshold.
+void optimizeOverdraw(u32* indices, u32 indexCount, f32 const* positions, u32 vertexCount,
+        u32 positionStride, u32 cacheSize=VERTEX_CACHE_SIZE, f32 threshold=1.05f);
+
+// Reorders vertices in the order they are first referenced so that vertex fetches are mostly
+// sequential, and drops vertices that aren't referenced. Returns the new vertex count.
+u32 optimizeVertexFetch(u8* vertices, u32 stride, u32 vertexCount, u32* indices, u32 indexCount);
+
+// Reduces the triangle count towards targetIndexCount by collapsing edges in order of their
+// quadric error (Garland, Heckbert, "Surface Simplification Using Quadric Error Metrics", 1997).
+// Vertices are only ever collapsed onto one of their neighbours, so the result indexes the same
+// vertex buffer. Border, seam and non-manifold vertices never move, which keeps attribute seams
+// and open edges intact. Writes the indices to destination (which must have room for indexCount
+// indices) and returns the new index count. The largest collapse error is written to
+// resultError as a distance in the units of the positions.
+u32 simplifyMesh(u32* destination, u32 const* indices, u32 indexCount,
+        f32 const* positions, u32 vertexCount, u32 positionStride, u32 targetIndexCount,
+        f32* resultError=nullptr);
+
+// Checks analyzeVertexCache against hand counted index sequences, then welds and optimizes a
+// shuffled grid and checks that the ACMR drops near the ideal, the ATVR stays near 1 and that
+// the grid still has the same triangles. Also checks that the overdraw pass draws the outside
+// of a box of two nested shells before the inside.
+void checkVertexCacheOptimization();
+
+// Simplifies a flat grid and a heightfield with hills and checks the triangle counts, the
+// reported errors and how far the simplified heightfield strays from the original vertices.
+void checkMeshSimplification();
@@ -2,27 +2,48 @@
 #include "scene.h"
 #include "collision_flags.h"
 #include "game.h"
+#include "threadpool.h"
+#include "datafile.h"
 
 constexpr f32 D = 1.f;
 constexpr f32 D2 = 1.41421356f * D;
 
-void MotionGrid::build(Scene* scene)
+const char* MOTION_GRID_CACHE_DIRECTORY = "../cache/motion_grid";
+// bump this whenever the way the grid is built changes
+const u32 MOTION_GRID_CACHE_VERSION = 1;
+const u32 MOTION_GRID_CACHE_MAGIC = 0x4447544D; // "MTGD"
+
+// each task builds at least this many rows so that small tracks don't pay for the task overhead
+const i32 MIN_ROWS_PER_BUILD_TASK = 16;
+
+NamedMesh g_motionGridSphereMesh("misc", "Sphere");
+
+struct MotionGridCacheHeader
 {
-    f32 x1 = scene->terrain->x1;
-    f32 y1 = scene->terrain->y1;
-    f32 x2 = scene->terrain->x2;
-    f32 y2 = scene->terrain->y2;
-
-    this->x1 = snap(x1, CELL_SIZE);
-    this->y1 = snap(y1, CELL_SIZE);
-    this->x2 = snap(x2, CELL_SIZE);
-    this->y2 = snap(y2, CELL_SIZE);
-    width = (i32)((this->x2 - this->x1) / CELL_SIZE);
-    height = (i32)((this->y2 - this->y1) / CELL_SIZE);
-	i32 size = width * height;
-    grid.reset(new Cell[size]);
-    pathFindingBuffer.reset(new CellPathInfo[size]);
+    u32 magic;
+    u32 version;
+    u64 key;
+    f32 x1, y1, x2, y2;
+    i32 width, height;
+    u32 layerCount;
+};
 
+// the key covers the serialized track, so the cached grid is rebuilt after the track or its
+// props are edited
+static u64 getMotionGridCacheKey(Scene* scene)
+{
+    DataFile::Value data = DataFile::makeDict();
+    Serializer s(data, false);
+    scene->serialize(s);
+
+    u64 hash = HASH_SEED;
+    hash = hashValue(hash, MOTION_GRID_CACHE_VERSION);
+    hash = hashValue(hash, MotionGrid::CELL_SIZE);
+    return data.hash(hash);
+}
+
+void MotionGrid::buildRows(Scene* scene, i32 rowBegin, i32 rowEnd, BuildStats& stats)
+{
     PxRaycastHit hitBuffer[8];
     PxRaycastBuffer hit(hitBuffer, ARRAY_SIZE(hitBuffer));
     PxQueryFilterData filter;
@@ -40,15 +61,15 @@ void MotionGrid::build(Scene* scene)
     overlapFilter.data = PxFilterData(COLLISION_FLAG_OBJECT, 0, 0, 0);
     const f32 overlapRadius = 4.f;
 
-    u32 count = 0;
-    u32 hitCount = 0;
-    u32 highestLayerCount = 0;
-    for (i32 x = 0; x<width; ++x)
+    // every cell only depends on the scene, so the rows can be built in any order and by any
+    // number of tasks without changing the result
+    for (i32 y = rowBegin; y<rowEnd; ++y)
     {
-        for (i32 y = 0; y<height; ++y)
+        for (i32 x = 0; x<width; ++x)
         {
             f32 rx = x1 + x * CELL_SIZE;
             f32 ry = y1 + y * CELL_SIZE;
+            auto& contents = grid[y * width + x].contents;
 
             if (scene->getPhysicsScene()->raycast(PxVec3(rx, ry, 5000.f), PxVec3(0, 0, -1),
                     10000.f, hit, hitFlags, filter))
@@ -64,19 +85,17 @@ void MotionGrid::build(Scene* scene)
                         bool obstructed = scene->getPhysicsScene()->overlap(PxSphereGeometry(overlapRadius),
                                 PxTransform(PxVec3(rx, ry, hit.touches[i].position.z + overlapRadius), PxIdentity),
                                 overlapHit, overlapFilter);
-                        grid[y * width + x].contents.push({
+                        contents.push({
                                 hit.touches[i].position.z, obstructed ? CellType::BLOCKED : CellType::TRACK, CellType::NONE });
-                        ++hitCount;
                     }
                 }
-                highestLayerCount = max(grid[y * width + x].contents.size(), highestLayerCount);
             }
 
             if (scene->terrain->isOffroadAt(rx, ry))
             {
                 f32 tz = scene->terrain->getZ(Vec2(rx, ry));
                 bool onSameLayerAsTrack = false;
-                for (auto& layer : grid[y * width + x].contents)
+                for (auto& layer : contents)
                 {
                     if (absolute(layer.z - tz) < 10.f)
                     {
@@ -90,120 +109,333 @@ void MotionGrid::build(Scene* scene)
                     bool obstructed = scene->getPhysicsScene()->overlap(PxSphereGeometry(overlapRadius),
                             PxTransform(PxVec3(rx, ry, tz + overlapRadius), PxIdentity),
                             overlapHit, overlapFilter);
-                    auto& contents = grid[y * width + x].contents;
-                    contents.push({ tz, obstructed ? CellType::BLOCKED : CellType::OFFROAD });
+                    contents.push({ tz, obstructed ? CellType::BLOCKED : CellType::OFFROAD, CellType::NONE });
                     contents.sort([](auto& a, auto& b) {
                         return a.z > b.z;
                     });
                 }
             }
 
-            ++count;
+            stats.layerCount += contents.size();
+            stats.highestLayerCount = max(contents.size(), stats.highestLayerCount);
+            ++stats.cellsChecked;
         }
     }
+}
 
-    println("Built motion grid. Cells checked: %i, Cells used: %i, ", count, hitCount, highestLayerCount);
+void MotionGrid::buildCells(Scene* scene, u32 taskCount)
+{
+    i32 size = width * height;
+    grid.reset(new Cell[size]);
+    dirtyRects.clear();
+
+    struct BuildJob
+    {
+        MotionGrid* grid;
+        Scene* scene;
+        i32 rowBegin, rowEnd;
+        BuildStats stats;
+    };
+    taskCount = max(taskCount, 1u);
+    i32 rowsPerTask = max((height + (i32)taskCount - 1) / (i32)taskCount, MIN_ROWS_PER_BUILD_TASK);
+    Array<BuildJob> jobs;
+    for (i32 y = 0; y<height; y += rowsPerTask)
+    {
+        jobs.push({ this, scene, y, min(y + rowsPerTask, height) });
+    }
+    TaskGroup group;
+    for (auto& job : jobs)
+    {
+        g_threadPool.addTask(group, { &job, [](void* data) -> void* {
+            BuildJob* job = (BuildJob*)data;
+            job->grid->buildRows(job->scene, job->rowBegin, job->rowEnd, job->stats);
+            return nullptr;
+        }});
+    }
+    g_threadPool.wait(group);
+
+    buildStats = BuildStats();
+    buildStats.taskCount = jobs.size();
+    for (auto& job : jobs)
+    {
+        buildStats.cellsChecked += job.stats.cellsChecked;
+        buildStats.layerCount += job.stats.layerCount;
+        buildStats.highestLayerCount = max(buildStats.highestLayerCount, job.stats.highestLayerCount);
+    }
 }
 
-void MotionGrid::setCell(Vec3 p, CellType cellType, bool permanent)
+void MotionGrid::build(Scene* scene)
 {
-    p.x = clamp(p.x, x1, x2);
-    p.y = clamp(p.y, y1, y2);
+    f64 startTime = getTime();
 
-    i32 x = (i32)((p.x - x1) / CELL_SIZE);
-    i32 y = (i32)((p.y - y1) / CELL_SIZE);
-    i32 z = -1;
-    auto& contents = grid[y * width + x].contents;
-    for (u32 i=0; i<contents.size(); ++i)
+    this->x1 = snap(scene->terrain->x1, CELL_SIZE);
+    this->y1 = snap(scene->terrain->y1, CELL_SIZE);
+    this->x2 = snap(scene->terrain->x2, CELL_SIZE);
+    this->y2 = snap(scene->terrain->y2, CELL_SIZE);
+    width = (i32)((this->x2 - this->x1) / CELL_SIZE);
+    height = (i32)((this->y2 - this->y1) / CELL_SIZE);
+
+    static bool createdCacheDirectory = false;
+    if (!createdCacheDirectory)
     {
-        CellContents& cell = contents[i];
-        if (absolute(cell.z - p.z) < 4.f)
+        createDirectory("../cache");
+        createDirectory(MOTION_GRID_CACHE_DIRECTORY);
+        createdCacheDirectory = true;
+    }
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%016llx.grid", MOTION_GRID_CACHE_DIRECTORY,
+            (unsigned long long)scene->guid);
+
+    u64 key = getMotionGridCacheKey(scene);
+    if (readCache(path, key))
+    {
+        buildStats = BuildStats();
+        buildStats.wasCached = true;
+        buildStats.cellsChecked = (u32)(width * height);
+        for (i32 i=0; i<width * height; ++i)
         {
-            z = (i32)i;
-            break;
+            buildStats.layerCount += grid[i].contents.size();
+            buildStats.highestLayerCount = max(buildStats.highestLayerCount, grid[i].contents.size());
         }
     }
-    if (z == -1)
+    else
     {
-        return;
+        buildCells(scene, g_threadPool.getThreadCount());
+        writeCache(path, key);
+    }
+    buildStats.buildTime = getTime() - startTime;
+    buildAbstraction();
+
+    println("Built motion grid in %.2fms%s. Cells checked: %u, Layers: %u, Most layers in one cell: %u",
+            buildStats.buildTime * 1000.0, buildStats.wasCached ? " (from cache)" : "",
+            buildStats.cellsChecked, buildStats.layerCount, buildStats.highestLayerCount);
+    println("Built motion grid clusters in %.2fms. Portals: %u, Portal edges: %u, Uniform clusters: %u/%u",
+            buildStats.abstractionTime * 1000.0, buildStats.portalCount, buildStats.portalEdgeCount,
+            buildStats.uniformClusterCount, clusters.size());
+}
+
+bool MotionGrid::checkDeterminism(Scene* scene)
+{
+    if (!grid)
+    {
+        return false;
+    }
+    BuildStats previousStats = buildStats;
+    u64 expectedHash = computeHash();
+
+    buildCells(scene, 1);
+    u64 serialHash = computeHash();
+    buildCells(scene, g_threadPool.getThreadCount());
+    u64 parallelHash = computeHash();
+    buildStats = previousStats;
+    buildAbstraction();
+
+    bool matches = serialHash == parallelHash && serialHash == expectedHash;
+    if (matches)
+    {
+        println("Motion grid builds match: %016llx", (unsigned long long)serialHash);
+    }
+    else
+    {
+        error("Motion grid builds differ: current %016llx, 1 task %016llx, %u tasks %016llx",
+                (unsigned long long)expectedHash, (unsigned long long)serialHash,
+                g_threadPool.getThreadCount(), (unsigned long long)parallelHash);
+    }
+    return matches;
+}
+
+u64 MotionGrid::computeHash() const
+{
+    u64 hash = HASH_SEED;
+    hash = hashValue(hash, width);
+    hash = hashValue(hash, height);
+    for (i32 i=0; i<width * height; ++i)
+    {
+        auto& contents = grid[i].contents;
+        hash = hashValue(hash, contents.size());
+        for (auto& layer : contents)
+        {
+            hash = hashValue(hash, layer.z);
+            hash = hashValue(hash, layer.staticCellType);
+        }
+    }
+    return hash;
+}
+
+bool MotionGrid::readCache(const char* path, u64 key)
+{
+    SDL_RWops* file = SDL_RWFromFile(path, "rb");
+    if (!file)
+    {
+        return false;
     }
-    if (grid[y * width + x].contents[z].staticCellType != CellType::BLOCKED)
+    MotionGridCacheHeader header;
+    u32 cellCount = (u32)(width * height);
+    bool valid = SDL_RWread(file, &header, sizeof(header), 1) == 1
+        && header.magic == MOTION_GRID_CACHE_MAGIC
+        && header.version == MOTION_GRID_CACHE_VERSION
+        && header.key == key
+        && header.x1 == x1 && header.y1 == y1 && header.x2 == x2 && header.y2 == y2
+        && header.width == width && header.height == height
+        && (i64)(sizeof(header) + cellCount + header.layerCount * (sizeof(f32) + sizeof(CellType)))
+            == SDL_RWsize(file);
+
+    Array<u8> layerCounts;
+    Array<f32> z;
+    Array<CellType> cellTypes;
+    if (valid)
     {
-        if (permanent)
+        layerCounts.resize(cellCount);
+        z.resize(header.layerCount);
+        cellTypes.resize(header.layerCount);
+        valid = SDL_RWread(file, layerCounts.data(), cellCount, 1) == 1
+            && (header.layerCount == 0
+                || (SDL_RWread(file, z.data(), sizeof(f32) * header.layerCount, 1) == 1
+                    && SDL_RWread(file, cellTypes.data(), sizeof(CellType) * header.layerCount, 1) == 1));
+    }
+    SDL_RWclose(file);
+    if (!valid)
+    {
+        return false;
+    }
+
+    grid.reset(new Cell[cellCount]);
+    dirtyRects.clear();
+    u32 layerIndex = 0;
+    for (u32 i=0; i<cellCount; ++i)
+    {
+        if (layerIndex + layerCounts[i] > header.layerCount)
         {
-            grid[y * width + x].contents[z].staticCellType = cellType;
+            grid.reset();
+            return false;
         }
-        else
+        for (u32 j=0; j<layerCounts[i]; ++j)
         {
-            grid[y * width + x].contents[z].dynamicCellType = cellType;
-            grid[y * width + x].contents[z].generation = (u32)g_game.frameCount;
+            grid[i].contents.push({ z[layerIndex], cellTypes[layerIndex], CellType::NONE });
+            ++layerIndex;
         }
     }
+    return true;
+}
+
+void MotionGrid::writeCache(const char* path, u64 key) const
+{
+    u32 cellCount = (u32)(width * height);
+    Array<u8> layerCounts;
+    layerCounts.reserve(cellCount);
+    Array<f32> z;
+    Array<CellType> cellTypes;
+    for (u32 i=0; i<cellCount; ++i)
+    {
+        auto& contents = grid[i].contents;
+        layerCounts.push((u8)contents.size());
+        for (auto& layer : contents)
+        {
+            z.push(layer.z);
+            cellTypes.push(layer.staticCellType);
+        }
+    }
+
+    // write to a temporary file first so that an interrupted write never leaves a truncated
+    // file behind under the real name
+    char tmpPath[256];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+    SDL_RWops* file = SDL_RWFromFile(tmpPath, "wb");
+    if (!file)
+    {
+        error("Failed to write motion grid cache file: %s", tmpPath);
+        return;
+    }
+    MotionGridCacheHeader header = { MOTION_GRID_CACHE_MAGIC, MOTION_GRID_CACHE_VERSION, key,
+        x1, y1, x2, y2, width, height, z.size() };
+    bool written = SDL_RWwrite(file, &header, sizeof(header), 1) == 1
+        && SDL_RWwrite(file, layerCounts.data(), cellCount, 1) == 1
+        && (z.empty()
+            || (SDL_RWwrite(file, z.data(), sizeof(f32) * z.size(), 1) == 1
+                && SDL_RWwrite(file, cellTypes.data(), sizeof(CellType) * cellTypes.size(), 1) == 1));
+    SDL_RWclose(file);
+    if (!written)
+    {
+        error("Failed to write motion grid cache file: %s", tmpPath);
+        remove(tmpPath);
+        return;
+    }
+    replaceFile(tmpPath, path);
+}
+
+void MotionGrid::setCell(Vec3 p, CellType cellType, bool permanent)
+{
+    setCells(p, 0.f, cellType, permanent);
 }
 
 void MotionGrid::setCells(Vec3 p, f32 radius, CellType cellType, bool permanent)
 {
-    p.x = clamp(p.x, x1, x2);
-    p.y = clamp(p.y, y1, y2);
-    Vec3 v1(p.x - radius, p.y - radius, p.z);
-    Vec3 v2(p.x + radius, p.y + radius, p.z);
-    i32 v1x = (i32)((v1.x - x1) / CELL_SIZE);
-    i32 v1y = (i32)((v1.y - y1) / CELL_SIZE);
-    i32 v2x = (i32)((v2.x - x1) / CELL_SIZE);
-    i32 v2y = (i32)((v2.y - y1) / CELL_SIZE);
-    for (i32 x = v1x; x <= v2x; ++x)
-    {
-        for (i32 y = v1y; y <= v2y; ++y)
-        {
-            i32 z = -1;
-            auto& contents = grid[y * width + x].contents;
-            for (u32 i=0; i<contents.size(); ++i)
+    if (!grid)
+    {
+        return;
+    }
+
+    i32 v1x = clamp((i32)((p.x - radius - x1) / CELL_SIZE), 0, width - 1);
+    i32 v1y = clamp((i32)((p.y - radius - y1) / CELL_SIZE), 0, height - 1);
+    i32 v2x = clamp((i32)((p.x + radius - x1) / CELL_SIZE), 0, width - 1);
+    i32 v2y = clamp((i32)((p.y + radius - y1) / CELL_SIZE), 0, height - 1);
+    if (!permanent)
+    {
+        dirtyRects.push({ v1x, v1y, v2x, v2y });
+    }
+    for (i32 y = v1y; y <= v2y; ++y)
+    {
+        for (i32 x = v1x; x <= v2x; ++x)
+        {
+            for (auto& cell : grid[y * width + x].contents)
             {
-                CellContents& cell = contents[i];
                 if (absolute(cell.z - p.z) < 4.f)
                 {
-                    z = (i32)i;
+                    if (cell.staticCellType != CellType::BLOCKED)
+                    {
+                        if (permanent)
+                        {
+                            cell.staticCellType = cellType;
+                        }
+                        else
+                        {
+                            cell.dynamicCellType = cellType;
+                        }
+                    }
                     break;
                 }
             }
-            if (z == -1)
-            {
-                continue;
-            }
-            if (grid[y * width + x].contents[z].staticCellType != CellType::BLOCKED)
+        }
+    }
+}
+
+void MotionGrid::clearDynamicCells()
+{
+    lastClearedCellCount = 0;
+    for (auto& rect : dirtyRects)
+    {
+        for (i32 y = rect.y1; y <= rect.y2; ++y)
+        {
+            for (i32 x = rect.x1; x <= rect.x2; ++x)
             {
-                if (permanent)
-                {
-                    grid[y * width + x].contents[z].staticCellType = cellType;
-                }
-                else
+                for (auto& cell : grid[y * width + x].contents)
                 {
-                    grid[y * width + x].contents[z].dynamicCellType = cellType;
-                    grid[y * width + x].contents[z].generation = (u32)g_game.frameCount;
+                    cell.dynamicCellType = CellType::NONE;
                 }
+                ++lastClearedCellCount;
             }
         }
     }
+    dirtyRects.clear();
 }
 
 void MotionGrid::debugDraw(class RenderWorld* rw)
 {
-    Mesh* mesh = g_res.getModel("misc")->getMeshByName("Sphere");
-#if DEBUG_INFO
-    for (auto& node : debugInfo)
+    if (!grid)
     {
-        f32 rx = x1 + node.x * CELL_SIZE;
-        f32 ry = y1 + node.y * CELL_SIZE;
-        Vec3 color(0.f, 0.f, 1.f);
-        f32 rz = grid[node.y * width + node.x].contents[node.z].z;
-        if (node.isBlocked)
-        {
-            rz += 2.f;
-            color = Vec3(1.f, 0.f, 0.f);
-        }
-        drawSimple(rw, mesh, &g_res.white, Mat4::translation(Vec3(rx, ry, rz)), color);
+        return;
     }
-#else
+    Mesh* mesh = g_motionGridSphereMesh;
     Mat4 scale = Mat4::translation(Vec3(0.4f));
     for (i32 x = 0; x<width; ++x)
     {
@@ -234,13 +466,21 @@ void MotionGrid::debugDraw(class RenderWorld* rw)
                     drawSimple(rw, mesh, &g_res.white, Mat4::translation(Vec3(rx, ry, cell.z)), color);
                 }
                 cellType = cell.dynamicCellType;
-                if (cellType != CellType::NONE && cell.generation == (u32)g_game.frameCount)
+                if (cellType != CellType::NONE)
                 {
                     Vec3 color;
                     if (cellType == CellType::VEHICLE)
                     {
                         color = Vec3(0, 1, 1);
                     }
+                    else if (cellType == CellType::HAZARD)
+                    {
+                        color = Vec3(1, 0, 1);
+                    }
+                    else if (cellType == CellType::PICKUP_MONEY || cellType == CellType::PICKUP_ARMOR)
+                    {
+                        color = Vec3(1, 1, 0);
+                    }
                     else if (cellType == CellType::TRACK)
                     {
                         color = Vec3(0, 1, 0);
@@ -260,14 +500,13 @@ void MotionGrid::debugDraw(class RenderWorld* rw)
             }
         }
     }
-#endif
 }
 
 i32 MotionGrid::getCellLayerIndex(Vec3 const& p) const
 {
-    i32 x = (i32)((p.x - x1) / CELL_SIZE);
-    i32 y = (i32)((p.y - y1) / CELL_SIZE);
-    auto& contents = grid[y * width + x].contents;
+    i32 x = clamp((i32)((p.x - x1) / CELL_SIZE), 0, width - 1);
+    i32 y = clamp((i32)((p.y - y1) / CELL_SIZE), 0, height - 1);
+    auto& contents = getCell(x, y).contents;
     for (u32 i=0; i<contents.size(); ++i)
     {
         CellContents& cell = contents[i];
@@ -286,191 +525,930 @@ static f32 octileDistance(i32 x1, i32 y1, i32 x2, i32 y2)
     return D * (dx + dy) + (D2 - 2 * D) * min(dx, dy);
 }
 
-void MotionGrid::findPath(Vec3& from, Vec3& to, bool isBlocking, Vec2 forward,
-        Array<PathNode>& outPath)
+static i32 signOf(i32 v)
 {
-    outPath.clear();
+    return (v > 0) - (v < 0);
+}
 
-    from.x = clamp(from.x, x1, x2);
-    from.y = clamp(from.y, y1, y2);
-    to.x = clamp(to.x, x1, x2);
-    to.y = clamp(to.y, y1, y2);
+static bool isPassable(MotionGrid::CellContents const& cell, bool includeDynamic)
+{
+    return cell.staticCellType > MotionGrid::BLOCKED
+        && (!includeDynamic || cell.dynamicCellType != MotionGrid::BLOCKED);
+}
 
-    // TODO: if the start or end cell is blocked, search the area for a valid cell
-    Node* startNode = g_tmpMem.bump<Node>();
-    *startNode = { (i32)((from.x - x1) / CELL_SIZE), (i32)((from.y - y1) / CELL_SIZE), getCellLayerIndex(from) };
-    Node endNode = { (i32)((to.x - x1) / CELL_SIZE), (i32)((to.y - y1) / CELL_SIZE), getCellLayerIndex(to) };
+static void heapPush(Array<MotionGrid::OpenEntry>& heap, MotionGrid::OpenEntry entry)
+{
+    heap.push(entry);
+    u32 i = heap.size() - 1;
+    while (i > 0)
+    {
+        u32 parent = (i - 1) / 2;
+        if (heap[parent].f <= heap[i].f)
+        {
+            break;
+        }
+        swap(heap[parent], heap[i]);
+        i = parent;
+    }
+}
 
-#if DEBUG_INFO
-    debugInfo.clear();
-#endif
+static MotionGrid::OpenEntry heapPop(Array<MotionGrid::OpenEntry>& heap)
+{
+    MotionGrid::OpenEntry top = heap[0];
+    heap[0] = heap.back();
+    heap.pop();
+    u32 i = 0;
+    for (;;)
+    {
+        u32 left = i * 2 + 1;
+        u32 right = left + 1;
+        u32 smallest = i;
+        if (left < heap.size() && heap[left].f < heap[smallest].f)
+        {
+            smallest = left;
+        }
+        if (right < heap.size() && heap[right].f < heap[smallest].f)
+        {
+            smallest = right;
+        }
+        if (smallest == i)
+        {
+            break;
+        }
+        swap(heap[smallest], heap[i]);
+        i = smallest;
+    }
+    return top;
+}
 
-    open.clear();
-    open.push(startNode);
+static bool operator == (MotionGrid::CellRef const& a, MotionGrid::CellRef const& b)
+{
+    return a.x == b.x && a.y == b.y && a.layer == b.layer;
+}
 
-    const u32 MAX_ITERATIONS = 800;
-    u32 gen = (u32)g_game.frameCount;
+i32 MotionGrid::getNeighborLayer(CellRef const& from, i32 tx, i32 ty, bool includeDynamic) const
+{
+    if (tx < 0 || ty < 0 || tx >= width || ty >= height)
+    {
+        return -1;
+    }
+    f32 z = getCell(from.x, from.y).contents[from.layer].z;
+    auto& contents = getCell(tx, ty).contents;
+    for (u32 i=0; i<contents.size(); ++i)
+    {
+        if (absolute(contents[i].z - z) < 4.f && isPassable(contents[i], includeDynamic))
+        {
+            return (i32)i;
+        }
+    }
+    return -1;
+}
 
-    ++pathGeneration;
-    u32 iterations = 0;
-    while (!open.empty())
+i32 MotionGrid::getStep(CellRef const& from, i32 dx, i32 dy, bool includeDynamic) const
+{
+    // diagonal steps may not cut the corners of blocked cells
+    if (dx != 0 && dy != 0 && (getNeighborLayer(from, from.x + dx, from.y, includeDynamic) == -1
+                || getNeighborLayer(from, from.x, from.y + dy, includeDynamic) == -1))
     {
-        auto currentNodeIt = open.begin();
-        for (auto it = open.begin()+1; it != open.end(); ++it)
+        return -1;
+    }
+    return getNeighborLayer(from, from.x + dx, from.y + dy, includeDynamic);
+}
+
+f32 MotionGrid::getStepCost(CellRef const& to, bool isDiagonal, PathQuery const* query) const
+{
+    f32 costMultiplier = 1.f;
+    if (getCell(to.x, to.y).contents[to.layer].staticCellType == CellType::OFFROAD)
+    {
+        costMultiplier = 1.75f;
+    }
+    if (query && query->isBlocking)
+    {
+        // avoid whatever is blocking the way straight ahead
+        Vec2 diff = Vec2(x1 + to.x * CELL_SIZE, y1 + to.y * CELL_SIZE) - query->from;
+        f32 len = length(diff);
+        if (len > 0.f && len < 20.f && dot(diff / len, query->forward) > 0.9f)
         {
-            if ((*it)->f < (*currentNodeIt)->f)
+            costMultiplier = 3.f;
+        }
+    }
+    return (isDiagonal ? D2 : D) * costMultiplier;
+}
+
+MotionGrid::CellRect MotionGrid::getClusterRect(u32 clusterIndex) const
+{
+    i32 cx = (i32)clusterIndex % clustersX;
+    i32 cy = (i32)clusterIndex / clustersX;
+    return {
+        cx * CLUSTER_SIZE,
+        cy * CLUSTER_SIZE,
+        min(cx * CLUSTER_SIZE + CLUSTER_SIZE, width) - 1,
+        min(cy * CLUSTER_SIZE + CLUSTER_SIZE, height) - 1,
+    };
+}
+
+bool MotionGrid::isWalkable(CellRect const& rect, i32 x, i32 y) const
+{
+    if (x < rect.x1 || y < rect.y1 || x > rect.x2 || y > rect.y2)
+    {
+        return false;
+    }
+    auto& contents = getCell(x, y).contents;
+    return contents.size() == 1 && isPassable(contents[0], true);
+}
+
+bool MotionGrid::jump(CellRect const& rect, i32 x, i32 y, i32 dx, i32 dy, CellRef const& goal,
+        CellRef& outJumpPoint) const
+{
+    for (;;)
+    {
+        if (dx != 0 && dy != 0 && (!isWalkable(rect, x + dx, y) || !isWalkable(rect, x, y + dy)))
+        {
+            return false;
+        }
+        x += dx;
+        y += dy;
+        if (!isWalkable(rect, x, y))
+        {
+            return false;
+        }
+        outJumpPoint = { x, y, 0 };
+        if (x == goal.x && y == goal.y)
+        {
+            return true;
+        }
+        if (dx != 0 && dy != 0)
+        {
+            // a diagonal move stops where one of the straight moves it passes would stop
+            CellRef unused;
+            if (jump(rect, x, y, dx, 0, goal, unused)
+                    || jump(rect, x, y, 0, dy, goal, unused))
             {
-                currentNodeIt = it;
+                return true;
             }
         }
+        else if (dx != 0)
+        {
+            if ((isWalkable(rect, x, y - 1) && !isWalkable(rect, x - dx, y - 1))
+                    || (isWalkable(rect, x, y + 1) && !isWalkable(rect, x - dx, y + 1)))
+            {
+                return true;
+            }
+        }
+        else
+        {
+            if ((isWalkable(rect, x - 1, y) && !isWalkable(rect, x - 1, y - dy))
+                    || (isWalkable(rect, x + 1, y) && !isWalkable(rect, x + 1, y - dy)))
+            {
+                return true;
+            }
+        }
+    }
+}
+
+// Searches from start to the targets without leaving rect. A single target is searched with A*,
+// or with jump point search when useJumps is set, and several targets with Dijkstra until all of
+// them have been reached. Without a query only the static cells are considered. Returns false
+// when a target could not be reached or the budget ran out.
+bool MotionGrid::searchCells(PathScratch& scratch, CellRect const& rect, CellRef const& start,
+        CellRef const* targets, u32 targetCount, PathQuery const* query, bool useJumps,
+        u32 budget, f32* outCosts, Array<CellRef>* outCells) const
+{
+    i32 rectWidth = rect.x2 - rect.x1 + 1;
+    i32 rectHeight = rect.y2 - rect.y1 + 1;
+    u32 layerStride = max(buildStats.highestLayerCount, 1u);
+    u32 nodeCount = (u32)(rectWidth * rectHeight) * layerStride;
+    if (scratch.cellNodes.size() < nodeCount)
+    {
+        scratch.cellNodes.resize(nodeCount);
+    }
+    u32 gen = ++scratch.generation;
+
+    auto getIndex = [&](CellRef const& c) {
+        return (u32)((c.y - rect.y1) * rectWidth + (c.x - rect.x1)) * layerStride + c.layer;
+    };
+    auto getRef = [&](u32 index) {
+        u32 cell = index / layerStride;
+        return CellRef{ rect.x1 + (i32)(cell % rectWidth), rect.y1 + (i32)(cell / rectWidth),
+            index % layerStride };
+    };
+
+    bool includeDynamic = query != nullptr;
+    bool useHeuristic = targetCount == 1;
+    CellRef const& goal = targets[0];
+    useJumps = useJumps && useHeuristic && start.layer == 0 && isWalkable(rect, start.x, start.y);
+    f32 jumpCostMultiplier =
+        getCell(start.x, start.y).contents[start.layer].staticCellType == CellType::OFFROAD ? 1.75f : 1.f;
+    for (u32 i=0; i<targetCount; ++i)
+    {
+        outCosts[i] = FLT_MAX;
+    }
+    u32 targetsFound = 0;
+
+    auto visit = [&](CellRef const& next, f32 g, u32 parentIndex) {
+        SearchNode& node = scratch.cellNodes[getIndex(next)];
+        if (node.seen == gen && (node.closed == gen || node.g <= g))
+        {
+            return;
+        }
+        node.g = g;
+        node.parent = parentIndex;
+        node.seen = gen;
+        f32 h = useHeuristic ? octileDistance(next.x, next.y, goal.x, goal.y) : 0.f;
+        heapPush(scratch.open, { g + h, getIndex(next) });
+    };
 
-        Node* currentNode = *currentNodeIt;
+    scratch.open.clear();
+    u32 startIndex = getIndex(start);
+    visit(start, 0.f, startIndex);
 
-#if DEBUG_INFO
-        debugInfo.push(*currentNode);
-#endif
+    u32 goalIndex = 0;
+    while (!scratch.open.empty())
+    {
+        OpenEntry entry = heapPop(scratch.open);
+        SearchNode& node = scratch.cellNodes[entry.index];
+        if (node.closed == gen)
+        {
+            continue;
+        }
+        if (scratch.expansions >= budget)
+        {
+            return false;
+        }
+        ++scratch.expansions;
+        node.closed = gen;
 
-        open.erase(currentNodeIt);
-        pathFindingBuffer[currentNode->y * width + currentNode->x].pathGeneration[currentNode->z] = pathGeneration;
+        CellRef current = getRef(entry.index);
+        for (u32 i=0; i<targetCount; ++i)
+        {
+            if (outCosts[i] == FLT_MAX && current == targets[i])
+            {
+                outCosts[i] = node.g;
+                ++targetsFound;
+            }
+        }
+        if (targetsFound == targetCount)
+        {
+            goalIndex = entry.index;
+            break;
+        }
 
-        ++iterations;
-        if ((currentNode->x == endNode.x && currentNode->y == endNode.y && currentNode->z == endNode.z)
-                || iterations > MAX_ITERATIONS)
+        if (useJumps)
         {
-            // if we have hit max iterations, then get as close to the goal as possible
-            if (iterations > MAX_ITERATIONS)
+            // only the directions that a shortest path could continue in are searched
+            CellRef parent = getRef(node.parent);
+            i32 dx = signOf(current.x - parent.x);
+            i32 dy = signOf(current.y - parent.y);
+            Vec2i directions[8];
+            u32 directionCount = 0;
+            auto addDirection = [&](bool condition, i32 x, i32 y) {
+                if (condition)
+                {
+                    directions[directionCount++] = { x, y };
+                }
+            };
+            if (dx == 0 && dy == 0)
             {
-                currentNodeIt = open.begin();
-                for (auto it = open.begin()+1; it != open.end(); ++it)
+                for (i32 y=-1; y<=1; ++y)
                 {
-                    if ((*it)->h < (*currentNodeIt)->h)
+                    for (i32 x=-1; x<=1; ++x)
                     {
-                        currentNodeIt = it;
+                        addDirection(x != 0 || y != 0, x, y);
                     }
                 }
             }
-            Node* current = currentNode;
-            while (current)
+            else if (dx != 0 && dy != 0)
+            {
+                bool walkX = isWalkable(rect, current.x + dx, current.y);
+                bool walkY = isWalkable(rect, current.x, current.y + dy);
+                addDirection(walkX, dx, 0);
+                addDirection(walkY, 0, dy);
+                addDirection(walkX && walkY, dx, dy);
+            }
+            else if (dx != 0)
+            {
+                bool next = isWalkable(rect, current.x + dx, current.y);
+                bool up = isWalkable(rect, current.x, current.y + 1);
+                bool down = isWalkable(rect, current.x, current.y - 1);
+                addDirection(next, dx, 0);
+                addDirection(next && up, dx, 1);
+                addDirection(next && down, dx, -1);
+                addDirection(up, 0, 1);
+                addDirection(down, 0, -1);
+            }
+            else
+            {
+                bool next = isWalkable(rect, current.x, current.y + dy);
+                bool right = isWalkable(rect, current.x + 1, current.y);
+                bool left = isWalkable(rect, current.x - 1, current.y);
+                addDirection(next, 0, dy);
+                addDirection(next && right, 1, dy);
+                addDirection(next && left, -1, dy);
+                addDirection(right, 1, 0);
+                addDirection(left, -1, 0);
+            }
+
+            for (u32 i=0; i<directionCount; ++i)
+            {
+                CellRef jumpPoint;
+                if (jump(rect, current.x, current.y, directions[i].x, directions[i].y, goal, jumpPoint))
+                {
+                    visit(jumpPoint, node.g + jumpCostMultiplier
+                            * octileDistance(current.x, current.y, jumpPoint.x, jumpPoint.y), entry.index);
+                }
+            }
+        }
+        else
+        {
+            for (i32 dy=-1; dy<=1; ++dy)
             {
-                outPath.push(PathNode{
+                for (i32 dx=-1; dx<=1; ++dx)
+                {
+                    if (dx == 0 && dy == 0)
+                    {
+                        continue;
+                    }
+                    i32 layer = getStep(current, dx, dy, includeDynamic);
+                    CellRef next = { current.x + dx, current.y + dy, (u32)layer };
+                    if (layer == -1 || next.x < rect.x1 || next.y < rect.y1
+                            || next.x > rect.x2 || next.y > rect.y2)
                     {
-                        x1 + current->x * CELL_SIZE,
-                        y1 + current->y * CELL_SIZE,
-                        grid[current->y * width + current->x].contents[current->z].z
-                    },
-                    current->f,
-                    current->g,
-                    current->h
-                });
-                current = current->parent;
+                        continue;
+                    }
+                    visit(next, node.g + getStepCost(next, dx != 0 && dy != 0, query), entry.index);
+                }
             }
+        }
+    }
 
-            outPath.reverse();
+    if (targetsFound != targetCount)
+    {
+        return false;
+    }
 
-            return;
+    if (outCells)
+    {
+        Array<CellRef>& chain = useJumps ? scratch.jumpPoints : *outCells;
+        chain.clear();
+        for (u32 index = goalIndex;; index = scratch.cellNodes[index].parent)
+        {
+            chain.push(getRef(index));
+            if (index == startIndex)
+            {
+                break;
+            }
         }
+        chain.reverse();
 
-        Vec2i offsets[] = {
-            { 0, -1 },
-            { 0, 1 },
-            { -1, 0 },
-            { 1, 0 },
-            { -1, -1 },
-            { -1, 1 },
-            { 1, -1 },
-            { 1, 1 },
-        };
-        f32 costs[] = { D, D, D, D, D2, D2, D2, D2 };
-        for (u32 i=0; i<ARRAY_SIZE(offsets); ++i)
+        if (useJumps)
         {
-            auto offset = offsets[i];
-            i32 tx = currentNode->x + offset.x;
-            i32 ty = currentNode->y + offset.y;
-            i32 tz = 0;
-
-            if (tx < 0 || tx >= width || ty < 0 || ty >= height)
+            // fill in the cells between the jump points, which always lie on a straight or
+            // diagonal line
+            outCells->clear();
+            outCells->push(chain[0]);
+            for (u32 i=1; i<chain.size(); ++i)
             {
-                continue;
+                CellRef c = outCells->back();
+                i32 dx = signOf(chain[i].x - c.x);
+                i32 dy = signOf(chain[i].y - c.y);
+                while (c.x != chain[i].x || c.y != chain[i].y)
+                {
+                    c.x += dx;
+                    c.y += dy;
+                    outCells->push(c);
+                }
             }
+        }
+    }
+    return true;
+}
 
-            CellContents* targetCell = nullptr;
-            auto& contents = grid[ty * width + tx].contents;
-            for (u32 i=0; i<contents.size(); ++i)
+void MotionGrid::buildAbstraction()
+{
+    f64 startTime = getTime();
+
+    clustersX = (width + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+    clustersY = (height + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+    u32 clusterCount = (u32)(clustersX * clustersY);
+    clusters.clear();
+    clusters.resize(clusterCount);
+    clusterNodes.clear();
+    portalNodes.clear();
+    portalEdges.clear();
+    buildStats.uniformClusterCount = 0;
+
+    for (u32 clusterIndex=0; clusterIndex<clusterCount; ++clusterIndex)
+    {
+        CellRect rect = getClusterRect(clusterIndex);
+        CellType uniformType = CellType::NONE;
+        bool isUniform = true;
+        for (i32 y=rect.y1; y<=rect.y2 && isUniform; ++y)
+        {
+            for (i32 x=rect.x1; x<=rect.x2 && isUniform; ++x)
             {
-                CellContents& cell = contents[i];
-                if (cell.generation != gen)
+                auto& contents = getCell(x, y).contents;
+                if (contents.size() > 1)
                 {
-                    cell.dynamicCellType = CellType::NONE;
+                    isUniform = false;
+                    break;
                 }
-                if (grid[currentNode->y * width + currentNode->x].contents.empty())
+                if (contents.empty() || !isPassable(contents[0], false))
                 {
-                    break;
+                    continue;
                 }
-                if (absolute(cell.z - grid[currentNode->y * width + currentNode->x].contents[currentNode->z].z) < 4.f)
+                if (uniformType == CellType::NONE)
                 {
-                    if (cell.staticCellType > CellType::BLOCKED &&
-                        cell.dynamicCellType != CellType::BLOCKED)
+                    uniformType = contents[0].staticCellType;
+                }
+                isUniform = contents[0].staticCellType == uniformType;
+
+                Vec2i neighbors[] = { { 1, 0 }, { 0, 1 }, { 1, 1 }, { 1, -1 } };
+                for (auto& offset : neighbors)
+                {
+                    i32 nx = x + offset.x;
+                    i32 ny = y + offset.y;
+                    if (nx > rect.x2 || ny < rect.y1 || ny > rect.y2)
                     {
-                        targetCell = &cell;
-                        tz = (i32)i;
-                        break;
+                        continue;
+                    }
+                    auto& neighborContents = getCell(nx, ny).contents;
+                    if (neighborContents.size() == 1 && isPassable(neighborContents[0], false)
+                            && absolute(neighborContents[0].z - contents[0].z) >= 4.f)
+                    {
+                        isUniform = false;
                     }
                 }
             }
+        }
+        clusters[clusterIndex].isUniform = isUniform;
+        clusters[clusterIndex].costMultiplier = uniformType == CellType::OFFROAD ? 1.75f : 1.f;
+        buildStats.uniformClusterCount += isUniform ? 1 : 0;
+    }
 
-            if (!targetCell)
+    // find the entrances between neighbouring clusters, and add a portal node on each side
+    Array<Array<u32>> nodesByCluster(clusterCount);
+    Array<Array<PortalEdge>> edgesByNode;
+    auto addNode = [&](CellRef const& cell) {
+        u32 clusterIndex = getClusterIndex(cell.x, cell.y);
+        for (u32 index : nodesByCluster[clusterIndex])
+        {
+            if (portalNodes[index].cell == cell)
             {
-                continue;
+                return index;
             }
-
-            if (pathFindingBuffer[ty * width + tx].pathGeneration[tz] == pathGeneration)
+        }
+        u32 index = portalNodes.size();
+        portalNodes.push({ cell, clusterIndex, nodesByCluster[clusterIndex].size(), 0, 0 });
+        nodesByCluster[clusterIndex].push(index);
+        edgesByNode.push(Array<PortalEdge>());
+        return index;
+    };
+    auto addEntrance = [&](CellRef const& a, CellRef const& b) {
+        u32 nodeA = addNode(a);
+        u32 nodeB = addNode(b);
+        edgesByNode[nodeA].push({ nodeB, getStepCost(b, false, nullptr) });
+        edgesByNode[nodeB].push({ nodeA, getStepCost(a, false, nullptr) });
+    };
+    // walks along one side of a border, from (x, y) in the direction (stepX, stepY), where
+    // (acrossX, acrossY) points over the border
+    auto scanBorder = [&](i32 x, i32 y, i32 stepX, i32 stepY, i32 acrossX, i32 acrossY, i32 length) {
+        for (u32 layer=0; layer<max(buildStats.highestLayerCount, 1u); ++layer)
+        {
+            i32 runStart = -1;
+            i32 runLayer = -1;
+            for (i32 i=0; i<=length; ++i)
             {
-                continue;
+                CellRef a = { x + stepX * i, y + stepY * i, layer };
+                i32 acrossLayer = -1;
+                if (i < length)
+                {
+                    auto& contents = getCell(a.x, a.y).contents;
+                    if (layer < contents.size() && isPassable(contents[layer], false))
+                    {
+                        acrossLayer = getNeighborLayer(a, a.x + acrossX, a.y + acrossY, false);
+                    }
+                }
+                if (runStart != -1 && acrossLayer != runLayer)
+                {
+                    // short runs get one entrance in the middle and long ones one at each end
+                    i32 runEnd = i - 1;
+                    i32 positions[2] = { (runStart + runEnd) / 2, runEnd };
+                    u32 positionCount = 1;
+                    if (runEnd - runStart + 1 >= 6)
+                    {
+                        positions[0] = runStart;
+                        positionCount = 2;
+                    }
+                    for (u32 p=0; p<positionCount; ++p)
+                    {
+                        CellRef from = { x + stepX * positions[p], y + stepY * positions[p], layer };
+                        addEntrance(from, { from.x + acrossX, from.y + acrossY, (u32)runLayer });
+                    }
+                    runStart = -1;
+                }
+                if (acrossLayer != -1 && runStart == -1)
+                {
+                    runStart = i;
+                    runLayer = acrossLayer;
+                }
             }
-
-            Node newNode = {
-                tx, ty, tz,
-                0.f, 0.f, 0.f,
-                currentNode,
-            };
-            f32 costMultiplier = 1.f;
-            if (targetCell->staticCellType == CellType::OFFROAD)
+        }
+    };
+    for (i32 cy=0; cy<clustersY; ++cy)
+    {
+        for (i32 cx=0; cx<clustersX; ++cx)
+        {
+            if (cx + 1 < clustersX)
             {
-                costMultiplier = 1.75f;
+                i32 y = cy * CLUSTER_SIZE;
+                scanBorder((cx + 1) * CLUSTER_SIZE - 1, y, 0, 1, 1, 0, min(CLUSTER_SIZE, height - y));
             }
-            Vec2 currentCellWorldPosition(x1 + currentNode->x * CELL_SIZE, y1 + currentNode->y * CELL_SIZE);
-            Vec2 targetCellWorldPosition(x1 + newNode.x * CELL_SIZE, y1 + newNode.y * CELL_SIZE);
-            Vec2 diff = targetCellWorldPosition - Vec2(from);
-            f32 len = length(diff);
-            if (isBlocking && len < 20.f && dot(diff / len, forward) > 0.9f)
+            if (cy + 1 < clustersY)
             {
-                costMultiplier = 3.f;
-#if DEBUG_INFO
-                Node debugInfoNode = newNode;
-                debugInfoNode.isBlocked = true;
-                debugInfo.push(debugInfoNode);
-#endif
+                i32 x = cx * CLUSTER_SIZE;
+                scanBorder(x, (cy + 1) * CLUSTER_SIZE - 1, 1, 0, 0, 1, min(CLUSTER_SIZE, width - x));
             }
-            newNode.g = currentNode->g + costs[i] * costMultiplier;
-            newNode.h = octileDistance(currentNode->x, currentNode->y, endNode.x, endNode.y) * 1.05f;
-            newNode.f = newNode.g + newNode.h;
+        }
+    }
+    for (u32 clusterIndex=0; clusterIndex<clusterCount; ++clusterIndex)
+    {
+        clusters[clusterIndex].firstNode = clusterNodes.size();
+        clusters[clusterIndex].nodeCount = nodesByCluster[clusterIndex].size();
+        for (u32 index : nodesByCluster[clusterIndex])
+        {
+            clusterNodes.push(index);
+        }
+    }
 
-            bool isOnOpen = false;
-            for (Node* openNode : open)
+    // connect the portals of each cluster to each other through the cells of the cluster; every
+    // task only adds edges to the nodes of its own clusters
+    struct ClusterJob
+    {
+        MotionGrid* grid;
+        Array<Array<PortalEdge>>* edgesByNode;
+        u32 clusterBegin, clusterEnd;
+    };
+    u32 clustersPerTask = max(clusterCount / (max(g_threadPool.getThreadCount(), 1u) * 4), 1u);
+    Array<ClusterJob> jobs;
+    for (u32 i=0; i<clusterCount; i += clustersPerTask)
+    {
+        jobs.push({ this, &edgesByNode, i, min(i + clustersPerTask, clusterCount) });
+    }
+    TaskGroup group;
+    for (auto& job : jobs)
+    {
+        g_threadPool.addTask(group, { &job, [](void* data) -> void* {
+            ClusterJob* job = (ClusterJob*)data;
+            MotionGrid* grid = job->grid;
+            PathScratch scratch;
+            Array<CellRef> targets;
+            Array<f32> costs;
+            for (u32 clusterIndex=job->clusterBegin; clusterIndex<job->clusterEnd; ++clusterIndex)
             {
-                if (openNode->x == tx && openNode->y == ty && openNode->z == tz && newNode.g > openNode->g)
+                Cluster const& cluster = grid->clusters[clusterIndex];
+                targets.clear();
+                for (u32 i=0; i<cluster.nodeCount; ++i)
                 {
-                    isOnOpen = true;
-                    break;
+                    targets.push(grid->portalNodes[grid->clusterNodes[cluster.firstNode + i]].cell);
+                }
+                costs.resize(cluster.nodeCount);
+                CellRect rect = grid->getClusterRect(clusterIndex);
+                for (u32 i=0; i<cluster.nodeCount; ++i)
+                {
+                    scratch.expansions = 0;
+                    grid->searchCells(scratch, rect, targets[i], targets.data(), targets.size(),
+                            nullptr, false, UINT32_MAX, costs.data(), nullptr);
+                    auto& edges = (*job->edgesByNode)[grid->clusterNodes[cluster.firstNode + i]];
+                    for (u32 j=0; j<cluster.nodeCount; ++j)
+                    {
+                        if (j != i && costs[j] != FLT_MAX)
+                        {
+                            edges.push({ grid->clusterNodes[cluster.firstNode + j], costs[j] });
+                        }
+                    }
                 }
             }
+            return nullptr;
+        }});
+    }
+    g_threadPool.wait(group);
+
+    for (u32 i=0; i<portalNodes.size(); ++i)
+    {
+        portalNodes[i].firstEdge = portalEdges.size();
+        portalNodes[i].edgeCount = edgesByNode[i].size();
+        for (auto& edge : edgesByNode[i])
+        {
+            portalEdges.push(edge);
+        }
+    }
+
+    buildStats.portalCount = portalNodes.size();
+    buildStats.portalEdgeCount = portalEdges.size();
+    buildStats.abstractionTime = getTime() - startTime;
+}
 
-            if (!isOnOpen)
+void MotionGrid::appendPathNodes(Array<CellRef> const& cells, CellRef const& goal,
+        Array<PathNode>& outPath) const
+{
+    f32 g = 0.f;
+    for (u32 i=0; i<cells.size(); ++i)
+    {
+        CellRef const& c = cells[i];
+        if (i > 0)
+        {
+            g += octileDistance(cells[i - 1].x, cells[i - 1].y, c.x, c.y);
+        }
+        f32 h = octileDistance(c.x, c.y, goal.x, goal.y);
+        outPath.push(PathNode{
+            { x1 + c.x * CELL_SIZE, y1 + c.y * CELL_SIZE, getCell(c.x, c.y).contents[c.layer].z },
+            g + h, g, h
+        });
+    }
+}
+
+void MotionGrid::findPath(Vec3& from, Vec3& to, bool isBlocking, Vec2 forward,
+        Array<PathNode>& outPath, PathScratch& scratch) const
+{
+    outPath.clear();
+    scratch.expansions = 0;
+    if (!grid)
+    {
+        return;
+    }
+
+    from.x = clamp(from.x, x1, x2);
+    from.y = clamp(from.y, y1, y2);
+    to.x = clamp(to.x, x1, x2);
+    to.y = clamp(to.y, y1, y2);
+
+    auto getCellRef = [&](Vec3 const& p) {
+        return CellRef{
+            clamp((i32)((p.x - x1) / CELL_SIZE), 0, width - 1),
+            clamp((i32)((p.y - y1) / CELL_SIZE), 0, height - 1),
+            (u32)getCellLayerIndex(p)
+        };
+    };
+    CellRef start = getCellRef(from);
+    CellRef goal = getCellRef(to);
+    // TODO: if the start or end cell is blocked, search the area for a valid cell
+    if (getCell(start.x, start.y).contents.empty() || getCell(goal.x, goal.y).contents.empty())
+    {
+        return;
+    }
+
+    PathQuery query = { Vec2(from), forward, isBlocking };
+    u32 startCluster = getClusterIndex(start.x, start.y);
+    u32 goalCluster = getClusterIndex(goal.x, goal.y);
+    // the penalty for blocked cells ahead makes the costs near the start uneven
+    auto canJump = [&](u32 clusterIndex) {
+        return clusters[clusterIndex].isUniform && !(isBlocking && clusterIndex == startCluster);
+    };
+
+    f32 cost;
+    if (startCluster == goalCluster && searchCells(scratch, getClusterRect(startCluster), start,
+                &goal, 1, &query, canJump(startCluster), PATH_EXPANSION_BUDGET, &cost, &scratch.cells))
+    {
+        appendPathNodes(scratch.cells, goal, outPath);
+        return;
+    }
+
+    // connect the start and the goal to the portals of their clusters
+    auto connect = [&](CellRef const& cell, u32 clusterIndex, Array<f32>& costs) {
+        Cluster const& cluster = clusters[clusterIndex];
+        scratch.segment.clear();
+        for (u32 i=0; i<cluster.nodeCount; ++i)
+        {
+            scratch.segment.push(portalNodes[clusterNodes[cluster.firstNode + i]].cell);
+        }
+        costs.resize(cluster.nodeCount);
+        if (cluster.nodeCount > 0)
+        {
+            searchCells(scratch, getClusterRect(clusterIndex), cell, scratch.segment.data(),
+                    cluster.nodeCount, &query, false, PATH_EXPANSION_BUDGET, costs.data(), nullptr);
+        }
+    };
+    connect(start, startCluster, scratch.startCosts);
+    connect(goal, goalCluster, scratch.goalCosts);
+
+    // A* over the portal graph, where the start and the goal are the last two nodes
+    u32 startNode = portalNodes.size();
+    u32 goalNode = startNode + 1;
+    if (scratch.portalNodes.size() < goalNode + 1)
+    {
+        scratch.portalNodes.resize(goalNode + 1);
+    }
+    u32 gen = ++scratch.generation;
+    auto getNodeCell = [&](u32 node) -> CellRef const& {
+        return node == startNode ? start : (node == goalNode ? goal : portalNodes[node].cell);
+    };
+    auto getHeuristic = [&](u32 node) {
+        CellRef const& c = getNodeCell(node);
+        return octileDistance(c.x, c.y, goal.x, goal.y);
+    };
+    auto visit = [&](u32 next, f32 g, u32 parent) {
+        SearchNode& node = scratch.portalNodes[next];
+        if (node.seen == gen && (node.closed == gen || node.g <= g))
+        {
+            return;
+        }
+        node.g = g;
+        node.parent = parent;
+        node.seen = gen;
+        heapPush(scratch.open, { g + getHeuristic(next), next });
+    };
+
+    scratch.open.clear();
+    visit(startNode, 0.f, startNode);
+    u32 bestNode = startNode;
+    f32 bestHeuristic = getHeuristic(startNode);
+    Cluster const& firstCluster = clusters[startCluster];
+    while (!scratch.open.empty() && scratch.expansions < PATH_EXPANSION_BUDGET)
+    {
+        OpenEntry entry = heapPop(scratch.open);
+        SearchNode& node = scratch.portalNodes[entry.index];
+        if (node.closed == gen)
+        {
+            continue;
+        }
+        node.closed = gen;
+        ++scratch.expansions;
+
+        if (entry.index == goalNode)
+        {
+            bestNode = goalNode;
+            break;
+        }
+        f32 h = getHeuristic(entry.index);
+        if (h < bestHeuristic)
+        {
+            bestHeuristic = h;
+            bestNode = entry.index;
+        }
+
+        if (entry.index == startNode)
+        {
+            for (u32 i=0; i<firstCluster.nodeCount; ++i)
             {
-                Node* node = g_tmpMem.bump<Node>();
-                *node = newNode;
-                open.push(node);
+                if (scratch.startCosts[i] != FLT_MAX)
+                {
+                    visit(clusterNodes[firstCluster.firstNode + i], scratch.startCosts[i], startNode);
+                }
             }
+            continue;
         }
+        PortalNode const& portal = portalNodes[entry.index];
+        for (u32 i=0; i<portal.edgeCount; ++i)
+        {
+            PortalEdge const& edge = portalEdges[portal.firstEdge + i];
+            visit(edge.target, node.g + edge.cost, entry.index);
+        }
+        if (portal.cluster == goalCluster && scratch.goalCosts[portal.indexInCluster] != FLT_MAX)
+        {
+            visit(goalNode, node.g + scratch.goalCosts[portal.indexInCluster], entry.index);
+        }
+    }
+    if (bestNode == startNode)
+    {
+        return;
     }
+
+    scratch.portalPath.clear();
+    for (u32 node = bestNode; node != startNode; node = scratch.portalNodes[node].parent)
+    {
+        scratch.portalPath.push(node);
+    }
+    scratch.portalPath.reverse();
+
+    // fill in the cells between the portals as long as the budget lasts, except for the first
+    // part which is always filled in since it is what the driver follows right away
+    scratch.cells.clear();
+    scratch.cells.push(start);
+    CellRef current = start;
+    for (u32 node : scratch.portalPath)
+    {
+        CellRef const& next = getNodeCell(node);
+        u32 clusterIndex = getClusterIndex(current.x, current.y);
+        u32 budget = current == start ? UINT32_MAX : PATH_EXPANSION_BUDGET;
+        if (getClusterIndex(next.x, next.y) == clusterIndex
+                && searchCells(scratch, getClusterRect(clusterIndex), current, &next, 1, &query,
+                    canJump(clusterIndex), budget, &cost, &scratch.segment))
+        {
+            for (u32 i=1; i<scratch.segment.size(); ++i)
+            {
+                scratch.cells.push(scratch.segment[i]);
+            }
+        }
+        else
+        {
+            // the two sides of a portal are next to each other, and once the budget is spent the
+            // rest of the path only goes through the portals
+            scratch.cells.push(next);
+        }
+        current = next;
+    }
+    appendPathNodes(scratch.cells, goal, outPath);
+}
+
+void MotionGrid::benchmarkPathFinding(u32 queryCount)
+{
+    if (!grid)
+    {
+        println("There is no motion grid to benchmark.");
+        return;
+    }
+
+    Array<Vec3> positions;
+    for (i32 y=0; y<height; ++y)
+    {
+        for (i32 x=0; x<width; ++x)
+        {
+            for (auto& cell : getCell(x, y).contents)
+            {
+                if (isPassable(cell, false))
+                {
+                    positions.push(Vec3(x1 + x * CELL_SIZE, y1 + y * CELL_SIZE, cell.z));
+                }
+            }
+        }
+    }
+    if (positions.size() < 2)
+    {
+        return;
+    }
+
+    struct Query
+    {
+        Vec3 from, to;
+    };
+    Array<Query> queries;
+    RandomSeries series;
+    for (u32 i=0; i<queryCount; ++i)
+    {
+        queries.push({ positions[irandom(series, 0, (i32)positions.size())],
+                       positions[irandom(series, 0, (i32)positions.size())] });
+    }
+
+    PathScratch scratch;
+    Array<PathNode> path;
+    f64 hierarchicalTime = 0.0;
+    f64 hierarchicalMaxTime = 0.0;
+    u64 hierarchicalExpansions = 0;
+    u32 hierarchicalMaxExpansions = 0;
+    u32 hierarchicalComplete = 0;
+    for (auto& q : queries)
+    {
+        Vec3 from = q.from;
+        Vec3 to = q.to;
+        f64 t = getTime();
+        findPath(from, to, false, Vec2(1.f, 0.f), path, scratch);
+        t = getTime() - t;
+        hierarchicalTime += t;
+        hierarchicalMaxTime = max(hierarchicalMaxTime, t);
+        hierarchicalExpansions += scratch.expansions;
+        hierarchicalMaxExpansions = max(hierarchicalMaxExpansions, scratch.expansions);
+        if (!path.empty() && path.back().p.x == to.x && path.back().p.y == to.y)
+        {
+            ++hierarchicalComplete;
+        }
+    }
+
+    // plain A* over the whole grid without a budget, for comparison
+    PathScratch flatScratch;
+    CellRect rect = { 0, 0, width - 1, height - 1 };
+    f64 flatTime = 0.0;
+    f64 flatMaxTime = 0.0;
+    u64 flatExpansions = 0;
+    u32 flatMaxExpansions = 0;
+    u32 flatComplete = 0;
+    for (auto& q : queries)
+    {
+        CellRef start = { (i32)((q.from.x - x1) / CELL_SIZE), (i32)((q.from.y - y1) / CELL_SIZE),
+            (u32)getCellLayerIndex(q.from) };
+        CellRef goal = { (i32)((q.to.x - x1) / CELL_SIZE), (i32)((q.to.y - y1) / CELL_SIZE),
+            (u32)getCellLayerIndex(q.to) };
+        PathQuery query = { Vec2(q.from), Vec2(1.f, 0.f), false };
+        f32 cost;
+        f64 t = getTime();
+        flatScratch.expansions = 0;
+        if (searchCells(flatScratch, rect, start, &goal, 1, &query, false, UINT32_MAX, &cost,
+                    &flatScratch.cells))
+        {
+            ++flatComplete;
+        }
+        t = getTime() - t;
+        flatTime += t;
+        flatMaxTime = max(flatMaxTime, t);
+        flatExpansions += flatScratch.expansions;
+        flatMaxExpansions = max(flatMaxExpansions, flatScratch.expansions);
+    }
+
+    println("%u path queries over %ix%i cells: hierarchical %.4fms avg %.4fms max, "
+            "%.0f avg %u max expansions, %u complete", queryCount, width, height,
+            hierarchicalTime * 1000.0 / queryCount, hierarchicalMaxTime * 1000.0,
+            (f64)hierarchicalExpansions / queryCount, hierarchicalMaxExpansions, hierarchicalComplete);
+    println("%u path queries over %ix%i cells: flat A* %.4fms avg %.4fms max, "
+            "%.0f avg %u max expansions, %u complete", queryCount, width, height,
+            flatTime * 1000.0 / queryCount, flatMaxTime * 1000.0,
+            (f64)flatExpansions / queryCount, flatMaxExpansions, flatComplete);
 }
@@ -2,12 +2,16 @@
 
 #include "misc.h"
 
-#define DEBUG_INFO 0
-
 class MotionGrid
 {
 public:
     static constexpr f32 CELL_SIZE = 2.f;
+    // the grid is divided into square clusters for the hierarchical path search
+    static constexpr i32 CLUSTER_SIZE = 16;
+    // matches the capacity of the contents of a cell
+    static constexpr u32 MAX_LAYERS = 8;
+    // the number of search nodes one path query may expand before it settles for a partial path
+    static constexpr u32 PATH_EXPANSION_BUDGET = 1024;
 
     enum CellType : u8
     {
@@ -26,12 +30,11 @@ public:
         f32 z;
         CellType staticCellType;
         CellType dynamicCellType;
-        u32 generation;
     };
 
     struct Cell
     {
-        SmallArray<CellContents> contents;
+        SmallArray<CellContents, MAX_LAYERS> contents;
     };
 
     struct PathNode
@@ -40,54 +43,169 @@ public:
         f32 f, g, h;
     };
 
+    struct BuildStats
+    {
+        f64 buildTime = 0.0;
+        f64 abstractionTime = 0.0;
+        u32 taskCount = 0;
+        u32 cellsChecked = 0;
+        u32 layerCount = 0;
+        u32 highestLayerCount = 0;
+        u32 portalCount = 0;
+        u32 portalEdgeCount = 0;
+        u32 uniformClusterCount = 0;
+        bool wasCached = false;
+    };
+
+    struct CellRef
+    {
+        i32 x, y;
+        u32 layer;
+    };
+
+    struct SearchNode
+    {
+        f32 g = 0.f;
+        u32 parent = 0;
+        u32 seen = 0;
+        u32 closed = 0;
+    };
+
+    struct OpenEntry
+    {
+        f32 f;
+        u32 index;
+    };
+
+    // Everything a path query writes to. Queries that run at the same time need their own
+    // scratch, but can share the grid.
+    struct PathScratch
+    {
+        Array<SearchNode> cellNodes;
+        Array<SearchNode> portalNodes;
+        Array<OpenEntry> open;
+        Array<f32> startCosts;
+        Array<f32> goalCosts;
+        Array<u32> portalPath;
+        Array<CellRef> cells;
+        Array<CellRef> segment;
+        Array<CellRef> jumpPoints;
+        u32 generation = 0;
+        u32 expansions = 0;
+    };
+
 private:
-    f32 x1 = 0, y1 = 0, x2 = 0, y2 = 0;
-    i32 width, height;
+    struct CellRect
+    {
+        i32 x1, y1, x2, y2;
+    };
 
-    OwnedPtr<Cell[]> grid;
+    struct PathQuery
+    {
+        Vec2 from;
+        Vec2 forward;
+        bool isBlocking;
+    };
 
-    u32 pathGeneration = 0;
-    struct CellPathInfo
+    // a cell next to a cluster border that connects to the neighbouring cluster
+    struct PortalNode
     {
-        u32 pathGeneration[8] = { 0 };
+        CellRef cell;
+        u32 cluster;
+        u32 indexInCluster;
+        u32 firstEdge;
+        u32 edgeCount;
     };
-    OwnedPtr<CellPathInfo[]> pathFindingBuffer;
 
-    struct Node
+    struct PortalEdge
     {
-        i32 x;
-        i32 y;
-        i32 z;
-        f32 g = 0.f;
-        f32 h = 0.f;
-        f32 f = 0.f;
-        Node* parent = nullptr;
-#if DEBUG_INFO
-        bool isBlocked = false;
-#endif
+        u32 target;
+        f32 cost;
     };
-    Array<Node*> open;
 
-#if DEBUG_INFO
-    Array<Node> debugInfo;
-#endif
+    struct Cluster
+    {
+        u32 firstNode;
+        u32 nodeCount;
+        // single layer cells of one type that all connect to each other, which is where jump
+        // point search gives the same paths as A*
+        bool isUniform;
+        f32 costMultiplier;
+    };
+
+    f32 x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+    i32 width = 0, height = 0;
+
+    OwnedPtr<Cell[]> grid;
+    BuildStats buildStats;
+
+    // the areas that have had dynamic cells set since the last call to clearDynamicCells()
+    Array<CellRect> dirtyRects;
+    u32 lastClearedCellCount = 0;
+
+    i32 clustersX = 0, clustersY = 0;
+    Array<Cluster> clusters;
+    Array<u32> clusterNodes;
+    Array<PortalNode> portalNodes;
+    Array<PortalEdge> portalEdges;
+
+    PathScratch defaultScratch;
+
+    void buildRows(class Scene* scene, i32 rowBegin, i32 rowEnd, BuildStats& stats);
+    void buildCells(class Scene* scene, u32 taskCount);
+    void buildAbstraction();
+    bool readCache(const char* path, u64 key);
+    void writeCache(const char* path, u64 key) const;
+
+    Cell& getCell(i32 x, i32 y) const { return grid[y * width + x]; }
+    i32 getNeighborLayer(CellRef const& from, i32 tx, i32 ty, bool includeDynamic) const;
+    i32 getStep(CellRef const& from, i32 dx, i32 dy, bool includeDynamic) const;
+    f32 getStepCost(CellRef const& to, bool isDiagonal, PathQuery const* query) const;
+    u32 getClusterIndex(i32 x, i32 y) const { return (y / CLUSTER_SIZE) * clustersX + x / CLUSTER_SIZE; }
+    CellRect getClusterRect(u32 clusterIndex) const;
+    bool isWalkable(CellRect const& rect, i32 x, i32 y) const;
+    bool jump(CellRect const& rect, i32 x, i32 y, i32 dx, i32 dy, CellRef const& goal,
+            CellRef& outJumpPoint) const;
+    bool searchCells(PathScratch& scratch, CellRect const& rect, CellRef const& start,
+            CellRef const* targets, u32 targetCount, PathQuery const* query, bool useJumps,
+            u32 budget, f32* outCosts, Array<CellRef>* outCells) const;
+    void appendPathNodes(Array<CellRef> const& cells, CellRef const& goal,
+            Array<PathNode>& outPath) const;
 
 public:
     MotionGrid()
     {
     }
 
+    // loads the grid from the cache when the track hasn't changed since it was last built
     void build(class Scene* scene);
-
+    // builds the grid with one task and then with every worker and checks that the results match
+    bool checkDeterminism(class Scene* scene);
+    u64 computeHash() const;
+    BuildStats const& getBuildStats() const { return buildStats; }
+    u32 getLastClearedCellCount() const { return lastClearedCellCount; }
+
+    // dynamic cells stay set until the next call to clearDynamicCells(), which only visits the
+    // areas that were set since the previous call
     void setCell(Vec3 p, CellType cellType, bool permanent=false);
     void setCells(Vec3 p, f32 radius, CellType cellType, bool permanent=false);
+    void clearDynamicCells();
 
     i32 getCellLayerIndex(Vec3 const& p) const;
 
+    // Searches the cluster graph first and then fills in the cells between the portals, so the
+    // cost doesn't grow with the distance to the goal. When the budget runs out the path ends at
+    // the portal closest to the goal, or continues with coarse portal waypoints.
+    void findPath(Vec3& from, Vec3& to, bool isBlockedAhead, Vec2 forward,
+            Array<PathNode>& outPath, PathScratch& scratch) const;
     void findPath(Vec3& from, Vec3& to, bool isBlockedAhead, Vec2 forward,
-            Array<PathNode>& outPath);
+            Array<PathNode>& outPath)
+    {
+        findPath(from, to, isBlockedAhead, forward, outPath, defaultScratch);
+    }
 
-    CellType getCellBleed(i32 x, i32 y, f32 z, CellType cellType);
+    // compares random queries against a plain A* over the whole grid
+    void benchmarkPathFinding(u32 queryCount);
 
     void debugDraw(class RenderWorld* rw);
 };
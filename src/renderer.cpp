@@ -29,8 +29,9 @@ void glShaderSources(GLuint shader, const char* src,
     buf.writef("#define FOG_ENABLED %u\n", u32(g_game.config.graphics.fogEnabled));
     buf.writef("#define HIGH_QUALITY_TERRAIN_ENABLED %u\n", u32(g_game.config.graphics.highQualityTerrainEnabled));
     buf.writef("#define HIGH_QUALITY_TRACK_ENABLED %u\n", u32(g_game.config.graphics.highQualityTrackEnabled));
-    buf.writef("#define MAX_POINT_LIGHTS %u\n", MAX_POINT_LIGHTS);
-    buf.writef("#define LIGHT_SPLITS %u\n", LIGHT_SPLITS);
+    buf.writef("#define CLUSTER_TILES_X %u\n", CLUSTER_TILES_X);
+    buf.writef("#define CLUSTER_TILES_Y %u\n", CLUSTER_TILES_Y);
+    buf.writef("#define CLUSTER_SLICES %u\n", CLUSTER_SLICES);
     for (auto const& d : defines)
     {
         buf.writef("#define %s %s\n", d.name, d.value);
@@ -494,6 +495,24 @@ Camera& RenderWorld::setViewportCamera(u32 index, Vec3 const& from,
     return cam;
 }
 
+f32 RenderWorld::getProjectedSize(Vec3 const& center, f32 radius)
+{
+    f32 size = 0.f;
+    for (u32 i=0; i<cameras.size(); ++i)
+    {
+        size = max(size, getProjectedSize(center, radius, i));
+    }
+    return size;
+}
+
+f32 RenderWorld::getProjectedSize(Vec3 const& center, f32 radius, u32 cameraIndex)
+{
+    f32 viewportHeight = height * viewportLayout[cameras.size() - 1].scale.y;
+    Camera const& cam = cameras[cameraIndex];
+    f32 distance = max(length(center - cam.position) - radius, cam.nearPlane);
+    return radius / distance * cam.projection[1][1] * viewportHeight;
+}
+
 void RenderWorld::addDirectionalLight(Vec3 const& direction, Vec3 const& color)
 {
     worldInfo.sunDirection = -normalize(direction);
@@ -713,23 +732,29 @@ void RenderWorld::createFramebuffers()
                 shadowMapResolution = 512;
             }
 
-            glGenTextures(1, &fb.shadowDepthTexture);
-            glBindTexture(GL_TEXTURE_2D, fb.shadowDepthTexture);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-                    shadowMapResolution, shadowMapResolution,
-                    0, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, nullptr);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LESS);
+            auto createShadowDepthTexture = [&](GLuint& texture, GLuint& framebuffer) {
+                glGenTextures(1, &texture);
+                glBindTexture(GL_TEXTURE_2D, texture);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
+                        shadowMapResolution, shadowMapResolution,
+                        0, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, nullptr);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LESS);
 
-            glGenFramebuffers(1, &fb.shadowFramebuffer);
-            glBindFramebuffer(GL_FRAMEBUFFER, fb.shadowFramebuffer);
-            glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, fb.shadowDepthTexture, 0);
+                glGenFramebuffers(1, &framebuffer);
+                glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+                glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0);
 
-            assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+                assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+            };
+            createShadowDepthTexture(fb.shadowDepthTexture, fb.shadowFramebuffer);
+
+            // static casters are rendered into this texture and copied into the shadow map each frame
+            createShadowDepthTexture(fb.staticShadowDepthTexture, fb.staticShadowFramebuffer);
         }
 
         // bloom framebuffers
@@ -820,6 +845,9 @@ void RenderWorld::createFramebuffers()
         fbs.push(fb);
         worldInfoUBO.push(DynamicBuffer(sizeof(WorldInfo)));
         worldInfoUBOShadow.push(DynamicBuffer(sizeof(WorldInfo)));
+        pointLightSSBO.push(DynamicBuffer(sizeof(PointLight) * MAX_POINT_LIGHTS));
+        lightClusterSSBO.push(DynamicBuffer(sizeof(LightCluster) * CLUSTER_COUNT));
+        lightIndexSSBO.push(DynamicBuffer(sizeof(u32) * MAX_LIGHT_INDICES));
     }
 
     glBindTexture(GL_TEXTURE_2D, 0);
@@ -828,17 +856,32 @@ void RenderWorld::createFramebuffers()
 
 void RenderWorld::destroy()
 {
-    for (auto& b : worldInfoUBO)
-    {
-        b.destroy();
-    }
-    worldInfoUBO.clear();
+    auto destroyBuffers = [](auto& buffers) {
+        for (auto& b : buffers)
+        {
+            b.destroy();
+        }
+        buffers.clear();
+    };
+    destroyBuffers(worldInfoUBO);
+    destroyBuffers(worldInfoUBOShadow);
+    destroyBuffers(pointLightSSBO);
+    destroyBuffers(lightClusterSSBO);
+    destroyBuffers(lightIndexSSBO);
 
-    for (auto& b : worldInfoUBOShadow)
+    for (u32 i=0; i<MAX_VIEWPORTS; ++i)
     {
-        b.destroy();
+        for (u32 j=0; j<MAX_BUFFERED_FRAMES; ++j)
+        {
+            if (shadowTimerQueries[i][j])
+            {
+                glDeleteQueries(1, &shadowTimerQueries[i][j]);
+                shadowTimerQueries[i][j] = 0;
+                shadowTimerQueryIssued[i][j] = false;
+            }
+        }
     }
-    worldInfoUBOShadow.clear();
+    invalidateStaticShadowCache();
 
     for (auto& fb : fbs)
     {
@@ -866,6 +909,11 @@ void RenderWorld::destroy()
             glDeleteTextures(1, &fb.shadowDepthTexture);
             glDeleteFramebuffers(1, &fb.shadowFramebuffer);
         }
+        if (fb.staticShadowFramebuffer)
+        {
+            glDeleteTextures(1, &fb.staticShadowDepthTexture);
+            glDeleteFramebuffers(1, &fb.staticShadowFramebuffer);
+        }
         if (fb.cszFramebuffers[0])
         {
             glDeleteTextures(1, &fb.cszTexture);
@@ -969,6 +1017,7 @@ void RenderWorld::clear()
 
     clearRenderItems(renderItems.depthPrepass);
     clearRenderItems(renderItems.shadowPass);
+    clearRenderItems(renderItems.staticShadowPass);
     clearRenderItems(renderItems.opaqueColorPass);
     clearRenderItems(renderItems.highlightPass);
     clearRenderItems(renderItems.pickPass);
@@ -998,13 +1047,51 @@ void RenderWorld::setShadowMatrices(WorldInfo& worldInfo, WorldInfo& worldInfoSh
     f32 extent = max(
             shadowBounds.max.x-shadowBounds.min.x,
             shadowBounds.max.y-shadowBounds.min.y) * 0.5f;
-    f32 snapMultiple = 2.f * extent / shadowMapResolution;
-    center.x = snap(center.x, snapMultiple);
-    center.y = snap(center.y, snapMultiple);
-    center.z = snap(center.z, snapMultiple);
+    f32 minZ = shadowBounds.min.z;
+    f32 maxZ = shadowBounds.max.z;
+
+    if (staticShadowCacheEnabled)
+    {
+        // keep using the cached region while the frustum still fits inside of it so the static
+        // shadow map can be reused
+        StaticShadowCache& cache = staticShadowCache[cameraIndex];
+        bool fits = cache.hasRegion
+            && cache.sunDirection == worldInfo.sunDirection
+            && extent <= cache.extent
+            && extent >= cache.extent * STATIC_SHADOW_MIN_FILL
+            && absolute(center.x - cache.center.x) + extent <= cache.extent
+            && absolute(center.y - cache.center.y) + extent <= cache.extent
+            && minZ >= cache.minZ
+            && maxZ <= cache.maxZ;
+        if (!fits)
+        {
+            cache.sunDirection = worldInfo.sunDirection;
+            cache.extent = extent * STATIC_SHADOW_REGION_MARGIN;
+            f32 margin = cache.extent - extent;
+            cache.minZ = minZ - margin;
+            cache.maxZ = maxZ + margin;
+            f32 snapMultiple = 2.f * cache.extent / shadowMapResolution;
+            cache.center.x = snap(center.x, snapMultiple);
+            cache.center.y = snap(center.y, snapMultiple);
+            cache.center.z = snap(center.z, snapMultiple);
+            cache.hasRegion = true;
+            cache.isDirty = true;
+        }
+        center = cache.center;
+        extent = cache.extent;
+        minZ = cache.minZ;
+        maxZ = cache.maxZ;
+    }
+    else
+    {
+        f32 snapMultiple = 2.f * extent / shadowMapResolution;
+        center.x = snap(center.x, snapMultiple);
+        center.y = snap(center.y, snapMultiple);
+        center.z = snap(center.z, snapMultiple);
+    }
+
     Mat4 depthProjection = Mat4::ortho(center.x-extent, center.x+extent,
-                                        center.y+extent, center.y-extent,
-                                        -shadowBounds.max.z, -shadowBounds.min.z);
+                                        center.y+extent, center.y-extent, -maxZ, -minZ);
     Mat4 viewProj = depthProjection * depthView;
 
     worldInfoShadow.cameraViewProjection = viewProj;
@@ -1041,52 +1128,45 @@ void RenderWorld::render(Renderer* renderer, f32 deltaTime)
     }
 }
 
-void RenderWorld::partitionPointLights(u32 viewportIndex)
+void RenderWorld::buildLightGrid(u32 viewportIndex)
 {
-    f32 partitionWidth = (f32)fbs[viewportIndex].renderWidth / (f32)LIGHT_SPLITS;
-    f32 partitionHeight = (f32)fbs[viewportIndex].renderHeight / (f32)LIGHT_SPLITS;
-    for (u32 x = 0; x<LIGHT_SPLITS; ++x)
-    {
-        f32 splitX = x * partitionWidth;
-
-        for (u32 y = 0; y<LIGHT_SPLITS; ++y)
-        {
-            f32 splitY = y * partitionHeight;
-
-            // TODO: perform circle vs box collision so that each light affects fewer pixels
-            u32 lightCount = 0;
-            for (auto& p : pointLights)
-            {
-                Vec4 tp = cameras[viewportIndex].viewProjection * Vec4(p.position, 1.f);
-                tp.x = (((tp.x / tp.w) + 1.f) / 2.f) * fbs[viewportIndex].renderWidth;
-                tp.y = ((-1.f * (tp.y / tp.w) + 1.f) / 2.f) * fbs[viewportIndex].renderHeight;
+    TIMED_BLOCK();
 
-                f32 screenSpaceLightRadius = fbs[viewportIndex].renderHeight
-                    * cameras[viewportIndex].projection[1][1] * p.radius / tp.w;
+    Camera const& cam = cameras[viewportIndex];
+    LightGrid& grid = lightGrids[viewportIndex];
+    grid.build(cam.view, cam.projection, cam.nearPlane, cam.farPlane,
+            pointLights.data(), pointLights.size());
+    worldInfo.clusterDepthScale = grid.depthScale;
+    worldInfo.clusterDepthBias = grid.depthBias;
 
-                if (!(tp.x - screenSpaceLightRadius > splitX + partitionWidth
-                    || tp.x + screenSpaceLightRadius < splitX
-                    || tp.y - screenSpaceLightRadius > splitY + partitionHeight
-                    || tp.y + screenSpaceLightRadius < splitY))
-                {
-                    worldInfo.lightPartitions[x][y].pointLights[lightCount++] = p;
-                    if (lightCount >= MAX_POINT_LIGHTS)
-                    {
-                        break;
-                    }
-                }
-            }
-            worldInfo.lightPartitions[x][y].pointLightCount = lightCount;
-        }
+    if (grid.lights.size() > 0)
+    {
+        pointLightSSBO[viewportIndex].updateData(grid.lights.data(),
+                grid.lights.size() * sizeof(PointLight));
+    }
+    if (grid.lightIndices.size() > 0)
+    {
+        lightIndexSSBO[viewportIndex].updateData(grid.lightIndices.data(),
+                grid.lightIndices.size() * sizeof(u32));
     }
+    lightClusterSSBO[viewportIndex].updateData(grid.clusters.data());
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pointLightSSBO[viewportIndex].getBuffer());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, lightClusterSSBO[viewportIndex].getBuffer());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, lightIndexSSBO[viewportIndex].getBuffer());
 }
 
 void RenderWorld::renderViewport(Renderer* renderer, u32 index, f32 deltaTime)
 {
     TIMED_BLOCK();
 
+    g_currentViewportIndex = index;
+
     // update worldinfo uniform buffer
-    partitionPointLights(index);
+    if (g_game.config.graphics.pointLightsEnabled)
+    {
+        buildLightGrid(index);
+    }
     worldInfo.orthoProjection = Mat4::ortho(0.f, (f32)g_game.windowWidth, (f32)g_game.windowHeight, 0.f);
     worldInfo.cameraViewProjection = cameras[index].viewProjection;
     worldInfo.cameraProjection = cameras[index].projection;
@@ -1119,7 +1199,26 @@ void RenderWorld::renderViewport(Renderer* renderer, u32 index, f32 deltaTime)
         // bind worldinfo with shadow matrices
         glBindBufferBase(GL_UNIFORM_BUFFER, 0, worldInfoUBOShadow[index].getBuffer());
 
-        glBindFramebuffer(GL_FRAMEBUFFER, fb.shadowFramebuffer);
+        // read back the timing from the last time this query was used (if it is ready)
+        ShadowPassStats& stats = shadowStats[index];
+        GLuint& timerQuery = shadowTimerQueries[index][g_game.frameIndex];
+        if (!timerQuery)
+        {
+            glCreateQueries(GL_TIME_ELAPSED, 1, &timerQuery);
+        }
+        else if (shadowTimerQueryIssued[index][g_game.frameIndex])
+        {
+            GLint available = 0;
+            glGetQueryObjectiv(timerQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                GLuint64 elapsed = 0;
+                glGetQueryObjectui64v(timerQuery, GL_QUERY_RESULT, &elapsed);
+                stats.gpuTime = (f64)elapsed / 1000000.0;
+            }
+        }
+        glBeginQuery(GL_TIME_ELAPSED, timerQuery);
+        shadowTimerQueryIssued[index][g_game.frameIndex] = true;
 
         glViewport(0, 0, shadowMapResolution, shadowMapResolution);
         glDepthMask(GL_TRUE);
@@ -1131,24 +1230,57 @@ void RenderWorld::renderViewport(Renderer* renderer, u32 index, f32 deltaTime)
         glBindTextureUnit(2, fb.shadowDepthTexture);
         glEnable(GL_DEPTH_CLAMP);
         glDisable(GL_BLEND);
-        glClear(GL_DEPTH_BUFFER_BIT);
         glEnable(GL_POLYGON_OFFSET_FILL);
         glPolygonOffset(2.f, 4096.f);
         glCullFace(GL_FRONT);
 
-        for (auto& pair : renderItems.shadowPass)
+        auto renderShadowItems = [&](Map<ShaderHandle, Array<RenderItem>>& items) {
+            u32 count = 0;
+            for (auto& pair : items)
+            {
+                ShaderProgram const& program = renderer->getShader(pair.key);
+                glUseProgram(program.program);
+                for (auto& renderItem : pair.value)
+                {
+                    renderItem.render(renderItem.renderData);
+                }
+                count += pair.value.size();
+            }
+            return count;
+        };
+
+        stats.staticItemCount = 0;
+        stats.staticCacheUsed = staticShadowCacheEnabled;
+        if (staticShadowCacheEnabled)
         {
-            ShaderProgram const& program = renderer->getShader(pair.key);
-            glUseProgram(program.program);
-            for (auto& renderItem : pair.value)
+            StaticShadowCache& cache = staticShadowCache[index];
+            if (cache.isDirty)
             {
-                renderItem.render(renderItem.renderData);
+                glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 1, -1, "Static Shadow Cache");
+                glBindFramebuffer(GL_FRAMEBUFFER, fb.staticShadowFramebuffer);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                stats.staticItemCount = renderShadowItems(renderItems.staticShadowPass);
+                cache.isDirty = false;
+                glPopDebugGroup();
             }
+
+            // start from the cached static depth and draw the dynamic casters on top
+            glCopyImageSubData(fb.staticShadowDepthTexture, GL_TEXTURE_2D, 0, 0, 0, 0,
+                    fb.shadowDepthTexture, GL_TEXTURE_2D, 0, 0, 0, 0,
+                    shadowMapResolution, shadowMapResolution, 1);
+            glBindFramebuffer(GL_FRAMEBUFFER, fb.shadowFramebuffer);
+        }
+        else
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, fb.shadowFramebuffer);
+            glClear(GL_DEPTH_BUFFER_BIT);
         }
+        stats.dynamicItemCount = renderShadowItems(renderItems.shadowPass);
 
         glDisable(GL_POLYGON_OFFSET_FILL);
         glCullFace(GL_BACK);
         glDisable(GL_DEPTH_CLAMP);
+        glEndQuery(GL_TIME_ELAPSED);
         glPopDebugGroup();
     }
 
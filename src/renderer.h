@@ -8,6 +8,7 @@
 #include "dynamic_buffer.h"
 #include "buffer.h"
 #include "map.h"
+#include "light_grid.h"
 
 struct RenderItem2D
 {
@@ -49,6 +50,10 @@ struct ShaderProgram
 
 GLuint emptyVAO;
 
+// the viewport that RenderWorld::renderViewport() is drawing; render callbacks use it to pick
+// per-viewport data such as the level of detail of a mesh
+u32 g_currentViewportIndex = 0;
+
 struct Camera
 {
     Vec3 position;
@@ -100,6 +105,9 @@ struct Framebuffers
     GLuint shadowFramebuffer;
     GLuint shadowDepthTexture;
 
+    GLuint staticShadowFramebuffer;
+    GLuint staticShadowDepthTexture;
+
     GLuint cszFramebuffers[5];
     GLuint cszTexture;
 
@@ -123,24 +131,6 @@ struct FullscreenFramebuffers
     GLuint fullscreenBlurFramebuffer;
 };
 
-const u32 MAX_POINT_LIGHTS = 18;
-const u32 LIGHT_SPLITS = 5;
-
-struct PointLight
-{
-    Vec3 position;
-    f32 radius;
-    Vec3 color;
-    f32 falloff;
-};
-
-struct LightPartition
-{
-    PointLight pointLights[MAX_POINT_LIGHTS];
-    u32 pointLightCount;
-    f32 pad[3];
-};
-
 struct WorldInfo
 {
     Mat4 orthoProjection;
@@ -153,7 +143,6 @@ struct WorldInfo
     Mat4 cameraView;
     Vec4 cameraPosition;
     Mat4 shadowViewProjectionBias;
-    LightPartition lightPartitions[LIGHT_SPLITS][LIGHT_SPLITS];
     Vec3 fogColor = { 0.5f, 0.6f, 1.f };
     f32 fogDensity = 0.f;
     Vec2 invResolution;
@@ -161,6 +150,9 @@ struct WorldInfo
     f32 cloudShadowStrength = 0.f;
     Vec3 ambientColor = Vec3(0.1f);
     f32 ambientStrength = 1.f;
+    f32 clusterDepthScale = 0.f;
+    f32 clusterDepthBias = 0.f;
+    Vec2 pad2;
 };
 
 static_assert(sizeof(WorldInfo) <= kilobytes(16));
@@ -170,6 +162,7 @@ struct RenderItems
 {
     Map<ShaderHandle, Array<RenderItem>> depthPrepass;
     Map<ShaderHandle, Array<RenderItem>> shadowPass;
+    Map<ShaderHandle, Array<RenderItem>> staticShadowPass;
     Map<ShaderHandle, Array<RenderItem>> opaqueColorPass;
     Array<TransparentRenderItem> transparentPass;
     Map<ShaderHandle, Array<HighlightPassRenderItem>> highlightPass;
@@ -177,6 +170,30 @@ struct RenderItems
     Array<TransparentRenderItem> overlayPass;
 };
 
+// the shadow region of the static shadow cache is kept until the camera frustum no longer fits
+// inside it or the frustum shrinks enough that the cached region wastes too much resolution
+const f32 STATIC_SHADOW_REGION_MARGIN = 1.3f;
+const f32 STATIC_SHADOW_MIN_FILL = 0.6f;
+
+struct StaticShadowCache
+{
+    Vec3 sunDirection;
+    Vec3 center;
+    f32 extent;
+    f32 minZ;
+    f32 maxZ;
+    bool hasRegion = false;
+    bool isDirty = true;
+};
+
+struct ShadowPassStats
+{
+    u32 dynamicItemCount = 0;
+    u32 staticItemCount = 0;
+    bool staticCacheUsed = false;
+    f64 gpuTime = 0.0;
+};
+
 class RenderWorld
 {
     friend class Renderer;
@@ -195,13 +212,24 @@ class RenderWorld
     SmallArray<Camera, MAX_VIEWPORTS> cameras;
     SmallArray<DynamicBuffer, MAX_VIEWPORTS> worldInfoUBO;
     SmallArray<DynamicBuffer, MAX_VIEWPORTS> worldInfoUBOShadow;
+    SmallArray<DynamicBuffer, MAX_VIEWPORTS> pointLightSSBO;
+    SmallArray<DynamicBuffer, MAX_VIEWPORTS> lightClusterSSBO;
+    SmallArray<DynamicBuffer, MAX_VIEWPORTS> lightIndexSSBO;
     Vec4 highlightColor[MAX_VIEWPORTS] = {};
     Vec2 motionBlur[MAX_VIEWPORTS];
     Array<PointLight> pointLights;
+    LightGrid lightGrids[MAX_VIEWPORTS];
 
     BoundingBox shadowBounds;
     bool hasCustomShadowBounds = false;
 
+    bool isSubmittingStaticGeometry = false;
+    bool staticShadowCacheEnabled = false;
+    StaticShadowCache staticShadowCache[MAX_VIEWPORTS];
+    ShadowPassStats shadowStats[MAX_VIEWPORTS];
+    GLuint shadowTimerQueries[MAX_VIEWPORTS][MAX_BUFFERED_FRAMES] = {};
+    bool shadowTimerQueryIssued[MAX_VIEWPORTS][MAX_BUFFERED_FRAMES] = {};
+
     RenderItems renderItems;
 
     // TODO: calculate these based on render resolution
@@ -227,7 +255,7 @@ class RenderWorld
     void setShadowMatrices(WorldInfo& worldInfo, WorldInfo& worldInfoShadow, u32 cameraIndex);
     void renderViewport(class Renderer* renderer, u32 cameraIndex, f32 deltaTime);
     void render(class Renderer* renderer, f32 deltaTime);
-    void partitionPointLights(u32 viewportIndex);
+    void buildLightGrid(u32 viewportIndex);
 
 public:
     RenderWorld() { cameras.resize(1); }
@@ -247,10 +275,45 @@ public:
         renderItems.depthPrepass[shaderHandle].push(renderItem);
     }
 
+    // whether shadowPass() currently adds to the cached static shadow map; those casters must
+    // not depend on the view either, since the cache outlives the frame that built it
+    bool isSubmittingStaticShadows() const
+    {
+        return isSubmittingStaticGeometry && staticShadowCacheEnabled;
+    }
+
     void shadowPass(ShaderHandle shaderHandle, RenderItem const& renderItem)
     {
-        renderItems.shadowPass[shaderHandle].push(renderItem);
+        if (isSubmittingStaticShadows())
+        {
+            renderItems.staticShadowPass[shaderHandle].push(renderItem);
+        }
+        else
+        {
+            renderItems.shadowPass[shaderHandle].push(renderItem);
+        }
+    }
+
+    // Shadow casters submitted between these calls must not move or change shape. When the
+    // static shadow cache is enabled they are only rendered when the cached shadow map is rebuilt.
+    void beginStaticGeometry() { isSubmittingStaticGeometry = true; }
+    void endStaticGeometry() { isSubmittingStaticGeometry = false; }
+    void setStaticShadowCacheEnabled(bool enabled)
+    {
+        if (enabled != staticShadowCacheEnabled)
+        {
+            staticShadowCacheEnabled = enabled;
+            invalidateStaticShadowCache();
+        }
+    }
+    void invalidateStaticShadowCache()
+    {
+        for (auto& cache : staticShadowCache)
+        {
+            cache.isDirty = true;
+        }
     }
+    ShadowPassStats const& getShadowStats(u32 index) const { return shadowStats[index]; }
 
     void opaqueColorPass(ShaderHandle shaderHandle, RenderItem const& renderItem)
     {
@@ -286,6 +349,11 @@ public:
     u32 getViewportCount() const { return cameras.size(); }
     Camera& setViewportCamera(u32 index, Vec3 const& from, Vec3 const& to, f32 nearPlane=0.5f, f32 farPlane=500.f, f32 fov=0.f);
     Camera& getCamera(u32 index) { return cameras[index]; }
+    // the largest height in pixels that a sphere covers in any of the viewports
+    f32 getProjectedSize(Vec3 const& center, f32 radius);
+    // the height in pixels that a sphere covers in one viewport
+    f32 getProjectedSize(Vec3 const& center, f32 radius, u32 cameraIndex);
+    LightGrid const& getLightGrid(u32 index) const { return lightGrids[index]; }
     u32 getWidth() const { return width; }
     u32 getHeight() const { return height; }
     void setSize(u32 width, u32 height)
@@ -21,12 +21,26 @@ inline u32 mapHash(ResourceType val)
     return (u32)val;
 }
 
+// A typed reference to a registered resource that resolves with an array index instead of a name
+// or guid lookup. The generation changes when the resource in the slot is replaced, so a handle to
+// a replaced resource resolves to nothing instead of to some other resource.
+template <typename T>
+struct ResourceHandle
+{
+    u32 index = 0;
+    u32 generation = 0;
+
+    bool isValid() const { return generation != 0; }
+};
+
 class Resource
 {
 public:
     i64 guid;
     Str64 name;
     ResourceType type;
+    // the slot of the resource in the handle table of Resources
+    u32 handleIndex = 0;
 
     virtual ~Resource() {}
     virtual void serialize(Serializer& s)
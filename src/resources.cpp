@@ -3,6 +3,7 @@
 #include "game.h"
 #include "driver.h"
 #include "util.h"
+#include "imgui.h"
 
 #include "texture.h"
 #include "editor/texture_editor.h"
@@ -50,6 +51,23 @@ Resource* Resources::newResource(ResourceType type, bool makeGUID)
 void Resources::registerResource(OwnedPtr<Resource>&& resource)
 {
     i64 guid = resource->guid;
+    auto existing = resources.get(guid);
+    if (existing)
+    {
+        // the replacement takes over the slot, and the handles to the old resource go stale
+        Resource* old = existing->get();
+        resource->handleIndex = old->handleIndex;
+        ++handleSlots[old->handleIndex].generation;
+        Array<Resource*>& ofType = resourcesByType[old->type];
+        ofType.erase(ofType.find(old));
+    }
+    else
+    {
+        resource->handleIndex = handleSlots.size();
+        handleSlots.push({ nullptr, 1 });
+    }
+    handleSlots[resource->handleIndex].resource = resource.get();
+    resourcesByType[resource->type].push(resource.get());
     resourceNameMap.set(resource->name, resource.get());
     resources.set(guid, move(resource));
 }
@@ -109,5 +127,118 @@ void Resources::load()
         }
     }
     defaultMaterial.loadShaderHandles();
+
+    resolveNamedResources();
+}
+
+void Resources::resolveNamedResources()
+{
+    u32 missingCount = 0;
+    for (NamedResourceBase* r = NamedResourceBase::first; r; r = r->next)
+    {
+        if (!r->isLoaded())
+        {
+            if (r->isRequired())
+            {
+                r->printMissing();
+                ++missingCount;
+            }
+            else
+            {
+                println("Warning: resource \"%s\" is missing, the default will be used", r->name);
+            }
+        }
+    }
+    if (missingCount > 0)
+    {
+        FATAL_ERROR("%u resources used by the game are missing. See the log for details.", missingCount);
+    }
+}
+
+void Resources::showFontDebugInfo()
+{
+    u32 sizeCount = 0;
+    for (auto& sizes : fonts)
+    {
+        sizeCount += sizes.value.size();
+    }
+    size_t memoryUsage = 0;
+    f64 creationTime = 0.0;
+    f64 rasterizationTime = 0.0;
+    u32 rasterizedGlyphCount = 0;
+    for (auto& face : fontFaces)
+    {
+        memoryUsage += face.value->getMemoryUsage();
+        creationTime += face.value->getStats().creationTime;
+        rasterizationTime += face.value->getStats().rasterizationTime;
+        rasterizedGlyphCount += face.value->getStats().rasterizedGlyphCount;
+    }
+    ImGui::Text("Fonts: %u faces, %u sizes, %.1fkb, created in %.2fms, "
+            "%u glyphs rasterized in %.2fms", fontFaces.size(), sizeCount,
+            memoryUsage / 1024.0, creationTime * 1000.0, rasterizedGlyphCount,
+            rasterizationTime * 1000.0);
+    if (ImGui::Button("Check Font Faces"))
+    {
+        ShelfPacker::check();
+        for (auto& face : fontFaces)
+        {
+            face.value->check();
+        }
+    }
+
+    auto const& layoutStats = g_textLayoutCache.getLastFrameStats();
+    ImGui::Text("Text layouts: %u cached, last frame %u hits, %u misses, %u evicted",
+            g_textLayoutCache.size(), layoutStats.hits, layoutStats.misses, layoutStats.evictions);
+    if (ImGui::Button("Benchmark Text Layout"))
+    {
+        TextLayoutCache::benchmark(getFont("font_bold", 40), 3600);
+    }
+}
+
+// Compares looking up resources by name and by guid with resolving handles.
+void Resources::benchmarkLookups()
+{
+    Array<Str64> names;
+    Array<i64> guids;
+    Array<ResourceHandle<Resource>> handles;
+    for (auto& res : resources)
+    {
+        names.push(res.value->name);
+        guids.push(res.value->guid);
+        handles.push({ res.value->handleIndex, handleSlots[res.value->handleIndex].generation });
+    }
+    if (names.empty())
+    {
+        return;
+    }
+
+    const u32 lookupCount = 1000000;
+    uintptr_t checksum = 0;
+
+    f64 t = getTime();
+    for (u32 i=0; i<lookupCount; ++i)
+    {
+        checksum += (uintptr_t)*resourceNameMap.get(names[i % names.size()]);
+    }
+    f64 nameTime = getTime() - t;
+
+    t = getTime();
+    for (u32 i=0; i<lookupCount; ++i)
+    {
+        checksum += (uintptr_t)getResource(guids[i % guids.size()]);
+    }
+    f64 guidTime = getTime() - t;
+
+    t = getTime();
+    for (u32 i=0; i<lookupCount; ++i)
+    {
+        ResourceHandle<Resource> const& handle = handles[i % handles.size()];
+        checksum += (uintptr_t)getHandleResource(handle.index, handle.generation);
+    }
+    f64 handleTime = getTime() - t;
+
+    println("%u lookups over %u resources: name %.3fms, guid %.3fms, handle %.3fms (checksum %llx)",
+            lookupCount, names.size(), nameTime * 1000.0, guidTime * 1000.0, handleTime * 1000.0,
+            (u64)checksum);
 }
 
@@ -6,6 +6,7 @@
 #include "resource.h"
 #include "material.h"
 #include "texture.h"
+#include "texture_streamer.h"
 #include "model.h"
 #include "audio.h"
 #include "trackdata.h"
@@ -49,13 +50,29 @@ void registerResourceType(ResourceType resourceType, const char* name, const cha
     g_resourceTypes.set(resourceType, t);
 }
 
+template <typename T> struct ResourceTypeOf;
+template <> struct ResourceTypeOf<Texture> { static constexpr ResourceType value = ResourceType::TEXTURE; };
+template <> struct ResourceTypeOf<Model> { static constexpr ResourceType value = ResourceType::MODEL; };
+template <> struct ResourceTypeOf<Sound> { static constexpr ResourceType value = ResourceType::SOUND; };
+template <> struct ResourceTypeOf<Material> { static constexpr ResourceType value = ResourceType::MATERIAL; };
+
 class Resources
 {
 private:
+    // one face per font file, shared by every size of the font
+    Map<const char*, OwnedPtr<FontFace>> fontFaces;
     Map<const char*, Map<u32, Font>> fonts;
     // TODO: use bigger map size than the default 64 because there are a lot of resources
     Map<i64, OwnedPtr<Resource>> resources;
     Map<Str64, Resource*> resourceNameMap;
+    Map<ResourceType, Array<Resource*>> resourcesByType;
+
+    struct HandleSlot
+    {
+        Resource* resource;
+        u32 generation;
+    };
+    Array<HandleSlot> handleSlots;
 
 public:
     void initResourceTypes();
@@ -63,6 +80,9 @@ public:
     void loadResource(DataFile::Value& data);
     Resource* newResource(ResourceType type, bool makeGUID);
     void registerResource(OwnedPtr<Resource>&& resource);
+    void resolveNamedResources();
+    void benchmarkLookups();
+    void showFontDebugInfo();
     void renameResource(Resource* resource, Str64 const& newName)
     {
         resourceNameMap.erase(resource->name);
@@ -74,16 +94,51 @@ public:
     template <typename T>
     void iterateResourceType(ResourceType type, T const& cb)
     {
-        // TODO: Store a map of each resource type to make this faster
-        for (auto& res : resources)
+        auto ofType = resourcesByType.get(type);
+        if (ofType)
         {
-            if (res.value->type == type)
+            for (Resource* res : *ofType)
             {
-                cb(res.value.get());
+                cb(res);
             }
         }
     }
 
+    Resource* findResource(const char* name, ResourceType type)
+    {
+        auto iter = resourceNameMap.get(name);
+        return (iter && (*iter)->type == type) ? *iter : nullptr;
+    }
+
+    Resource* getHandleResource(u32 index, u32 generation) const
+    {
+        if (index >= handleSlots.size())
+        {
+            return nullptr;
+        }
+        HandleSlot const& slot = handleSlots[index];
+        return slot.generation == generation ? slot.resource : nullptr;
+    }
+
+    u32 getHandleGeneration(u32 index) const { return handleSlots[index].generation; }
+
+    template <typename T>
+    ResourceHandle<T> getHandle(const char* name)
+    {
+        Resource* resource = findResource(name, ResourceTypeOf<T>::value);
+        if (!resource)
+        {
+            return {};
+        }
+        return { resource->handleIndex, handleSlots[resource->handleIndex].generation };
+    }
+
+    template <typename T>
+    T* get(ResourceHandle<T> handle) const
+    {
+        return (T*)getHandleResource(handle.index, handle.generation);
+    }
+
     template <typename T>
     void iterateResources(T const& cb)
     {
@@ -116,18 +171,28 @@ public:
         return ptr ? ptr->get() : nullptr;
     }
 
+    FontFace* getFontFace(const char* name)
+    {
+        auto ptr = fontFaces.get(name);
+        if (!ptr)
+        {
+            return (fontFaces[name] = OwnedPtr<FontFace>(new FontFace(tmpStr("%s.ttf", name)))).get();
+        }
+        return ptr->get();
+    }
+
     Font& getFont(const char* name, u32 height)
     {
         auto ptr = fonts.get(name);
         if (!ptr)
         {
-            return fonts[name][height] = Font(tmpStr("%s.ttf", name), (f32)height);
+            return fonts[name][height] = Font(getFontFace(name), (f32)height);
         }
 
         auto ptr2 = ptr->get(height);
         if (!ptr2)
         {
-            return fonts[name][height] = Font(tmpStr("%s.ttf", name), (f32)height);
+            return fonts[name][height] = Font(getFontFace(name), (f32)height);
         }
 
         return *ptr2;
@@ -244,3 +309,121 @@ public:
     }
 } g_res;
 
+// A resource that gameplay code refers to by name. Declared as a global, it is looked up once when
+// the resources are loaded, so using it costs an array index instead of hashing the name, and a
+// name that doesn't exist stops the game at load instead of in the middle of a race. A missing
+// texture or material only prints a warning and falls back like the name lookups do.
+class NamedResourceBase
+{
+    NamedResourceBase* next;
+
+protected:
+    const char* name;
+    ResourceType type;
+    ResourceHandle<Resource> handle;
+
+    NamedResourceBase(const char* name, ResourceType type) : next(first), name(name), type(type)
+    {
+        first = this;
+    }
+
+    Resource* resolve()
+    {
+        Resource* resource = g_res.get(handle);
+        if (!resource)
+        {
+            // not resolved yet, or the resource was replaced in the editor since
+            resource = g_res.findResource(name, type);
+            if (resource)
+            {
+                handle.index = resource->handleIndex;
+                handle.generation = g_res.getHandleGeneration(handle.index);
+            }
+        }
+        return resource;
+    }
+
+public:
+    static NamedResourceBase* first;
+
+    virtual ~NamedResourceBase() {}
+    virtual bool isLoaded() { return resolve() != nullptr; }
+    virtual void printMissing() { error("Missing resource: \"%s\"", name); }
+    bool isRequired() const { return type != ResourceType::TEXTURE && type != ResourceType::MATERIAL; }
+
+    friend class Resources;
+};
+
+NamedResourceBase* NamedResourceBase::first = nullptr;
+
+inline Texture* getFallbackResource(Texture*, const char* name) { return &g_res.white; }
+inline Material* getFallbackResource(Material*, const char* name) { return &g_res.defaultMaterial; }
+template <typename T>
+T* getFallbackResource(T*, const char* name)
+{
+    FATAL_ERROR("Resource not found: %s", name);
+}
+
+template <typename T>
+class NamedResource : public NamedResourceBase
+{
+public:
+    NamedResource(const char* name) : NamedResourceBase(name, ResourceTypeOf<T>::value) {}
+
+    T* get()
+    {
+        Resource* resource = resolve();
+        return resource ? (T*)resource : getFallbackResource((T*)nullptr, name);
+    }
+    operator T*() { return get(); }
+    T* operator->() { return get(); }
+};
+
+// a mesh of a named model; the index of the mesh is found once as well
+class NamedMesh : public NamedResource<Model>
+{
+    const char* meshName;
+    Model* resolvedModel = nullptr;
+    u32 meshIndex = 0;
+
+    i32 findMesh(Model* model) const
+    {
+        for (u32 i=0; i<model->meshes.size(); ++i)
+        {
+            if (model->meshes[i].name == meshName)
+            {
+                return (i32)i;
+            }
+        }
+        return -1;
+    }
+
+public:
+    NamedMesh(const char* modelName, const char* meshName)
+        : NamedResource<Model>(modelName), meshName(meshName) {}
+
+    bool isLoaded() override
+    {
+        Resource* model = resolve();
+        return model && findMesh((Model*)model) != -1;
+    }
+    void printMissing() override { error("Missing mesh: \"%s\" in model \"%s\"", meshName, name); }
+
+    Mesh* get()
+    {
+        Model* model = NamedResource<Model>::get();
+        if (model != resolvedModel || meshIndex >= model->meshes.size())
+        {
+            i32 index = findMesh(model);
+            if (index == -1)
+            {
+                FATAL_ERROR("Cannot find mesh with name \"%s\" in model \"%s\"", meshName, name);
+            }
+            meshIndex = (u32)index;
+            resolvedModel = model;
+        }
+        return &model->meshes[meshIndex];
+    }
+    operator Mesh*() { return get(); }
+    Mesh* operator->() { return get(); }
+};
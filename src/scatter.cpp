@@ -0,0 +1,643 @@
+#include "scatter.h"
+#include "renderer.h"
+#include "resources.h"
+#include "model.h"
+#include "track.h"
+
+// whether a road triangle covers p no higher than the clearance above the terrain there
+static bool isUnderRoad(Array<Vec3> const& roadTriangles, Array<u32> const& nearbyTriangles,
+        Vec2 p, f32 terrainZ)
+{
+    for (u32 i : nearbyTriangles)
+    {
+        Vec3 const& a = roadTriangles[i + 0];
+        Vec3 const& b = roadTriangles[i + 1];
+        Vec3 const& c = roadTriangles[i + 2];
+        f32 area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+        if (area == 0.f)
+        {
+            continue;
+        }
+        f32 u = ((b.x - p.x) * (c.y - p.y) - (c.x - p.x) * (b.y - p.y)) / area;
+        f32 v = ((c.x - p.x) * (a.y - p.y) - (a.x - p.x) * (c.y - p.y)) / area;
+        f32 w = 1.f - u - v;
+        if (u >= 0.f && v >= 0.f && w >= 0.f
+                && a.z * u + b.z * v + c.z * w < terrainZ + SCATTER_ROAD_CLEARANCE)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void generateScatterCell(Terrain const* terrain, TerrainLayer const* layers,
+        Array<Vec3> const& roadTriangles, u32 seed, i32 cellX, i32 cellY,
+        Array<ScatterInstance>& output)
+{
+    output.clear();
+    Vec2 cellMin(cellX * SCATTER_CELL_SIZE, cellY * SCATTER_CELL_SIZE);
+    Vec2 cellMax = cellMin + Vec2(SCATTER_CELL_SIZE);
+
+    // only the road triangles that overlap the cell need to be tested
+    Array<u32> nearbyTriangles;
+    for (u32 i=0; i<roadTriangles.size(); i+=3)
+    {
+        Vec3 const& a = roadTriangles[i + 0];
+        Vec3 const& b = roadTriangles[i + 1];
+        Vec3 const& c = roadTriangles[i + 2];
+        if (max(max(a.x, b.x), c.x) >= cellMin.x && min(min(a.x, b.x), c.x) <= cellMax.x
+                && max(max(a.y, b.y), c.y) >= cellMin.y && min(min(a.y, b.y), c.y) <= cellMax.y)
+        {
+            nearbyTriangles.push(i);
+        }
+    }
+    for (u32 layerIndex=0; layerIndex<NUM_TERRAIN_LAYERS; ++layerIndex)
+    {
+        TerrainLayer const& layer = layers[layerIndex];
+        if (!layer.scatterModelGuid || layer.scatterDensity <= 0.f)
+        {
+            continue;
+        }
+
+        RandomSeries series;
+        series.state = seed;
+        series.state = (series.state ^ (u32)cellX) * 16777619u;
+        series.state = (series.state ^ (u32)cellY) * 16777619u;
+        series.state = (series.state ^ layerIndex) * 16777619u;
+        if (series.state == 0)
+        {
+            series.state = 1;
+        }
+
+        u32 candidateCount = (u32)(min(layer.scatterDensity, MAX_SCATTER_DENSITY)
+                * SCATTER_CELL_SIZE * SCATTER_CELL_SIZE);
+        for (u32 i=0; i<candidateCount; ++i)
+        {
+            // every candidate draws the same random numbers whether it is kept or not, so
+            // painting one spot doesn't move the instances in the rest of the cell
+            Vec2 p = cellMin + Vec2(random01(series), random01(series)) * SCATTER_CELL_SIZE;
+            f32 threshold = random01(series);
+            f32 angle = random(series, 0.f, PI * 2.f);
+            f32 scale = random(series, layer.scatterMinScale, layer.scatterMaxScale);
+
+            if (p.x < terrain->x1 || p.y < terrain->y1 || p.x > terrain->x2 || p.y > terrain->y2)
+            {
+                continue;
+            }
+            if (terrain->getLayerWeight(p, layerIndex) <= threshold)
+            {
+                continue;
+            }
+
+            Vec3 position(p.x, p.y, terrain->getZ(p));
+            if (!nearbyTriangles.empty()
+                    && isUnderRoad(roadTriangles, nearbyTriangles, p, position.z))
+            {
+                continue;
+            }
+            output.push({ Mat4::translation(position) * Mat4::rotationZ(angle)
+                    * Mat4::scaling(Vec3(scale)), layerIndex });
+        }
+    }
+}
+
+bool ScatterSystem::hasSettingsChanged(Terrain* terrain, Track* track, u32 seed) const
+{
+    if (terrain != this->terrain || track != this->track || seed != this->seed)
+    {
+        return true;
+    }
+    if (track && track->getVersion() != trackVersion)
+    {
+        return true;
+    }
+    if (!terrain)
+    {
+        return false;
+    }
+    if (terrain->getVersion() != terrainVersion)
+    {
+        return true;
+    }
+    for (u32 i=0; i<NUM_TERRAIN_LAYERS; ++i)
+    {
+        TerrainLayer const& a = terrain->getMaterial()->terrainLayers[i];
+        TerrainLayer const& b = layers[i];
+        if (a.scatterModelGuid != b.scatterModelGuid || a.scatterDensity != b.scatterDensity
+                || a.scatterMinScale != b.scatterMinScale || a.scatterMaxScale != b.scatterMaxScale)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ScatterSystem::applySettings(Terrain* terrain, Track* track, u32 seed)
+{
+    this->terrain = terrain;
+    this->track = track;
+    this->seed = seed;
+    roadTriangles.clear();
+    if (track)
+    {
+        // the preview geometry is the driving surface without the edges, in position and
+        // normal pairs
+        trackVersion = track->getVersion();
+        Array<f32> vertices;
+        Array<u32> indices;
+        track->buildPreviewGeometry(vertices, indices);
+        roadTriangles.reserve(indices.size());
+        for (u32 index : indices)
+        {
+            roadTriangles.push(Vec3(vertices[index * 6 + 0], vertices[index * 6 + 1],
+                        vertices[index * 6 + 2]));
+        }
+    }
+    if (terrain)
+    {
+        terrainVersion = terrain->getVersion();
+        for (u32 i=0; i<NUM_TERRAIN_LAYERS; ++i)
+        {
+            layers[i] = terrain->getMaterial()->terrainLayers[i];
+        }
+    }
+}
+
+u32 ScatterSystem::getDrawIndex(Material* material, Mesh* mesh)
+{
+    // there are only as many draws as there are objects in the scatter models
+    for (u32 i=0; i<draws.size(); ++i)
+    {
+        if (draws[i].material == material && draws[i].mesh == mesh)
+        {
+            return i;
+        }
+    }
+    Draw draw;
+    draw.material = material;
+    draw.mesh = mesh;
+    draws.push(move(draw));
+    stats.drawCount = draws.size();
+    return draws.size() - 1;
+}
+
+void ScatterSystem::addCell(i32 x, i32 y, Array<ScatterInstance> const& placed)
+{
+    u32 key = getCellKey(x, y);
+    Cell& cell = cells[key];
+    cell.x = x;
+    cell.y = y;
+    for (auto& instance : placed)
+    {
+        Resource* resource = g_res.getResource(layers[instance.layer].scatterModelGuid);
+        if (!resource || resource->type != ResourceType::MODEL)
+        {
+            continue;
+        }
+        Model* model = (Model*)resource;
+        for (auto& obj : model->objects)
+        {
+            if (!obj.isVisible)
+            {
+                continue;
+            }
+            u32 drawIndex = getDrawIndex(g_res.getMaterial(obj.materialGuid),
+                    &model->meshes[obj.meshIndex]);
+            Draw& draw = draws[drawIndex];
+            u32 index = draw.instances.size();
+            draw.instances.push(makeInstanceData(instance.transform * obj.getTransform()));
+            draw.owners.push({ key, cell.slots.size() });
+            draw.dirtyInstances.push(index);
+            cell.slots.push({ drawIndex, index });
+        }
+        ++cell.instanceCount;
+    }
+    ++stats.cellCount;
+    stats.instanceCount += cell.instanceCount;
+}
+
+void ScatterSystem::removeCell(u32 key)
+{
+    Cell* cell = cells.get(key);
+    assert(cell);
+
+    // Going from the last slot of each draw to the first means that the last instance of the
+    // draw is never one of this cell's other instances, so it can always be moved into the slot.
+    Array<InstanceSlot> slots = cell->slots;
+    slots.sort([](InstanceSlot const& a, InstanceSlot const& b) {
+        return a.drawIndex != b.drawIndex ? a.drawIndex < b.drawIndex : a.index > b.index;
+    });
+    for (auto& slot : slots)
+    {
+        Draw& draw = draws[slot.drawIndex];
+        u32 last = draw.instances.size() - 1;
+        if (slot.index != last)
+        {
+            draw.instances[slot.index] = draw.instances[last];
+            draw.owners[slot.index] = draw.owners[last];
+            InstanceOwner const& owner = draw.owners[slot.index];
+            cells.get(owner.cellKey)->slots[owner.slotIndex].index = slot.index;
+            draw.dirtyInstances.push(slot.index);
+        }
+        draw.instances.pop();
+        draw.owners.pop();
+    }
+
+    --stats.cellCount;
+    stats.instanceCount -= cell->instanceCount;
+    cells.erase(key);
+}
+
+void ScatterSystem::update(Terrain* terrain, Track* track, RenderWorld* rw, u32 seed)
+{
+    TIMED_BLOCK();
+
+    stats.cellsGeneratedLastFrame = 0;
+    stats.cellsEvictedLastFrame = 0;
+    if (hasSettingsChanged(terrain, track, seed))
+    {
+        clear();
+        applySettings(terrain, track, seed);
+    }
+    if (!terrain)
+    {
+        return;
+    }
+
+    // the distance from the closest camera to the closest point of a cell
+    auto getCellDistance = [rw](i32 x, i32 y) {
+        Vec2 cellMin(x * SCATTER_CELL_SIZE, y * SCATTER_CELL_SIZE);
+        Vec2 cellMax = cellMin + Vec2(SCATTER_CELL_SIZE);
+        f32 minDistance = FLT_MAX;
+        for (u32 i=0; i<rw->getViewportCount(); ++i)
+        {
+            Vec3 p = rw->getCamera(i).position;
+            f32 dx = max(max(cellMin.x - p.x, p.x - cellMax.x), 0.f);
+            f32 dy = max(max(cellMin.y - p.y, p.y - cellMax.y), 0.f);
+            minDistance = min(minDistance, sqrtf(dx * dx + dy * dy));
+        }
+        return minDistance;
+    };
+
+    Array<u32> evictedCells;
+    for (auto& pair : cells)
+    {
+        if (getCellDistance(pair.value.x, pair.value.y) > SCATTER_VIEW_DISTANCE)
+        {
+            evictedCells.push(pair.key);
+        }
+    }
+    for (u32 key : evictedCells)
+    {
+        removeCell(key);
+        ++stats.cellsEvictedLastFrame;
+    }
+
+    struct MissingCell
+    {
+        i32 x, y;
+        f32 distance;
+    };
+    Array<MissingCell> missingCells;
+    Map<u32, bool> queuedCells;
+    i32 cellRange = (i32)ceilf(SCATTER_VIEW_DISTANCE / SCATTER_CELL_SIZE);
+    for (u32 i=0; i<rw->getViewportCount(); ++i)
+    {
+        Vec3 p = rw->getCamera(i).position;
+        i32 centerX = (i32)floorf(p.x / SCATTER_CELL_SIZE);
+        i32 centerY = (i32)floorf(p.y / SCATTER_CELL_SIZE);
+        for (i32 y=centerY-cellRange; y<=centerY+cellRange; ++y)
+        {
+            for (i32 x=centerX-cellRange; x<=centerX+cellRange; ++x)
+            {
+                u32 key = getCellKey(x, y);
+                if (cells.get(key) || queuedCells.get(key))
+                {
+                    continue;
+                }
+                f32 distance = getCellDistance(x, y);
+                if (distance <= SCATTER_VIEW_DISTANCE)
+                {
+                    queuedCells[key] = true;
+                    missingCells.push({ x, y, distance });
+                }
+            }
+        }
+    }
+
+    // the closest cells are generated first, and the rest wait for the next frames when the
+    // budget runs out
+    missingCells.sort([](MissingCell const& a, MissingCell const& b) {
+        return a.distance < b.distance;
+    });
+    f64 startTime = getTime();
+    Array<ScatterInstance> placed;
+    for (auto& missing : missingCells)
+    {
+        if (stats.cellsGeneratedLastFrame > 0 && getTime() - startTime > SCATTER_GENERATION_BUDGET)
+        {
+            break;
+        }
+        f64 cellStartTime = getTime();
+        generateScatterCell(terrain, layers, roadTriangles, seed, missing.x, missing.y, placed);
+        addCell(missing.x, missing.y, placed);
+        stats.maxCellGenerationTime = max(stats.maxCellGenerationTime, getTime() - cellStartTime);
+        ++stats.cellsGeneratedLastFrame;
+    }
+}
+
+void ScatterSystem::upload()
+{
+    stats.instancesUploadedLastFrame = 0;
+
+    // when a draw has outgrown its range every range is laid out again with room to grow, and
+    // the whole buffer is uploaded
+    bool fits = instanceBuffer != 0;
+    for (auto& draw : draws)
+    {
+        fits = fits && draw.instances.size() <= draw.bufferCapacity;
+    }
+    if (!fits)
+    {
+        u32 capacity = 0;
+        for (auto& draw : draws)
+        {
+            draw.bufferOffset = capacity;
+            draw.bufferCapacity = max(draw.instances.size() + draw.instances.size() / 2, 256u);
+            capacity += draw.bufferCapacity;
+        }
+        if (capacity > instanceBufferCapacity)
+        {
+            if (instanceBuffer)
+            {
+                glDeleteBuffers(1, &instanceBuffer);
+            }
+            instanceBufferCapacity = capacity;
+            glCreateBuffers(1, &instanceBuffer);
+            glNamedBufferData(instanceBuffer, instanceBufferCapacity * sizeof(InstanceData),
+                    nullptr, GL_DYNAMIC_DRAW);
+        }
+        else
+        {
+            glInvalidateBufferData(instanceBuffer);
+        }
+        for (auto& draw : draws)
+        {
+            if (!draw.instances.empty())
+            {
+                glNamedBufferSubData(instanceBuffer, draw.bufferOffset * sizeof(InstanceData),
+                        draw.instances.size() * sizeof(InstanceData), draw.instances.data());
+            }
+            stats.instancesUploadedLastFrame += draw.instances.size();
+            draw.dirtyInstances.clear();
+        }
+        return;
+    }
+
+    // otherwise only the instances that changed are uploaded, in runs of neighbouring slots
+    for (auto& draw : draws)
+    {
+        if (draw.dirtyInstances.empty())
+        {
+            continue;
+        }
+        draw.dirtyInstances.sort();
+        u32 i = 0;
+        while (i < draw.dirtyInstances.size())
+        {
+            u32 begin = draw.dirtyInstances[i];
+            u32 end = begin + 1;
+            ++i;
+            while (i < draw.dirtyInstances.size() && draw.dirtyInstances[i] <= end)
+            {
+                end = draw.dirtyInstances[i] + 1;
+                ++i;
+            }
+            // slots that were dirtied and then removed from the end need no upload
+            end = min(end, draw.instances.size());
+            if (begin < end)
+            {
+                glNamedBufferSubData(instanceBuffer,
+                        (draw.bufferOffset + begin) * sizeof(InstanceData),
+                        (end - begin) * sizeof(InstanceData), draw.instances.data() + begin);
+                stats.instancesUploadedLastFrame += end - begin;
+            }
+        }
+        draw.dirtyInstances.clear();
+    }
+}
+
+void ScatterSystem::render(RenderWorld* rw)
+{
+    upload();
+    for (auto& draw : draws)
+    {
+        if (!draw.instances.empty())
+        {
+            draw.material->drawInstanced(rw, draw.mesh, instanceBuffer, nullptr,
+                    draw.bufferOffset, draw.instances.size(),
+                    Vec2(SCATTER_FADE_START_DISTANCE, SCATTER_VIEW_DISTANCE));
+        }
+    }
+}
+
+void ScatterSystem::clear()
+{
+    cells.clear();
+    draws.clear();
+    stats = ScatterStats();
+}
+
+void ScatterSystem::check(Terrain* terrain, Track* track, u32 seed)
+{
+    ScatterSystem system;
+    system.applySettings(terrain, track, seed);
+
+    const i32 cellRange = 4;
+    i32 centerX = (i32)floorf((terrain->x1 + terrain->x2) * 0.5f / SCATTER_CELL_SIZE);
+    i32 centerY = (i32)floorf((terrain->y1 + terrain->y2) * 0.5f / SCATTER_CELL_SIZE);
+    struct CheckedCell
+    {
+        i32 x, y;
+        u64 hash;
+    };
+    Array<CheckedCell> checkedCells;
+    Array<ScatterInstance> placed;
+    auto hashInstances = [](Array<ScatterInstance> const& instances) {
+        u64 hash = HASH_SEED;
+        for (auto& instance : instances)
+        {
+            hash = hashValue(hash, instance.transform);
+            hash = hashValue(hash, instance.layer);
+        }
+        return hash;
+    };
+
+    // generate every cell once and time it
+    f64 totalTime = 0.0;
+    f64 maxTime = 0.0;
+    u32 placedCount = 0;
+    for (i32 y=centerY-cellRange; y<centerY+cellRange; ++y)
+    {
+        for (i32 x=centerX-cellRange; x<centerX+cellRange; ++x)
+        {
+            f64 t = getTime();
+            generateScatterCell(terrain, system.layers, system.roadTriangles, seed,
+                    x, y, placed);
+            f64 cellTime = getTime() - t;
+            totalTime += cellTime;
+            maxTime = max(maxTime, cellTime);
+            placedCount += placed.size();
+            checkedCells.push({ x, y, hashInstances(placed) });
+        }
+    }
+
+    // generating them again in the opposite order must give the same instances
+    bool isDeterministic = true;
+    for (i32 i=(i32)checkedCells.size()-1; i>=0; --i)
+    {
+        CheckedCell const& cell = checkedCells[i];
+        generateScatterCell(terrain, system.layers, system.roadTriangles, seed,
+                cell.x, cell.y, placed);
+        if (hashInstances(placed) != cell.hash)
+        {
+            error("Scatter cell %i,%i is different when it is generated again", cell.x, cell.y);
+            isDeterministic = false;
+        }
+    }
+
+    // cells along the road must not have instances on it; every road triangle is tested here
+    // rather than only the ones the generation found near the cell
+    Array<u32> allRoadTriangles;
+    for (u32 i=0; i<system.roadTriangles.size(); i+=3)
+    {
+        allRoadTriangles.push(i);
+    }
+    bool isOffRoad = true;
+    u32 roadCellCount = 0;
+    u32 roadStep = max(system.roadTriangles.size() / 3 / 32, 1u) * 3;
+    for (u32 i=0; i<system.roadTriangles.size() && isOffRoad; i+=roadStep)
+    {
+        Vec3 const& p = system.roadTriangles[i];
+        i32 x = (i32)floorf(p.x / SCATTER_CELL_SIZE);
+        i32 y = (i32)floorf(p.y / SCATTER_CELL_SIZE);
+        generateScatterCell(terrain, system.layers, system.roadTriangles, seed, x, y, placed);
+        ++roadCellCount;
+        for (auto& instance : placed)
+        {
+            Vec3 position = instance.transform.position();
+            if (isUnderRoad(system.roadTriangles, allRoadTriangles, Vec2(position), position.z))
+            {
+                error("Scatter cell %i,%i has an instance on the road at %.1f, %.1f", x, y,
+                        position.x, position.y);
+                isOffRoad = false;
+                break;
+            }
+        }
+    }
+
+    // add all cells, then evict and add them back in a mixed order
+    RandomSeries series;
+    Array<u32> liveCells;
+    for (u32 i=0; i<checkedCells.size(); ++i)
+    {
+        generateScatterCell(terrain, system.layers, system.roadTriangles, seed,
+                checkedCells[i].x, checkedCells[i].y, placed);
+        system.addCell(checkedCells[i].x, checkedCells[i].y, placed);
+        liveCells.push(i);
+    }
+    for (u32 n=0; n<checkedCells.size() * 2; ++n)
+    {
+        bool isFull = liveCells.size() == checkedCells.size();
+        if (liveCells.size() > 1 && (isFull || irandom(series, 0, 3) > 0))
+        {
+            u32 i = irandom(series, 0, liveCells.size());
+            CheckedCell const& cell = checkedCells[liveCells[i]];
+            system.removeCell(getCellKey(cell.x, cell.y));
+            liveCells[i] = liveCells.back();
+            liveCells.pop();
+        }
+        else
+        {
+            for (u32 i=0; i<checkedCells.size(); ++i)
+            {
+                CheckedCell const& cell = checkedCells[i];
+                if (!system.cells.get(getCellKey(cell.x, cell.y)))
+                {
+                    generateScatterCell(terrain, system.layers, system.roadTriangles, seed,
+                            cell.x, cell.y, placed);
+                    system.addCell(cell.x, cell.y, placed);
+                    liveCells.push(i);
+                    break;
+                }
+            }
+        }
+    }
+
+    // the same cells added to an empty system must give the same instances in every draw,
+    // though not in the same order
+    ScatterSystem expected;
+    expected.applySettings(terrain, track, seed);
+    for (u32 i : liveCells)
+    {
+        generateScatterCell(terrain, system.layers, system.roadTriangles, seed,
+                checkedCells[i].x, checkedCells[i].y, placed);
+        expected.addCell(checkedCells[i].x, checkedCells[i].y, placed);
+    }
+    auto sumInstances = [](Draw const& draw) {
+        u64 sum = 0;
+        for (auto& instance : draw.instances)
+        {
+            sum += hashValue(HASH_SEED, instance);
+        }
+        return sum;
+    };
+    bool isConsistent = system.stats.cellCount == expected.stats.cellCount
+        && system.stats.instanceCount == expected.stats.instanceCount;
+    for (u32 i=0; i<expected.draws.size() && isConsistent; ++i)
+    {
+        Draw const& expectedDraw = expected.draws[i];
+        u32 drawIndex = system.getDrawIndex(expectedDraw.material, expectedDraw.mesh);
+        Draw const& draw = system.draws[drawIndex];
+        isConsistent = draw.instances.size() == expectedDraw.instances.size()
+            && sumInstances(draw) == sumInstances(expectedDraw);
+    }
+    // every instance must be where its cell thinks it is
+    for (u32 d=0; d<system.draws.size() && isConsistent; ++d)
+    {
+        for (u32 i=0; i<system.draws[d].owners.size() && isConsistent; ++i)
+        {
+            InstanceOwner const& owner = system.draws[d].owners[i];
+            Cell* cell = system.cells.get(owner.cellKey);
+            isConsistent = cell && cell->slots[owner.slotIndex].drawIndex == d
+                && cell->slots[owner.slotIndex].index == i;
+        }
+    }
+    if (!isConsistent)
+    {
+        error("Scatter draws don't match the instances of their cells after evictions");
+    }
+
+    println("Scatter: %u cells with %u instances, %.3fms on average and %.3fms at most per cell "
+            "(budget %.3fms per frame)", checkedCells.size(), placedCount,
+            totalTime / checkedCells.size() * 1000.0, maxTime * 1000.0,
+            SCATTER_GENERATION_BUDGET * 1000.0);
+    if (maxTime > SCATTER_GENERATION_BUDGET)
+    {
+        error("Generating a scatter cell took %.3fms, more than the %.3fms budget",
+                maxTime * 1000.0, SCATTER_GENERATION_BUDGET * 1000.0);
+    }
+    if (isDeterministic && isConsistent && isOffRoad)
+    {
+        println("Scatter placement is deterministic, stays off the road in %u cells along it "
+                "and the draws match their cells", roadCellCount);
+    }
+}
+
+ScatterSystem::~ScatterSystem()
+{
+    if (instanceBuffer)
+    {
+        glDeleteBuffers(1, &instanceBuffer);
+    }
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "math.h"
+#include "map.h"
+#include "instancing.h"
+#include "terrain.h"
+
+// the terrain is split into square cells of this size that are generated and evicted as a whole
+const f32 SCATTER_CELL_SIZE = 16.f;
+// instances start shrinking at the fade start distance and are gone at the view distance
+const f32 SCATTER_FADE_START_DISTANCE = 70.f;
+const f32 SCATTER_VIEW_DISTANCE = 100.f;
+const f32 MAX_SCATTER_DENSITY = 8.f;
+// cells are generated until this much time has been spent in a frame (at least one per frame)
+const f64 SCATTER_GENERATION_BUDGET = 0.001;
+// instances are kept under the road only when the road is at least this high above the terrain,
+// like under a bridge
+const f32 SCATTER_ROAD_CLEARANCE = 3.f;
+
+struct ScatterInstance
+{
+    Mat4 transform;
+    u32 layer;
+};
+
+// Places the instances of one cell from the density maps of the terrain's paint layers, leaving
+// out the ones covered by the road. roadTriangles holds three positions for every triangle of
+// the road surface. The result only depends on the seed, the cell coordinates, the layer
+// settings, the terrain and the road, so a cell that is evicted and generated again looks the
+// same. This does not touch GL.
+void generateScatterCell(Terrain const* terrain, TerrainLayer const* layers,
+        Array<Vec3> const& roadTriangles, u32 seed, i32 cellX, i32 cellY,
+        Array<ScatterInstance>& output);
+
+struct ScatterStats
+{
+    u32 cellCount = 0;
+    u32 instanceCount = 0;
+    u32 drawCount = 0;
+    u32 cellsGeneratedLastFrame = 0;
+    u32 cellsEvictedLastFrame = 0;
+    u32 instancesUploadedLastFrame = 0;
+    f64 maxCellGenerationTime = 0.0;
+};
+
+// Scatters grass and other small details over the terrain without creating entities or physics
+// actors. Only the cells near the cameras exist, and they are drawn instanced.
+class ScatterSystem
+{
+    // where one instance of a cell is in the draws
+    struct InstanceSlot
+    {
+        u32 drawIndex;
+        u32 index;
+    };
+    struct Cell
+    {
+        i32 x, y;
+        u32 instanceCount = 0;
+        Array<InstanceSlot> slots;
+    };
+    struct InstanceOwner
+    {
+        u32 cellKey;
+        u32 slotIndex;
+    };
+    // Every material and mesh pair is one instanced draw of its own range of the instance buffer.
+    // The instances in a range are in no particular order: a new cell appends its instances and
+    // the slots of an evicted cell are filled with the last instances of the draw, so generating
+    // or evicting a cell only touches as many instances as the cell has.
+    struct Draw
+    {
+        Material* material;
+        Mesh* mesh;
+        Array<InstanceData> instances;
+        // the cell of every instance and the index of the instance in that cell's slots
+        Array<InstanceOwner> owners;
+        Array<u32> dirtyInstances;
+        u32 bufferOffset = 0;
+        u32 bufferCapacity = 0;
+    };
+    Map<u32, Cell> cells;
+    Array<Draw> draws;
+    GLuint instanceBuffer = 0;
+    u32 instanceBufferCapacity = 0;
+
+    // settings that the generated cells were built with; when they change all cells are dropped
+    Terrain* terrain = nullptr;
+    u32 terrainVersion = 0;
+    class Track* track = nullptr;
+    u32 trackVersion = 0;
+    u32 seed = 0;
+    TerrainLayer layers[NUM_TERRAIN_LAYERS];
+    Array<Vec3> roadTriangles;
+
+    ScatterStats stats;
+
+    static u32 getCellKey(i32 x, i32 y) { return ((u32)x & 0xFFFF) | ((u32)y << 16); }
+    bool hasSettingsChanged(Terrain* terrain, class Track* track, u32 seed) const;
+    void applySettings(Terrain* terrain, class Track* track, u32 seed);
+    u32 getDrawIndex(Material* material, Mesh* mesh);
+    void addCell(i32 x, i32 y, Array<ScatterInstance> const& placed);
+    void removeCell(u32 key);
+    void upload();
+
+public:
+    ScatterSystem() {}
+    ScatterSystem(ScatterSystem const&) = delete;
+    ScatterSystem& operator = (ScatterSystem const&) = delete;
+    ~ScatterSystem();
+
+    void update(Terrain* terrain, class Track* track, class RenderWorld* rw, u32 seed);
+    void render(class RenderWorld* rw);
+    void clear();
+
+    // Generates the cells around the middle of the terrain twice and checks that they come out
+    // the same and within the generation budget, then adds and evicts them in a mixed order and
+    // checks that the draws hold exactly the instances of the remaining cells. This does not
+    // touch GL. Also checks that no instance was placed on the road.
+    static void check(Terrain* terrain, class Track* track, u32 seed);
+
+    ScatterStats const& getStats() const { return stats; }
+};
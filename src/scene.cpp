@@ -59,6 +59,13 @@ Scene::Scene(TrackData* data)
         serialize(s);
     }
 
+    Array<CollisionMeshRequest> collisionMeshRequests;
+    for (auto& e : newEntities)
+    {
+        e->gatherCollisionMeshes(collisionMeshRequests);
+    }
+    prepareCollisionMeshes(collisionMeshRequests);
+
     while (newEntities.size() > 0)
     {
         Array<OwnedPtr<Entity>> savedNewEntities = move(newEntities);
@@ -73,6 +80,7 @@ Scene::Scene(TrackData* data)
             entities.push(move(e));
         }
     }
+    areEntityListsDirty = true;
 
     assert(track != nullptr);
     assert(start != nullptr);
@@ -86,6 +94,7 @@ Scene::Scene(TrackData* data)
 
 Scene::~Scene()
 {
+    fetchPhysicsResults();
     physicsScene->release();
     if (backgroundSound)
     {
@@ -131,7 +140,9 @@ void Scene::startRace()
     {
         p.build(trackGraph);
     }
-    //motionGrid.build(this);
+    motionGrid.build(this);
+    aiScheduler.reset();
+    spatialHash.clear();
 
     struct OrderedDriver
     {
@@ -157,6 +168,7 @@ void Scene::startRace()
     }
 #endif
 
+    vehicleBatch.setup(physicsScene, createOrder.size());
     numHumanDrivers = 0;
     for (u32 i=0; i<createOrder.size(); ++i)
     {
@@ -194,6 +206,31 @@ void Scene::startRace()
     }
 
     isRaceInProgress = true;
+    physicsClock = PhysicsClock();
+    physicsInterpolation = 1.f;
+}
+
+void Scene::rebuildEntityLists()
+{
+    updatedEntities.clear();
+    renderedEntities.clear();
+    physicsEntities.clear();
+    for (auto& e : entities)
+    {
+        if ((e->entityFlags & EntityFlags::HAS_UPDATE) == EntityFlags::HAS_UPDATE)
+        {
+            updatedEntities.push(e.get());
+        }
+        if ((e->entityFlags & EntityFlags::HAS_RENDER) == EntityFlags::HAS_RENDER)
+        {
+            renderedEntities.push(e.get());
+        }
+        if ((e->entityFlags & EntityFlags::HAS_PHYSICS_RESULTS) == EntityFlags::HAS_PHYSICS_RESULTS)
+        {
+            physicsEntities.push(e.get());
+        }
+    }
+    areEntityListsDirty = false;
 }
 
 void Scene::buildBatches()
@@ -206,12 +243,16 @@ void Scene::buildBatches()
     }
     batcher.end();
     f64 timeTakenToBuildBatches = getTime() - t;
-    println("Built %u batches in %.2f seconds", batcher.batches.size(), timeTakenToBuildBatches);
+    println("Built %u batches and %u instanced draws of %u instances in %.2f seconds",
+            batcher.batches.size(), batcher.instances.getDrawCount(),
+            batcher.instances.getInstanceCount(), timeTakenToBuildBatches);
     isBatched = true;
 }
 
 void Scene::stopRace()
 {
+    fetchPhysicsResults();
+
     // TODO: fix this
     trackPreviewCameraFrom = g_game.renderer->getRenderWorld()->getCamera(0).position;
     trackPreviewCameraTarget =
@@ -220,6 +261,8 @@ void Scene::stopRace()
     finishOrder.clear();
     placements.clear();
     vehicles.clear();
+    spatialHash.clear();
+    vehicleBatch.destroy();
     isRaceInProgress = false;
     g_audio.setPaused(false);
     g_audio.stopAllGameplaySounds();
@@ -255,6 +298,7 @@ void Scene::stopRace()
 
 void Scene::onStart()
 {
+    g_game.renderer->getRenderWorld()->invalidateStaticShadowCache();
     backgroundSound = g_audio.playSound(
             g_res.getSound("environment"), SoundType::MUSIC, true, 1.f, 0.f);
 }
@@ -263,6 +307,8 @@ void Scene::onUpdate(Renderer* renderer, f32 deltaTime)
 {
     TIMED_BLOCK();
 
+    fetchPhysicsResults();
+
     RenderWorld* rw = renderer->getRenderWorld();
     rw->setShadowBounds({}, false);
     //rw->setClearColor(g_game.isEditing || g_game.isDebugCameraEnabled);
@@ -343,18 +389,30 @@ void Scene::onUpdate(Renderer* renderer, f32 deltaTime)
             listenerPositions.push(trackPreviewCameraTarget);
         }
 
-        // TODO: Use PhysX scratch buffer to reduce allocations
         if (isRaceInProgress)
         {
             physicsMouseDrag(renderer);
-            physicsScene->simulate(deltaTime);
-            physicsScene->fetchResults(true);
         }
         else
         {
             rw->setMotionBlur(0, Vec2(0.f));
         }
 
+        // mark the cells under the vehicles for the AI; hazards and pickups mark their cells in
+        // their own updates further down, so the AI sees those as they were last frame
+        if (isRaceInProgress)
+        {
+            for (auto& v : vehicles)
+            {
+                if (!v->isDead())
+                {
+                    motionGrid.setCells(v->getPosition(), 3.f, MotionGrid::VEHICLE);
+                }
+            }
+        }
+
+        aiScheduler.update(this, vehicles);
+
         // update vehicles
         for (u32 i=0; i<vehicles.size(); ++i)
         {
@@ -364,9 +422,36 @@ void Scene::onUpdate(Renderer* renderer, f32 deltaTime)
                 listenerPositions.push(vehicles[i]->lastValidPosition);
             }
         }
+        motionGrid.clearDynamicCells();
+
+        if (isRaceInProgress)
+        {
+            catchUpPhysics(deltaTime);
+        }
+
+        // built after the physics steps of the frame, so the entities that look for vehicles
+        // see them where they are now
+        for (auto& v : vehicles)
+        {
+            spatialHash.add(v->getPosition(), v.get());
+        }
+        spatialHash.build();
+
+        // the cameras follow the interpolated poses, so they are updated after the physics steps
+        for (u32 i=0; i<vehicles.size(); ++i)
+        {
+            if (vehicles[i]->cameraIndex >= 0)
+            {
+                vehicles[i]->updateCamera(rw, deltaTime);
+            }
+        }
 
         // update entities
-        for (auto const& e : entities)
+        if (areEntityListsDirty)
+        {
+            rebuildEntityLists();
+        }
+        for (Entity* e : updatedEntities)
         {
             e->onUpdate(rw, this, deltaTime);
         }
@@ -439,39 +524,62 @@ void Scene::onUpdate(Renderer* renderer, f32 deltaTime)
         vehicles[i]->drawHUD(renderer, deltaTime);
     }
 
-    // delete destroyed entities
-    for (auto it = entities.begin(); it != entities.end();)
+    // delete destroyed entities, keeping the order of the rest
+    u32 aliveEntityCount = 0;
+    for (u32 i=0; i<entities.size(); ++i)
     {
-        if ((*it)->isDestroyed())
-        {
-            it = entities.erase(it);
-        }
-        else
+        if (!entities[i]->isDestroyed())
         {
-            ++it;
+            if (i != aliveEntityCount)
+            {
+                entities[aliveEntityCount] = move(entities[i]);
+            }
+            ++aliveEntityCount;
         }
     }
+    if (aliveEntityCount != entities.size())
+    {
+        entities.resize(aliveEntityCount);
+        areEntityListsDirty = true;
+    }
 
     // render entities
-    for (auto const& e : entities)
+    if (areEntityListsDirty)
+    {
+        rebuildEntityLists();
+    }
+    rw->setStaticShadowCacheEnabled(isBatched && g_game.config.graphics.staticShadowCacheEnabled);
+    frameInstances.clear();
+    for (Entity* e : renderedEntities)
     {
+        bool isStaticGeometry = e == terrain || e == track;
+        if (isStaticGeometry)
+        {
+            rw->beginStaticGeometry();
+        }
         e->onRender(rw, this, deltaTime);
+        if (isStaticGeometry)
+        {
+            rw->endStaticGeometry();
+        }
     }
 
-    // render the batches
-    batcher.render(rw);
+    frameInstances.build();
+    frameInstances.upload();
+    frameInstances.render(rw);
 
-    // handle newly created entities
-    for (auto& e : newEntities)
+    if (terrain)
     {
-        e->onCreate(this);
-    }
-    for (auto& e : newEntities)
-    {
-        e->onCreateEnd(this);
-        entities.push(move(e));
+        scatter.update(terrain, track, rw, (u32)guid);
+        scatter.render(rw);
     }
-    newEntities.clear();
+
+    // render the batches
+    rw->beginStaticGeometry();
+    batcher.render(rw);
+    rw->endStaticGeometry();
+
+    createNewEntities();
 
     if (g_game.isPhysicsDebugVisualizationEnabled)
     {
@@ -507,7 +615,7 @@ void Scene::onUpdate(Renderer* renderer, f32 deltaTime)
 
     if (g_game.isMotionGridDebugVisualizationEnabled)
     {
-        //motionGrid.debugDraw(rw);
+        motionGrid.debugDraw(rw);
     }
 
     if (g_game.isPathVisualizationEnabled)
@@ -570,6 +678,102 @@ void Scene::onUpdate(Renderer* renderer, f32 deltaTime)
         f32 volume = (g_game.isEditing && !isRaceInProgress) ? 0.f : 1.f;
         g_audio.setSoundVolume(backgroundSound, volume);
     }
+
+    // everything that writes to the physics scene this frame is done, so the step that the next
+    // frame will need can run while this one is rendered
+    if (isRaceInProgress && !isPaused && physicsClock.needsStep(getPhysicsTimestep()))
+    {
+        simulatePhysics(!isPhysicsOverlapEnabled);
+    }
+}
+
+f32 Scene::getPhysicsTimestep() const
+{
+    return 1.f / (f32)max(g_game.config.gameplay.physicsTickRate, 1u);
+}
+
+void Scene::simulatePhysics(bool waitForResults)
+{
+    f32 timestep = getPhysicsTimestep();
+    for (auto& v : vehicles)
+    {
+        v->onPhysicsStep(timestep);
+    }
+    vehicleBatch.step(timestep);
+
+    // TODO: Use PhysX scratch buffer to reduce allocations
+    f64 t = getTime();
+    physicsScene->simulate(timestep);
+    physicsSimulateCallTime = getTime() - t;
+    isPhysicsSimulating = true;
+    ++physicsStepCount;
+    if (waitForResults)
+    {
+        fetchPhysicsResults();
+    }
+}
+
+void Scene::catchUpPhysics(f32 deltaTime)
+{
+    physicsClock.advance(deltaTime);
+
+    // the step that was kicked off at the end of the last frame is enough unless the frame was
+    // longer than a step
+    u32 stepCount = 0;
+    while (physicsClock.isBehind() && stepCount < g_game.config.gameplay.maxPhysicsSubsteps)
+    {
+        simulatePhysics(true);
+        ++stepCount;
+    }
+    physicsClock.dropBacklog();
+    physicsInterpolation = physicsClock.getInterpolation(getPhysicsTimestep());
+}
+
+void Scene::fetchPhysicsResults()
+{
+    if (isPhysicsSimulating)
+    {
+        f64 t = getTime();
+        physicsScene->fetchResults(true);
+        physicsStallTime = getTime() - t;
+        isPhysicsSimulating = false;
+        physicsClock.onStepFetched(getPhysicsTimestep());
+        onPhysicsResults();
+    }
+}
+
+void Scene::createNewEntities()
+{
+    for (auto& e : newEntities)
+    {
+        e->onCreate(this);
+    }
+    for (auto& e : newEntities)
+    {
+        e->onCreateEnd(this);
+        entities.push(move(e));
+    }
+    if (!newEntities.empty())
+    {
+        areEntityListsDirty = true;
+    }
+    newEntities.clear();
+}
+
+void Scene::onPhysicsResults()
+{
+    for (auto& v : vehicles)
+    {
+        v->vehiclePhysics.capturePose();
+    }
+    if (areEntityListsDirty)
+    {
+        rebuildEntityLists();
+    }
+    for (Entity* e : physicsEntities)
+    {
+        e->onPhysicsResults(this);
+    }
 }
 
 void Scene::physicsMouseDrag(Renderer* renderer)
@@ -692,94 +896,41 @@ void Scene::vehicleFinish(u32 n)
 
 void Scene::updateTrackPreview(Renderer* renderer, u32 size)
 {
+    TIMED_BLOCK();
+
     BoundingBox bb = track->getBoundingBox();
 
 #if 1
-    if (!hasTrackPreview)
-    {
-        hasTrackPreview = true;
-
-        Vec3 bbCenter = (bb.min + bb.max) * 0.5f;
-        Vec3 dir = normalize(Vec3(1.f));
-        f32 dist = 850.f;
-        Vec3 camPosition;
-        Mat4 viewProjection;
-        for (u32 i=1; i<150; ++i)
-        {
-            camPosition = (bbCenter - Vec3(0, 0, 20)) + dir * dist;
-            Mat4 view = Mat4::lookAt(camPosition, bbCenter, Vec3(0, 0, 1));
-            Mat4 projection = Mat4::perspective(radians(26.f), 1.f, 1.f, 2500.f);
-            viewProjection = projection * view;
-
-            Vec3 points[] = {
-                { bb.min.x, bb.min.y, bb.min.z },
-                { bb.min.x, bb.max.y, bb.min.z },
-                { bb.max.x, bb.min.y, bb.min.z },
-                { bb.max.x, bb.max.y, bb.min.z },
-                { bb.min.x, bb.min.y, bb.max.z },
-                { bb.min.x, bb.max.y, bb.max.z },
-                { bb.max.x, bb.min.y, bb.max.z },
-                { bb.max.x, bb.max.y, bb.max.z },
-            };
-
-            bool allPointsVisible = true;
-            f32 margin = 0.01f;
-            for (auto& p : points)
-            {
-                Vec4 tp = viewProjection * Vec4(p, 1.f);
-                tp.x = (((tp.x / tp.w) + 1.f) / 2.f);
-                tp.y = ((-1.f * (tp.y / tp.w) + 1.f) / 2.f);
-                if (tp.x < margin || tp.x > 1.f - margin || tp.y < margin || tp.y > 1.f - margin)
-                {
-                    allPointsVisible = false;
-                    break;
-                }
-            }
-
-            if (allPointsVisible)
-            {
-                break;
-            }
-            dist += 10.f;
-        }
-        trackPreview2D.setCamPosition(camPosition);
-        trackPreview2D.setCamViewProjection(viewProjection);
-    }
-    trackPreview2D.beginUpdate(renderer, size, size);
-
-    //Mesh* startMesh = &g_res.getModel("misc")->meshes.front();
-    Mesh* startMesh = &g_res.getModel("HUDStart")->meshes.back();
-    trackPreview2D.drawItem(
-        startMesh->vao, startMesh->numIndices, start->transform, Vec3(1.f), false);
-
+    // the track is only drawn again when it has been edited or the preview size has changed
     Mesh* trackMesh = track->getPreviewMesh(this);
-    trackPreview2D.drawItem(trackMesh->vao, (u32)trackMesh->numIndices, Mat4(1.f),
-            Vec3(1.f), true, 1);
-    trackPreview2D.drawItem(trackMesh->vao, (u32)trackMesh->numIndices,
-            Mat4::translation({ 0, 0, -5 }), Vec3(0.2f), true, 0);
-    /*
-    for (u32 i=0; i<20; ++i)
+    if (trackPreviewVersion != track->getPreviewVersion()
+            || memcmp(&trackPreviewStartTransform, &start->transform, sizeof(Mat4)) != 0
+            || trackPreview2D.needsStaticUpdate(size, size))
     {
-        trackPreview2D.drawItem(trackMesh->vao, (u32)trackMesh->numIndices,
-                Mat4::translation(
-                    { 0, 0, track->getBoundingBox().min.z - 7.f + (i/20.f * 7.f)})
-                    * Mat4::scaling({ 1, 1, i/20.f }), Vec3(0.18f), true, 0);
+        trackPreviewVersion = track->getPreviewVersion();
+        trackPreviewStartTransform = start->transform;
+
+        //Mesh* startMesh = &g_res.getModel("misc")->meshes.front();
+        Mesh* startMesh = &g_res.getModel("HUDStart")->meshes.back();
+        trackPreview2D.drawStaticLayer(renderer, size, bb, trackMesh, startMesh,
+                start->transform);
     }
-    */
+
+    trackPreview2D.beginUpdate(renderer);
 
     Mesh* sphereMesh = &g_res.getModel("sphere")->meshes.front();
     //Mesh* cubeMesh = &g_res.getModel("HUDCar")->meshes.front();
+    trackPreviewMarkers.clear();
     for (auto const& v : vehicles)
     {
-        trackPreview2D.drawItem(sphereMesh->vao, sphereMesh->numIndices,
-            Mat4::translation(Vec3(0, 0, 2.1f) + v->getPosition())
-                * Mat4::scaling(Vec3(5.1f)),
-            v->getDriver()->getVehicleConfig()->cosmetics.color, false, 2);
+        trackPreviewMarkers.push(TrackPreview2D::makeMarker(v->getPosition(),
+                v->getDriver()->getVehicleConfig()->cosmetics.color));
         /*
         trackPreview2D.drawItem(cubeMesh->vao, cubeMesh->numIndices, v->getTransform(),
             v->getDriver()->getVehicleConfig()->color, false, 0);
         */
     }
+    trackPreview2D.drawMarkers(sphereMesh, trackPreviewMarkers);
 #else
 
     f32 pad = 20.f;
@@ -801,7 +952,7 @@ void Scene::updateTrackPreview(Renderer* renderer, u32 size)
                 bb.max.y, -bb.max.z - 10.f, -bb.min.z + 10.f) * transform;
 
     trackPreview2D.setCamViewProjection(trackOrtho);
-    trackPreview2D.beginUpdate(renderer, size, size);
+    trackPreview2D.beginStaticUpdate(renderer, size, size);
 
     Mesh* quadMesh = g_res.getModel("misc")->getMeshByName("Quad");
     trackPreview2D.drawItem(
@@ -813,6 +964,9 @@ void Scene::updateTrackPreview(Renderer* renderer, u32 size)
     trackPreview2D.drawItem(trackMesh->vao, (u32)trackMesh->numIndices, Mat4(1.f),
             Vec3(1.f), true, 1);
 
+    trackPreview2D.endStaticUpdate();
+    trackPreview2D.beginUpdate(renderer);
+
     Mesh* mesh = g_res.getModel("misc")->getMeshByName("TrackArrow");
     for (auto const& v : vehicles)
     {
@@ -836,6 +990,78 @@ void Scene::writeTrackData()
     g_res.getTrackData(guid)->data = move(data);
 }
 
+void Scene::benchmarkTrackSave()
+{
+    // larger than the terrain of any shipped track, so the heights and the paint layers alone
+    // are several megabytes
+    Terrain* terrain = (Terrain*)g_entities[0].create(0);
+    terrain->resize(-1024, -1024, 1024, 1024);
+    RandomSeries series;
+    for (u32 i=0; i<64; ++i)
+    {
+        Vec2 pos(random(series, -1024.f, 1024.f), random(series, -1024.f, 1024.f));
+        terrain->raise(pos, random(series, 20.f, 200.f), 2.f, random(series, -10.f, 30.f));
+    }
+
+    auto buildData = [&] {
+        DataFile::Value data = DataFile::makeDict();
+        Serializer s(data, false);
+        serialize(s);
+        auto dict = DataFile::makeDict();
+        Serializer terrainSerializer(dict, false);
+        terrain->serialize(terrainSerializer);
+        data.dict().val()["entities"].array().val().push(move(dict));
+        return data;
+    };
+
+    f64 startTime = getTime();
+    DataFile::Value data = buildData();
+    f64 serializeTime = getTime() - startTime;
+
+    createDirectory("../cache");
+    const char* filename = "../cache/track_save_benchmark.dat";
+    startTime = getTime();
+    if (!DataFile::save(data, filename))
+    {
+        error("Track save benchmark failed: could not write %s", filename);
+        delete terrain;
+        return;
+    }
+    f64 saveTime = getTime() - startTime;
+    SDL_RWops* file = SDL_RWFromFile(filename, "rb");
+    i64 fileSize = file ? SDL_RWsize(file) : 0;
+    if (file)
+    {
+        SDL_RWclose(file);
+    }
+
+    DataFile::Value loaded = DataFile::load(filename);
+    bool matches = loaded.hash() == data.hash();
+
+    // the caller only pays for handing the value over; the write happens on the save thread
+    DataFile::Value backgroundData = buildData();
+    startTime = getTime();
+    DataFile::saveInBackground(move(backgroundData), filename);
+    f64 queueTime = getTime() - startTime;
+    DataFile::finishBackgroundSaves();
+    f64 backgroundTime = getTime() - startTime;
+
+    DataFile::Value loadedFromBackground = DataFile::load(filename);
+    matches = matches && loadedFromBackground.hash() == data.hash();
+    remove(filename);
+    delete terrain;
+
+    if (!matches)
+    {
+        error("Track save benchmark: the saved track does not load back unchanged");
+        return;
+    }
+    println("Track save benchmark: %.2fMB, serialize %.2fms, save %.2fms, "
+            "background save %.3fms on the caller (%.2fms total)",
+            fileSize / (1024.0 * 1024.0), serializeTime * 1000.0, saveTime * 1000.0,
+            queueTime * 1000.0, backgroundTime * 1000.0);
+}
+
 void Scene::onEnd()
 {
     if (g_game.isEditing)
@@ -929,16 +1155,15 @@ void Scene::buildRaceResults()
 
 void Scene::applyAreaForce(Vec3 const& position, f32 strength) const
 {
-    for (auto& v : vehicles)
-    {
+    f32 radius = strength * 1.5f;
+    forEachVehicleInRadius(position, radius, [&](Vehicle* v) {
         f32 dist = distance(v->getPosition(), position);
-        f32 radius = strength * 1.5f;
         if (dist < radius)
         {
             v->shakeScreen(powf(
                         clamp(1.f - dist / radius, 0.f, 1.f), 0.5f) * radius);
         }
-    }
+    });
     // TODO: apply force to nearby physics bodies
 }
 
@@ -1309,6 +1534,7 @@ void Scene::deserializeTransientEntities(Array<DataFile::Value>& entities)
         if (((*it)->entityFlags & EntityFlags::TRANSIENT) == EntityFlags::TRANSIENT)
         {
             it = this->entities.erase(it);
+            areEntityListsDirty = true;
         }
         else
         {
@@ -1321,11 +1547,385 @@ void Scene::deserializeTransientEntities(Array<DataFile::Value>& entities)
     }
 }
 
+void Scene::checkPhysicsRenderRates()
+{
+    if (g_game.state.drivers.empty())
+    {
+        error("Checking physics across render rates needs drivers to race");
+        return;
+    }
+    if (g_game.isEditing)
+    {
+        writeTrackData();
+    }
+
+    const f32 timestep = getPhysicsTimestep();
+    const u32 totalStepCount = 300;
+    // frame times in seconds; the last one alternates between a short and a long frame
+    f32 frameTimes[][2] = {
+        { 1.f / 30.f, 1.f / 30.f },
+        { timestep, timestep },
+        { 1.f / 75.f, 1.f / 75.f },
+        { 1.f / 144.f, 1.f / 144.f },
+        { timestep * 0.7f, timestep * 1.3f },
+    };
+
+    u64 expectedHash = 0;
+    bool allMatch = true;
+    for (u32 rate=0; rate<ARRAY_SIZE(frameTimes); ++rate)
+    {
+        OwnedPtr<Scene> scene(new Scene(g_res.getTrackData(guid)));
+        scene->startRace();
+        if (!scene->isRaceInProgress)
+        {
+            return;
+        }
+
+        // a booster just ahead of the grid, so every vehicle drives over it
+        Mat4 const& startTransform = scene->start->transform;
+        Booster* booster = (Booster*)g_entities[6].create(6);
+        booster->position = (startTransform * Mat4::translation(Vec3(25.f, 0.f, 0.f))).position();
+        booster->rotation = Quat(Mat3(startTransform.rotation())) * booster->rotation;
+        scene->addEntity(booster);
+        scene->createNewEntities();
+
+        // the inputs stay the same for the whole race, and every rocket booster is fired once
+        for (auto& vehicle : scene->vehicles)
+        {
+            Vehicle* v = vehicle.get();
+            v->input = VehicleInput();
+            v->input.accel = 1.f;
+            for (auto& w : v->rearWeapons)
+            {
+                if (strcmp(w->info.name, "Rocket Booster") == 0 && w->ammo > 0)
+                {
+                    w->update(scene.get(), v, true, false, 0.f);
+                }
+            }
+        }
+
+        u32 blockingStepCount = 0;
+        for (u32 frame=0;; ++frame)
+        {
+            scene->fetchPhysicsResults();
+            if (scene->physicsStepCount == totalStepCount)
+            {
+                break;
+            }
+
+            scene->physicsClock.advance(frameTimes[rate][frame % 2]);
+            u32 frameStepCount = 0;
+            while (scene->physicsClock.isBehind() && scene->physicsStepCount < totalStepCount
+                    && frameStepCount < g_game.config.gameplay.maxPhysicsSubsteps)
+            {
+                scene->simulatePhysics(true);
+                ++frameStepCount;
+                if (frame > 0)
+                {
+                    ++blockingStepCount;
+                }
+            }
+            scene->physicsClock.dropBacklog();
+
+            if (scene->physicsStepCount < totalStepCount
+                    && scene->physicsClock.needsStep(timestep))
+            {
+                scene->simulatePhysics(false);
+            }
+        }
+
+        u64 hash = HASH_SEED;
+        for (auto& v : scene->vehicles)
+        {
+            PxTransform pose = v->getRigidBody()->getGlobalPose();
+            hash = hashValue(hash, pose.p);
+            hash = hashValue(hash, pose.q);
+        }
+
+        // the vehicles point at the friction table of the batch
+        scene->vehicles.clear();
+        scene->vehicleBatch.destroy();
+        scene.reset(nullptr);
+
+        f32 averageFrameTime = (frameTimes[rate][0] + frameTimes[rate][1]) * 0.5f;
+        println("Race physics at %.1f fps: %u steps, %u blocking, hash %016llx",
+                1.f / averageFrameTime, totalStepCount, blockingStepCount,
+                (unsigned long long)hash);
+        if (rate == 0)
+        {
+            expectedHash = hash;
+        }
+        else if (hash != expectedHash)
+        {
+            allMatch = false;
+        }
+        bool isSteady = frameTimes[rate][0] == frameTimes[rate][1];
+        if (isSteady && frameTimes[rate][0] <= timestep && blockingStepCount > 0)
+        {
+            error("Race physics at %.1f fps took %u blocking steps", 1.f / averageFrameTime,
+                    blockingStepCount);
+        }
+    }
+
+    if (allMatch)
+    {
+        println("Race physics outcome is the same at every render rate");
+    }
+    else
+    {
+        error("Race physics outcome differs between render rates");
+    }
+}
+
+void Scene::benchmarkVehicleSteps()
+{
+    if (g_game.state.drivers.empty())
+    {
+        error("Benchmarking vehicle steps needs drivers to race");
+        return;
+    }
+    if (g_game.isEditing)
+    {
+        writeTrackData();
+    }
+
+    const u32 vehicleCounts[] = { 1, 4, 8, 20 };
+    // the first steps are left out while the vehicles settle onto the track
+    const u32 settleStepCount = 30;
+    const u32 measuredStepCount = 300;
+
+    // the races are started with copies of the current drivers, repeated to make up the count
+    Array<Driver> savedDrivers = move(g_game.state.drivers);
+    for (u32 vehicleCount : vehicleCounts)
+    {
+        g_game.state.drivers.clear();
+        for (u32 i=0; i<vehicleCount; ++i)
+        {
+            Driver const& from = savedDrivers[i % savedDrivers.size()];
+            Driver driver;
+            driver.playerName = from.playerName;
+            driver.aiDriverGUID = from.aiDriverGUID;
+            driver.vehicleGuid = from.vehicleGuid;
+            driver.isPlayer = from.isPlayer;
+            driver.vehicleConfig = from.vehicleConfig;
+            driver.lastPlacement = i;
+            g_game.state.drivers.push(move(driver));
+        }
+
+        for (u32 concurrent=0; concurrent<2; ++concurrent)
+        {
+            OwnedPtr<Scene> scene(new Scene(g_res.getTrackData(guid)));
+            scene->startRace();
+            if (!scene->isRaceInProgress)
+            {
+                g_game.state.drivers = move(savedDrivers);
+                return;
+            }
+            scene->vehicleBatch.isConcurrentUpdateEnabled = concurrent == 1;
+            for (auto& v : scene->vehicles)
+            {
+                v->input = VehicleInput();
+                v->input.accel = 1.f;
+            }
+
+            f64 totalStepTime = 0.0;
+            u32 maxTaskCount = 0;
+            for (u32 step=0; step<settleStepCount + measuredStepCount; ++step)
+            {
+                scene->simulatePhysics(true);
+                if (step >= settleStepCount)
+                {
+                    totalStepTime += scene->vehicleBatch.lastStepTime;
+                    maxTaskCount = max(maxTaskCount, scene->vehicleBatch.lastStepTaskCount);
+                }
+            }
+
+            // the vehicles point at the friction table of the batch
+            scene->vehicles.clear();
+            scene->vehicleBatch.destroy();
+            scene.reset(nullptr);
+
+            f64 stepTime = totalStepTime / measuredStepCount;
+            println("Vehicle step with %2u vehicles, %s (%u tasks): %.4fms per step, "
+                    "%.4fms per vehicle", vehicleCount, concurrent ? "concurrent" : "serial",
+                    maxTaskCount, stepTime * 1000.0, stepTime * 1000.0 / vehicleCount);
+        }
+    }
+    g_game.state.drivers = move(savedDrivers);
+}
+
+// Compares the old loop that called onUpdate on every entity with the packed list of entities
+// that actually override it.
+static void benchmarkEntityIteration(u32 entityCount)
+{
+    class BenchmarkStaticEntity : public Entity
+    {
+        Mat4 transform;
+    };
+    class BenchmarkDynamicEntity : public Entity
+    {
+        Vec3 position = Vec3(0.f);
+        Vec3 velocity = Vec3(1.f);
+    public:
+        void onUpdate(RenderWorld* rw, Scene* scene, f32 deltaTime) override
+        {
+            position += velocity * deltaTime;
+        }
+    };
+
+    // most entities in a track are static, so one in eight is dynamic
+    Array<OwnedPtr<Entity>> entities;
+    for (u32 i=0; i<entityCount; ++i)
+    {
+        Entity* e = (i % 8 == 0) ? (Entity*)new BenchmarkDynamicEntity()
+                                 : (Entity*)new BenchmarkStaticEntity();
+        e->entityFlags |= (i % 8 == 0) ? getEntityTickFlags<BenchmarkDynamicEntity>()
+                                       : getEntityTickFlags<BenchmarkStaticEntity>();
+        entities.push(OwnedPtr<Entity>(e));
+    }
+
+    const u32 iterations = 100;
+    f64 t = getTime();
+    for (u32 n=0; n<iterations; ++n)
+    {
+        for (auto& e : entities)
+        {
+            e->onUpdate(nullptr, nullptr, 1.f / 60.f);
+        }
+    }
+    f64 allEntitiesTime = (getTime() - t) / iterations;
+
+    t = getTime();
+    Array<Entity*> updatedEntities;
+    for (auto& e : entities)
+    {
+        if ((e->entityFlags & EntityFlags::HAS_UPDATE) == EntityFlags::HAS_UPDATE)
+        {
+            updatedEntities.push(e.get());
+        }
+    }
+    f64 buildTime = getTime() - t;
+
+    t = getTime();
+    for (u32 n=0; n<iterations; ++n)
+    {
+        for (Entity* e : updatedEntities)
+        {
+            e->onUpdate(nullptr, nullptr, 1.f / 60.f);
+        }
+    }
+    f64 packedTime = (getTime() - t) / iterations;
+
+    println("Entity iteration with %u entities (%u updated): every entity %.4fms, "
+            "packed list %.4fms (built in %.4fms)", entityCount, updatedEntities.size(),
+            allEntitiesTime * 1000.0, packedTime * 1000.0, buildTime * 1000.0);
+}
+
 void Scene::showDebugInfo()
 {
     ImGui::Gap();
     ImGui::Text("Scene Name: %s", name.data());
-    ImGui::Text("Entities: %i", entities.size());
+    ImGui::Text("Entities: %i (%u updated, %u rendered)", entities.size(),
+            updatedEntities.size(), renderedEntities.size());
+    u32 entityPoolChunkCount = 0;
+    for (auto& pool : g_entityPools)
+    {
+        entityPoolChunkCount += pool.value.getChunkCount();
+    }
+    ImGui::Text("Entity Pools: %u, Chunks: %u", g_entityPools.size(), entityPoolChunkCount);
+    if (ImGui::Button("Benchmark Entity Iteration"))
+    {
+        benchmarkEntityIteration(10000);
+    }
+    ImGui::Text("Batches: %u, Instanced Draws: %u of %u instances, %u this frame",
+            batcher.batches.size(), batcher.instances.getDrawCount(),
+            batcher.instances.getInstanceCount(), frameInstances.getDrawCount());
+    if (ImGui::Button("Check Instance Grouping"))
+    {
+        InstanceGrouper::check();
+    }
+    ImGui::Text("Physics: %u steps taken, %.3fms in simulate, %.3fms waiting for results",
+            physicsStepCount, physicsSimulateCallTime * 1000.0, physicsStallTime * 1000.0);
+    ImGui::Checkbox("Overlap Physics With Rendering", &isPhysicsOverlapEnabled);
+    if (ImGui::Button("Check Physics Across Render Rates"))
+    {
+        checkPhysicsRenderRates();
+    }
+    auto const& trackStats = track->getBuildStats();
+    ImGui::Text("Track Build: %u segments in %.2fms, %u render triangles, "
+            "%u collision triangles (%u with fixed steps)", trackStats.segmentCount,
+            trackStats.buildTime * 1000.0, trackStats.renderTriangleCount,
+            trackStats.collisionTriangleCount, trackStats.fixedStepTriangleCount);
+    if (ImGui::Button("Benchmark Track Save"))
+    {
+        benchmarkTrackSave();
+    }
+    if (ImGui::Button("Check Track Preview Camera"))
+    {
+        TrackPreview2D::checkFitCamera(track->getBoundingBox());
+    }
+    if (ImGui::Button("Check Track Preview Outline"))
+    {
+        Array<f32> outlineVertices;
+        Array<u32> outlineIndices;
+        track->buildPreviewGeometry(outlineVertices, outlineIndices);
+        TrackPreview2D::checkOutlineAndMarkers(outlineVertices, outlineIndices,
+                track->getBoundingBox());
+    }
+    if (ImGui::Button("Benchmark Track Preview"))
+    {
+        // as many markers as the largest races have vehicles
+        const u32 markerCount = 20;
+        BoundingBox bb = track->getBoundingBox();
+        Array<TrackPreview2D::Marker> markers;
+        for (u32 i=0; i<markerCount; ++i)
+        {
+            markers.push(TrackPreview2D::makeMarker(
+                        bb.min + (bb.max - bb.min) * (i / (f32)markerCount), Vec3(1.f)));
+        }
+        u32 size = (u32)trackPreview2D.getSize().x;
+        trackPreview2D.benchmarkSubmissions(g_game.renderer.get(), size > 0 ? size : 256, bb,
+                track->getPreviewMesh(this),
+                &g_res.getModel("HUDStart")->meshes.back(), start->transform,
+                &g_res.getModel("sphere")->meshes.front(), markers);
+    }
+    ImGui::Text("Vehicle Step: %u vehicles in %u tasks, %.3fms (%.3fms per vehicle)",
+            vehicleBatch.lastStepVehicleCount, vehicleBatch.lastStepTaskCount,
+            vehicleBatch.lastStepTime * 1000.0,
+            vehicleBatch.lastStepTime * 1000.0 / max(vehicleBatch.lastStepVehicleCount, 1u));
+    ImGui::Checkbox("Update Vehicles On Worker Threads", &vehicleBatch.isConcurrentUpdateEnabled);
+    if (ImGui::Button("Benchmark Vehicle Steps"))
+    {
+        benchmarkVehicleSteps();
+    }
+    auto const& hashStats = spatialHash.getBuildStats();
+    ImGui::Text("Spatial Hash: %u items, %u of %u buckets used, largest %u, built in %.3fms",
+            hashStats.itemCount, hashStats.occupiedBucketCount, hashStats.bucketCount,
+            hashStats.largestBucketSize, hashStats.buildTime * 1000.0);
+    if (ImGui::Button("Benchmark Spatial Hash"))
+    {
+        SpatialHash::benchmark(100, 10000);
+    }
+    aiScheduler.showDebugInfo();
+    if (ImGui::Button("Check AI Determinism"))
+    {
+        aiScheduler.checkDeterminism(this, vehicles);
+    }
+    auto const& gridStats = motionGrid.getBuildStats();
+    ImGui::Text("Motion Grid: %.2fms%s, %u tasks, %u layers, %u dynamic cells cleared",
+            gridStats.buildTime * 1000.0, gridStats.wasCached ? " (cached)" : "",
+            gridStats.taskCount, gridStats.layerCount, motionGrid.getLastClearedCellCount());
+    ImGui::Text("Motion Grid Clusters: %.2fms, %u portals, %u edges, %u uniform",
+            gridStats.abstractionTime * 1000.0, gridStats.portalCount, gridStats.portalEdgeCount,
+            gridStats.uniformClusterCount);
+    if (ImGui::Button("Check Motion Grid Determinism"))
+    {
+        motionGrid.checkDeterminism(this);
+    }
+    if (ImGui::Button("Benchmark Path Finding"))
+    {
+        motionGrid.benchmarkPathFinding(1000);
+    }
     ImGui::Text("Generated Paths: %s", hasGeneratedPaths ? "true" : "false");
     ImGui::Text("World Time: %.4f", worldTime);
     if (auto playerVehicle = vehicles.findIf([](auto& v) { return v->driver->isPlayer; }))
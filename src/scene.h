@@ -3,6 +3,8 @@
 #include "math.h"
 #include "track_graph.h"
 #include "motion_grid.h"
+#include "ai_scheduler.h"
+#include "spatial_hash.h"
 #include "entity.h"
 #include "ribbon.h"
 #include "particle_system.h"
@@ -17,8 +19,43 @@
 #include "collision_flags.h"
 #include "racing_line.h"
 #include "batcher.h"
+#include "scatter.h"
+#include "vehicle_physics.h"
 #include "track_preview.h"
 
+// how far the center of a vehicle can be from something its chassis touches
+const f32 VEHICLE_CONTACT_MARGIN = 6.f;
+
+// Decides when the fixed physics steps run. stepTime is the time of the newest step whose
+// results have been fetched and targetTime is the race time that is drawn.
+struct PhysicsClock
+{
+    f64 stepTime = 0.0;
+    f64 targetTime = 0.0;
+
+    void advance(f64 deltaTime) { targetTime += deltaTime; }
+    bool isBehind() const { return stepTime < targetTime; }
+    void onStepFetched(f32 timestep) { stepTime += timestep; }
+
+    // a long hitch slows the race down instead of piling up steps that make the next frames
+    // slow as well
+    void dropBacklog()
+    {
+        if (stepTime < targetTime)
+        {
+            targetTime = stepTime;
+        }
+    }
+
+    // whether the next frame will need another step, assuming it is no longer than a step
+    bool needsStep(f32 timestep) const { return stepTime - targetTime < timestep; }
+
+    f32 getInterpolation(f32 timestep) const
+    {
+        return clamp(1.f - (f32)((stepTime - targetTime) / timestep), 0.f, 1.f);
+    }
+};
+
 struct RaceBonus
 {
     const char* name;
@@ -83,8 +120,16 @@ private:
 
     Array<OwnedPtr<Entity>> entities;
     Array<OwnedPtr<Entity>> newEntities;
+    // the entities that have per-frame work, in the same order as entities; rebuilt whenever
+    // entities are added or removed
+    Array<Entity*> updatedEntities;
+    Array<Entity*> renderedEntities;
+    Array<Entity*> physicsEntities;
+    bool areEntityListsDirty = true;
 
     Array<u32> finishOrder;
+    // declared before the vehicles so that it outlives them
+    VehicleBatch vehicleBatch;
     Array<OwnedPtr<class Vehicle>> vehicles;
     Array<u32> placements;
     Array<RaceResult> raceResults;
@@ -103,9 +148,13 @@ private:
     u32 numHumanDrivers = 0;
     TrackGraph trackGraph;
     MotionGrid motionGrid;
+    AIScheduler aiScheduler;
+    SpatialHash spatialHash;
     PxDistanceJoint* dragJoint = nullptr;
     Batcher batcher;
-    bool hasTrackPreview = false;
+    u32 trackPreviewVersion = 0;
+    Mat4 trackPreviewStartTransform;
+    Array<TrackPreview2D::Marker> trackPreviewMarkers;
 
     bool allPlayersFinished = false;
     f32 finishTimer = 0.f;
@@ -119,7 +168,36 @@ private:
     void onContact(const PxContactPairHeader& pairHeader, const PxContactPair* pairs, PxU32 nbPairs);
 
     void buildRaceResults();
+    void rebuildEntityLists();
+
+    // Physics runs in fixed steps of 1 / physicsTickRate. Each frame catches the step time up to
+    // the drawn time with blocking steps, and then kicks off at most one more step at the end of
+    // onUpdate that runs on the worker threads while the frame is rendered. Its results are
+    // collected at the start of the next onUpdate, so gameplay always reads the poses of the
+    // newest finished step. PhysX can only run one step at a time, so a steady frame rate at or
+    // above the tick rate needs no blocking steps, and slower frames block for the rest.
+    PhysicsClock physicsClock;
+    f32 physicsInterpolation = 1.f;
+    bool isPhysicsSimulating = false;
+    // how long the main thread waited in fetchResults and spent in simulate during the last step
+    f64 physicsStallTime = 0.0;
+    f64 physicsSimulateCallTime = 0.0;
+    u32 physicsStepCount = 0;
+
+    void simulatePhysics(bool waitForResults);
+    void catchUpPhysics(f32 deltaTime);
+    void onPhysicsResults();
     void physicsMouseDrag(Renderer* renderer);
+    void createNewEntities();
+
+    // Races copies of this track at several render rates with the same inputs and a booster in
+    // front of the vehicles, driving the steps the way onUpdate does, and compares the poses
+    // of the vehicles after the same number of steps.
+    void checkPhysicsRenderRates();
+
+    // Steps copies of this track with 1, 4, 8 and 20 vehicles, with the vehicle update on this
+    // thread and then on the worker threads, and prints how long the vehicle steps took.
+    void benchmarkVehicleSteps();
 
 public:
     i64 guid = 0;
@@ -131,6 +209,8 @@ public:
     bool isPaused = false;
     bool isCameraTourEnabled = true;
     bool isBatched = false;
+    // when disabled the results are fetched right after simulate, for comparison
+    bool isPhysicsOverlapEnabled = true;
 
     RandomSeries randomSeries;
     SoundHandle backgroundSound = 0;
@@ -138,6 +218,9 @@ public:
     ParticleSystem sparks;
     RibbonRenderer ribbons;
     DebugDraw debugDraw;
+    // meshes that entities draw this frame; repeated mesh and material pairs are drawn instanced
+    InstanceGrouper frameInstances;
+    ScatterSystem scatter;
     Terrain* terrain = nullptr;
     Track* track = nullptr;
     Start* start = nullptr;
@@ -194,6 +277,7 @@ public:
     void showDebugInfo();
     Mat4 getStart() const { return start->transform; }
     PxScene* const& getPhysicsScene() const { return physicsScene; }
+    VehicleBatch* getVehicleBatch() { return &vehicleBatch; }
     TrackGraph& getTrackGraph() { return trackGraph; }
     MotionGrid& getMotionGrid() { return motionGrid; }
     u32 getTotalLaps() const { return totalLaps; }
@@ -209,11 +293,39 @@ public:
     bool sweep(f32 radius, Vec3 const& from, Vec3 const& dir, f32 dist,
             PxSweepBuffer* hit=nullptr, PxRigidActor* ignore=nullptr,
             u32 flags=COLLISION_FLAG_TERRAIN | COLLISION_FLAG_OBJECT | COLLISION_FLAG_CHASSIS) const;
+    void fetchPhysicsResults();
+    // how far the drawn time is between the poses of the last two physics steps
+    f32 getPhysicsInterpolation() const { return physicsInterpolation; }
+    f32 getPhysicsTimestep() const;
+
+    // Proximity queries against the vehicles, dead ones included, at the positions they had
+    // after the physics steps of the frame. Queries made before the steps would see the
+    // vehicles where they were a frame earlier.
+    template <typename F>
+    void forEachVehicleInRadius(Vec3 const& p, f32 radius, F const& f) const
+    {
+        spatialHash.forEachInRadius(p, radius,
+                [&](SpatialHash::Item const& item) { f((Vehicle*)item.object); });
+    }
+    bool isAnyVehicleInRadius(Vec3 const& p, f32 radius) const
+    {
+        bool found = false;
+        forEachVehicleInRadius(p, radius, [&](Vehicle*) { found = true; });
+        return found;
+    }
 
-    void addEntity(Entity* entity) { newEntities.push(OwnedPtr<Entity>(entity)); }
+    template <typename T>
+    void addEntity(T* entity)
+    {
+        entity->entityFlags |= getEntityTickFlags<T>();
+        newEntities.push(OwnedPtr<Entity>(entity));
+    }
     Array<OwnedPtr<Entity>>& getEntities() { return entities; }
     Array<OwnedPtr<Vehicle>>& getVehicles() { return vehicles; }
     Vehicle* getVehicleByPlacement(u32 placement) { return vehicles[placements[placement]].get(); }
 
     void writeTrackData();
+    // times saving this track together with a large terrain, in the foreground and in the
+    // background, and checks that the file loads back unchanged
+    void benchmarkTrackSave();
 };
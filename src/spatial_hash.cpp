@@ -0,0 +1,154 @@
+#include "spatial_hash.h"
+
+void SpatialHash::build()
+{
+    f64 t = getTime();
+
+    u32 bucketCount = MIN_BUCKET_COUNT;
+    while (bucketCount < newItems.size() * 2)
+    {
+        bucketCount *= 2;
+    }
+    bucketMask = bucketCount - 1;
+
+    // count the items in each bucket, turn the counts into offsets and then put every item at
+    // the offset of its bucket
+    bucketStarts.resize(bucketCount + 1);
+    bucketCursors.resize(bucketCount);
+    for (u32 i=0; i<=bucketCount; ++i)
+    {
+        bucketStarts[i] = 0;
+    }
+    minCellX = INT32_MAX;
+    minCellY = INT32_MAX;
+    maxCellX = INT32_MIN;
+    maxCellY = INT32_MIN;
+    for (auto& item : newItems)
+    {
+        i32 x = getCellCoord(item.position.x);
+        i32 y = getCellCoord(item.position.y);
+        minCellX = min(minCellX, x);
+        minCellY = min(minCellY, y);
+        maxCellX = max(maxCellX, x);
+        maxCellY = max(maxCellY, y);
+        ++bucketStarts[getBucket(x, y) + 1];
+    }
+    buildStats.occupiedBucketCount = 0;
+    buildStats.largestBucketSize = 0;
+    for (u32 i=0; i<bucketCount; ++i)
+    {
+        u32 count = bucketStarts[i + 1];
+        buildStats.occupiedBucketCount += count > 0 ? 1 : 0;
+        buildStats.largestBucketSize = max(buildStats.largestBucketSize, count);
+        bucketStarts[i + 1] = bucketStarts[i] + count;
+        bucketCursors[i] = bucketStarts[i];
+    }
+
+    items.resize(newItems.size());
+    for (auto& item : newItems)
+    {
+        i32 x = getCellCoord(item.position.x);
+        i32 y = getCellCoord(item.position.y);
+        items[bucketCursors[getBucket(x, y)]++] = { item, x, y };
+    }
+    newItems.clear();
+
+    buildStats.itemCount = items.size();
+    buildStats.bucketCount = bucketCount;
+    buildStats.buildTime = getTime() - t;
+}
+
+void SpatialHash::clear()
+{
+    newItems.clear();
+    items.clear();
+    bucketStarts.clear();
+    bucketMask = 0;
+    minCellX = 0;
+    minCellY = 0;
+    maxCellX = -1;
+    maxCellY = -1;
+}
+
+void SpatialHash::benchmark(u32 itemCount, u32 queryCount)
+{
+    RandomSeries series;
+    const f32 areaSize = 600.f;
+    const f32 queryRadius = 40.f;
+
+    Array<Item> allItems;
+    SpatialHash hash;
+    for (u32 i=0; i<itemCount; ++i)
+    {
+        Vec3 p(random(series, 0.f, areaSize), random(series, 0.f, areaSize), random(series, 0.f, 20.f));
+        allItems.push({ p, (void*)(uintptr_t)(i + 1) });
+        hash.add(p, allItems.back().object);
+    }
+    hash.build();
+
+    Array<Vec3> points;
+    for (u32 i=0; i<queryCount; ++i)
+    {
+        points.push(Vec3(random(series, 0.f, areaSize), random(series, 0.f, areaSize), 10.f));
+    }
+
+    // each query's results are compared as a set, since the hash visits them in bucket order
+    u32 mismatches = 0;
+    u32 totalFound = 0;
+    f64 linearTime = 0.0;
+    f64 hashTime = 0.0;
+    Array<uintptr_t> linearResults;
+    Array<uintptr_t> hashResults;
+    for (auto& p : points)
+    {
+        linearResults.clear();
+        f64 t = getTime();
+        for (auto& item : allItems)
+        {
+            if (distanceSquared(item.position, p) <= square(queryRadius))
+            {
+                linearResults.push((uintptr_t)item.object);
+            }
+        }
+        linearTime += getTime() - t;
+
+        hashResults.clear();
+        t = getTime();
+        hash.forEachInRadius(p, queryRadius, [&](Item const& item) {
+            hashResults.push((uintptr_t)item.object);
+        });
+        hashTime += getTime() - t;
+
+        totalFound += linearResults.size();
+        hashResults.sort();
+        if (hashResults.size() != linearResults.size())
+        {
+            ++mismatches;
+            continue;
+        }
+        for (u32 i=0; i<hashResults.size(); ++i)
+        {
+            // the linear loop finds them in id order
+            if (hashResults[i] != linearResults[i])
+            {
+                ++mismatches;
+                break;
+            }
+        }
+    }
+
+    println("Spatial hash with %u items (built in %.4fms, %u/%u buckets used, largest %u), "
+            "%u radius queries finding %u items: linear %.4fms, hash %.4fms", itemCount,
+            hash.buildStats.buildTime * 1000.0, hash.buildStats.occupiedBucketCount,
+            hash.buildStats.bucketCount, hash.buildStats.largestBucketSize, queryCount,
+            totalFound, linearTime * 1000.0, hashTime * 1000.0);
+    if (mismatches > 0)
+    {
+        error("Spatial hash radius queries differ from the linear search in %u of %u queries",
+                mismatches, queryCount);
+    }
+    else
+    {
+        println("    every query found the same items as the linear search");
+    }
+}
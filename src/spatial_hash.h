@@ -0,0 +1,122 @@
+#pragma once
+
+#include "misc.h"
+
+// Buckets the vehicles by the square of the ground plane they are in, so that proximity queries
+// only look at the vehicles in the squares near them. The squares are hashed into a bucket array
+// that is sized for the number of items, so the size of the track doesn't matter, and the whole
+// thing is rebuilt with a counting sort every frame.
+//
+// Items are added during the frame and become visible to the queries at the next call to
+// build(). Queries don't modify anything and can run on worker threads.
+class SpatialHash
+{
+public:
+    static constexpr f32 CELL_SIZE = 10.f;
+    static constexpr u32 MIN_BUCKET_COUNT = 64;
+
+    struct Item
+    {
+        Vec3 position;
+        void* object;
+    };
+
+    struct BuildStats
+    {
+        f64 buildTime = 0.0;
+        u32 itemCount = 0;
+        u32 bucketCount = 0;
+        u32 occupiedBucketCount = 0;
+        u32 largestBucketSize = 0;
+    };
+
+private:
+    struct SortedItem
+    {
+        Item item;
+        i32 cellX, cellY;
+    };
+
+    Array<Item> newItems;
+    Array<SortedItem> items;
+    Array<u32> bucketStarts;
+    Array<u32> bucketCursors;
+    u32 bucketMask = 0;
+    i32 minCellX = 0, minCellY = 0, maxCellX = -1, maxCellY = -1;
+    BuildStats buildStats;
+
+    static i32 getCellCoord(f32 v)
+    {
+        return (i32)floorf(clamp(v / CELL_SIZE, -1000000000.f, 1000000000.f));
+    }
+    u32 getBucket(i32 x, i32 y) const
+    {
+        return ((u32)x * 73856093u ^ (u32)y * 19349663u) & bucketMask;
+    }
+
+    // calls f for every item in the squares that overlap the rectangle, or for every item when
+    // that would be fewer lookups
+    template <typename F>
+    void forEachInRect(f32 x1, f32 y1, f32 x2, f32 y2, F const& f) const
+    {
+        i32 cx1 = max(getCellCoord(x1), minCellX);
+        i32 cy1 = max(getCellCoord(y1), minCellY);
+        i32 cx2 = min(getCellCoord(x2), maxCellX);
+        i32 cy2 = min(getCellCoord(y2), maxCellY);
+        if (cx1 > cx2 || cy1 > cy2)
+        {
+            return;
+        }
+        if ((u64)(cx2 - cx1 + 1) * (u64)(cy2 - cy1 + 1) >= items.size())
+        {
+            for (auto& sortedItem : items)
+            {
+                f(sortedItem.item);
+            }
+            return;
+        }
+        for (i32 y=cy1; y<=cy2; ++y)
+        {
+            for (i32 x=cx1; x<=cx2; ++x)
+            {
+                u32 bucket = getBucket(x, y);
+                for (u32 i=bucketStarts[bucket]; i<bucketStarts[bucket + 1]; ++i)
+                {
+                    // other squares can share the bucket, and are visited on their own turn
+                    SortedItem const& sortedItem = items[i];
+                    if (sortedItem.cellX == x && sortedItem.cellY == y)
+                    {
+                        f(sortedItem.item);
+                    }
+                }
+            }
+        }
+    }
+
+public:
+    void add(Vec3 const& position, void* object)
+    {
+        newItems.push({ position, object });
+    }
+    // replaces the items seen by the queries with the ones that were added since the last build
+    void build();
+    void clear();
+    BuildStats const& getBuildStats() const { return buildStats; }
+    u32 size() const { return items.size(); }
+
+    template <typename F>
+    void forEachInRadius(Vec3 const& p, f32 radius, F const& f) const
+    {
+        f32 radiusSquared = radius * radius;
+        forEachInRect(p.x - radius, p.y - radius, p.x + radius, p.y + radius,
+            [&](Item const& item) {
+                if (distanceSquared(item.position, p) <= radiusSquared)
+                {
+                    f(item);
+                }
+            });
+    }
+
+    // compares the radius queries against a plain loop over random items
+    static void benchmark(u32 itemCount, u32 queryCount);
+};
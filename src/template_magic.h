@@ -67,6 +67,9 @@ template <typename T> struct IsArray : FalseType {};
 template <typename T> struct IsArray<T[]> : TrueType {};
 template <typename T, unsigned long long N> struct IsArray<T[N]> : TrueType {};
 
+template <typename A, typename B> struct IsSame : FalseType {};
+template <typename A> struct IsSame<A, A> : TrueType {};
+
 template <typename T> struct IsEnum : IntegralConstant<bool, __is_enum(T)> {};
 
 template <typename T, T MIN, T MAX>
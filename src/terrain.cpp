@@ -355,6 +355,28 @@ f32 Terrain::getZ(Vec2 pos) const
         tx * (1 - ty) * c10 + (1 - tx) * ty * c01 + tx * ty * c11;
 }
 
+f32 Terrain::getLayerWeight(Vec2 pos, u32 layer) const
+{
+    u32 width = (u32)((x2 - x1) / tileSize);
+    u32 height = (u32)((y2 - y1) / tileSize);
+    f32 x = clamp((pos.x - x1) / tileSize, 0.f, width - 1.001f);
+    f32 y = clamp((pos.y - y1) / tileSize, 0.f, height - 1.001f);
+    u32 px = (u32)x;
+    u32 py = (u32)y;
+
+    u8 const* b = reinterpret_cast<u8 const*>(blend.get());
+    f32 c00 = b[((py + 0) * width + px + 0) * 4 + layer];
+    f32 c10 = b[((py + 0) * width + px + 1) * 4 + layer];
+    f32 c01 = b[((py + 1) * width + px + 0) * 4 + layer];
+    f32 c11 = b[((py + 1) * width + px + 1) * 4 + layer];
+
+    f32 tx = x - px;
+    f32 ty = y - py;
+
+    return ((1 - tx) * (1 - ty) * c00 +
+        tx * (1 - ty) * c10 + (1 - tx) * ty * c01 + tx * ty * c11) / 255.f;
+}
+
 i32 Terrain::getCellX(f32 x) const
 {
     i32 width = (i32)((x2 - x1) / tileSize);
@@ -31,6 +31,7 @@ class Terrain : public Entity
 
     bool isDirty = true;
     bool isCollisionMeshDirty = true;
+    u32 version = 0;
 
     PxMaterial* materials[2];
     OwnedPtr<PxMaterialTableIndex[]> materialIndices;
@@ -40,6 +41,7 @@ class Terrain : public Entity
     {
         isDirty = true;
         isCollisionMeshDirty = true;
+        ++version;
     }
 
     static constexpr u8 OFFROAD_THRESHOLD = 170;
@@ -89,6 +91,8 @@ public:
     void createBuffers();
     void resize(f32 x1, f32 y1, f32 x2, f32 y2, bool preserve=false);
     f32 getZ(Vec2 pos) const;
+    // how much of the given paint layer is at pos, from 0 to 1
+    f32 getLayerWeight(Vec2 pos, u32 layer) const;
     //bool containsPoint(Vec2 p) const { return p.x >= x1 && p.y >= y1 && p.x <= x2 && p.y <= y2; };
     i32 getCellX(f32 x) const;
     i32 getCellY(f32 y) const;
@@ -98,6 +102,8 @@ public:
     void regenerateMaterial();
 
     Material* getMaterial() const { return material; }
+    // changes whenever the height or the paint layers are edited
+    u32 getVersion() const { return version; }
 
     bool isOffroadAt(f32 x, f32 y) const;
 
@@ -1,4 +1,5 @@
 #include "texture.h"
+#include "texture_streamer.h"
 #include "resources.h"
 #include "game.h"
 
@@ -126,6 +127,7 @@ bool Texture::loadSourceFile(u32 index)
     this->height = (u32)h;
     sourceFiles[index].width = width;
     sourceFiles[index].height = height;
+    sourceFiles[index].evictedMipMask = 0;
 
     // smallest mipmap dimension is 4 pixels
     u32 mipLevels = generateMipMaps ? (1 + (u32)max((i32)log2(min(width, height)) - 2, 0)) : 1;
@@ -283,8 +285,25 @@ bool Texture::reloadSourceFiles()
     return true;
 }
 
+Texture::~Texture()
+{
+    // TODO: cleanup
+    if (isStreamed)
+    {
+        g_textureStreamer.remove(this);
+    }
+}
+
 void Texture::destroy()
 {
+    reclaimSourceData();
+    if (isStreamed)
+    {
+        g_textureStreamer.remove(this);
+        isStreamed = false;
+        residentMip = 0;
+        tailMip = 0;
+    }
     for (u32 i=0; i<sourceFiles.size(); ++i)
     {
         if (sourceFiles[i].previewHandle)
@@ -345,105 +364,225 @@ void Texture::regenerate()
     }
 }
 
-void Texture::initGLTexture(u32 index)
+Texture::GLFormat Texture::getGLFormat() const
 {
-    if (sourceFiles[index].mipLevels.empty())
-    {
-        return;
-    }
-
-    u32 unpackAlignment = 4;
-    GLuint internalFormat, baseFormat;
+    GLFormat format = {};
+    format.unpackAlignment = 4;
     switch (textureType)
     {
         case TextureType::NORMAL_MAP:
-            internalFormat = compressed ? GL_COMPRESSED_RG_RGTC2 : GL_RG8;
-            baseFormat = compressed ? internalFormat : GL_RG;
-            unpackAlignment = 2;
+            format.internalFormat = compressed ? GL_COMPRESSED_RG_RGTC2 : GL_RG8;
+            format.baseFormat = compressed ? format.internalFormat : GL_RG;
+            format.unpackAlignment = 2;
             break;
         case TextureType::GRAYSCALE:
             // NOTE: Compressed grayscale textures are always in linear color space
-            internalFormat = compressed
+            format.internalFormat = compressed
                 ? GL_COMPRESSED_RED_RGTC1 : (srgbSourceData ? GL_SR8_EXT : GL_R8);
-            baseFormat = compressed ? internalFormat : GL_RED;
-            unpackAlignment = 1;
+            format.baseFormat = compressed ? format.internalFormat : GL_RED;
+            format.unpackAlignment = 1;
             break;
         case TextureType::CUBE_MAP:
-            internalFormat = compressed ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_SRGB8;
-            baseFormat = compressed ? internalFormat : GL_RGBA;
+            format.internalFormat = compressed ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_SRGB8;
+            format.baseFormat = compressed ? format.internalFormat : GL_RGBA;
             break;
         case TextureType::COLOR:
-            internalFormat = compressed
+            format.internalFormat = compressed
                 ? (preserveAlpha ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_SRGB_S3TC_DXT1_EXT)
                 : (preserveAlpha ? GL_SRGB8_ALPHA8 : GL_SRGB8);
-            baseFormat = compressed ? internalFormat : GL_RGBA;
+            format.baseFormat = compressed ? format.internalFormat : GL_RGBA;
             break;
     }
-    glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment);
-
-    SourceFile& s = sourceFiles[index];
-    u32 mipLevels = s.mipLevels.size();
+    return format;
+}
 
-    glCreateTextures(GL_TEXTURE_2D, 1, &s.previewHandle);
-    glTextureStorage2D(s.previewHandle, mipLevels, internalFormat, s.width, s.height);
-    for (u32 level=0; level<mipLevels; ++level)
+u32 Texture::getMipDataSize(u32 index, u32 level) const
+{
+    u32 w = sourceFiles[index].width >> level;
+    u32 h = sourceFiles[index].height >> level;
+    if (compressed)
     {
-        i32 width = s.width >> level;
-        i32 height = s.height >> level;
-        if (compressed)
-        {
-#ifndef NDEBUG
-            int v;
-            glGetTextureLevelParameteriv(s.previewHandle, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &v);
-            assert(s.mipLevels[level].size() == v);
-#endif
-            glCompressedTextureSubImage2D(s.previewHandle, level, 0, 0, width, height, baseFormat,
-                    s.mipLevels[level].size(), s.mipLevels[level].data());
-        }
-        else
-        {
-            glTextureSubImage2D(s.previewHandle, level, 0, 0, width, height, baseFormat,
-                    GL_UNSIGNED_BYTE, s.mipLevels[level].data());
-        }
+        bool isSmallBlock = textureType == TextureType::GRAYSCALE
+            || textureType == TextureType::CUBE_MAP
+            || (textureType == TextureType::COLOR && !preserveAlpha);
+        return (w / 4) * (h / 4) * (isSmallBlock ? 8 : 16);
     }
+    u32 channels = 4;
+    if (textureType == TextureType::GRAYSCALE)
+    {
+        channels = 1;
+    }
+    else if (textureType == TextureType::NORMAL_MAP)
+    {
+        channels = 2;
+    }
+    return w * h * channels;
+}
+
+GLuint Texture::createMipStorage(u32 index, u32 firstMip)
+{
+    SourceFile& s = sourceFiles[index];
+    GLFormat format = getGLFormat();
+
+    GLuint tex;
+    glCreateTextures(GL_TEXTURE_2D, 1, &tex);
+    glTextureStorage2D(tex, s.mipLevels.size() - firstMip, format.internalFormat,
+            s.width >> firstMip, s.height >> firstMip);
 
     if (textureType == TextureType::GRAYSCALE)
     {
         GLint swizzle[] = { GL_RED, GL_RED, GL_RED, GL_ONE };
-        glTextureParameteriv(s.previewHandle, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+        glTextureParameteriv(tex, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
     }
     if (repeat && textureType != TextureType::CUBE_MAP)
     {
-        glTextureParameteri(s.previewHandle, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTextureParameteri(s.previewHandle, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTextureParameteri(tex, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTextureParameteri(tex, GL_TEXTURE_WRAP_T, GL_REPEAT);
     }
     else
     {
-        glTextureParameteri(s.previewHandle, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTextureParameteri(s.previewHandle, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(tex, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(tex, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     }
     if (filter == TextureFilter::NEAREST)
     {
-        glTextureParameteri(s.previewHandle, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTextureParameteri(s.previewHandle, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTextureParameteri(tex, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     }
     else if (filter == TextureFilter::BILINEAR)
     {
-        glTextureParameteri(s.previewHandle, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTextureParameteri(s.previewHandle, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTextureParameteri(tex, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     }
     else if (filter == TextureFilter::TRILINEAR)
     {
-        glTextureParameteri(s.previewHandle, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTextureParameteri(s.previewHandle, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTextureParameteri(tex, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     }
-    glTextureParameterf(s.previewHandle, GL_TEXTURE_MAX_ANISOTROPY, min(max((f32)anisotropy, 1.f),
+    glTextureParameterf(tex, GL_TEXTURE_MAX_ANISOTROPY, min(max((f32)anisotropy, 1.f),
                 max((f32)g_game.config.graphics.anisotropicFilteringLevel, 1.f)));
-    glTextureParameterf(s.previewHandle, GL_TEXTURE_LOD_BIAS, lodBias);
+    glTextureParameterf(tex, GL_TEXTURE_LOD_BIAS, lodBias);
 
 #ifndef NDEBUG
-    glObjectLabel(GL_TEXTURE, s.previewHandle, name.size(), name.data());
+    glObjectLabel(GL_TEXTURE, tex, name.size(), name.data());
 #endif
+
+    return tex;
+}
+
+void Texture::uploadMip(GLuint tex, u32 textureLevel, u32 index, u32 level, void const* data)
+{
+    GLFormat format = getGLFormat();
+    glPixelStorei(GL_UNPACK_ALIGNMENT, format.unpackAlignment);
+
+    i32 width = sourceFiles[index].width >> level;
+    i32 height = sourceFiles[index].height >> level;
+    if (compressed)
+    {
+#ifndef NDEBUG
+        int v;
+        glGetTextureLevelParameteriv(tex, textureLevel, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &v);
+        assert(getMipDataSize(index, level) == (u32)v);
+#endif
+        glCompressedTextureSubImage2D(tex, textureLevel, 0, 0, width, height, format.baseFormat,
+                getMipDataSize(index, level), data);
+    }
+    else
+    {
+        glTextureSubImage2D(tex, textureLevel, 0, 0, width, height, format.baseFormat,
+                GL_UNSIGNED_BYTE, data);
+    }
+}
+
+void Texture::readbackMip(GLuint tex, u32 textureLevel, u32 index, u32 level, u8* output)
+{
+    GLFormat format = getGLFormat();
+    glPixelStorei(GL_PACK_ALIGNMENT, format.unpackAlignment);
+
+    u32 size = getMipDataSize(index, level);
+    if (compressed)
+    {
+        glGetCompressedTextureImage(tex, textureLevel, size, output);
+    }
+    else
+    {
+        glGetTextureImage(tex, textureLevel, format.baseFormat, GL_UNSIGNED_BYTE, size, output);
+    }
+}
+
+void Texture::evictSourceData(u32 index, u32 level)
+{
+    sourceFiles[index].mipLevels[level] = Array<u8>();
+    sourceFiles[index].evictedMipMask |= 1u << level;
+}
+
+void Texture::reclaimSourceData()
+{
+    if (pendingReadbackMask)
+    {
+        g_textureStreamer.finishReadbacks(this);
+    }
+    for (u32 i=0; i<sourceFiles.size(); ++i)
+    {
+        SourceFile& s = sourceFiles[i];
+        if (!s.evictedMipMask)
+        {
+            continue;
+        }
+        for (u32 level=0; level<s.mipLevels.size(); ++level)
+        {
+            if (s.evictedMipMask & (1u << level))
+            {
+                s.mipLevels[level].resize(getMipDataSize(i, level));
+                readbackMip(s.previewHandle, level - residentMip, i, level, s.mipLevels[level].data());
+            }
+        }
+        s.evictedMipMask = 0;
+    }
+}
+
+void Texture::initGLTexture(u32 index)
+{
+    SourceFile& s = sourceFiles[index];
+    if (s.mipLevels.empty())
+    {
+        return;
+    }
+
+    // Only the smallest mip levels of large textures are uploaded here. The TextureStreamer
+    // brings in the rest once it knows how big the texture is on screen.
+    u32 mipLevels = s.mipLevels.size();
+    u32 firstMip = 0;
+    if (textureType != TextureType::CUBE_MAP)
+    {
+        while (firstMip < mipLevels - 1
+                && max(s.width >> firstMip, s.height >> firstMip) > TEXTURE_STREAMING_TAIL_SIZE)
+        {
+            ++firstMip;
+        }
+    }
+
+    s.previewHandle = createMipStorage(index, firstMip);
+    for (u32 level=firstMip; level<mipLevels; ++level)
+    {
+        uploadMip(s.previewHandle, level - firstMip, index, level, s.mipLevels[level].data());
+    }
+
+    if (firstMip > 0)
+    {
+        for (u32 level=firstMip; level<mipLevels; ++level)
+        {
+            evictSourceData(index, level);
+        }
+        residentMip = firstMip;
+        tailMip = firstMip;
+        targetMip = 0;
+        requestedScreenSize = 0.f;
+        hasScreenSizeRequests = false;
+        pendingReadbackMask = 0;
+        isStreamed = true;
+        g_textureStreamer.add(this);
+    }
 }
 
 void Texture::onUpdateGlobalTextureSettings()
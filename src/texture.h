@@ -48,6 +48,10 @@ public:
 
         GLuint previewHandle = 0;
 
+        // mip levels whose data has been freed after being uploaded and now only lives in the
+        // GL texture (see TextureStreamer)
+        u32 evictedMipMask = 0;
+
         void serialize(Serializer& s)
         {
             s.field(mipLevels);
@@ -61,6 +65,11 @@ public:
     {
         Resource::serialize(s);
 
+        if (!s.deserialize)
+        {
+            reclaimSourceData();
+        }
+
         s.field(textureType);
         s.field(repeat);
         s.field(compressed);
@@ -79,16 +88,42 @@ public:
     }
 
 private:
+    friend class TextureStreamer;
+
     i32 textureType = TextureType::COLOR;
 
     Array<SourceFile> sourceFiles;
 
+    struct GLFormat
+    {
+        GLuint internalFormat;
+        GLuint baseFormat;
+        u32 unpackAlignment;
+    };
+
     bool loadSourceFile(u32 index);
     void initGLTexture(u32 index);
     void initCubemap();
+    GLFormat getGLFormat() const;
+    u32 getMipDataSize(u32 index, u32 level) const;
+    GLuint createMipStorage(u32 index, u32 firstMip);
+    void uploadMip(GLuint tex, u32 textureLevel, u32 index, u32 level, void const* data);
+    void readbackMip(GLuint tex, u32 textureLevel, u32 index, u32 level, u8* output);
+    void evictSourceData(u32 index, u32 level);
+    void reclaimSourceData();
 
     GLuint cubemapHandle = 0;
 
+    // streaming state, only used for textures that are registered with the TextureStreamer
+    bool isStreamed = false;
+    u32 residentMip = 0;        // finest mip level that is in the GL texture
+    u32 tailMip = 0;            // levels from here on are uploaded at load and never dropped
+    u32 targetMip = 0;          // finest mip level the streamer wants resident
+    u32 pendingReadbackMask = 0;
+    f32 requestedScreenSize = 0.f;
+    bool hasScreenSizeRequests = false;
+    u64 lastVisibleFrame = 0;
+
 public:
     u32 width = 0;
     u32 height = 0;
@@ -116,14 +151,20 @@ public:
     void setSourceFile(u32 index, const char* path);
     GLuint getPreviewHandle() const { return sourceFiles[0].previewHandle; }
     u32 getPreviewTexture() override { return getPreviewHandle(); }
+    bool isStreaming() const { return isStreamed; }
+
+    // Reports how many pixels tall something sampling this texture is on screen this frame.
+    // The largest request decides which mip levels need to be resident.
+    void requestScreenSize(f32 pixels)
+    {
+        requestedScreenSize = max(requestedScreenSize, pixels);
+        hasScreenSizeRequests = true;
+    }
     SourceFile const& getSourceFile(u32 index) const { return sourceFiles[index]; }
     u32 getSourceFileCount() const { return (u32)sourceFiles.size(); }
     i32 getTextureType() const { return textureType; }
     void destroy();
     void onUpdateGlobalTextureSettings();
 
-    ~Texture()
-    {
-        // TODO: cleanup
-    }
+    ~Texture();
 };
@@ -0,0 +1,326 @@
+#include "texture_streamer.h"
+#include "game.h"
+
+static u32 alignRingOffset(u32 offset)
+{
+    return (offset + 15) & ~15u;
+}
+
+void TextureStreamer::add(Texture* texture)
+{
+    if (!textures.find(texture))
+    {
+        textures.push(texture);
+    }
+}
+
+void TextureStreamer::remove(Texture* texture)
+{
+    Texture** it = textures.find(texture);
+    if (it)
+    {
+        textures.erase(it);
+    }
+    for (auto& section : sections)
+    {
+        for (auto r = section.readbacks.begin(); r != section.readbacks.end();)
+        {
+            if (r->texture == texture)
+            {
+                section.readbacks.erase(r);
+                continue;
+            }
+            ++r;
+        }
+    }
+    texture->pendingReadbackMask = 0;
+}
+
+bool TextureStreamer::waitForSection(RingSection& section, bool block)
+{
+    if (!section.fence)
+    {
+        return true;
+    }
+    GLenum result = glClientWaitSync(section.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+            block ? 1000000000 : 0);
+    if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+    {
+        return false;
+    }
+    glDeleteSync(section.fence);
+    section.fence = 0;
+    finishReadbacks(section);
+    return true;
+}
+
+void TextureStreamer::finishReadbacks(RingSection& section)
+{
+    for (auto& r : section.readbacks)
+    {
+        Texture::SourceFile& s = r.texture->sourceFiles[0];
+        s.mipLevels[r.level] = Array<u8>(ringData + r.offset, ringData + r.offset + r.size);
+        s.evictedMipMask &= ~(1u << r.level);
+        r.texture->pendingReadbackMask &= ~(1u << r.level);
+    }
+    section.readbacks.clear();
+}
+
+void TextureStreamer::finishReadbacks(Texture* texture)
+{
+    for (auto& section : sections)
+    {
+        if (section.readbacks.findIf([&](Readback const& r) { return r.texture == texture; }))
+        {
+            waitForSection(section, true);
+        }
+    }
+}
+
+void TextureStreamer::updateTarget(Texture* texture)
+{
+    if (texture->requestedScreenSize > 0.f)
+    {
+        f32 texels = (f32)max(texture->width, texture->height);
+        f32 neededTexels = texture->requestedScreenSize * TEXTURE_STREAMING_TEXELS_PER_PIXEL;
+        u32 mip = neededTexels >= texels ? 0 : (u32)log2f(texels / neededTexels);
+        texture->targetMip = min(mip, texture->tailMip);
+        texture->lastVisibleFrame = g_game.frameCount;
+        texture->requestedScreenSize = 0.f;
+    }
+    else if (!texture->hasScreenSizeRequests)
+    {
+        // textures that are bound directly instead of through a material don't report their
+        // size, so they are treated as always visible at full resolution
+        texture->targetMip = 0;
+        texture->lastVisibleFrame = g_game.frameCount;
+    }
+}
+
+u64 TextureStreamer::getResidentBytes(Texture* texture) const
+{
+    u64 bytes = 0;
+    for (u32 level=texture->residentMip; level<texture->sourceFiles[0].mipLevels.size(); ++level)
+    {
+        bytes += texture->getMipDataSize(0, level);
+    }
+    return bytes;
+}
+
+void TextureStreamer::streamIn(Texture* texture, u32& ringOffset, u32 ringEnd)
+{
+    Texture::SourceFile& s = texture->sourceFiles[0];
+    u32 level = texture->residentMip - 1;
+    u32 size = texture->getMipDataSize(0, level);
+    assert(s.mipLevels[level].size() == size);
+
+    GLuint tex = texture->createMipStorage(0, level);
+    for (u32 l=texture->residentMip; l<s.mipLevels.size(); ++l)
+    {
+        glCopyImageSubData(s.previewHandle, GL_TEXTURE_2D, l - texture->residentMip, 0, 0, 0,
+                tex, GL_TEXTURE_2D, l - level, 0, 0, 0,
+                max(1u, s.width >> l), max(1u, s.height >> l), 1);
+    }
+
+    if (ringOffset + size <= ringEnd)
+    {
+        memcpy(ringData + ringOffset, s.mipLevels[level].data(), size);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ringBuffer);
+        texture->uploadMip(tex, 0, 0, level, (void*)(uintptr_t)ringOffset);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        ringOffset = alignRingOffset(ringOffset + size);
+    }
+    else
+    {
+        // too big for the transfer ring
+        texture->uploadMip(tex, 0, 0, level, s.mipLevels[level].data());
+        ringOffset = ringEnd;
+    }
+
+    glDeleteTextures(1, &s.previewHandle);
+    s.previewHandle = tex;
+    texture->handle = tex;
+    texture->residentMip = level;
+    texture->evictSourceData(0, level);
+    ++stats.uploadCount;
+}
+
+void TextureStreamer::dropMip(Texture* texture, u32& ringOffset, u32 ringEnd)
+{
+    Texture::SourceFile& s = texture->sourceFiles[0];
+    u32 level = texture->residentMip;
+    u32 levelBit = 1u << level;
+    if (s.evictedMipMask & levelBit)
+    {
+        u32 size = texture->getMipDataSize(0, level);
+        if (ringOffset + size <= ringEnd)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, ringBuffer);
+            texture->readbackMip(s.previewHandle, 0, 0, level, (u8*)(uintptr_t)ringOffset);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            sections[sectionIndex].readbacks.push({ texture, level, ringOffset, size });
+            texture->pendingReadbackMask |= levelBit;
+            ringOffset = alignRingOffset(ringOffset + size);
+        }
+        else
+        {
+            s.mipLevels[level].resize(size);
+            texture->readbackMip(s.previewHandle, 0, 0, level, s.mipLevels[level].data());
+            s.evictedMipMask &= ~levelBit;
+            ringOffset = ringEnd;
+        }
+    }
+
+    GLuint tex = texture->createMipStorage(0, level + 1);
+    for (u32 l=level+1; l<s.mipLevels.size(); ++l)
+    {
+        glCopyImageSubData(s.previewHandle, GL_TEXTURE_2D, l - level, 0, 0, 0,
+                tex, GL_TEXTURE_2D, l - level - 1, 0, 0, 0,
+                max(1u, s.width >> l), max(1u, s.height >> l), 1);
+    }
+
+    // NOTE: the readback above was queued before the old texture is deleted, so GL keeps it
+    // alive until the copy is done
+    glDeleteTextures(1, &s.previewHandle);
+    s.previewHandle = tex;
+    texture->handle = tex;
+    texture->residentMip = level + 1;
+    ++stats.evictionCount;
+}
+
+void TextureStreamer::update()
+{
+    TIMED_BLOCK();
+
+    stats.uploadCount = 0;
+    stats.evictionCount = 0;
+    stats.budgetBytes = (u64)g_game.config.graphics.textureMemoryBudgetMB * megabytes(1);
+
+    if (!ringBuffer && !textures.empty())
+    {
+        const u32 ringSize = TEXTURE_STREAMING_SECTION_SIZE * MAX_BUFFERED_FRAMES;
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_READ_BIT
+            | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glCreateBuffers(1, &ringBuffer);
+        glNamedBufferStorage(ringBuffer, ringSize, nullptr, flags);
+        ringData = (u8*)glMapNamedBufferRange(ringBuffer, 0, ringSize, flags);
+#ifndef NDEBUG
+        const char* label = "Texture Streaming Ring";
+        glObjectLabel(GL_BUFFER, ringBuffer, (GLsizei)strlen(label), label);
+#endif
+    }
+
+    u64 residentBytes = 0;
+    for (Texture* texture : textures)
+    {
+        updateTarget(texture);
+        residentBytes += getResidentBytes(texture);
+    }
+
+    RingSection& section = sections[sectionIndex];
+    if (ringBuffer && waitForSection(section, false))
+    {
+        u32 ringOffset = sectionIndex * TEXTURE_STREAMING_SECTION_SIZE;
+        u32 ringEnd = ringOffset + TEXTURE_STREAMING_SECTION_SIZE;
+
+        // make room first: levels that are no longer needed go before anything else, then the
+        // textures that haven't been seen for the longest time
+        if (residentBytes > stats.budgetBytes)
+        {
+            Array<Texture*> candidates;
+            for (Texture* texture : textures)
+            {
+                if (texture->residentMip < texture->tailMip)
+                {
+                    candidates.push(texture);
+                }
+            }
+            candidates.sort([](Texture* a, Texture* b) {
+                bool aUnneeded = a->residentMip < a->targetMip;
+                bool bUnneeded = b->residentMip < b->targetMip;
+                if (aUnneeded != bUnneeded)
+                {
+                    return aUnneeded;
+                }
+                return a->lastVisibleFrame < b->lastVisibleFrame;
+            });
+            for (Texture* texture : candidates)
+            {
+                if (residentBytes <= stats.budgetBytes || ringOffset >= ringEnd)
+                {
+                    break;
+                }
+                bool isStillNeeded = texture->residentMip >= texture->targetMip
+                    && texture->lastVisibleFrame + TEXTURE_STREAMING_EVICTION_DELAY > g_game.frameCount;
+                if (isStillNeeded)
+                {
+                    break;
+                }
+                residentBytes -= texture->getMipDataSize(0, texture->residentMip);
+                dropMip(texture, ringOffset, ringEnd);
+            }
+        }
+
+        // stream in one level per texture, starting with what is visible right now and is the
+        // furthest away from its target
+        Array<Texture*> candidates;
+        for (Texture* texture : textures)
+        {
+            if (texture->residentMip > texture->targetMip
+                    && !(texture->pendingReadbackMask & (1u << (texture->residentMip - 1))))
+            {
+                candidates.push(texture);
+            }
+        }
+        candidates.sort([](Texture* a, Texture* b) {
+            if (a->lastVisibleFrame != b->lastVisibleFrame)
+            {
+                return a->lastVisibleFrame > b->lastVisibleFrame;
+            }
+            return a->residentMip - a->targetMip > b->residentMip - b->targetMip;
+        });
+        for (Texture* texture : candidates)
+        {
+            if (ringOffset >= ringEnd)
+            {
+                break;
+            }
+            u32 size = texture->getMipDataSize(0, texture->residentMip - 1);
+            if (residentBytes + size > stats.budgetBytes)
+            {
+                continue;
+            }
+            // levels that don't fit in a ring section are uploaded directly, but only when
+            // nothing else has been uploaded this frame
+            if (ringOffset + size > ringEnd
+                    && (size <= TEXTURE_STREAMING_SECTION_SIZE || stats.uploadCount > 0))
+            {
+                continue;
+            }
+            residentBytes += size;
+            streamIn(texture, ringOffset, ringEnd);
+        }
+
+        if (stats.uploadCount > 0 || stats.evictionCount > 0)
+        {
+            section.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+        sectionIndex = (sectionIndex + 1) % MAX_BUFFERED_FRAMES;
+    }
+
+    stats.residentBytes = residentBytes;
+    stats.streamedTextureCount = textures.size();
+    stats.pendingUploadCount = 0;
+    for (Texture* texture : textures)
+    {
+        if (texture->residentMip > texture->targetMip)
+        {
+            stats.pendingUploadCount += texture->residentMip - texture->targetMip;
+        }
+    }
+    stats.pendingReadbackCount = 0;
+    for (auto& s : sections)
+    {
+        stats.pendingReadbackCount += s.readbacks.size();
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "texture.h"
+#include "buffer.h"
+
+// mip levels that are no larger than this are uploaded when a texture is loaded and are never
+// dropped, so there is always something to sample
+const u32 TEXTURE_STREAMING_TAIL_SIZE = 128;
+// every buffered frame gets its own section of the transfer ring, which also caps how much
+// texture data is moved per frame
+const u32 TEXTURE_STREAMING_SECTION_SIZE = (u32)megabytes(16);
+// how many texels a texture should have for every pixel it covers on screen
+const f32 TEXTURE_STREAMING_TEXELS_PER_PIXEL = 2.f;
+// textures seen within this many frames don't lose mip levels they still need
+const u32 TEXTURE_STREAMING_EVICTION_DELAY = 120;
+
+struct TextureStreamingStats
+{
+    u64 residentBytes = 0;
+    u64 budgetBytes = 0;
+    u32 streamedTextureCount = 0;
+    u32 pendingUploadCount = 0;
+    u32 pendingReadbackCount = 0;
+    u32 uploadCount = 0;
+    u32 evictionCount = 0;
+};
+
+// Keeps the mip levels of large textures resident based on how big they are on screen. Levels
+// are uploaded through a persistently mapped buffer and their CPU copy is freed afterward. When
+// the memory budget is exceeded, levels are copied back into CPU memory before they are dropped
+// from the GL texture.
+class TextureStreamer
+{
+    struct Readback
+    {
+        Texture* texture;
+        u32 level;
+        u32 offset;
+        u32 size;
+    };
+
+    struct RingSection
+    {
+        GLsync fence = 0;
+        Array<Readback> readbacks;
+    };
+
+    Array<Texture*> textures;
+    GLuint ringBuffer = 0;
+    u8* ringData = nullptr;
+    RingSection sections[MAX_BUFFERED_FRAMES];
+    u32 sectionIndex = 0;
+    TextureStreamingStats stats;
+
+    bool waitForSection(RingSection& section, bool block);
+    void finishReadbacks(RingSection& section);
+    void updateTarget(Texture* texture);
+    u64 getResidentBytes(Texture* texture) const;
+    void streamIn(Texture* texture, u32& ringOffset, u32 ringEnd);
+    void dropMip(Texture* texture, u32& ringOffset, u32 ringEnd);
+
+public:
+    void add(Texture* texture);
+    void remove(Texture* texture);
+    void finishReadbacks(Texture* texture);
+    void update();
+    TextureStreamingStats const& getStats() const { return stats; }
+} g_textureStreamer;
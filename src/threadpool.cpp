@@ -21,8 +21,10 @@ void ThreadPool::start()
 
 void ThreadPool::signalCompletion()
 {
+    SDL_LockMutex(taskMtx);
 	isFinished = true;
 	SDL_CondBroadcast(wakeCond);
+    SDL_UnlockMutex(taskMtx);
 }
 
 void ThreadPool::join()
@@ -37,54 +39,87 @@ void ThreadPool::addTask(Task const&& task)
 {
     SDL_LockMutex(taskMtx);
 	tasks.push(task);
-	SDL_UnlockMutex(taskMtx);
+    if (task.group)
+    {
+        ++task.group->pendingTaskCount;
+    }
 	SDL_CondSignal(wakeCond);
+	SDL_UnlockMutex(taskMtx);
 }
 
-void ThreadPool::wait()
+void ThreadPool::addTask(TaskGroup& group, Task const&& task)
 {
-    if (tasks.empty())
+    addTask({ task.data, task.execute, &group });
+}
+
+void ThreadPool::finishTask(Task const& task)
+{
+    if (!task.group)
     {
         return;
     }
-	SDL_LockMutex(waitMtx);
-	SDL_CondWait(waitCond, wakeMtx);
-	SDL_UnlockMutex(waitMtx);
+    SDL_LockMutex(taskMtx);
+    --task.group->pendingTaskCount;
+    if (task.group->pendingTaskCount == 0)
+    {
+        SDL_CondBroadcast(waitCond);
+    }
+    SDL_UnlockMutex(taskMtx);
 }
 
-void ThreadPool::worker()
+void ThreadPool::wait(TaskGroup& group)
 {
-	while (!isFinished)
-	{
-	    SDL_LockMutex(wakeMtx);
-	    SDL_CondWait(wakeCond, wakeMtx);
-	    SDL_UnlockMutex(wakeMtx);
-
-	    while (!tasks.empty())
-	    {
-            Task task;
-            {
-	            SDL_LockMutex(taskMtx);
-                if (!tasks.empty())
-                {
-#if 0
-                    task = tasks.front();
-                    tasks.erase(tasks.begin());
-#else
-                    task = tasks.back();
-                    tasks.pop();
-#endif
-                }
-                SDL_UnlockMutex(taskMtx);
-            }
-            if (task.execute)
+	SDL_LockMutex(taskMtx);
+    while (group.pendingTaskCount > 0)
+    {
+        // only pick up tasks of this group, a task of some other batch could take much longer
+        // than the work that is being waited for
+        i32 index = (i32)tasks.size() - 1;
+        while (index >= 0 && tasks[index].group != &group)
+        {
+            --index;
+        }
+        if (index >= 0)
+        {
+            Task task = tasks[index];
+            for (u32 i=(u32)index; i+1<tasks.size(); ++i)
             {
-                task.execute(task.data);
+                tasks[i] = tasks[i+1];
             }
-	    }
+            tasks.pop();
+            SDL_UnlockMutex(taskMtx);
+            task.execute(task.data);
+            finishTask(task);
+            SDL_LockMutex(taskMtx);
+        }
+        else
+        {
+            SDL_CondWait(waitCond, taskMtx);
+        }
+    }
+	SDL_UnlockMutex(taskMtx);
+}
+
+void ThreadPool::worker()
+{
+    SDL_LockMutex(taskMtx);
+	while (true)
+	{
+        while (tasks.empty() && !isFinished)
+        {
+            SDL_CondWait(wakeCond, taskMtx);
+        }
+        if (isFinished)
+        {
+            break;
+        }
 
-	    SDL_LockMutex(waitMtx);
-	    SDL_CondSignal(waitCond);
-	    SDL_UnlockMutex(waitMtx);
+        Task task = tasks.back();
+        tasks.pop();
+        SDL_UnlockMutex(taskMtx);
+        task.execute(task.data);
+        finishTask(task);
+        SDL_LockMutex(taskMtx);
 	}
+    SDL_UnlockMutex(taskMtx);
 }
@@ -27,10 +27,18 @@ public:
     }
 };
 
+// Counts the tasks of one batch that have not finished yet, so a caller can wait for its own
+// tasks without also waiting for everything else that is queued (like the PhysX tasks).
+struct TaskGroup
+{
+    u32 pendingTaskCount = 0;
+};
+
 struct Task
 {
     void* data = nullptr;
     void* (*execute)(void*) = nullptr;
+    TaskGroup* group = nullptr;
 };
 
 class ThreadPool
@@ -38,41 +46,60 @@ class ThreadPool
     Array<Task> tasks;
     Array<SDL_Thread*> threads;
 
-	SDL_mutex* wakeMtx;
     SDL_mutex* taskMtx;
-    SDL_mutex* waitMtx;
 	SDL_cond* wakeCond;
 	SDL_cond* waitCond;
 
     bool isFinished = false;
 
     void worker();
+    void finishTask(Task const& task);
 
 public:
     ThreadPool()
     {
-        wakeMtx = SDL_CreateMutex();
         taskMtx = SDL_CreateMutex();
-        waitMtx = SDL_CreateMutex();
         wakeCond = SDL_CreateCond();
         waitCond = SDL_CreateCond();
     }
     ~ThreadPool()
     {
-        SDL_DestroyMutex(wakeMtx);
         SDL_DestroyMutex(taskMtx);
-        SDL_DestroyMutex(waitMtx);
         SDL_DestroyCond(wakeCond);
         SDL_DestroyCond(waitCond);
     }
 
     void start();
     void addTask(Task const&& task);
+    void addTask(TaskGroup& group, Task const&& task);
     void signalCompletion();
     void join();
-    void wait();
+    // blocks until every task of the group is done, running the group's tasks on the calling
+    // thread in the meantime
+    void wait(TaskGroup& group);
+    u32 getThreadCount() const { return threads.size(); }
 
 	friend i32 threadFunc(void* data);
 };
 
 ThreadPool g_threadPool;
+
+// Runs PhysX tasks on the worker threads of g_threadPool instead of threads of its own, so
+// simulation and the game's jobs share one set of workers.
+class PhysicsDispatcher : public PxCpuDispatcher
+{
+public:
+    void submitTask(PxBaseTask& task) override
+    {
+        g_threadPool.addTask({ &task, [](void* data) -> void* {
+            PxBaseTask* task = (PxBaseTask*)data;
+            task->run();
+            task->release();
+            return nullptr;
+        }});
+    }
+
+    PxU32 getWorkerCount() const override { return g_threadPool.getThreadCount(); }
+};
+
+PhysicsDispatcher g_physicsDispatcher;
@@ -22,13 +22,7 @@ void Track::onCreate(Scene* scene)
     actor->userData = &physicsUserData;
     scene->getPhysicsScene()->addActor(*actor);
     this->scene = scene;
-    for (auto& c : connections)
-    {
-        if (c->isDirty || c->vertices.empty())
-        {
-            createSegmentMesh(*c, scene);
-        }
-    }
+    buildSegmentMeshes();
     if (!scene->track)
     {
         scene->track = this;
@@ -146,6 +140,7 @@ void Track::trackModeUpdate(Renderer* renderer, Scene* scene, f32 deltaTime, boo
                 }
                 selectedPoints.erase(it);
                 points.erase(points.begin() + i);
+                ++version;
                 for (auto& conn : connections)
                 {
                     if (conn->pointIndexA > i)
@@ -624,127 +619,266 @@ Vec3 Track::getPointDir(i32 pointIndex) const
     return { 0, 0, 0 };
 }
 
-void Track::createSegmentMesh(BezierSegment& c, Scene* scene)
+namespace
 {
-    previewMesh.destroy();
-    c.isDirty = false;
+    struct TrackSample
+    {
+        f32 t;
+        Vec3 position;
+        Vec3 left;
+        Vec3 right;
+        Vec3 xDir;
+        Vec3 yDir;
+        Vec3 zDir;
+    };
 
-    if (c.vertices.empty())
+    struct SegmentBuild
     {
-        glCreateBuffers(1, &c.vbo);
-        glCreateBuffers(1, &c.ebo);
+        Track::BezierSegment* segment;
+        Array<u8> cookedCollisionMesh;
+        u32 collisionTriangleCount = 0;
+        bool cooked = false;
+    };
+}
 
-        enum
-        {
-            POSITION_BIND_INDEX = 0,
-            NORMAL_BIND_INDEX = 1
-        };
+static TrackSample sampleSegment(Track::BezierSegment const& c, f32 t)
+{
+    TrackSample s;
+    s.t = t;
+    s.position = c.pointOnCurve(t);
+    s.xDir = c.tangentOnCurve(t);
+    s.yDir = normalize(cross(s.xDir, Vec3(0, 0, 1)));
+    s.zDir = normalize(cross(s.yDir, s.xDir));
+    f32 width = lerp(c.widthA, c.widthB, t);
+    s.left = s.position + s.yDir * width;
+    s.right = s.position - s.yDir * width;
+    return s;
+}
 
-        glCreateVertexArrays(1, &c.vao);
+// how far the surface strays from the straight line between two samples
+static f32 tessellationError(Track::BezierSegment const& c, TrackSample const& a, TrackSample const& b)
+{
+    f32 error = 0.f;
+    // checking more than the midpoint catches s-bends whose midpoint happens to lie on the chord
+    const f32 fractions[] = { 0.25f, 0.5f, 0.75f };
+    for (f32 f : fractions)
+    {
+        TrackSample m = sampleSegment(c, lerp(a.t, b.t, f));
+        error = max(error, length(m.position - lerp(a.position, b.position, f)));
+        error = max(error, length(m.left - lerp(a.left, b.left, f)));
+        error = max(error, length(m.right - lerp(a.right, b.right, f)));
+    }
+    return error;
+}
 
-        glEnableVertexArrayAttrib(c.vao, POSITION_BIND_INDEX);
-        glVertexArrayAttribFormat(c.vao, POSITION_BIND_INDEX, 3, GL_FLOAT, GL_FALSE, 0);
-        glVertexArrayAttribBinding(c.vao, POSITION_BIND_INDEX, 0);
+static void subdivideSegment(Track::BezierSegment const& c, TrackSample const& a, TrackSample const& b,
+        f32 tolerance, f32 totalLength, Array<TrackSample>& output)
+{
+    f32 stepLength = (b.t - a.t) * totalLength;
+    if (stepLength > TRACK_MIN_STEP_SIZE && tessellationError(c, a, b) > tolerance)
+    {
+        TrackSample m = sampleSegment(c, (a.t + b.t) * 0.5f);
+        subdivideSegment(c, a, m, tolerance, totalLength, output);
+        subdivideSegment(c, m, b, tolerance, totalLength, output);
+        return;
+    }
+    output.push(b);
+}
 
-        glEnableVertexArrayAttrib(c.vao, NORMAL_BIND_INDEX);
-        glVertexArrayAttribFormat(c.vao, NORMAL_BIND_INDEX, 3, GL_FLOAT, GL_FALSE, 12);
-        glVertexArrayAttribBinding(c.vao, NORMAL_BIND_INDEX, 0);
+void Track::BezierSegment::tessellate(f32 tolerance, Array<Vertex>& outVertices,
+        Array<u32>& outIndices, BoundingBox& outBoundingBox) const
+{
+    f32 totalLength = getLength();
+
+    // Start from evenly spaced samples no further apart than the max step size, then split
+    // wherever curvature or a change in width pulls the surface away from the triangles.
+    Array<TrackSample> samples;
+    u32 initialSteps = max(1u, (u32)ceilf(totalLength / TRACK_MAX_STEP_SIZE));
+    TrackSample prev = sampleSegment(*this, 0.f);
+    samples.push(prev);
+    for (u32 i=1; i<=initialSteps; ++i)
+    {
+        TrackSample next = sampleSegment(*this, (f32)i / (f32)initialSteps);
+        subdivideSegment(*this, prev, next, tolerance, totalLength, samples);
+        prev = next;
     }
 
-    f32 totalLength = c.getLength();
-
-    c.boundingBox = { Vec3(FLT_MAX), Vec3(-FLT_MAX) };
-    c.vertices.clear();
-    c.indices.clear();
-    // TODO: find the maximum viable step size
-    const f32 stepSize = 2.f;
-    u32 totalSteps = (u32)(totalLength / stepSize);
-    Vec3 prevP = points[c.pointIndexA].position;
-    for (u32 i=0; i<=totalSteps; ++i)
-    {
-        f32 t = (f32)i / (f32)totalSteps;
-        Vec3 p = pointOnBezierCurve(
-                points[c.pointIndexA].position,
-                points[c.pointIndexA].position + c.handleOffsetA,
-                points[c.pointIndexB].position + c.handleOffsetB,
-                points[c.pointIndexB].position, t);
-        Vec3 xDir = normalize(i == 0 ? c.handleOffsetA :
-                (i == totalSteps ? -c.handleOffsetB : normalize(p - prevP)));
-        Vec3 yDir = normalize(cross(xDir, Vec3(0, 0, 1)));
-        Vec3 zDir = normalize(cross(yDir, xDir));
-        f32 width = lerp(c.widthA, c.widthB, t);
+    outBoundingBox = { Vec3(FLT_MAX), Vec3(-FLT_MAX) };
+    outVertices.clear();
+    outIndices.clear();
+    outVertices.reserve(samples.size() * 4);
+    outIndices.reserve((samples.size() - 1) * 18);
+    for (u32 i=0; i<samples.size(); ++i)
+    {
+        TrackSample const& s = samples[i];
         f32 edgeWidth = 0.f;
         f32 edgeHeight = 0.36f;
-        Vec3 p1 = p + yDir * (width + edgeWidth) - Vec3(0, 0, edgeHeight);
-        Vec3 p2 = p + yDir * width;
-        Vec3 p3 = p - yDir * width;
-        Vec3 p4 = p - yDir * (width + edgeWidth) - Vec3(0, 0, edgeHeight);
-        c.vertices.push(Vertex{ p1, -yDir }); // current: j,   previous: j-4
-        c.vertices.push(Vertex{ p2, zDir });  // current: j+1, previous: j-3
-        c.vertices.push(Vertex{ p3, zDir });  // current: j+2, previous: j-2
-        c.vertices.push(Vertex{ p4, yDir });  // current: j+3, previous: j-1
+        Vec3 p1 = s.left + s.yDir * edgeWidth - Vec3(0, 0, edgeHeight);
+        Vec3 p2 = s.left;
+        Vec3 p3 = s.right;
+        Vec3 p4 = s.right - s.yDir * edgeWidth - Vec3(0, 0, edgeHeight);
+        outVertices.push(Vertex{ p1, -s.yDir }); // current: j,   previous: j-4
+        outVertices.push(Vertex{ p2, s.zDir });  // current: j+1, previous: j-3
+        outVertices.push(Vertex{ p3, s.zDir });  // current: j+2, previous: j-2
+        outVertices.push(Vertex{ p4, s.yDir });  // current: j+3, previous: j-1
         if (i > 0)
         {
             u32 j = i*4;
 
             // left edge tri 1
-            c.indices.push(j-3);
-            c.indices.push(j-4);
-            c.indices.push(j);
+            outIndices.push(j-3);
+            outIndices.push(j-4);
+            outIndices.push(j);
 
             // left edge tri 2
-            c.indices.push(j-3);
-            c.indices.push(j);
-            c.indices.push(j+1);
+            outIndices.push(j-3);
+            outIndices.push(j);
+            outIndices.push(j+1);
 
             // center tri 1
-            c.indices.push(j-2);
-            c.indices.push(j-3);
-            c.indices.push(j+1);
+            outIndices.push(j-2);
+            outIndices.push(j-3);
+            outIndices.push(j+1);
 
             // center tri 2
-            c.indices.push(j-2);
-            c.indices.push(j+1);
-            c.indices.push(j+2);
+            outIndices.push(j-2);
+            outIndices.push(j+1);
+            outIndices.push(j+2);
 
             // right edge tri 1
-            c.indices.push(j-1);
-            c.indices.push(j-2);
-            c.indices.push(j+2);
+            outIndices.push(j-1);
+            outIndices.push(j-2);
+            outIndices.push(j+2);
 
             // right edge tri 2
-            c.indices.push(j-1);
-            c.indices.push(j+2);
-            c.indices.push(j+3);
+            outIndices.push(j-1);
+            outIndices.push(j+2);
+            outIndices.push(j+3);
         }
-        c.boundingBox.min = min(c.boundingBox.min, min(min(p1, p2), min(p3, p4)));
-        c.boundingBox.max = max(c.boundingBox.max, max(max(p1, p2), max(p3, p4)));
-        prevP = p;
+        outBoundingBox.min = min(outBoundingBox.min, min(min(p1, p2), min(p3, p4)));
+        outBoundingBox.max = max(outBoundingBox.max, max(max(p1, p2), max(p3, p4)));
     }
-    computeBoundingBox();
+}
 
-    glBindVertexArray(c.vao);
-    glNamedBufferData(c.vbo, c.vertices.size() * sizeof(Vertex), c.vertices.data(), GL_DYNAMIC_DRAW);
-    glNamedBufferData(c.ebo, c.indices.size() * sizeof(u32), c.indices.data(), GL_DYNAMIC_DRAW);
-    glVertexArrayVertexBuffer(c.vao, 0, c.vbo, 0, sizeof(Vertex));
-    glVertexArrayElementBuffer(c.vao, c.ebo);
+// Builds the render mesh and cooks the collision mesh. Doesn't touch GL or the physics scene,
+// so it can run on a worker thread.
+static void buildSegment(SegmentBuild& build)
+{
+    Track::BezierSegment& c = *build.segment;
+    c.tessellate(TRACK_RENDER_TOLERANCE, c.vertices, c.indices, c.boundingBox);
+
+    Array<Track::Vertex> collisionVertices;
+    Array<u32> collisionIndices;
+    BoundingBox collisionBoundingBox;
+    c.tessellate(TRACK_COLLISION_TOLERANCE, collisionVertices, collisionIndices, collisionBoundingBox);
 
-    // collision mesh
     PxTriangleMeshDesc desc;
-    desc.points.count = (u32)c.vertices.size();
-    desc.points.stride = sizeof(Vertex);
-    desc.points.data = c.vertices.data();
-    desc.triangles.count = (u32)c.indices.size() / 3;
-    desc.triangles.stride = 3 * sizeof(c.indices[0]);
-    desc.triangles.data = c.indices.data();
+    desc.points.count = (u32)collisionVertices.size();
+    desc.points.stride = sizeof(Track::Vertex);
+    desc.points.data = collisionVertices.data();
+    desc.triangles.count = (u32)collisionIndices.size() / 3;
+    desc.triangles.stride = 3 * sizeof(collisionIndices[0]);
+    desc.triangles.data = collisionIndices.data();
 
     PxDefaultMemoryOutputStream writeBuffer;
-    if (!g_game.physx.cooking->cookTriangleMesh(desc, writeBuffer))
+    build.cooked = g_game.physx.cooking->cookTriangleMesh(desc, writeBuffer);
+    build.cookedCollisionMesh.assign(writeBuffer.getData(), writeBuffer.getData() + writeBuffer.getSize());
+    build.collisionTriangleCount = desc.triangles.count;
+}
+
+void Track::createSegmentMesh(BezierSegment& c, Scene* scene)
+{
+    SegmentBuild build;
+    build.segment = &c;
+    buildSegment(build);
+    if (!build.cooked)
     {
         FATAL_ERROR("Failed to create collision mesh for track segment");
     }
+    finishSegmentMesh(c, build.cookedCollisionMesh);
+    computeBoundingBox();
+}
+
+void Track::buildSegmentMeshes()
+{
+    f64 startTime = getTime();
 
-    PxDefaultMemoryInputData readBuffer(writeBuffer.getData(), writeBuffer.getSize());
+    Array<SegmentBuild> builds;
+    for (auto& c : connections)
+    {
+        if (c->isDirty || c->vertices.empty())
+        {
+            builds.push({ c.get() });
+        }
+    }
+    if (builds.empty())
+    {
+        return;
+    }
+
+    TaskGroup group;
+    for (auto& build : builds)
+    {
+        g_threadPool.addTask(group, { &build, [](void* data) -> void* {
+            buildSegment(*(SegmentBuild*)data);
+            return nullptr;
+        }});
+    }
+    g_threadPool.wait(group);
+
+    buildStats = {};
+    buildStats.segmentCount = builds.size();
+    for (auto& build : builds)
+    {
+        if (!build.cooked)
+        {
+            FATAL_ERROR("Failed to create collision mesh for track segment");
+        }
+        finishSegmentMesh(*build.segment, build.cookedCollisionMesh);
+        buildStats.renderTriangleCount += build.segment->indices.size() / 3;
+        buildStats.collisionTriangleCount += build.collisionTriangleCount;
+        buildStats.fixedStepTriangleCount += (u32)(build.segment->getLength() / 2.f) * 6;
+    }
+    computeBoundingBox();
+    ++version;
+    buildStats.buildTime = getTime() - startTime;
+}
+
+void Track::finishSegmentMesh(BezierSegment& c, Array<u8> const& cookedCollisionMesh)
+{
+    previewMesh.destroy();
+    c.isDirty = false;
+
+    if (!c.vao)
+    {
+        glCreateBuffers(1, &c.vbo);
+        glCreateBuffers(1, &c.ebo);
+
+        enum
+        {
+            POSITION_BIND_INDEX = 0,
+            NORMAL_BIND_INDEX = 1
+        };
+
+        glCreateVertexArrays(1, &c.vao);
+
+        glEnableVertexArrayAttrib(c.vao, POSITION_BIND_INDEX);
+        glVertexArrayAttribFormat(c.vao, POSITION_BIND_INDEX, 3, GL_FLOAT, GL_FALSE, 0);
+        glVertexArrayAttribBinding(c.vao, POSITION_BIND_INDEX, 0);
+
+        glEnableVertexArrayAttrib(c.vao, NORMAL_BIND_INDEX);
+        glVertexArrayAttribFormat(c.vao, NORMAL_BIND_INDEX, 3, GL_FLOAT, GL_FALSE, 12);
+        glVertexArrayAttribBinding(c.vao, NORMAL_BIND_INDEX, 0);
+    }
+
+    glBindVertexArray(c.vao);
+    glNamedBufferData(c.vbo, c.vertices.size() * sizeof(Vertex), c.vertices.data(), GL_DYNAMIC_DRAW);
+    glNamedBufferData(c.ebo, c.indices.size() * sizeof(u32), c.indices.data(), GL_DYNAMIC_DRAW);
+    glVertexArrayVertexBuffer(c.vao, 0, c.vbo, 0, sizeof(Vertex));
+    glVertexArrayElementBuffer(c.vao, c.ebo);
+
+    // collision mesh
+    PxDefaultMemoryInputData readBuffer((PxU8*)cookedCollisionMesh.data(), cookedCollisionMesh.size());
     PxTriangleMesh* triMesh = g_game.physx.physics->createTriangleMesh(readBuffer);
 
     if (!c.collisionShape)
@@ -810,11 +944,10 @@ void Track::computeBoundingBox()
     boundingBox.max += Vec3(addSize * 0.5f, 0.f);
 }
 
-void Track::buildPreviewMesh(Scene* scene)
+void Track::buildPreviewGeometry(Array<f32>& vertices, Array<u32>& indices) const
 {
-    previewMesh.destroy();
-    previewMesh.vertices.clear();
-    previewMesh.indices.clear();
+    vertices.clear();
+    indices.clear();
 
     u32 indexOffset = 0;
     for (auto& c : connections)
@@ -823,37 +956,44 @@ void Track::buildPreviewMesh(Scene* scene)
         {
             // skip edges
 
-            previewMesh.vertices.push(c->vertices[i+1].position.x);
-            previewMesh.vertices.push(c->vertices[i+1].position.y);
-            previewMesh.vertices.push(c->vertices[i+1].position.z);
-            previewMesh.vertices.push(c->vertices[i+1].normal.x);
-            previewMesh.vertices.push(c->vertices[i+1].normal.y);
-            previewMesh.vertices.push(c->vertices[i+1].normal.z);
+            vertices.push(c->vertices[i+1].position.x);
+            vertices.push(c->vertices[i+1].position.y);
+            vertices.push(c->vertices[i+1].position.z);
+            vertices.push(c->vertices[i+1].normal.x);
+            vertices.push(c->vertices[i+1].normal.y);
+            vertices.push(c->vertices[i+1].normal.z);
 
-            previewMesh.vertices.push(c->vertices[i+2].position.x);
-            previewMesh.vertices.push(c->vertices[i+2].position.y);
-            previewMesh.vertices.push(c->vertices[i+2].position.z);
-            previewMesh.vertices.push(c->vertices[i+2].normal.x);
-            previewMesh.vertices.push(c->vertices[i+2].normal.y);
-            previewMesh.vertices.push(c->vertices[i+2].normal.z);
+            vertices.push(c->vertices[i+2].position.x);
+            vertices.push(c->vertices[i+2].position.y);
+            vertices.push(c->vertices[i+2].position.z);
+            vertices.push(c->vertices[i+2].normal.x);
+            vertices.push(c->vertices[i+2].normal.y);
+            vertices.push(c->vertices[i+2].normal.z);
 
             if (i > 0)
             {
-                previewMesh.indices.push(indexOffset-1);
-                previewMesh.indices.push(indexOffset-2);
-                previewMesh.indices.push(indexOffset);
+                indices.push(indexOffset-1);
+                indices.push(indexOffset-2);
+                indices.push(indexOffset);
 
-                previewMesh.indices.push(indexOffset-1);
-                previewMesh.indices.push(indexOffset);
-                previewMesh.indices.push(indexOffset+1);
+                indices.push(indexOffset-1);
+                indices.push(indexOffset);
+                indices.push(indexOffset+1);
             }
 
             indexOffset += 2;
         }
     }
+}
+
+void Track::buildPreviewMesh(Scene* scene)
+{
+    ++previewVersion;
+    previewMesh.destroy();
+    buildPreviewGeometry(previewMesh.vertices, previewMesh.indices);
 
     previewMesh.name = "Track Preview";
-    previewMesh.numVertices = previewMesh.vertices.size() / 7;
+    previewMesh.numVertices = previewMesh.vertices.size() / 6;
     previewMesh.numIndices = previewMesh.indices.size();
     previewMesh.numColors = 0;
     previewMesh.numTexCoords = 0;
@@ -8,6 +8,13 @@
 #include "decal.h"
 #include "spline.h"
 
+// largest distance in meters between the curved track surface and its triangles
+const f32 TRACK_RENDER_TOLERANCE = 0.01f;
+const f32 TRACK_COLLISION_TOLERANCE = 0.04f;
+// long straights are still split up so that vertex lighting and decal clipping stay reasonable
+const f32 TRACK_MAX_STEP_SIZE = 25.f;
+const f32 TRACK_MIN_STEP_SIZE = 0.5f;
+
 class Track : public Entity
 {
 public:
@@ -53,8 +60,6 @@ public:
         }},
     };
 
-
-private:
     struct BezierSegment
     {
         Vec3 handleOffsetA;
@@ -114,6 +119,25 @@ private:
             return normalize(p0 - p1);
         }
 
+        // exact tangent, which matches the handle directions at both ends
+        Vec3 tangentOnCurve(f32 t) const
+        {
+            Vec3 p0 = track->points[pointIndexA].position;
+            Vec3 p1 = track->points[pointIndexA].position + handleOffsetA;
+            Vec3 p2 = track->points[pointIndexB].position + handleOffsetB;
+            Vec3 p3 = track->points[pointIndexB].position;
+            f32 u = 1.f - t;
+            Vec3 d = (p1 - p0) * (3.f * u * u) + (p2 - p1) * (6.f * u * t) + (p3 - p2) * (3.f * t * t);
+            if (lengthSquared(d) < 0.0001f)
+            {
+                return normalize(pointOnCurve(min(t + 0.01f, 1.f)) - pointOnCurve(max(t - 0.01f, 0.f)));
+            }
+            return normalize(d);
+        }
+
+        void tessellate(f32 tolerance, Array<Vertex>& outVertices, Array<u32>& outIndices,
+                BoundingBox& outBoundingBox) const;
+
         f32 getLength() const
         {
             f32 totalLength = 0.f;
@@ -128,8 +152,21 @@ private:
         }
     };
 
+    // the segments rebuilt by the last call to buildSegmentMeshes()
+    struct BuildStats
+    {
+        f64 buildTime = 0.0;
+        u32 segmentCount = 0;
+        u32 renderTriangleCount = 0;
+        u32 collisionTriangleCount = 0;
+        // what the old fixed 2m step would have produced, for comparison
+        u32 fixedStepTriangleCount = 0;
+    };
+
+private:
     Array<Point> points;
     Array<OwnedPtr<BezierSegment>> connections;
+    BuildStats buildStats;
 
     struct Selection
     {
@@ -153,12 +190,16 @@ private:
 
     BezierSegment* getPointConnection(i32 pointIndex);
     void createSegmentMesh(BezierSegment& segment, Scene* scene);
+    void buildSegmentMeshes();
+    void finishSegmentMesh(BezierSegment& segment, Array<u8> const& cookedCollisionMesh);
     void computeBoundingBox();
 
     ShaderHandle colorShader = getShaderHandle("track");
     ShaderHandle depthShader = getShaderHandle("track", { {"DEPTH_ONLY"} });
 
     Mesh previewMesh;
+    u32 previewVersion = 0;
+    u32 version = 0;
     void buildPreviewMesh(Scene* scene);
 
 public:
@@ -211,6 +252,7 @@ public:
     void clearSelection();
     void buildTrackGraph(class TrackGraph* trackGraph, Mat4 const& startTransform);
     BoundingBox getBoundingBox() const { return boundingBox; }
+    BuildStats const& getBuildStats() const { return buildStats; }
     void applyDecal(Decal& decal) override
     {
         BoundingBox decalBoundingBox = decal.getBoundingBox();
@@ -231,6 +273,12 @@ public:
         }
         return &previewMesh;
     }
+    // the vertices (position and normal) and indices of the preview mesh, without touching GL
+    void buildPreviewGeometry(Array<f32>& vertices, Array<u32>& indices) const;
+    // incremented every time the preview mesh is rebuilt
+    u32 getPreviewVersion() const { return previewVersion; }
+    // changes whenever segments are rebuilt or removed
+    u32 getVersion() const { return version; }
 
     // entity
     void onCreate(Scene* scene) override;
@@ -2,9 +2,14 @@
 
 #include "renderer.h"
 
+// Renders the 2D track overview for the HUD. The track itself is drawn once into a cached
+// multisampled layer, and every frame that layer is copied into the working framebuffer before
+// the vehicle markers are drawn on top of it.
 class TrackPreview2D
 {
     bool isInitialized = false;
+    bool hasStaticLayer = false;
+    GLuint staticFramebuffer, staticTex, staticDepthBuffer;
     GLuint multisampleFramebuffer, multisampleTex, multisampleDepthBuffer;
     GLuint destFramebuffer, destTex;
     u32 width = 0;
@@ -14,6 +19,119 @@ class TrackPreview2D
 
     Texture outputTexture;
 
+    void createMultisampleTarget(GLuint& framebuffer, GLuint& tex, GLuint& depthBuffer)
+    {
+        const u32 samples = 4;
+        glGenTextures(1, &tex);
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, tex);
+        glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, samples, GL_RGBA, width, height, GL_TRUE);
+
+        glGenRenderbuffers(1, &depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT, width, height);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, tex, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+
+        assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    }
+
+    void resize(u32 width, u32 height)
+    {
+        if (this->width == width && this->height == height)
+        {
+            return;
+        }
+
+        if (isInitialized)
+        {
+            cleanup();
+        }
+
+        this->width = width;
+        this->height = height;
+
+        createMultisampleTarget(staticFramebuffer, staticTex, staticDepthBuffer);
+        createMultisampleTarget(multisampleFramebuffer, multisampleTex, multisampleDepthBuffer);
+
+        // dest
+        glGenTextures(1, &this->destTex);
+        glBindTexture(GL_TEXTURE_2D, this->destTex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        glGenFramebuffers(1, &this->destFramebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->destFramebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->destTex, 0);
+
+        assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        isInitialized = true;
+        hasStaticLayer = false;
+    }
+
+    void bindForDrawing(Renderer* renderer, GLuint framebuffer)
+    {
+        glViewport(0, 0, width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+        glDepthMask(GL_TRUE);
+        glEnable(GL_DEPTH_TEST);
+        glDisable(GL_CULL_FACE);
+        glDisable(GL_BLEND);
+
+        static ShaderHandle shader = getShaderHandle("mesh2D");
+        glUseProgram(renderer->getShaderProgram(shader));
+        glUniform3fv(5, 1, (GLfloat*)&camPosition);
+        glUniformMatrix4fv(0, 1, GL_FALSE, viewProjection.valuePtr());
+    }
+
+    static void getCorners(BoundingBox const& bb, Vec3* points)
+    {
+        points[0] = { bb.min.x, bb.min.y, bb.min.z };
+        points[1] = { bb.min.x, bb.max.y, bb.min.z };
+        points[2] = { bb.max.x, bb.min.y, bb.min.z };
+        points[3] = { bb.max.x, bb.max.y, bb.min.z };
+        points[4] = { bb.min.x, bb.min.y, bb.max.z };
+        points[5] = { bb.min.x, bb.max.y, bb.max.z };
+        points[6] = { bb.max.x, bb.min.y, bb.max.z };
+        points[7] = { bb.max.x, bb.max.y, bb.max.z };
+    }
+
+    static bool areAllPointsVisible(Vec3 const* points, u32 count, Mat4 const& viewProjection)
+    {
+        f32 margin = 0.01f;
+        for (u32 i=0; i<count; ++i)
+        {
+            Vec4 tp = viewProjection * Vec4(points[i], 1.f);
+            tp.x = (((tp.x / tp.w) + 1.f) / 2.f);
+            tp.y = ((-1.f * (tp.y / tp.w) + 1.f) / 2.f);
+            if (tp.x < margin || tp.x > 1.f - margin || tp.y < margin || tp.y > 1.f - margin)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static Mat4 getFitCameraViewProjection(BoundingBox const& bb, f32 dist, Vec3& camPosition)
+    {
+        Vec3 bbCenter = (bb.min + bb.max) * 0.5f;
+        Vec3 dir = normalize(Vec3(1.f));
+        camPosition = (bbCenter - Vec3(0, 0, 20)) + dir * dist;
+        Mat4 view = Mat4::lookAt(camPosition, bbCenter, Vec3(0, 0, 1));
+        Mat4 projection = Mat4::perspective(radians(26.f), 1.f, 1.f, 2500.f);
+        return projection * view;
+    }
+
 public:
     TrackPreview2D() {}
     ~TrackPreview2D()
@@ -26,78 +144,261 @@ public:
 
     void cleanup()
     {
+        glDeleteFramebuffers(1, &staticFramebuffer);
         glDeleteFramebuffers(1, &multisampleFramebuffer);
         glDeleteFramebuffers(1, &destFramebuffer);
+        glDeleteRenderbuffers(1, &staticDepthBuffer);
         glDeleteRenderbuffers(1, &multisampleDepthBuffer);
+        glDeleteTextures(1, &staticTex);
         glDeleteTextures(1, &multisampleTex);
         glDeleteTextures(1, &destTex);
     }
 
-    void beginUpdate(Renderer* renderer, u32 width, u32 height)
+    static constexpr f32 FIT_CAMERA_MIN_DISTANCE = 850.f;
+    static constexpr f32 FIT_CAMERA_DISTANCE_STEP = 10.f;
+
+    // Finds a camera that looks down at the track diagonally from as close as possible while
+    // keeping the whole bounding box in view. This does not touch GL.
+    static void fitCamera(BoundingBox const& bb, Vec3& camPosition, Mat4& viewProjection)
     {
-        if (this->width != width || this->height != height)
+        Vec3 points[8];
+        getCorners(bb, points);
+        f32 dist = FIT_CAMERA_MIN_DISTANCE;
+        for (u32 i=1; i<150; ++i)
         {
-            if (isInitialized)
+            viewProjection = getFitCameraViewProjection(bb, dist, camPosition);
+            if (areAllPointsVisible(points, ARRAY_SIZE(points), viewProjection))
             {
-                cleanup();
+                break;
             }
+            dist += FIT_CAMERA_DISTANCE_STEP;
+        }
+    }
 
-            this->width = width;
-            this->height = height;
+    // Checks that fitCamera keeps every corner of the track and of a few made up tracks in
+    // view from as close as the search allows, and times it.
+    static void checkFitCamera(BoundingBox const& trackBoundingBox)
+    {
+        BoundingBox boxes[] = {
+            trackBoundingBox,
+            { Vec3(-20.f, -20.f, -2.f), Vec3(20.f, 20.f, 2.f) },
+            { Vec3(-200.f, -150.f, -10.f), Vec3(200.f, 150.f, 25.f) },
+            { Vec3(-500.f, -60.f, 0.f), Vec3(500.f, 60.f, 40.f) },
+            { Vec3(100.f, 300.f, -30.f), Vec3(450.f, 520.f, 60.f) },
+        };
 
-            // multisample
-            const u32 samples = 4;
-            glGenTextures(1, &this->multisampleTex);
-            glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, this->multisampleTex);
-            glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, samples, GL_RGBA, width, height, GL_TRUE);
+        bool allPassed = true;
+        for (u32 i=0; i<ARRAY_SIZE(boxes); ++i)
+        {
+            BoundingBox const& bb = boxes[i];
+            Vec3 points[8];
+            getCorners(bb, points);
 
-            glGenRenderbuffers(1, &this->multisampleDepthBuffer);
-            glBindRenderbuffer(GL_RENDERBUFFER, this->multisampleDepthBuffer);
-            glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT, width, height);
+            Vec3 camPosition;
+            Mat4 viewProjection;
+            fitCamera(bb, camPosition, viewProjection);
+            Vec3 bbCenter = (bb.min + bb.max) * 0.5f;
+            f32 dist = length(camPosition - (bbCenter - Vec3(0, 0, 20)));
 
-            glGenFramebuffers(1, &this->multisampleFramebuffer);
-            glBindFramebuffer(GL_FRAMEBUFFER, this->multisampleFramebuffer);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, this->multisampleTex, 0);
-            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->multisampleDepthBuffer);
+            if (!areAllPointsVisible(points, ARRAY_SIZE(points), viewProjection))
+            {
+                error("Track preview camera %u: the bounding box is not in view", i);
+                allPassed = false;
+                continue;
+            }
+            // one step closer must cut something off, unless the search started there
+            Vec3 closerPosition;
+            Mat4 closerViewProjection = getFitCameraViewProjection(bb,
+                    dist - FIT_CAMERA_DISTANCE_STEP, closerPosition);
+            if (dist > FIT_CAMERA_MIN_DISTANCE + 0.5f
+                    && areAllPointsVisible(points, ARRAY_SIZE(points), closerViewProjection))
+            {
+                error("Track preview camera %u: the camera could be closer than %.1f", i, dist);
+                allPassed = false;
+            }
+        }
 
-            assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+        const u32 iterations = 1000;
+        f64 t = getTime();
+        for (u32 n=0; n<iterations; ++n)
+        {
+            Vec3 camPosition;
+            Mat4 viewProjection;
+            fitCamera(boxes[n % ARRAY_SIZE(boxes)], camPosition, viewProjection);
+        }
+        f64 fitTime = (getTime() - t) / iterations;
 
-            // dest
-            glGenTextures(1, &this->destTex);
-            glBindTexture(GL_TEXTURE_2D, this->destTex);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        if (allPassed)
+        {
+            println("Track preview camera fits all %u bounding boxes, %.4fms per fit",
+                    (u32)ARRAY_SIZE(boxes), fitTime * 1000.0);
+        }
+    }
 
-            glGenFramebuffers(1, &this->destFramebuffer);
-            glBindFramebuffer(GL_FRAMEBUFFER, this->destFramebuffer);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->destTex, 0);
+    // a vehicle dot drawn on top of the cached track layer
+    struct Marker
+    {
+        Mat4 transform;
+        Vec3 color;
+    };
 
-            assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    static Marker makeMarker(Vec3 const& position, Vec3 const& color)
+    {
+        return {
+            Mat4::translation(Vec3(0, 0, 2.1f) + position) * Mat4::scaling(Vec3(5.1f)),
+            color
+        };
+    }
 
-            glBindTexture(GL_TEXTURE_2D, 0);
-            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    // Checks the track outline and the marker list without touching GL: the outline has to be
+    // well formed, lie inside the track bounds and be fully in view of the fitted camera, and
+    // the markers have to keep their order, positions and colors.
+    static void checkOutlineAndMarkers(Array<f32> const& outlineVertices,
+            Array<u32> const& outlineIndices, BoundingBox const& bb)
+    {
+        bool allPassed = true;
+        const u32 vertexSize = 6;
+        u32 vertexCount = outlineVertices.size() / vertexSize;
+        if (outlineVertices.empty() || outlineVertices.size() % vertexSize != 0
+                || outlineIndices.empty() || outlineIndices.size() % 3 != 0)
+        {
+            error("Track preview outline has %u floats and %u indices", outlineVertices.size(),
+                    outlineIndices.size());
+            return;
+        }
+        for (u32 index : outlineIndices)
+        {
+            if (index >= vertexCount)
+            {
+                error("Track preview outline index %u is out of range (%u vertices)", index,
+                        vertexCount);
+                return;
+            }
+        }
 
-            isInitialized = true;
+        Array<Vec3> points;
+        f32 epsilon = 0.01f;
+        for (u32 i=0; i<vertexCount; ++i)
+        {
+            Vec3 p(outlineVertices[i * vertexSize + 0], outlineVertices[i * vertexSize + 1],
+                    outlineVertices[i * vertexSize + 2]);
+            if (p.x < bb.min.x - epsilon || p.y < bb.min.y - epsilon || p.z < bb.min.z - epsilon
+                    || p.x > bb.max.x + epsilon || p.y > bb.max.y + epsilon
+                    || p.z > bb.max.z + epsilon)
+            {
+                error("Track preview outline vertex %u is outside of the track bounds", i);
+                allPassed = false;
+                break;
+            }
+            points.push(p);
         }
 
-		glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 1, -1, "2D Track HUD");
-        glViewport(0, 0, width, height);
-        glBindFramebuffer(GL_FRAMEBUFFER, this->multisampleFramebuffer);
-        glDrawBuffer(GL_COLOR_ATTACHMENT0);
-        glDepthMask(GL_TRUE);
-        glEnable(GL_DEPTH_TEST);
-        glDisable(GL_CULL_FACE);
-        glClearColor(0.f, 0.f, 0.f, 0.f);
-        glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
-        glDisable(GL_BLEND);
+        Vec3 camPosition;
+        Mat4 viewProjection;
+        fitCamera(bb, camPosition, viewProjection);
+        if (!areAllPointsVisible(points.data(), points.size(), viewProjection))
+        {
+            error("Track preview outline is not fully in view");
+            allPassed = false;
+        }
 
-        static ShaderHandle shader = getShaderHandle("mesh2D");
-        glUseProgram(renderer->getShaderProgram(shader));
-        glUniform3fv(5, 1, (GLfloat*)&camPosition);
-        glUniformMatrix4fv(0, 1, GL_FALSE, viewProjection.valuePtr());
+        const u32 markerCount = 20;
+        Array<Marker> markers;
+        for (u32 i=0; i<markerCount; ++i)
+        {
+            Vec3 position = bb.min + (bb.max - bb.min) * Vec3((i % 5) / 4.f, (i / 5) / 3.f, 0.5f);
+            markers.push(makeMarker(position, Vec3(i / (f32)markerCount, 0.5f, 1.f)));
+        }
+        for (u32 i=0; i<markerCount; ++i)
+        {
+            Vec3 position = bb.min + (bb.max - bb.min) * Vec3((i % 5) / 4.f, (i / 5) / 3.f, 0.5f);
+            Vec3 expected = position + Vec3(0, 0, 2.1f);
+            if (lengthSquared(markers[i].transform.position() - expected) > 0.0001f
+                    || absolute(markers[i].transform.scale().x - 5.1f) > 0.001f
+                    || markers[i].color.x != i / (f32)markerCount)
+            {
+                error("Track preview marker %u is wrong", i);
+                allPassed = false;
+                break;
+            }
+        }
+
+        if (allPassed)
+        {
+            println("Track preview outline has %u triangles in view, %u markers match",
+                    outlineIndices.size() / 3, markers.size());
+        }
+    }
+
+    // Draws the track into the cached layer. Only needed when the track or the size changes.
+    void drawStaticLayer(Renderer* renderer, u32 size, BoundingBox const& bb, Mesh* trackMesh,
+            Mesh* startMesh, Mat4 const& startTransform)
+    {
+        fitCamera(bb, camPosition, viewProjection);
+
+        beginStaticUpdate(renderer, size, size);
+
+        drawItem(startMesh->vao, startMesh->numIndices, startTransform, Vec3(1.f), false);
+
+        drawItem(trackMesh->vao, (u32)trackMesh->numIndices, Mat4(1.f), Vec3(1.f), true, 1);
+        drawItem(trackMesh->vao, (u32)trackMesh->numIndices, Mat4::translation({ 0, 0, -5 }),
+                Vec3(0.2f), true, 0);
+        /*
+        for (u32 i=0; i<20; ++i)
+        {
+            drawItem(trackMesh->vao, (u32)trackMesh->numIndices,
+                    Mat4::translation({ 0, 0, bb.min.z - 7.f + (i/20.f * 7.f)})
+                        * Mat4::scaling({ 1, 1, i/20.f }), Vec3(0.18f), true, 0);
+        }
+        */
+
+        endStaticUpdate();
+    }
+
+    // draws the markers between beginUpdate() and endUpdate()
+    void drawMarkers(Mesh* markerMesh, Array<Marker> const& markers)
+    {
+        for (auto const& marker : markers)
+        {
+            drawItem(markerMesh->vao, markerMesh->numIndices, marker.transform, marker.color,
+                    false, 2);
+        }
+    }
+
+    // Compares redrawing the track every frame (as before the track layer was cached) with only
+    // drawing the markers on top of the cached layer. Both wait for the GPU every frame.
+    void benchmarkSubmissions(Renderer* renderer, u32 size, BoundingBox const& bb,
+            Mesh* trackMesh, Mesh* startMesh, Mat4 const& startTransform, Mesh* markerMesh,
+            Array<Marker> const& markers)
+    {
+        const u32 iterations = 200;
+        f64 submitTime[2] = {};
+        f64 frameTime[2] = {};
+        for (u32 cached=0; cached<2; ++cached)
+        {
+            glFinish();
+            f64 startTime = getTime();
+            for (u32 n=0; n<iterations; ++n)
+            {
+                f64 t = getTime();
+                if (!cached || n == 0)
+                {
+                    drawStaticLayer(renderer, size, bb, trackMesh, startMesh, startTransform);
+                }
+                beginUpdate(renderer);
+                drawMarkers(markerMesh, markers);
+                endUpdate();
+                submitTime[cached] += getTime() - t;
+                glFinish();
+            }
+            frameTime[cached] = (getTime() - startTime) / iterations;
+            submitTime[cached] /= iterations;
+        }
+
+        println("Track preview with %u markers: redrawn every frame %u draws, %.4fms to submit, "
+                "%.4fms with GPU; cached %u draws, %.4fms to submit, %.4fms with GPU",
+                markers.size(), markers.size() + 3, submitTime[0] * 1000.0, frameTime[0] * 1000.0,
+                markers.size(), submitTime[1] * 1000.0, frameTime[1] * 1000.0);
     }
 
     void setCamViewProjection(Mat4 const& viewProjection)
@@ -110,6 +411,47 @@ public:
         this->camPosition = camPosition;
     }
 
+    bool needsStaticUpdate(u32 width, u32 height) const
+    {
+        return !hasStaticLayer || this->width != width || this->height != height;
+    }
+
+    void invalidateStaticLayer() { hasStaticLayer = false; }
+
+    // draw calls between beginStaticUpdate() and endStaticUpdate() go into the cached layer
+    void beginStaticUpdate(Renderer* renderer, u32 width, u32 height)
+    {
+        resize(width, height);
+
+		glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 1, -1, "2D Track HUD Static");
+        bindForDrawing(renderer, staticFramebuffer);
+        glClearColor(0.f, 0.f, 0.f, 0.f);
+        glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+    }
+
+    void endStaticUpdate()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glPopDebugGroup();
+        hasStaticLayer = true;
+    }
+
+    // draw calls between beginUpdate() and endUpdate() are drawn on top of the cached layer
+    void beginUpdate(Renderer* renderer)
+    {
+        assert(hasStaticLayer);
+
+		glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 1, -1, "2D Track HUD");
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, this->staticFramebuffer);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->multisampleFramebuffer);
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+                GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+        bindForDrawing(renderer, multisampleFramebuffer);
+    }
+
     void drawItem(GLuint vao, u32 numIndices, Mat4 const& worldTransform,
             Vec3 const& color=Vec3(1.0), bool overwriteColor=false, i32 shadeMode=0)
     {
@@ -182,6 +182,30 @@ void renameFile(const char* oldFilename, const char* newFilename)
 #endif
 }
 
+// renames a file over an existing one; readers see either the old or the new file, never a
+// partially written one
+bool replaceFile(const char* oldFilename, const char* newFilename)
+{
+#if _WIN32
+    auto result = MoveFileExA(oldFilename, newFilename,
+            MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+    if (result == 0)
+    {
+        error("Failed to replace file: %s -> %s", oldFilename, newFilename);
+        return false;
+    }
+#else
+    auto result = rename(oldFilename, newFilename);
+    if (result != 0)
+    {
+        error("Failed to replace file: %s -> %s: %s", oldFilename, newFilename,
+                strerror(errno));
+        return false;
+    }
+#endif
+    return true;
+}
+
 void deleteDirectory(const char* path)
 {
 #if _WIN32
@@ -443,3 +467,22 @@ void writeFile(const char* filename, void* data, size_t len)
     }
     SDL_RWclose(file);
 }
+
+const u64 HASH_SEED = 0xcbf29ce484222325ull;
+
+// FNV-1a, for cache keys that must stay the same from one run to the next
+inline u64 hashBytes(u64 hash, void const* data, size_t size)
+{
+    for (size_t i=0; i<size; ++i)
+    {
+        hash ^= ((u8 const*)data)[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+template <typename T>
+inline u64 hashValue(u64 hash, T const& value)
+{
+    return hashBytes(hash, &value, sizeof(T));
+}
@@ -9,6 +9,18 @@
 #include "weapon.h"
 #include "imgui.h"
 
+NamedResource<Sound> g_engineSound("engine2");
+NamedResource<Sound> g_tireSound("tires");
+NamedResource<Sound> g_lapSound("lap");
+NamedResource<Sound> g_stickySound("sticky");
+NamedResource<Sound> g_vehicleExplosionSounds[] = {
+    "explosion4", "explosion5", "explosion6", "explosion7"
+};
+NamedResource<Texture> g_weaponIconBackground("weapon_iconbg");
+NamedResource<Texture> g_iconBackground("iconbg");
+NamedResource<Texture> g_selectedWeaponIconBackground("weapon_iconbg_selected");
+NamedResource<Texture> g_ammoTickTexture("ammotick");
+
 // TODO: play with this value to find best distance
 const f32 CAM_DISTANCE = 90.f;
 
@@ -40,17 +52,18 @@ Vehicle::Vehicle(Scene* scene, Mat4 const& transform, Vec3 const& startOffset,
     this->tuning = move(tuning);
     this->hitPoints = this->tuning.maxHitPoints;
     this->previousTargetPosition = transform.position();
-    this->rearWeaponTimer = 0.f + vehicleIndex * 0.2f;
     this->placement = vehicleIndex;
+    this->aiRandomSeries.state = 1234 + vehicleIndex * 7919;
 
-    engineSound = g_audio.playSound3D(g_res.getSound("engine2"),
+    engineSound = g_audio.playSound3D(g_engineSound,
             SoundType::VEHICLE, transform.position(), true);
-    tireSound = g_audio.playSound3D(g_res.getSound("tires"),
+    tireSound = g_audio.playSound3D(g_tireSound,
             SoundType::VEHICLE, transform.position(), true, 1.f, 0.f);
 
     actorUserData.entityType = ActorUserData::VEHICLE;
     actorUserData.vehicle = this;
-    vehiclePhysics.setup(&actorUserData, scene->getPhysicsScene(), transform, &this->tuning);
+    vehiclePhysics.setup(&actorUserData, scene->getPhysicsScene(), transform, &this->tuning,
+            scene->getVehicleBatch());
 
     // create weapons
     u32 frontWeaponSlotCount = 0;
@@ -135,19 +148,19 @@ void Vehicle::drawWeaponAmmo(Renderer* renderer, Vec2 pos, Weapon* weapon,
     f32 iconSize = floorf(g_game.windowHeight * 0.05f);
     if (showAmmo)
     {
-        Texture* iconbg = g_res.getTexture("weapon_iconbg");
+        Texture* iconbg = g_weaponIconBackground;
         ui::rect(-100, iconbg, pos, {iconSize * 1.5f, iconSize});
     }
     else
     {
-        Texture* iconbg = g_res.getTexture("iconbg");
+        Texture* iconbg = g_iconBackground;
         ui::rect(-100, iconbg, pos, Vec2(iconSize));
     }
 
     ui::rect(-90, weapon->info.icon, pos, Vec2(iconSize));
     if (selected)
     {
-        Texture* selectedTex = g_res.getTexture("weapon_iconbg_selected");
+        Texture* selectedTex = g_selectedWeaponIconBackground;
         ui::rect(-80, selectedTex, pos, Vec2(iconSize * 1.5f, iconSize));
     }
     if (showAmmo)
@@ -156,7 +169,7 @@ void Vehicle::drawWeaponAmmo(Renderer* renderer, Vec2 pos, Weapon* weapon,
         u32 ammoTickCount = (weapon->ammo + weapon->ammoUnitCount - 1) / weapon->ammoUnitCount;
         f32 ammoTickMargin = iconSize * 0.025f;
         f32 ammoTickHeight = (f32)(iconSize - iconSize * 0.2f) / (f32)ammoTickCountMax;
-        Texture* ammoTickTex = g_res.getTexture("ammotick");
+        Texture* ammoTickTex = g_ammoTickTexture;
         for (u32 i=0; i<ammoTickCount; ++i)
         {
             ui::rect(-70, ammoTickTex,
@@ -280,6 +293,47 @@ void Vehicle::drawHUD(Renderer* renderer, f32 deltaTime)
     }
 }
 
+void Vehicle::onPhysicsStep(f32 timestep)
+{
+    // the input of a dead vehicle is not updated and it doesn't drive
+    if (deadTimer > 0.f)
+    {
+        return;
+    }
+
+    for (auto& w : frontWeapons)
+    {
+        w->onPhysicsStep(this, timestep);
+    }
+    for (auto& w : rearWeapons)
+    {
+        w->onPhysicsStep(this, timestep);
+    }
+    for (auto& w : specialAbilities)
+    {
+        w->onPhysicsStep(this, timestep);
+    }
+
+    if (!finishedRace)
+    {
+        vehiclePhysics.prepareStep(timestep,
+                input.digital, input.accel, input.brake, input.steer, false, true, false);
+    }
+    else
+    {
+        vehiclePhysics.prepareStep(timestep, false, 0.f,
+                controlledBrakingTimer < 0.5f ? 0.f : 0.5f, 0.f, 0.f, true, true);
+        if (vehiclePhysics.getForwardSpeed() > 1.f)
+        {
+            controlledBrakingTimer = min(controlledBrakingTimer + timestep, 1.f);
+        }
+        else
+        {
+            controlledBrakingTimer = max(controlledBrakingTimer - timestep, 0.f);
+        }
+    }
+}
+
 void Vehicle::onRender(RenderWorld* rw, f32 deltaTime)
 {
     TIMED_BLOCK();
@@ -294,7 +348,8 @@ void Vehicle::onRender(RenderWorld* rw, f32 deltaTime)
     {
         wheelTransforms[i] = vehiclePhysics.wheelInfo[i].transform;
     }
-    Mat4 transform = vehiclePhysics.getTransform();
+    Mat4 transform = Mat4(PxMat44(
+                vehiclePhysics.getInterpolatedPose(scene->getPhysicsInterpolation())));
     driver->getVehicleData()->render(rw, transform,
             wheelTransforms, *driver->getVehicleConfig(), nullptr, this, isBraking,
             cameraIndex >= 0, Vec4(shieldColor, shieldStrength));
@@ -304,7 +359,10 @@ void Vehicle::onRender(RenderWorld* rw, f32 deltaTime)
 
 void Vehicle::updateCamera(RenderWorld* rw, f32 deltaTime)
 {
-    Vec3 pos = lastValidPosition;
+    // follow the pose that is drawn; a dead vehicle is parked far away, so keep looking at where
+    // it was destroyed
+    Vec3 pos = deadTimer > 0.f ? lastValidPosition
+        : Vec3(vehiclePhysics.getInterpolatedPose(scene->getPhysicsInterpolation()).p);
     pos.z = max(pos.z, -10.f);
 
     if (g_game.config.gameplay.thirdPersonCameraEnabled)
@@ -493,11 +551,6 @@ void Vehicle::onUpdate(RenderWorld* rw, f32 deltaTime)
                         PxForceMode::eVELOCITY_CHANGE);
             }
         }
-        if (cameraIndex >= 0)
-        {
-            updateCamera(rw, deltaTime);
-        }
-
         return;
     }
 
@@ -569,26 +622,6 @@ void Vehicle::onUpdate(RenderWorld* rw, f32 deltaTime)
         vehiclePhysics.setSpeedHandicap(1.f, 1.f);
     }
 
-    // update vehicle physics
-    if (!finishedRace)
-    {
-        vehiclePhysics.update(scene->getPhysicsScene(), deltaTime,
-                input.digital, input.accel, input.brake, input.steer, false, true, false);
-    }
-    else
-    {
-        vehiclePhysics.update(scene->getPhysicsScene(), deltaTime, false, 0.f,
-                controlledBrakingTimer < 0.5f ? 0.f : 0.5f, 0.f, 0.f, true, true);
-        if (vehiclePhysics.getForwardSpeed() > 1.f)
-        {
-            controlledBrakingTimer = min(controlledBrakingTimer + deltaTime, 1.f);
-        }
-        else
-        {
-            controlledBrakingTimer = max(controlledBrakingTimer - deltaTime, 0.f);
-        }
-    }
-
     Vec3 currentPosition = getPosition();
     lastValidPosition = currentPosition;
 
@@ -646,7 +679,7 @@ void Vehicle::onUpdate(RenderWorld* rw, f32 deltaTime)
                 }
                 if (currentLap > 0)
                 {
-                    g_audio.playSound3D(g_res.getSound("lap"), SoundType::GAME_SFX, checkPosition);
+                    g_audio.playSound3D(g_lapSound, SoundType::GAME_SFX, checkPosition);
                 }
                 ++currentLap;
                 if ((u32)currentLap == scene->getTotalLaps())
@@ -702,11 +735,6 @@ void Vehicle::onUpdate(RenderWorld* rw, f32 deltaTime)
         g_audio.setSoundPosition(tireSound, lastValidPosition);
     }
 
-    if (cameraIndex >= 0)
-    {
-        updateCamera(rw, deltaTime);
-    }
-
     // destroy vehicle if off track or out of bounds
     bool onGround = false;
     if (currentPosition.z < -32.f)
@@ -770,7 +798,7 @@ void Vehicle::onUpdate(RenderWorld* rw, f32 deltaTime)
                 isTouchingAnyGlue = true;
                 if (glueSoundTimer == 0.f)
                 {
-                    g_audio.playSound3D(g_res.getSound("sticky"), SoundType::GAME_SFX,
+                    g_audio.playSound3D(g_stickySound, SoundType::GAME_SFX,
                             currentPosition, false, 1.f, 0.95f);
                     glueSoundTimer = 0.5f;
                 }
@@ -1004,14 +1032,8 @@ void Vehicle::blowUp(f32 respawnTime, bool giveAttackCredit)
             scene->attackCredit(lastDamagedBy, vehicleIndex);
         }
     }
-    const char* sounds[] = {
-        "explosion4",
-        "explosion5",
-        "explosion6",
-        "explosion7",
-    };
-    u32 index = irandom(scene->randomSeries, 0, ARRAY_SIZE(sounds));
-    g_audio.playSound3D(g_res.getSound(sounds[index]), SoundType::GAME_SFX, getPosition(), false, 1.f, 0.95f);
+    u32 index = irandom(scene->randomSeries, 0, ARRAY_SIZE(g_vehicleExplosionSounds));
+    g_audio.playSound3D(g_vehicleExplosionSounds[index], SoundType::GAME_SFX, getPosition(), false, 1.f, 0.95f);
     reset(Mat4::translation({ 0, 0, 1000 }));
     if (raceStatistics.destroyed + raceStatistics.accidents == 10)
     {
@@ -1164,20 +1186,39 @@ void Vehicle::updatePlayerInput(f32 deltaTime, RenderWorld* rw)
 #endif
 }
 
-void Vehicle::updateAiInput(f32 deltaTime, RenderWorld* rw)
+f32 Vehicle::getAiAggression() const
 {
-    auto& ai = *getAI();
+    return min(max(((f32)scene->getWorldTime() - 3.f) * 0.3f, 0.f), getAI()->aggression);
+}
 
+void Vehicle::runAiDecision(AIDecision decision, Array<AIVehicleSnapshot> const& snapshots)
+{
+    switch (decision)
+    {
+        case AIDecision::PATH:
+            decideAiPath();
+            break;
+        case AIDecision::OBSTACLES:
+            decideAiObstacles();
+            break;
+        case AIDecision::TARGET:
+            decideAiTarget(snapshots);
+            break;
+        case AIDecision::ITEMS:
+            decideAiItems();
+            break;
+    }
+}
+
+void Vehicle::decideAiPath()
+{
     Vec3 currentPosition = vehiclePhysics.getPosition();
     Vec3 forwardVector = vehiclePhysics.getForwardVector();
-    Vec3 rightVector = vehiclePhysics.getRightVector();
-    f32 forwardSpeed = vehiclePhysics.getForwardSpeed();
 
     RacingLine::Point targetPathPoint =
         scene->getPaths()[currentFollowPathIndex].getPointAt(distanceAlongPath);
 
     // look for other paths if too far off course
-    const f32 pathStepSize = 14.f;
     f32 facingBias = dot(forwardVector, normalize(targetPathPoint.position - currentPosition)) * 5.f;
     if (currentFollowPathIndex != preferredFollowPathIndex ||
             distance(currentPosition, targetPathPoint.position) - facingBias > 26.f)
@@ -1208,72 +1249,32 @@ void Vehicle::updateAiInput(f32 deltaTime, RenderWorld* rw)
         }
         f32 pathLength = scene->getPaths()[currentFollowPathIndex].length;
         distanceAlongPath = targetPathPoint.distanceToHere
-            + (pathLength * max(0, currentLap - 1)) + pathStepSize;
-        targetPathPoint = scene->getPaths()[currentFollowPathIndex].getPointAt(distanceAlongPath);
+            + (pathLength * max(0, currentLap - 1)) + AI_PATH_STEP_SIZE;
     }
-    else
+    else if (distanceSquared(currentPosition, targetPathPoint.position) >= square(16.f))
     {
-        if (distanceSquared(currentPosition, targetPathPoint.position) < square(16.f))
+        // catch up if the vehicle has passed the point it was heading for
+        f32 pathLength = scene->getPaths()[currentFollowPathIndex].length;
+        f32 distanceToHere = scene->getPaths()[currentFollowPathIndex]
+                .getNearestPoint(currentPosition, graphResult.currentLapDistance).distanceToHere
+                + (pathLength * max(0, currentLap - 1));
+        if (distanceToHere > distanceAlongPath)
         {
-            distanceAlongPath += pathStepSize;
-        }
-        else
-        {
-            f32 pathLength = scene->getPaths()[currentFollowPathIndex].length;
-            f32 distanceToHere = scene->getPaths()[currentFollowPathIndex]
-                    .getNearestPoint(currentPosition, graphResult.currentLapDistance).distanceToHere
-                    + (pathLength * max(0, currentLap - 1));
-            if (distanceToHere > distanceAlongPath)
-            {
-                distanceAlongPath = distanceToHere + pathStepSize;
-            }
+            distanceAlongPath = distanceToHere + AI_PATH_STEP_SIZE;
         }
 
         // TODO: check if we have line of site to the path point
     }
+}
 
-    // use reset if stuck
-    if (scene->timeUntilStart() < -3.f && !finishedRace)
-    {
-        f32 facingTarget = dot(forwardVector, normalize(targetPathPoint.position - currentPosition));
-        if (((facingTarget < 0.4f && forwardSpeed < 5.f)
-            || (distance(currentPosition, targetPathPoint.position) > 24.f)) && !isInAir)
-        {
-            resetTimer += deltaTime;
-            if (resetTimer >= 2.f - ai.drivingSkill)
-            {
-                input.reset = true;
-                resetTimer = 0.f;
-            }
-        }
-        else
-        {
-            resetTimer = 0.f;
-        }
-    }
-
-    // TODO: Use targetSpeed of the racingLine to modulate throttle
-    Vec2 diff = Vec2(previousTargetPosition) - Vec2(targetPathPoint.position);
-    Vec2 dir = lengthSquared(diff) > 0.f ? normalize(diff) : Vec2(forwardVector);
-    Vec3 targetP = targetPathPoint.position -
-        Vec3(targetOffset.x * dir + targetOffset.y * Vec2(-dir.y, dir.x), 0);
-    Vec2 dirToTargetP = normalize(Vec2(currentPosition) - Vec2(targetP));
-    previousTargetPosition = targetPathPoint.position;
-#if 0
-    Mesh* sphere = g_res.getModel("misc")->getMeshByName("Sphere");
-    drawSimple(rw, sphere, &g_res.white, Mat4::translation(targetP),
-                Vec3(1, 0, 0)));
-#endif
-
-    input.accel = (scene->timeUntilStart() < ai.drivingSkill * 0.45f + 0.0025f) ? 1.f : 0.f;
-    //input.accel *= 0.8f;
-    input.brake = 0.f;
-    input.steer = clamp(dot(Vec2(rightVector), dirToTargetP) * 1.2f, -1.f, 1.f);
-    f32 aggression = min(max(((f32)scene->getWorldTime() - 3.f) * 0.3f, 0.f),
-            ai.aggression);
+void Vehicle::decideAiObstacles()
+{
+    Vec3 currentPosition = vehiclePhysics.getPosition();
+    Vec3 forwardVector = vehiclePhysics.getForwardVector();
+    Vec3 rightVector = vehiclePhysics.getRightVector();
+    Vec2 dirToTargetP = normalize(Vec2(currentPosition) - Vec2(aiSteerTarget));
+    auto& ai = *getAI();
 
-    // obstacle avoidance
-#if 1
     u32 flags = COLLISION_FLAG_DYNAMIC | COLLISION_FLAG_OIL  |
                 COLLISION_FLAG_GLUE    | COLLISION_FLAG_MINE; // | COLLISION_FLAG_BOOSTER;
     if (attackTimer < 0.6f)
@@ -1285,6 +1286,7 @@ void Vehicle::updateAiInput(f32 deltaTime, RenderWorld* rw)
     PxRigidBody* ignoreBody = getRigidBody();
     isBlocked = false;
     isNearHazard = false;
+    aiAvoidSteer = 0.f;
     f32 mySpeed = getRigidBody()->getLinearVelocity().magnitude();
     if (mySpeed < 35.f && scene->sweep(tuning.collisionWidth * 0.5f + 0.05f,
             currentPosition + Vec3(0, 0, 0.25f), forwardVector, sweepLength,
@@ -1347,7 +1349,7 @@ void Vehicle::updateAiInput(f32 deltaTime, RenderWorld* rw)
                     if (!scene->sweep(cw, sweepFrom, forwardVector, sweepLength * 0.7f, nullptr,
                             ignoreBody, collisionFlags))
                     {
-                        input.steer = -(0.4f + sweepOffsetCount * 0.1f) * sweepSide;
+                        aiAvoidSteer = -(0.4f + sweepOffsetCount * 0.1f) * sweepSide;
                         foundOpening = true;
                         break;
                     }
@@ -1363,45 +1365,228 @@ void Vehicle::updateAiInput(f32 deltaTime, RenderWorld* rw)
     Vec4 c = isBlocked ? Vec4(1, 0, 0, 1) : Vec4(0, 1, 0, 1);
     scene->debugDraw.line(currentPosition, currentPosition + forwardVector * sweepLength, c, c);
     */
-#endif
 
-#if 1
-    if (!isInAir && aggression > 0.f)
+    // the sweeps that decide when to back up and when to stop backing up
+    f32 forwardSpeed = vehiclePhysics.getForwardSpeed();
+    isAiStuckAhead = !isInAir && forwardSpeed < 2.5f &&
+        scene->sweep(tuning.collisionWidth * 0.35f, currentPosition, forwardVector,
+            4.2f, nullptr, getRigidBody(), COLLISION_FLAG_OBJECT | COLLISION_FLAG_CHASSIS);
+    isAiClearAhead = isBackingUp &&
+        !scene->sweep(tuning.collisionWidth * 0.3f, currentPosition, forwardVector,
+            6.f, nullptr, getRigidBody(), COLLISION_FLAG_OBJECT | COLLISION_FLAG_CHASSIS);
+}
+
+void Vehicle::decideAiTarget(Array<AIVehicleSnapshot> const& snapshots)
+{
+    Vec3 currentPosition = vehiclePhysics.getPosition();
+    Vec3 forwardVector = vehiclePhysics.getForwardVector();
+    auto& ai = *getAI();
+    f32 aggression = getAiAggression();
+
+    // search for target if there is none
+    if (!isInAir && aggression > 0.f && !target && frontWeapons.size() > 0
+            && frontWeapons[currentFrontWeaponIndex]->ammo > 0)
     {
-        // search for target if there is none
-        if (!target && frontWeapons.size() > 0
-                && frontWeapons[currentFrontWeaponIndex]->ammo > 0)
+        f32 maxTargetDist = aggression * 25.f + 15.f;
+        f32 lowestTargetPriority = FLT_MAX;
+        for (auto& v : scene->getVehicles())
         {
-            f32 maxTargetDist = aggression * 25.f + 15.f;
-            f32 lowestTargetPriority = FLT_MAX;
-            for (auto& v : scene->getVehicles())
+            if (v.get() == this)
             {
-                if (v.get() == this)
-                {
-                    continue;
-                }
+                continue;
+            }
 
-                Vec2 diff = Vec2(v->getPosition()) - Vec2(currentPosition);
-                Vec2 targetDiff = normalize(-diff);
-                f32 d = lengthSquared(diff);
-                f32 vDot = dot(Vec2(forwardVector), targetDiff);
-                f32 targetPriority = d + vDot * 4.f;
-                // TODO: vDot < aggression seems like the wrong calculation
-                if (vDot < aggression && d < square(maxTargetDist) && targetPriority < lowestTargetPriority)
-                {
-                    target = v.get();
-                    lowestTargetPriority = targetPriority;
-                }
+            Vec2 diff = Vec2(snapshots[v->vehicleIndex].position) - Vec2(currentPosition);
+            Vec2 targetDiff = normalize(-diff);
+            f32 d = lengthSquared(diff);
+            f32 vDot = dot(Vec2(forwardVector), targetDiff);
+            f32 targetPriority = d + vDot * 4.f;
+            // TODO: vDot < aggression seems like the wrong calculation
+            if (vDot < aggression && d < square(maxTargetDist) && targetPriority < lowestTargetPriority)
+            {
+                target = v.get();
+                lowestTargetPriority = targetPriority;
+            }
+        }
+    }
+
+    hasAiTargetLineOfSight = false;
+    if (target && !snapshots[target->vehicleIndex].isDead)
+    {
+        Vec3 diff = snapshots[target->vehicleIndex].position - currentPosition;
+        f32 dist = length(diff);
+        hasAiTargetLineOfSight = !scene->raycastStatic(currentPosition, diff / dist, dist);
+    }
+
+    // fear
+    if (ai.fear > 0.f)
+    {
+        // TODO: shouldn't this use fear rather than aggression?
+        f32 fearRayLength = aggression * 35.f + 10.f;
+        isFollowed = scene->sweep(0.5f, currentPosition, -forwardVector,
+                    fearRayLength, nullptr, getRigidBody(), COLLISION_FLAG_CHASSIS);
+        /*
+        scene->debugDraw.line(
+                currentPosition,
+                currentPosition-getForwardVector()*fearRayLength,
+                Vec4(1, 0, 0, 1), Vec4(1, 0, 0, 1));
+        */
+    }
+}
+
+void Vehicle::decideAiItems()
+{
+    Vec3 currentPosition = vehiclePhysics.getPosition();
+    Vec3 forwardVector = vehiclePhysics.getForwardVector();
+    f32 aggression = getAiAggression();
+
+    isAiVehicleInFiringLine = false;
+    if (aggression > 0.f && frontWeapons.size() > 0
+            && frontWeapons[currentFrontWeaponIndex]->ammo > 0)
+    {
+        f32 rayLength = aggression * 50.f + 10.f;
+        /*
+        scene->debugDraw.line(
+                currentPosition,
+                currentPosition+getForwardVector()*rayLength,
+                Vec4(0, 1, 0, 1), Vec4(0, 1, 0, 1));
+        */
+        PxSweepBuffer hit;
+        isAiVehicleInFiringLine = scene->sweep(0.5f, currentPosition, forwardVector, rayLength,
+                    &hit, getRigidBody(), COLLISION_FLAG_CHASSIS | COLLISION_FLAG_OBJECT)
+                && hit.block.actor->userData
+                && ((ActorUserData*)(hit.block.actor->userData))->entityType == ActorUserData::VEHICLE;
+    }
+
+    if (rearWeapons.size() > 0 && rearWeapons[currentRearWeaponIndex]->shouldUse(scene, this))
+    {
+        shouldAiUseRearWeapon = true;
+    }
+}
+
+AIDecisionState Vehicle::getAiDecisionState() const
+{
+    AIDecisionState state;
+    state.target = target;
+    state.currentFollowPathIndex = currentFollowPathIndex;
+    state.distanceAlongPath = distanceAlongPath;
+    state.avoidSteer = aiAvoidSteer;
+    state.randomSeries = aiRandomSeries;
+    state.isBlocked = isBlocked;
+    state.isNearHazard = isNearHazard;
+    state.isFollowed = isFollowed;
+    state.isStuckAhead = isAiStuckAhead;
+    state.isClearAhead = isAiClearAhead;
+    state.hasTargetLineOfSight = hasAiTargetLineOfSight;
+    state.isVehicleInFiringLine = isAiVehicleInFiringLine;
+    state.shouldUseRearWeapon = shouldAiUseRearWeapon;
+    return state;
+}
+
+void Vehicle::setAiDecisionState(AIDecisionState const& state)
+{
+    target = state.target;
+    currentFollowPathIndex = state.currentFollowPathIndex;
+    distanceAlongPath = state.distanceAlongPath;
+    aiAvoidSteer = state.avoidSteer;
+    aiRandomSeries = state.randomSeries;
+    isBlocked = state.isBlocked;
+    isNearHazard = state.isNearHazard;
+    isFollowed = state.isFollowed;
+    isAiStuckAhead = state.isStuckAhead;
+    isAiClearAhead = state.isClearAhead;
+    hasAiTargetLineOfSight = state.hasTargetLineOfSight;
+    isAiVehicleInFiringLine = state.isVehicleInFiringLine;
+    shouldAiUseRearWeapon = state.shouldUseRearWeapon;
+}
+
+u64 Vehicle::hashAiDecisionState(u64 hash) const
+{
+    AIDecisionState state = getAiDecisionState();
+    hash = hashValue(hash, state.target ? (i32)state.target->vehicleIndex : -1);
+    hash = hashValue(hash, state.currentFollowPathIndex);
+    hash = hashValue(hash, state.distanceAlongPath);
+    hash = hashValue(hash, state.avoidSteer);
+    hash = hashValue(hash, state.randomSeries.state);
+    bool flags[] = {
+        state.isBlocked, state.isNearHazard, state.isFollowed, state.isStuckAhead,
+        state.isClearAhead, state.hasTargetLineOfSight, state.isVehicleInFiringLine,
+        state.shouldUseRearWeapon
+    };
+    return hashBytes(hash, flags, sizeof(flags));
+}
+
+// The expensive decisions are made by the AI scheduler every few frames and only their results
+// are used here, so that the cost of a frame doesn't grow with the number of AI drivers.
+void Vehicle::updateAiInput(f32 deltaTime, RenderWorld* rw)
+{
+    auto& ai = *getAI();
+
+    Vec3 currentPosition = vehiclePhysics.getPosition();
+    Vec3 forwardVector = vehiclePhysics.getForwardVector();
+    Vec3 rightVector = vehiclePhysics.getRightVector();
+    f32 forwardSpeed = vehiclePhysics.getForwardSpeed();
+
+    RacingLine::Point targetPathPoint =
+        scene->getPaths()[currentFollowPathIndex].getPointAt(distanceAlongPath);
+    if (distanceSquared(currentPosition, targetPathPoint.position) < square(16.f))
+    {
+        distanceAlongPath += AI_PATH_STEP_SIZE;
+    }
+
+    // use reset if stuck
+    if (scene->timeUntilStart() < -3.f && !finishedRace)
+    {
+        f32 facingTarget = dot(forwardVector, normalize(targetPathPoint.position - currentPosition));
+        if (((facingTarget < 0.4f && forwardSpeed < 5.f)
+            || (distance(currentPosition, targetPathPoint.position) > 24.f)) && !isInAir)
+        {
+            resetTimer += deltaTime;
+            if (resetTimer >= 2.f - ai.drivingSkill)
+            {
+                input.reset = true;
+                resetTimer = 0.f;
             }
         }
+        else
+        {
+            resetTimer = 0.f;
+        }
+    }
+
+    // TODO: Use targetSpeed of the racingLine to modulate throttle
+    Vec2 diff = Vec2(previousTargetPosition) - Vec2(targetPathPoint.position);
+    Vec2 dir = lengthSquared(diff) > 0.f ? normalize(diff) : Vec2(forwardVector);
+    Vec3 targetP = targetPathPoint.position -
+        Vec3(targetOffset.x * dir + targetOffset.y * Vec2(-dir.y, dir.x), 0);
+    Vec2 dirToTargetP = normalize(Vec2(currentPosition) - Vec2(targetP));
+    previousTargetPosition = targetPathPoint.position;
+    aiSteerTarget = targetP;
+#if 0
+    Mesh* sphere = g_res.getModel("misc")->getMeshByName("Sphere");
+    drawSimple(rw, sphere, &g_res.white, Mat4::translation(targetP),
+                Vec3(1, 0, 0)));
+#endif
+
+    input.accel = (scene->timeUntilStart() < ai.drivingSkill * 0.45f + 0.0025f) ? 1.f : 0.f;
+    //input.accel *= 0.8f;
+    input.brake = 0.f;
+    input.steer = clamp(dot(Vec2(rightVector), dirToTargetP) * 1.2f, -1.f, 1.f);
+    f32 aggression = getAiAggression();
 
+    // obstacle avoidance
+    if (aiAvoidSteer != 0.f)
+    {
+        input.steer = aiAvoidSteer;
+    }
+
+    if (!isInAir && aggression > 0.f)
+    {
         // get behind target
         if (target && !target->isDead())
         {
             targetTimer += deltaTime;
-            Vec3 diff = target->getPosition() - currentPosition;
-            f32 dist = length(diff);
-            if (!scene->raycastStatic(currentPosition, diff / dist, dist))
+            if (hasAiTargetLineOfSight)
             {
                 if (targetTimer > (1.f - aggression) * 2.f)
                 {
@@ -1431,16 +1616,11 @@ void Vehicle::updateAiInput(f32 deltaTime, RenderWorld* rw)
             target = nullptr;
         }
     }
-#endif
 
     // fear
-#if 1
     if (ai.fear > 0.f)
     {
-        // TODO: shouldn't this use fear rather than aggression?
-        f32 fearRayLength = aggression * 35.f + 10.f;
-        if (scene->sweep(0.5f, currentPosition, -forwardVector,
-                    fearRayLength, nullptr, getRigidBody(), COLLISION_FLAG_CHASSIS))
+        if (isFollowed)
         {
             fearTimer += deltaTime;
             if (fearTimer > 1.f * (1.f - ai.fear) + 0.5f)
@@ -1448,21 +1628,12 @@ void Vehicle::updateAiInput(f32 deltaTime, RenderWorld* rw)
                 input.steer += sinf((f32)scene->getWorldTime() * 3.f)
                     * (ai.fear * 0.25f);
             }
-            isFollowed = true;
         }
         else
         {
             fearTimer = 0.f;
-            isFollowed = false;
         }
-        /*
-        scene->debugDraw.line(
-                currentPosition,
-                currentPosition-getForwardVector()*fearRayLength,
-                Vec4(1, 0, 0, 1), Vec4(1, 0, 0, 1));
-        */
     }
-#endif
 
     if (scene->canGo() && scene->getWorldTime() > 5.f)
     {
@@ -1478,9 +1649,7 @@ void Vehicle::updateAiInput(f32 deltaTime, RenderWorld* rw)
                 backupTimer = 0.f;
                 isBackingUp = false;
             }
-            else if (backupTimer > 1.f &&
-                !scene->sweep(tuning.collisionWidth * 0.3f, currentPosition, forwardVector,
-                    6.f, nullptr, getRigidBody(), COLLISION_FLAG_OBJECT | COLLISION_FLAG_CHASSIS))
+            else if (backupTimer > 1.f && isAiClearAhead)
             {
                 backupTimer = 0.f;
                 isBackingUp = false;
@@ -1488,9 +1657,7 @@ void Vehicle::updateAiInput(f32 deltaTime, RenderWorld* rw)
         }
         else
         {
-            if (!isInAir && forwardSpeed < 2.5f &&
-                scene->sweep(tuning.collisionWidth * 0.35f, currentPosition, forwardVector,
-                    4.2f, nullptr, getRigidBody(), COLLISION_FLAG_OBJECT | COLLISION_FLAG_CHASSIS))
+            if (!isInAir && forwardSpeed < 2.5f && isAiStuckAhead)
             {
                 backupTimer += deltaTime;
                 if (backupTimer > 0.6f)
@@ -1524,18 +1691,7 @@ void Vehicle::updateAiInput(f32 deltaTime, RenderWorld* rw)
     if (aggression > 0.f && frontWeapons.size() > 0
             && frontWeapons[currentFrontWeaponIndex]->ammo > 0)
     {
-        f32 rayLength = aggression * 50.f + 10.f;
-        /*
-        scene->debugDraw.line(
-                currentPosition,
-                currentPosition+getForwardVector()*rayLength,
-                Vec4(0, 1, 0, 1), Vec4(0, 1, 0, 1));
-        */
-        PxSweepBuffer hit;
-        if (scene->sweep(0.5f, currentPosition, forwardVector, rayLength, &hit, getRigidBody(),
-                    COLLISION_FLAG_CHASSIS | COLLISION_FLAG_OBJECT)
-                && hit.block.actor->userData
-                && ((ActorUserData*)(hit.block.actor->userData))->entityType == ActorUserData::VEHICLE)
+        if (isAiVehicleInFiringLine)
         {
             attackTimer += deltaTime;
         }
@@ -1566,17 +1722,10 @@ void Vehicle::updateAiInput(f32 deltaTime, RenderWorld* rw)
     }
 
     // rear weapons
-    if (rearWeapons.size() > 0)
+    if (shouldAiUseRearWeapon)
     {
-        rearWeaponTimer += deltaTime;
-        if (rearWeaponTimer > 0.2f)
-        {
-            if (rearWeapons[currentRearWeaponIndex]->shouldUse(scene, this))
-            {
-                input.beginShootRear = true;
-            }
-            rearWeaponTimer = 0.f;
-        }
+        input.beginShootRear = true;
+        shouldAiUseRearWeapon = false;
     }
 
     // TODO: make the sign correct in the first place
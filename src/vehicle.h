@@ -23,6 +23,24 @@ struct VehicleInput
     bool reset = false;
 };
 
+// everything the AI decisions write, so that they can be made again from the same state
+struct AIDecisionState
+{
+    class Vehicle* target;
+    u32 currentFollowPathIndex;
+    f32 distanceAlongPath;
+    f32 avoidSteer;
+    RandomSeries randomSeries;
+    bool isBlocked;
+    bool isNearHazard;
+    bool isFollowed;
+    bool isStuckAhead;
+    bool isClearAhead;
+    bool hasTargetLineOfSight;
+    bool isVehicleInFiringLine;
+    bool shouldUseRearWeapon;
+};
+
 class Vehicle
 {
 // TODO: should be private
@@ -98,7 +116,21 @@ public:
     f32 resetTimer = 0.f;
     Vehicle* target = nullptr;
     f32 fearTimer = 0.f;
-    f32 rearWeaponTimer = 0.f;
+
+    // the results of the decisions that the AI scheduler spreads over frames, which
+    // updateAiInput() reads every frame
+    static constexpr f32 AI_PATH_STEP_SIZE = 14.f;
+    f64 aiDecisionTimes[NUM_AI_DECISIONS] = { -100.0, -100.0, -100.0, -100.0 };
+    Vec3 aiSteerTarget = Vec3(0);
+    f32 aiAvoidSteer = 0.f;
+    bool isAiStuckAhead = false;
+    bool isAiClearAhead = false;
+    bool hasAiTargetLineOfSight = false;
+    bool isAiVehicleInFiringLine = false;
+    bool shouldAiUseRearWeapon = false;
+    // each driver has its own random series so that the decisions don't depend on the order the
+    // vehicles are processed in
+    RandomSeries aiRandomSeries;
 
     // weapons
     SmallArray<OwnedPtr<Weapon>, ARRAY_SIZE(VehicleConfiguration::weaponIndices)>
@@ -176,10 +208,24 @@ public:
         hitPoints = this->tuning.maxHitPoints;
     }
 
+    f32 getAiAggression() const;
+    // may run on a worker thread; only writes to this vehicle and reads the others through the
+    // snapshots, which are indexed by vehicleIndex
+    void runAiDecision(AIDecision decision, Array<AIVehicleSnapshot> const& snapshots);
+    void decideAiPath();
+    void decideAiObstacles();
+    void decideAiTarget(Array<AIVehicleSnapshot> const& snapshots);
+    void decideAiItems();
+    AIDecisionState getAiDecisionState() const;
+    void setAiDecisionState(AIDecisionState const& state);
+    u64 hashAiDecisionState(u64 hash) const;
     void updateAiInput(f32 deltaTime, RenderWorld* rw);
     void updatePlayerInput(f32 deltaTime, RenderWorld* rw);
 
     void onUpdate(RenderWorld* rw, f32 deltaTime);
+    // applies the input to the vehicle physics before the scene steps all the vehicles together;
+    // called once for every fixed physics step
+    void onPhysicsStep(f32 timestep);
     void onRender(RenderWorld* rw, f32 deltaTime);
     void drawWeaponAmmo(Renderer* renderer, Vec2 pos, Weapon* weapon,
             bool showAmmo, bool selected);
@@ -142,19 +142,29 @@ PxBatchQuery* VehicleSceneQueryData::setUpBatchedSceneQuery(const PxU32 batchId,
     return scene->createBatchQuery(sqDesc);
 }
 
-static PxVehicleDrivableSurfaceToTireFrictionPairs* createFrictionPairs(
-        VehicleTuning const& settings, const PxMaterial** materials)
+constexpr u32 NUM_SURFACE_TYPES = 2;
+constexpr u32 TIRE_TYPES_PER_VEHICLE = 2;
+
+static PxVehicleDrivableSurfaceToTireFrictionPairs* createFrictionPairs(u32 numTireTypes)
 {
-    constexpr u32 NUM_SURFACE_TYPES = 2;
+    const PxMaterial* materials[NUM_SURFACE_TYPES] = {
+        g_game.physx.materials.track,
+        g_game.physx.materials.offroad
+    };
     PxVehicleDrivableSurfaceType surfaceTypes[NUM_SURFACE_TYPES] = { { 0 }, { 1 } };
 
-    const u32 numTireTypes = 2;
     PxVehicleDrivableSurfaceToTireFrictionPairs* surfaceTirePairs =
         PxVehicleDrivableSurfaceToTireFrictionPairs::allocate(numTireTypes, NUM_SURFACE_TYPES);
 
     surfaceTirePairs->setup(numTireTypes, NUM_SURFACE_TYPES, materials, surfaceTypes);
 
-    f32 tireFriction[numTireTypes] = {
+    return surfaceTirePairs;
+}
+
+static void setFrictionPairs(PxVehicleDrivableSurfaceToTireFrictionPairs* surfaceTirePairs,
+        VehicleTuning const& settings, u32 tireTypeOffset)
+{
+    f32 tireFriction[TIRE_TYPES_PER_VEHICLE] = {
         1.f,
         settings.rearTireGripPercent,
     };
@@ -166,13 +176,12 @@ static PxVehicleDrivableSurfaceToTireFrictionPairs* createFrictionPairs(
 
     for(u32 i = 0; i < NUM_SURFACE_TYPES; i++)
     {
-        for(u32 j = 0; j < numTireTypes; j++)
+        for(u32 j = 0; j < TIRE_TYPES_PER_VEHICLE; j++)
         {
-            surfaceTirePairs->setTypePairFriction(i, j, frictionTable[i] * tireFriction[j]);
+            surfaceTirePairs->setTypePairFriction(i, tireTypeOffset + j,
+                    frictionTable[i] * tireFriction[j]);
         }
     }
-
-    return surfaceTirePairs;
 }
 
 static PxConvexMesh* createConvexMesh(const PxVec3* verts, const PxU32 numVerts)
@@ -211,21 +220,28 @@ static PxConvexMesh* createWheelMesh(const PxF32 width, const PxF32 radius)
 }
 
 void VehiclePhysics::setup(void* userData, PxScene* scene, Mat4 const& transform,
-        VehicleTuning* tune)
+        VehicleTuning* tune, VehicleBatch* batch)
 {
     this->tuning = tune;
+    this->batch = batch;
     VehicleTuning& tuning = *tune;
 
-    const PxMaterial* surfaceMaterials[] = {
-        g_game.physx.materials.track,
-        g_game.physx.materials.offroad
-    };
     PxMaterial* vehicleMaterial = g_game.physx.materials.vehicle;
 
-    sceneQueryData = VehicleSceneQueryData::allocate(1, NUM_WHEELS, QUERY_HITS_PER_WHEEL, 1,
-            &WheelSceneQueryPreFilterNonBlocking, &WheelSceneQueryPostFilterNonBlocking, g_game.physx.allocator);
-    batchQuery = VehicleSceneQueryData::setUpBatchedSceneQuery(0, *sceneQueryData, scene);
-    frictionPairs = createFrictionPairs(tuning, surfaceMaterials);
+    if (batch)
+    {
+        tireTypeOffset = batch->add(this, tuning);
+        frictionPairs = batch->getFrictionPairs();
+    }
+    else
+    {
+        tireTypeOffset = 0;
+        sceneQueryData = VehicleSceneQueryData::allocate(1, NUM_WHEELS, QUERY_HITS_PER_WHEEL, 1,
+                &WheelSceneQueryPreFilterNonBlocking, &WheelSceneQueryPostFilterNonBlocking, g_game.physx.allocator);
+        batchQuery = VehicleSceneQueryData::setUpBatchedSceneQuery(0, *sceneQueryData, scene);
+        frictionPairs = createFrictionPairs(TIRE_TYPES_PER_VEHICLE);
+        setFrictionPairs(frictionPairs, tuning, 0);
+    }
 
     PxConvexMesh* wheelConvexMeshes[NUM_WHEELS];
     PxMaterial* wheelMaterials[NUM_WHEELS];
@@ -325,10 +341,10 @@ void VehiclePhysics::setup(void* userData, PxScene* scene, Mat4 const& transform
     wheels[WHEEL_FRONT_RIGHT].mMaxSteer = radians(tuning.maxSteerAngleDegrees);
 
     PxVehicleTireData tires[NUM_WHEELS] = { };
-    tires[WHEEL_FRONT_LEFT].mType = 0;
-    tires[WHEEL_FRONT_RIGHT].mType = 0;
-    tires[WHEEL_REAR_LEFT].mType = 1;
-    tires[WHEEL_REAR_RIGHT].mType = 1;
+    tires[WHEEL_FRONT_LEFT].mType = tireTypeOffset;
+    tires[WHEEL_FRONT_RIGHT].mType = tireTypeOffset;
+    tires[WHEEL_REAR_LEFT].mType = tireTypeOffset + 1;
+    tires[WHEEL_REAR_RIGHT].mType = tireTypeOffset + 1;
 
     for(PxU32 i = 0; i < NUM_WHEELS; i++)
     {
@@ -496,6 +512,7 @@ void VehiclePhysics::setup(void* userData, PxScene* scene, Mat4 const& transform
 
     actor->setRigidBodyFlag(PxRigidBodyFlag::eENABLE_CCD, true);
     scene->addActor(*actor);
+    previousPose = currentPose = actor->getGlobalPose();
 
     vehicle4W->setToRestState();
     vehicle4W->mDriveDynData.forceGearChange(PxVehicleGearsData::eFIRST);
@@ -507,10 +524,13 @@ VehiclePhysics::~VehiclePhysics()
 {
     vehicle4W->getRigidDynamicActor()->release();
     vehicle4W->free();
-    sceneQueryData->free(g_game.physx.allocator);
-    // TODO: find out why this causes an exception
-    //batchQuery->release();
-    frictionPairs->release();
+    if (!batch)
+    {
+        sceneQueryData->free(g_game.physx.allocator);
+        // TODO: find out why this causes an exception
+        //batchQuery->release();
+        frictionPairs->release();
+    }
 }
 
 void VehiclePhysics::reset(Mat4 const& transform)
@@ -518,15 +538,19 @@ void VehiclePhysics::reset(Mat4 const& transform)
     vehicle4W->setToRestState();
     vehicle4W->mDriveDynData.forceGearChange(PxVehicleGearsData::eFIRST);
     getRigidBody()->setGlobalPose(convert(transform));
+    // don't blend the teleport
+    previousPose = currentPose = convert(transform);
     for (u32 i=0; i<NUM_WHEELS; ++i)
     {
         wheelInfo[i].oilCoverage = 0.f;
     }
 }
 
-void VehiclePhysics::update(PxScene* scene, f32 timestep, bool digital, f32 accel, f32 brake, f32 steer,
+void VehiclePhysics::prepareStep(f32 timestep, bool digital, f32 accel, f32 brake, f32 steer,
             bool handbrake, bool canGo, bool onlyBrake)
 {
+    isStepPending = true;
+    accelInput = accel;
     engineThrottle = 0.f;
     if (canGo)
     {
@@ -624,6 +648,14 @@ void VehiclePhysics::update(PxScene* scene, f32 timestep, bool digital, f32 acce
             }
         }
     }
+}
+
+void VehiclePhysics::update(PxScene* scene, f32 timestep, bool digital, f32 accel, f32 brake, f32 steer,
+            bool handbrake, bool canGo, bool onlyBrake)
+{
+    assert(!batch);
+    prepareStep(timestep, digital, accel, brake, steer, handbrake, canGo, onlyBrake);
+    isStepPending = false;
 
     PxVehicleWheels* vehicles[1] = { vehicle4W };
     PxSweepQueryResult* sweepResults = sceneQueryData->getSweepQueryResultBuffer(0);
@@ -636,7 +668,13 @@ void VehiclePhysics::update(PxScene* scene, f32 timestep, bool digital, f32 acce
     };
     PxVehicleUpdates(timestep, grav, *frictionPairs, 1, vehicles, vehicleQueryResults);
 
-    isInAir = PxVehicleIsInAir(vehicleQueryResults[0]);
+    finishStep(scene, timestep);
+}
+
+void VehiclePhysics::finishStep(PxScene* scene, f32 timestep)
+{
+    PxVehicleWheelQueryResult vehicleQueryResult = { wheelQueryResults, NUM_WHEELS };
+    isInAir = PxVehicleIsInAir(vehicleQueryResult);
 
     if (!isInAir)
     {
@@ -656,7 +694,7 @@ void VehiclePhysics::update(PxScene* scene, f32 timestep, bool digital, f32 acce
                 maxSlip = max(maxSlip, lateralSlip);
             }
         }
-        f32 driftBoost = min(maxSlip, 1.f) * accel * tuning->driftBoost * 20.f;
+        f32 driftBoost = min(maxSlip, 1.f) * accelInput * tuning->driftBoost * 20.f;
         PxVec3 boostDir = getRigidBody()->getLinearVelocity().getNormalized();
         getRigidBody()->addForce(boostDir * driftBoost, PxForceMode::eACCELERATION);
     }
@@ -753,14 +791,14 @@ void VehiclePhysics::updateWheelInfo(f32 deltaTime)
                     f32 amount = clamp(wheelInfo[i].oilCoverage, 0.f, 1.f);
                     // TODO: should this be a percentage of trackTireFriction rather than the hardcoded 0.95?
                     f32 oilFriction = lerp(tuning->trackTireFriction, 0.95f, amount);
-                    frictionPairs->setTypePairFriction(0, 0, oilFriction);
-                    frictionPairs->setTypePairFriction(0, 1,
+                    frictionPairs->setTypePairFriction(0, tireTypeOffset, oilFriction);
+                    frictionPairs->setTypePairFriction(0, tireTypeOffset + 1,
                             oilFriction * tuning->rearTireGripPercent);
                 }
                 else
                 {
-                    frictionPairs->setTypePairFriction(0, 0, tuning->trackTireFriction);
-                    frictionPairs->setTypePairFriction(0, 1,
+                    frictionPairs->setTypePairFriction(0, tireTypeOffset, tuning->trackTireFriction);
+                    frictionPairs->setTypePairFriction(0, tireTypeOffset + 1,
                             tuning->trackTireFriction * tuning->rearTireGripPercent);
                 }
             }
@@ -864,3 +902,145 @@ void VehiclePhysics::checkGroundSpots(PxScene* physicsScene, f32 deltaTime)
     }
 }
 
+
+// below this many vehicles per task the update isn't worth handing to the worker threads
+const u32 MIN_VEHICLES_PER_UPDATE_TASK = 4;
+
+void VehicleBatch::setup(PxScene* scene, u32 maxVehicles)
+{
+    destroy();
+    this->scene = scene;
+    this->maxVehicles = max(maxVehicles, 1u);
+    sceneQueryData = VehicleSceneQueryData::allocate(this->maxVehicles, NUM_WHEELS,
+            QUERY_HITS_PER_WHEEL, this->maxVehicles, &WheelSceneQueryPreFilterNonBlocking,
+            &WheelSceneQueryPostFilterNonBlocking, g_game.physx.allocator);
+    batchQuery = VehicleSceneQueryData::setUpBatchedSceneQuery(0, *sceneQueryData, scene);
+    frictionPairs = createFrictionPairs(this->maxVehicles * TIRE_TYPES_PER_VEHICLE);
+    vehicles.reserve(this->maxVehicles);
+}
+
+void VehicleBatch::destroy()
+{
+    // the vehicles must have been destroyed already, since they point at the friction table
+    if (sceneQueryData)
+    {
+        sceneQueryData->free(g_game.physx.allocator);
+        sceneQueryData = nullptr;
+    }
+    // TODO: find out why this causes an exception
+    //batchQuery->release();
+    batchQuery = nullptr;
+    if (frictionPairs)
+    {
+        frictionPairs->release();
+        frictionPairs = nullptr;
+    }
+    vehicles.clear();
+    maxVehicles = 0;
+    scene = nullptr;
+}
+
+u32 VehicleBatch::add(VehiclePhysics* vehicle, VehicleTuning const& tuning)
+{
+    assert(vehicles.size() < maxVehicles);
+    u32 tireTypeOffset = vehicles.size() * TIRE_TYPES_PER_VEHICLE;
+    setFrictionPairs(frictionPairs, tuning, tireTypeOffset);
+    vehicles.push(vehicle);
+    return tireTypeOffset;
+}
+
+void VehicleBatch::step(f32 timestep)
+{
+    TIMED_BLOCK();
+
+    f64 startTime = getTime();
+    stepVehicles.clear();
+    stepWheels.clear();
+    stepQueryResults.clear();
+    for (VehiclePhysics* v : vehicles)
+    {
+        // dead vehicles skip their steps
+        if (v->isStepPending)
+        {
+            v->isStepPending = false;
+            stepVehicles.push(v);
+            stepWheels.push(v->vehicle4W);
+            stepQueryResults.push({ v->wheelQueryResults, NUM_WHEELS });
+        }
+    }
+    u32 vehicleCount = stepVehicles.size();
+    if (vehicleCount == 0)
+    {
+        return;
+    }
+
+    // the sweeps of all the wheels go out in one batch
+    PxVehicleSuspensionSweeps(batchQuery, vehicleCount, stepWheels.data(),
+            sceneQueryData->getQueryResultBufferSize(), sceneQueryData->getSweepQueryResultBuffer(0),
+            QUERY_HITS_PER_WHEEL, NULL, 1.0f, 1.01f);
+
+    const PxVec3 gravity = scene->getGravity();
+    u32 taskCount = isConcurrentUpdateEnabled
+        ? min(g_threadPool.getThreadCount(), vehicleCount / MIN_VEHICLES_PER_UPDATE_TASK) : 0;
+    if (taskCount > 1)
+    {
+        // Each task updates a contiguous range of vehicles. The changes to the actors are written
+        // to the concurrent update data and applied afterwards on this thread, because PhysX
+        // actors can't be written from several threads at once.
+        concurrentWheelUpdates.resize(vehicleCount * NUM_WHEELS);
+        concurrentUpdates.resize(vehicleCount);
+        for (u32 i=0; i<vehicleCount; ++i)
+        {
+            concurrentUpdates[i].concurrentWheelUpdates = &concurrentWheelUpdates[i * NUM_WHEELS];
+            concurrentUpdates[i].nbConcurrentWheelUpdates = NUM_WHEELS;
+        }
+
+        struct UpdateTask
+        {
+            VehicleBatch* batch;
+            PxVec3 gravity;
+            f32 timestep;
+            u32 first;
+            u32 count;
+        };
+        SmallArray<UpdateTask, 16> tasks;
+        taskCount = min(taskCount, 16u);
+        u32 first = 0;
+        for (u32 i=0; i<taskCount; ++i)
+        {
+            u32 count = (vehicleCount - first) / (taskCount - i);
+            tasks.push({ this, gravity, timestep, first, count });
+            first += count;
+        }
+        TaskGroup group;
+        for (auto& task : tasks)
+        {
+            g_threadPool.addTask(group, { &task, [](void* data) -> void* {
+                UpdateTask* task = (UpdateTask*)data;
+                VehicleBatch* batch = task->batch;
+                PxVehicleUpdates(task->timestep, task->gravity, *batch->frictionPairs, task->count,
+                        batch->stepWheels.data() + task->first,
+                        batch->stepQueryResults.data() + task->first,
+                        batch->concurrentUpdates.data() + task->first);
+                return nullptr;
+            }});
+        }
+        g_threadPool.wait(group);
+        PxVehiclePostUpdates(concurrentUpdates.data(), vehicleCount, stepWheels.data());
+    }
+    else
+    {
+        taskCount = 1;
+        PxVehicleUpdates(timestep, gravity, *frictionPairs, vehicleCount, stepWheels.data(),
+                stepQueryResults.data());
+    }
+
+    for (VehiclePhysics* v : stepVehicles)
+    {
+        v->finishStep(scene, timestep);
+    }
+
+    lastStepTime = getTime() - startTime;
+    lastStepVehicleCount = vehicleCount;
+    lastStepTaskCount = taskCount;
+}
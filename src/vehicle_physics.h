@@ -96,9 +96,15 @@ struct IgnoredGroundSpot
 class VehiclePhysics
 {
     PxVehicleDrive4W* vehicle4W;
-    VehicleSceneQueryData* sceneQueryData;
-    PxBatchQuery* batchQuery;
-    PxVehicleDrivableSurfaceToTireFrictionPairs* frictionPairs;
+    // owned by the vehicle unless it is stepped by a VehicleBatch, which shares its own
+    VehicleSceneQueryData* sceneQueryData = nullptr;
+    PxBatchQuery* batchQuery = nullptr;
+    PxVehicleDrivableSurfaceToTireFrictionPairs* frictionPairs = nullptr;
+    class VehicleBatch* batch = nullptr;
+    // the front tires use this tire type and the rear tires the one after it
+    u32 tireTypeOffset = 0;
+    bool isStepPending = false;
+    f32 accelInput = 0.f;
 	f32 engineThrottle = 0.f;
 	f32 topSpeedHandicapPercent = 1.f;
 	f32 accelHandicapPercent = 1.f;
@@ -107,21 +113,38 @@ class VehiclePhysics
 
 	bool isInAir = true;
 
+    // the poses after the last two physics steps, blended when drawing between steps
+    PxTransform previousPose = PxTransform(PxIdentity);
+    PxTransform currentPose = PxTransform(PxIdentity);
+
     SmallArray<GroundSpot, 16> groundSpots;
     SmallArray<IgnoredGroundSpot> ignoredGroundSpots;
 
     void checkGroundSpots(PxScene* physicsScene, f32 deltaTime);
     void updateWheelInfo(f32 deltaTime);
+    void finishStep(PxScene* scene, f32 timestep);
 
 public:
     WheelInfo wheelInfo[NUM_WHEELS];
 
-    void setup(void* userData, PxScene* scene, Mat4 const& transform, VehicleTuning* tuning);
+    void setup(void* userData, PxScene* scene, Mat4 const& transform, VehicleTuning* tuning,
+            class VehicleBatch* batch=nullptr);
     ~VehiclePhysics();
 
+    // applies the inputs for the next step; the vehicle is then stepped along with the others
+    // by VehicleBatch::step
+    void prepareStep(f32 timestep, bool digital, f32 accel, f32 brake, f32 steer,
+            bool handbrake, bool canGo, bool onlyBrake);
+    // steps a vehicle that isn't part of a batch on its own
     void update(PxScene* scene, f32 timestep, bool digital, f32 accel, f32 brake, f32 steer,
             bool handbrake, bool canGo, bool onlyBrake);
     void reset(Mat4 const& transform);
+    void capturePose()
+    {
+        previousPose = currentPose;
+        currentPose = getRigidBody()->getGlobalPose();
+    }
+    PxTransform getInterpolatedPose(f32 t) const { return interpolate(previousPose, currentPose, t); }
     f32 getEngineRPM() const { return vehicle4W->mDriveDynData.getEngineRotationSpeed() * 9.5493f + 900.f; }
     f32 getForwardSpeed() const { return vehicle4W->computeForwardSpeed(); }
     f32 getSidewaysSpeed() const { return vehicle4W->computeSidewaysSpeed(); }
@@ -141,4 +164,42 @@ public:
         accelHandicapPercent = accelPercent;
         topSpeedHandicapPercent = topSpeedPercent;
     }
+
+    friend class VehicleBatch;
+};
+
+// Steps all the vehicles of a scene together, with one set of suspension sweeps and one
+// PxVehicleUpdates call per physics step instead of one of each per vehicle. The tires of every
+// vehicle share one friction table, where each vehicle has its own pair of tire types so that oil
+// on one vehicle's tires doesn't change the grip of the others. With enough vehicles the update is
+// split across the worker threads.
+class VehicleBatch
+{
+    PxScene* scene = nullptr;
+    VehicleSceneQueryData* sceneQueryData = nullptr;
+    PxBatchQuery* batchQuery = nullptr;
+    PxVehicleDrivableSurfaceToTireFrictionPairs* frictionPairs = nullptr;
+    u32 maxVehicles = 0;
+    Array<VehiclePhysics*> vehicles;
+
+    // the vehicles that take part in the current step
+    Array<VehiclePhysics*> stepVehicles;
+    Array<PxVehicleWheels*> stepWheels;
+    Array<PxVehicleWheelQueryResult> stepQueryResults;
+    Array<PxVehicleWheelConcurrentUpdateData> concurrentWheelUpdates;
+    Array<PxVehicleConcurrentUpdateData> concurrentUpdates;
+
+public:
+    bool isConcurrentUpdateEnabled = true;
+    // how long the last step took and how many vehicles it stepped, shown in the debug overlay
+    f64 lastStepTime = 0.0;
+    u32 lastStepVehicleCount = 0;
+    u32 lastStepTaskCount = 0;
+
+    ~VehicleBatch() { destroy(); }
+    void setup(PxScene* scene, u32 maxVehicles);
+    void destroy();
+    u32 add(VehiclePhysics* vehicle, VehicleTuning const& tuning);
+    PxVehicleDrivableSurfaceToTireFrictionPairs* getFrictionPairs() const { return frictionPairs; }
+    void step(f32 timestep);
 };
@@ -2,18 +2,24 @@
 #include "resources.h"
 #include "vehicle.h"
 
+NamedResource<Sound> g_weaponDenySound("nono");
+
+void Weapon::playDenySound()
+{
+    g_audio.playSound(g_weaponDenySound, SoundType::GAME_SFX);
+}
+
 void Weapon::outOfAmmo(Vehicle* vehicle)
 {
     if (vehicle->driver->isPlayer)
     {
-        g_audio.playSound(g_res.getSound("nono"), SoundType::GAME_SFX);
+        playDenySound();
         // TODO: out of ammo notification?
     }
 }
 
-void Weapon::loadModelData(const char* modelName)
+void Weapon::loadModelData(Model* model)
 {
-    Model* model = g_res.getModel(modelName);
     for (auto const & obj : model->objects)
     {
         if (obj.name.find("SpawnPoint"))
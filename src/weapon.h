@@ -94,18 +94,23 @@ public:
     Mat4 mountTransform;
     SmallArray<Vec3, 3> projectileSpawnPoints;
 
-    void loadModelData(const char* modelName);
+    void loadModelData(class Model* model);
     void outOfAmmo(class Vehicle* vehicle);
+    static void playDenySound();
     virtual void initialize() {}
     virtual ~Weapon() {}
     u32 getMaxAmmo() const { return ammoUnitCount * upgradeLevel; }
     void refillAmmo() { ammo = getMaxAmmo(); }
     virtual void update(class Scene* scene, class Vehicle* vehicle,
             bool fireBegin, bool fireHold, f32 deltaTime) = 0;
+    // called before every physics step of a vehicle that isn't dead; forces that are applied
+    // over time go here so that they don't depend on the frame rate
+    virtual void onPhysicsStep(class Vehicle* vehicle, f32 timestep) {}
     virtual void render(class RenderWorld* rw, Mat4 const& vehicleTransform,
             struct VehicleConfiguration const& config, struct VehicleData const& vehicleData) {}
     virtual void reset() {}
     virtual f32 onDamage(f32 damage, class Vehicle* vehicle) { return damage; }
+    // asked by the AI, possibly on a worker thread, so random choices use the vehicle's series
     virtual bool shouldUse(class Scene* scene, class Vehicle* vehicle) { return false; }
 };
 
@@ -3,6 +3,8 @@
 #include "../weapon.h"
 #include "../vehicle.h"
 
+NamedResource<Texture> g_autoRepairIcon("icon_auto_repair");
+
 class WAutoRepair : public Weapon
 {
 public:
@@ -10,7 +12,7 @@ public:
     {
         info.name = "Auto Repair";
         info.description = "Slowly repairs damage over time.";
-        info.icon = g_res.getTexture("icon_auto_repair");
+        info.icon = g_autoRepairIcon;
         info.price = 2500;
         info.maxUpgradeLevel = 1;
         info.weaponType = WeaponType::SPECIAL_ABILITY;
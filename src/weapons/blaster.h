@@ -4,6 +4,13 @@
 #include "../vehicle.h"
 #include "../entities/projectile.h"
 
+NamedResource<Texture> g_blasterIcon("icon_blaster");
+NamedResource<Model> g_blasterModel("weapon_blaster");
+NamedMesh g_blasterBaseMesh("weapon_blaster", "blaster.BlasterBase");
+NamedMesh g_blasterBarrelMesh("weapon_blaster", "blaster.BlasterBarrel");
+NamedResource<Sound> g_blasterSound("blaster");
+NamedResource<Material> g_blasterMaterial("plastic");
+
 class WBlaster : public Weapon
 {
     Mesh* mesh;
@@ -16,17 +23,16 @@ public:
     {
         info.name = "Blaster";
         info.description = "High damage split into two shots.";
-        info.icon = g_res.getTexture("icon_blaster");
+        info.icon = g_blasterIcon;
         info.price = 800;
         info.maxUpgradeLevel = 5;
         info.weaponType = WeaponType::FRONT_WEAPON;
         info.tags[0] = "hood-1";
         info.tags[1] = "narrow";
 
-        loadModelData("weapon_blaster");
-        Model* model = g_res.getModel("weapon_blaster");
-        mesh = model->getMeshByName("blaster.BlasterBase");
-        meshBarrel = model->getMeshByName("blaster.BlasterBarrel");
+        loadModelData(g_blasterModel);
+        mesh = g_blasterBaseMesh;
+        meshBarrel = g_blasterBarrelMesh;
     }
 
     void update(Scene* scene, Vehicle* vehicle, bool fireBegin, bool fireHold,
@@ -61,7 +67,7 @@ public:
                     Projectile::BLASTER));
         scene->addEntity(new Projectile(pos2, vel, transform.zAxis(), vehicle->vehicleIndex,
                     Projectile::BLASTER));
-        g_audio.playSound3D(g_res.getSound("blaster"),
+        g_audio.playSound3D(g_blasterSound,
                 SoundType::GAME_SFX, vehicle->getPosition(), false,
                 random(scene->randomSeries, 0.95f, 1.05f), 1.f);
 
@@ -72,7 +78,7 @@ public:
     void render(class RenderWorld* rw, Mat4 const& vehicleTransform,
             VehicleConfiguration const& config, VehicleData const& vehicleData) override
     {
-        Material* mat = g_res.getMaterial("plastic");
+        Material* mat = g_blasterMaterial;
         mat->draw(rw, vehicleTransform * mountTransform, mesh, 2);
         mat->draw(rw, vehicleTransform * mountTransform
                 * Mat4::translation(Vec3(recoil, 0.f, 0.f)), meshBarrel, 2);
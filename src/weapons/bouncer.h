@@ -5,6 +5,13 @@
 #include "../entities/projectile.h"
 #include "../billboard.h"
 
+NamedResource<Texture> g_bouncerIcon("icon_bouncer");
+NamedResource<Model> g_bouncerModel("weapon_bouncer");
+NamedMesh g_bouncerMesh("weapon_bouncer", "bouncer.Bouncer");
+NamedResource<Sound> g_bouncerSound("bouncer_fire");
+NamedResource<Material> g_bouncerMaterial("plastic");
+NamedResource<Texture> g_bouncerGlowTexture("bouncer_projectile");
+
 class WBouncer : public Weapon
 {
     Mesh* mesh;
@@ -15,7 +22,7 @@ public:
     {
         info.name = "Bouncer";
         info.description = "Medium damage. Bounces off obstacles and follows slopes.";
-        info.icon = g_res.getTexture("icon_bouncer");
+        info.icon = g_bouncerIcon;
         info.price = 800;
         info.maxUpgradeLevel = 5;
         info.weaponType = WeaponType::FRONT_WEAPON;
@@ -23,8 +30,8 @@ public:
         info.tags[1] = "narrow";
         info.tags[2] = "roof-1";
 
-        loadModelData("weapon_bouncer");
-        mesh = g_res.getModel("weapon_bouncer")->getMeshByName("bouncer.Bouncer");
+        loadModelData(g_bouncerModel);
+        mesh = g_bouncerMesh;
     }
 
     void update(Scene* scene, Vehicle* vehicle, bool fireBegin, bool fireHold,
@@ -57,7 +64,7 @@ public:
         Vec3 pos = Vec3(transform * mountTransform * Vec4(projectileSpawnPoints[0], 1.f));
         scene->addEntity(new Projectile(pos,
                 vel, transform.zAxis(), vehicle->vehicleIndex, Projectile::BOUNCER));
-        g_audio.playSound3D(g_res.getSound("bouncer_fire"),
+        g_audio.playSound3D(g_bouncerSound,
                 SoundType::GAME_SFX, vehicle->getPosition(), false,
                 random(scene->randomSeries, 0.95f, 1.05f), 0.9f);
 
@@ -68,11 +75,11 @@ public:
     void render(class RenderWorld* rw, Mat4 const& vehicleTransform,
             VehicleConfiguration const& config, VehicleData const& vehicleData) override
     {
-        Material* mat = g_res.getMaterial("plastic");
+        Material* mat = g_bouncerMaterial;
         mat->draw(rw, vehicleTransform * mountTransform, mesh, 2);
         Vec3 pos = Vec3(vehicleTransform * mountTransform *
             Vec4(projectileSpawnPoints[0] + Vec3(0.01f, 0.f, 0.05f), 1.f));
-        drawBillboard(rw, g_res.getTexture("bouncer_projectile"),
+        drawBillboard(rw, g_bouncerGlowTexture,
                     pos, Vec4(1.f), 0.7f * glow, 0.f, false);
     }
 };
@@ -4,6 +4,9 @@
 #include "../vehicle.h"
 #include "../entities/mine.h"
 
+NamedResource<Texture> g_explosiveMineIcon("icon_mine");
+NamedResource<Sound> g_explosiveMineSound("thunk");
+
 class WExplosiveMine : public Weapon
 {
 public:
@@ -11,7 +14,7 @@ public:
     {
         info.name = "Exploding Mine";
         info.description = "It explodes";
-        info.icon = g_res.getTexture("icon_mine");
+        info.icon = g_explosiveMineIcon;
         info.price = 1250;
         info.maxUpgradeLevel = 4;
         info.weaponType = WeaponType::REAR_WEAPON;
@@ -36,7 +39,7 @@ public:
         if (!scene->raycastStatic(vehicle->getPosition(), down, 2.f, &hit,
                     COLLISION_FLAG_TERRAIN | COLLISION_FLAG_TRACK))
         {
-            g_audio.playSound(g_res.getSound("nono"), SoundType::GAME_SFX);
+            playDenySound();
             return;
         }
 
@@ -49,7 +52,7 @@ public:
         m[2] = Vec4(normalize(
                 cross(Vec3(m[0]), Vec3(m[1]))), m[2].w);
         scene->addEntity(new Mine(Mat4::translation(pos) * m, vehicle->vehicleIndex));
-        g_audio.playSound3D(g_res.getSound("thunk"), SoundType::GAME_SFX,
+        g_audio.playSound3D(g_explosiveMineSound, SoundType::GAME_SFX,
                 vehicle->getPosition(), false, 1.f, 0.9f);
 
         ammo -= 1;
@@ -59,6 +62,6 @@ public:
     {
         return vehicle->isOnTrack && vehicle->getAI()->aggression > 0.f
                 && ammo > 0 && vehicle->getForwardSpeed() > 10.f
-                && irandom(scene->randomSeries, 0, 100 + (i32)((1.f - vehicle->getAI()->aggression) * 100)) < 2;
+                && irandom(vehicle->aiRandomSeries, 0, 100 + (i32)((1.f - vehicle->getAI()->aggression) * 100)) < 2;
     }
 };
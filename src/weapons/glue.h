@@ -4,6 +4,9 @@
 #include "../vehicle.h"
 #include "../entities/glue.h"
 
+NamedResource<Texture> g_glueIcon("icon_glue");
+NamedResource<Sound> g_glueSound("glue");
+
 class WGlue : public Weapon
 {
 public:
@@ -11,7 +14,7 @@ public:
     {
         info.name = "Glue";
         info.description = "Force your opponents to slow down!";
-        info.icon = g_res.getTexture("icon_glue");
+        info.icon = g_glueIcon;
         info.price = 750;
         info.maxUpgradeLevel = 3;
         info.weaponType = WeaponType::REAR_WEAPON;
@@ -35,14 +38,14 @@ public:
         Vec3 down = convert(vehicle->getRigidBody()->getGlobalPose().q.getBasisVector2() * -1.f);
         if (!scene->raycastStatic(vehicle->getPosition(), down, 2.f, &hit, COLLISION_FLAG_TRACK))
         {
-            g_audio.playSound(g_res.getSound("nono"), SoundType::GAME_SFX);
+            playDenySound();
             return;
         }
 
         Vec3 pos = convert(hit.block.position);
         Glue* glue = new Glue(pos);
         scene->addEntity(glue);
-        g_audio.playSound3D(g_res.getSound("glue"), SoundType::GAME_SFX,
+        g_audio.playSound3D(g_glueSound, SoundType::GAME_SFX,
                 vehicle->getPosition(), false, 1.f, 0.9f);
         vehicle->getVehiclePhysics()->addIgnoredGroundSpot(glue);
 
@@ -53,6 +56,6 @@ public:
     {
         return vehicle->isOnTrack && vehicle->getAI()->aggression > 0.f
                 && ammo > 0 && vehicle->getForwardSpeed() > 10.f
-                && irandom(scene->randomSeries, 0, 140 + (i32)((1.f - vehicle->getAI()->aggression) * 140)) < 2;
+                && irandom(vehicle->aiRandomSeries, 0, 140 + (i32)((1.f - vehicle->getAI()->aggression) * 140)) < 2;
     }
 };
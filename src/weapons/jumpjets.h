@@ -4,6 +4,9 @@
 #include "../vehicle.h"
 #include "../entities/projectile.h"
 
+NamedResource<Texture> g_jumpJetsIcon("icon_jumpjet");
+NamedResource<Sound> g_jumpJetsSound("jumpjet");
+
 class WJumpJets : public Weapon
 {
     f32 t = 0.f;
@@ -15,7 +18,7 @@ public:
         info.description =
             "Propels the vehicle upwards with a single burst of energy.\n"
             "Useful for avoiding hazards.";
-        info.icon = g_res.getTexture("icon_jumpjet");
+        info.icon = g_jumpJetsIcon;
         info.price = 900;
         info.maxUpgradeLevel = 5;
         info.weaponType = WeaponType::REAR_WEAPON;
@@ -43,7 +46,7 @@ public:
             // TODO: play no-no sound
             return;
         }
-        g_audio.playSound3D(g_res.getSound("jumpjet"), SoundType::GAME_SFX,
+        g_audio.playSound3D(g_jumpJetsSound, SoundType::GAME_SFX,
                 vehicle->getPosition(), false, 1.f, 0.9f);
         PxVec3 vel = vehicle->getRigidBody()->getAngularVelocity();
         vel.x = 0.f;
@@ -61,6 +64,6 @@ public:
     bool shouldUse(Scene* scene, Vehicle* vehicle) override
     {
         return !vehicle->isInAir && ammo > 0 && vehicle->getForwardSpeed() > 13.f
-                && vehicle->isNearHazard && irandom(scene->randomSeries, 0, 8) < 2;
+                && vehicle->isNearHazard && irandom(vehicle->aiRandomSeries, 0, 8) < 2;
     }
 };
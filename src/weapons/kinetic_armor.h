@@ -4,6 +4,9 @@
 #include "../vehicle.h"
 #include "../entities/projectile.h"
 
+NamedResource<Texture> g_kineticArmorIcon("icon_kinetic_armor");
+NamedResource<Sound> g_kineticArmorSound("kinetic_armor");
+
 class WKineticArmor : public Weapon
 {
     f32 timer = 0.f;
@@ -13,7 +16,7 @@ public:
     {
         info.name = "Kinetic Armor";
         info.description = "Completely nullifies the first damage taken each lap.";
-        info.icon = g_res.getTexture("icon_kinetic_armor");
+        info.icon = g_kineticArmorIcon;
         info.price = 2000;
         info.maxUpgradeLevel = 1;
         info.weaponType = WeaponType::SPECIAL_ABILITY;
@@ -44,7 +47,7 @@ public:
         if (ammo > 0 && damage > 8.f)
         {
             ammo = 0;
-            g_audio.playSound3D(g_res.getSound("kinetic_armor"), SoundType::GAME_SFX, vehicle->getPosition());
+            g_audio.playSound3D(g_kineticArmorSound, SoundType::GAME_SFX, vehicle->getPosition());
 
             // Add a small time window of invulnerability. Without it would only absorb one bullet
             // from a scattergun shot
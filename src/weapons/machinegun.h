@@ -4,6 +4,13 @@
 #include "../vehicle.h"
 #include "../entities/projectile.h"
 
+NamedResource<Texture> g_machineGunIcon("icon_mg");
+NamedResource<Model> g_machineGunModel("weapon_minigun");
+NamedMesh g_machineGunMesh("weapon_minigun", "minigun.Minigun");
+NamedMesh g_machineGunBarrelMesh("weapon_minigun", "minigun.MinigunBarrel");
+NamedResource<Sound> g_machineGunSound("mg2");
+NamedResource<Material> g_machineGunMaterial("plastic");
+
 class WMachineGun : public Weapon
 {
     f32 repeatTimer = 0.f;
@@ -17,7 +24,7 @@ public:
     {
         info.name = "Machine Gun";
         info.description = "Low damage but high rate of fire.";
-        info.icon = g_res.getTexture("icon_mg");
+        info.icon = g_machineGunIcon;
         info.price = 1000;
         info.maxUpgradeLevel = 5;
         info.weaponType = WeaponType::FRONT_WEAPON;
@@ -27,10 +34,9 @@ public:
         ammoUnitCount = 18;
         fireMode = FireMode::CONTINUOUS;
 
-        loadModelData("weapon_minigun");
-        Model* model = g_res.getModel("weapon_minigun");
-        mesh = model->getMeshByName("minigun.Minigun");
-        meshBarrel = model->getMeshByName("minigun.MinigunBarrel");
+        loadModelData(g_machineGunModel);
+        mesh = g_machineGunMesh;
+        meshBarrel = g_machineGunBarrelMesh;
     }
 
     void update(Scene* scene, Vehicle* vehicle, bool fireBegin, bool fireHold,
@@ -73,7 +79,7 @@ public:
         scene->addEntity(new Projectile(pos,
                 vel, transform.zAxis(), vehicle->vehicleIndex, Projectile::BULLET));
 
-        g_audio.playSound3D(g_res.getSound("mg2"),
+        g_audio.playSound3D(g_machineGunSound,
                 SoundType::GAME_SFX, vehicle->getPosition(), false,
                 random(scene->randomSeries, 0.95f, 1.05f), 1.f,
                 random(scene->randomSeries, -0.05f, 0.05f));
@@ -86,7 +92,7 @@ public:
     void render(class RenderWorld* rw, Mat4 const& vehicleTransform,
             VehicleConfiguration const& config, VehicleData const& vehicleData) override
     {
-        Material* mat = g_res.getMaterial("plastic");
+        Material* mat = g_machineGunMaterial;
         mat->draw(rw, vehicleTransform * mountTransform, mesh, 2);
         mat->draw(rw, vehicleTransform * mountTransform
                     * Mat4::translation(Vec3(0.556007f, 0, 0.397523f))
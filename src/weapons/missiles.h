@@ -4,6 +4,12 @@
 #include "../vehicle.h"
 #include "../entities/projectile.h"
 
+NamedResource<Texture> g_missilesIcon("icon_missile");
+NamedMesh g_missilesMesh("weapon_missile", "missile.Missile");
+NamedMesh g_missilesMountMesh("weapon_missile", "missile.Mount");
+NamedResource<Sound> g_missilesSound("missile");
+NamedResource<Material> g_missilesMaterial("plastic");
+
 class WMissiles : public Weapon
 {
     Mesh* mesh;
@@ -14,16 +20,15 @@ public:
     {
         info.name = "Missiles";
         info.description = "Deals high damage and follows slopes!";
-        info.icon = g_res.getTexture("icon_missile");
+        info.icon = g_missilesIcon;
         info.price = 1000;
         info.maxUpgradeLevel = 5;
         info.weaponType = WeaponType::FRONT_WEAPON;
         info.tags[0] = "hood-1";
         info.tags[1] = "roof-1";
 
-        Model* model = g_res.getModel("weapon_missile");
-        mesh = model->getMeshByName("missile.Missile");
-        mountMesh = model->getMeshByName("missile.Mount");
+        mesh = g_missilesMesh;
+        mountMesh = g_missilesMountMesh;
     }
 
     void update(Scene* scene, Vehicle* vehicle, bool fireBegin, bool fireHold,
@@ -51,7 +56,7 @@ public:
         Vec3 pos = Vec3(transform * mountTransform * Vec4(missileSpawnPoint(ammo - 1), 1.f));
         scene->addEntity(new Projectile(pos,
                 vel, transform.zAxis(), vehicle->vehicleIndex, Projectile::MISSILE));
-        g_audio.playSound3D(g_res.getSound("missile"),
+        g_audio.playSound3D(g_missilesSound,
                 SoundType::GAME_SFX, vehicle->getPosition(), false,
                 random(scene->randomSeries, 0.95f, 1.05f), 0.9f);
 
@@ -68,7 +73,7 @@ public:
     void render(class RenderWorld* rw, Mat4 const& vehicleTransform,
             VehicleConfiguration const& config, VehicleData const& vehicleData) override
     {
-        Material* mat = g_res.getMaterial("plastic");
+        Material* mat = g_missilesMaterial;
         for (u32 i=0; i<info.maxUpgradeLevel; ++i)
         {
             Mat4 t = vehicleTransform * mountTransform
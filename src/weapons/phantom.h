@@ -4,6 +4,13 @@
 #include "../vehicle.h"
 #include "../entities/projectile.h"
 
+NamedResource<Texture> g_phantomIcon("icon_phantom");
+NamedResource<Model> g_phantomModel("weapon_blaster");
+NamedMesh g_phantomBaseMesh("weapon_blaster", "blaster.BlasterBase");
+NamedMesh g_phantomBarrelMesh("weapon_blaster", "blaster.BlasterBarrel");
+NamedResource<Sound> g_phantomSound("blaster");
+NamedResource<Material> g_phantomMaterial("plastic");
+
 class WPhantom : public Weapon
 {
     Mesh* mesh;
@@ -16,17 +23,16 @@ public:
     {
         info.name = "Phantom";
         info.description = "Can hit multiple targets with a single shot by passing through vehicles!";
-        info.icon = g_res.getTexture("icon_phantom");
+        info.icon = g_phantomIcon;
         info.price = 1100;
         info.maxUpgradeLevel = 5;
         info.weaponType = WeaponType::FRONT_WEAPON;
         info.tags[0] = "hood-1";
         info.tags[1] = "narrow";
 
-        loadModelData("weapon_blaster");
-        Model* model = g_res.getModel("weapon_blaster");
-        mesh = model->getMeshByName("blaster.BlasterBase");
-        meshBarrel = model->getMeshByName("blaster.BlasterBarrel");
+        loadModelData(g_phantomModel);
+        mesh = g_phantomBaseMesh;
+        meshBarrel = g_phantomBarrelMesh;
     }
 
     void update(Scene* scene, Vehicle* vehicle, bool fireBegin, bool fireHold,
@@ -61,7 +67,7 @@ public:
                     Projectile::PHANTOM));
         scene->addEntity(new Projectile(pos2, vel, transform.zAxis(), vehicle->vehicleIndex,
                     Projectile::PHANTOM));
-        g_audio.playSound3D(g_res.getSound("blaster"),
+        g_audio.playSound3D(g_phantomSound,
                 SoundType::GAME_SFX, vehicle->getPosition(), false,
                 random(scene->randomSeries, 0.95f, 1.05f), 1.f);
 
@@ -72,7 +78,7 @@ public:
     void render(class RenderWorld* rw, Mat4 const& vehicleTransform,
             VehicleConfiguration const& config, VehicleData const& vehicleData) override
     {
-        Material* mat = g_res.getMaterial("plastic");
+        Material* mat = g_phantomMaterial;
         mat->draw(rw, vehicleTransform * mountTransform, mesh, 2);
         mat->draw(rw, vehicleTransform * mountTransform
                 * Mat4::translation(Vec3(recoil, 0.f, 0.f)), meshBarrel, 2);
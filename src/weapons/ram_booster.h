@@ -4,6 +4,8 @@
 #include "../vehicle.h"
 #include "../entities/projectile.h"
 
+NamedResource<Texture> g_ramBoosterIcon("icon_spikes");
+
 class WRamBooster : public Weapon
 {
 public:
@@ -11,7 +13,7 @@ public:
     {
         info.name = "Ram Booster";
         info.description = "Bonus ramming damage against your opponents,\nbut less damage to you!";
-        info.icon = g_res.getTexture("icon_spikes");
+        info.icon = g_ramBoosterIcon;
         info.price = 4000;
         info.maxUpgradeLevel = 1;
         info.weaponType = WeaponType::SPECIAL_ABILITY;
@@ -4,6 +4,11 @@
 #include "../vehicle.h"
 #include "../entities/projectile.h"
 
+NamedResource<Texture> g_rocketBoosterIcon("icon_rocketbooster");
+NamedMesh g_rocketBoosterExhaustMesh("exhaust_cone", "world.Cone");
+NamedResource<Sound> g_rocketBoosterSound("rocketboost");
+NamedResource<Texture> g_rocketBoosterFlamesTexture("flames");
+
 class WRocketBooster : public Weapon
 {
     f32 boostTimer = 0.f;
@@ -15,12 +20,12 @@ public:
     {
         info.name = "Rocket Booster";
         info.description = "It's like nitrous, but better!";
-        info.icon = g_res.getTexture("icon_rocketbooster");
+        info.icon = g_rocketBoosterIcon;
         info.price = 1000;
         info.maxUpgradeLevel = 4;
         info.weaponType = WeaponType::REAR_WEAPON;
 
-        mesh = g_res.getModel("exhaust_cone")->getMeshByName("world.Cone");
+        mesh = g_rocketBoosterExhaustMesh;
     }
 
     void reset() override
@@ -33,10 +38,6 @@ public:
     {
         if (boostTimer > 0.f)
         {
-            vehicle->getRigidBody()->addForce(
-                    convert(vehicle->getForwardVector() * 9.f),
-                    PxForceMode::eACCELERATION);
-            boostTimer = max(boostTimer - deltaTime, 0.f);
             g_audio.setSoundPosition(boostSound, vehicle->getPosition());
             vehicle->setMotionBlur(min(boostTimer, 1.f), 0.1f);
             return;
@@ -50,7 +51,7 @@ public:
                 return;
             }
 
-            boostSound = g_audio.playSound3D(g_res.getSound("rocketboost"),
+            boostSound = g_audio.playSound3D(g_rocketBoosterSound,
                     SoundType::GAME_SFX, vehicle->getPosition(), false, 1.f, 0.8f);
 
             boostTimer = 1.4f;
@@ -58,6 +59,18 @@ public:
         }
     }
 
+    void onPhysicsStep(Vehicle* vehicle, f32 timestep) override
+    {
+        // the boost lasts a fixed number of steps and pushes the same amount in each one
+        if (boostTimer > 0.f)
+        {
+            vehicle->getRigidBody()->addForce(
+                    convert(vehicle->getForwardVector() * 9.f * timestep),
+                    PxForceMode::eVELOCITY_CHANGE);
+            boostTimer = max(boostTimer - timestep, 0.f);
+        }
+    }
+
     void render(class RenderWorld* rw, Mat4 const& vehicleTransform,
             VehicleConfiguration const& config, VehicleData const& vehicleData) override
     {
@@ -88,7 +101,7 @@ public:
 
         auto render = [](void* renderData) {
             Flames* flames = (Flames*)renderData;
-            glBindTextureUnit(0, g_res.getTexture("flames")->handle);
+            glBindTextureUnit(0, g_rocketBoosterFlamesTexture->handle);
             glBindVertexArray(flames->vao);
             for (u32 i=0; i<flames->exhaustCount; ++i)
             {
@@ -107,6 +120,6 @@ public:
     bool shouldUse(Scene* scene, Vehicle* vehicle) override
     {
         return !vehicle->isInAir && ammo > 0 && vehicle->getForwardSpeed() > 5.f
-                && irandom(scene->randomSeries, 0, 100 - (i32)vehicle->isFollowed * 50) < 2;
+                && irandom(vehicle->aiRandomSeries, 0, 100 - (i32)vehicle->isFollowed * 50) < 2;
     }
 };
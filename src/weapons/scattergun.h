@@ -4,6 +4,12 @@
 #include "../vehicle.h"
 #include "../entities/projectile.h"
 
+NamedResource<Texture> g_scatterGunIcon("icon_scattergun");
+NamedResource<Model> g_scatterGunModel("weapon_scattergun");
+NamedMesh g_scatterGunMesh("weapon_scattergun", "Cube");
+NamedResource<Sound> g_scatterGunSound("scattergun");
+NamedResource<Material> g_scatterGunMaterial("plastic");
+
 class WScatterGun : public Weapon
 {
     Mesh* mesh;
@@ -14,7 +20,7 @@ public:
     {
         info.name = "Scatter Gun";
         info.description = "Wide area of effect. Hard to miss!";
-        info.icon = g_res.getTexture("icon_scattergun");
+        info.icon = g_scatterGunIcon;
         info.price = 900;
         info.maxUpgradeLevel = 5;
         info.weaponType = WeaponType::FRONT_WEAPON;
@@ -24,9 +30,8 @@ public:
         ammoUnitCount = 1;
         fireMode = FireMode::ONE_SHOT;
 
-        loadModelData("weapon_scattergun");
-        Model* model = g_res.getModel("weapon_scattergun");
-        mesh = model->getMeshByName("Cube");
+        loadModelData(g_scatterGunModel);
+        mesh = g_scatterGunMesh;
     }
 
     void update(Scene* scene, Vehicle* vehicle, bool fireBegin, bool fireHold,
@@ -61,7 +66,7 @@ public:
             scene->addEntity(new Projectile(pos,
                     v, transform.zAxis(), vehicle->vehicleIndex, Projectile::BULLET_SMALL));
         }
-        g_audio.playSound3D(g_res.getSound("scattergun"),
+        g_audio.playSound3D(g_scatterGunSound,
                 SoundType::GAME_SFX, vehicle->getPosition(), false,
                 random(scene->randomSeries, 0.95f, 1.05f), 1.f,
                 random(scene->randomSeries, -0.05f, 0.05f));
@@ -72,7 +77,7 @@ public:
     void render(class RenderWorld* rw, Mat4 const& vehicleTransform,
             VehicleConfiguration const& config, VehicleData const& vehicleData) override
     {
-        Material* mat = g_res.getMaterial("plastic");
+        Material* mat = g_scatterGunMaterial;
         mat->draw(rw, vehicleTransform * mountTransform, mesh, 2);
     }
 };
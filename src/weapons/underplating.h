@@ -4,6 +4,8 @@
 #include "../vehicle.h"
 #include "../entities/projectile.h"
 
+NamedResource<Texture> g_underplatingIcon("icon_underplating");
+
 class WUnderPlating : public Weapon
 {
 public:
@@ -11,7 +13,7 @@ public:
     {
         info.name = "Underplating";
         info.description = "Provides immunity to damage from mines.";
-        info.icon = g_res.getTexture("icon_underplating");
+        info.icon = g_underplatingIcon;
         info.price = 2000;
         info.maxUpgradeLevel = 1;
         info.weaponType = WeaponType::SPECIAL_ABILITY;
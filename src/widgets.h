@@ -39,10 +39,20 @@ namespace gui
 
         Sized(Constraints const& constraints) : Widget("Sized"), constraints(constraints) {}
 
+        // the constraints are clamped to the screen, which is the size of the GUI root; the
+        // root member of the widget is only the root of its own subtree
+        virtual u64 hashLayoutInputs(u64 h) const override
+        {
+            h = Widget::hashLayoutInputs(hashLayoutTag(h, "Sized"));
+            return hashValue(hashValue(h, constraints), gui::root->desiredSize);
+        }
+
         virtual void computeSize(Constraints const& constraints) override
         {
-            this->constraints.maxWidth = clamp(this->constraints.maxWidth, 0.f, root->computedSize.x);
-            this->constraints.maxHeight = clamp(this->constraints.maxHeight, 0.f, root->computedSize.y);
+            this->constraints.maxWidth =
+                clamp(this->constraints.maxWidth, 0.f, gui::root->desiredSize.x);
+            this->constraints.maxHeight =
+                clamp(this->constraints.maxHeight, 0.f, gui::root->desiredSize.y);
             Widget::computeSize(this->constraints);
         }
     };
@@ -65,6 +75,13 @@ namespace gui
             font = &g_res.getFont(fontDescription.fontName, (u32)(fontDescription.fontSize * guiScale));
         }
 
+        virtual u64 hashLayoutInputs(u64 h) const override
+        {
+            h = hashValue(hashLayoutTag(h, "Text"), font->getFace());
+            h = hashValue(h, font->getFaceScale());
+            return hashBytes(h, text, strlen(text));
+        }
+
         virtual void computeSize(Constraints const& constraints) override
         {
             desiredSize = font->stringDimensions(text);
@@ -127,6 +144,15 @@ namespace gui
             : Widget("Image"), tex(tex), preserveAspectRatio(preserveAspectRatio), flipX(flipX),
               flipY(flipY), color(color) {}
 
+        virtual u64 hashLayoutInputs(u64 h) const override
+        {
+            h = Widget::hashLayoutInputs(hashLayoutTag(h, "Image"));
+            h = hashValue(h, tex->width);
+            h = hashValue(h, tex->height);
+            h = hashValue(h, preserveAspectRatio);
+            return hashValue(h, guiScale);
+        }
+
         virtual void computeSize(Constraints const& constraints) override
         {
             if (desiredSize.x == 0.f)
@@ -203,6 +229,11 @@ namespace gui
             adjustScale();
         }
 
+        virtual u64 hashLayoutInputs(u64 h) const override
+        {
+            return hashValue(Widget::hashLayoutInputs(hashLayoutTag(h, "Border")), borders);
+        }
+
         void adjustScale()
         {
             this->borders.left   = floorf(borders.left   * guiScale);
@@ -233,7 +264,7 @@ namespace gui
 
                 for (Widget* child = childFirst; child; child = child->neighbor)
                 {
-                    child->computeSize(childConstraints);
+                    child->updateSize(childConstraints);
                     maxDim = max(maxDim, child->computedSize);
                 }
             }
@@ -354,6 +385,12 @@ namespace gui
         Container(Vec4 const& backgroundColor)
             : Widget("Container"), backgroundColor(backgroundColor) {}
 
+        virtual u64 hashLayoutInputs(u64 h) const override
+        {
+            h = Widget::hashLayoutInputs(hashLayoutTag(h, "Container"));
+            return hashValue(hashValue(h, padding), margin);
+        }
+
         void adjustScale()
         {
             padding.left   = floorf(padding.left   * guiScale);
@@ -391,7 +428,7 @@ namespace gui
 
                 for (Widget* child = childFirst; child; child = child->neighbor)
                 {
-                    child->computeSize(childConstraints);
+                    child->updateSize(childConstraints);
                     maxDim = max(maxDim, child->computedSize);
                 }
             }
@@ -459,13 +496,17 @@ namespace gui
     struct Row : public Widget
     {
         f32 itemSpacing;
-        f32 totalWidthOfChildren;
         HAlign halign;
         VAlign valign;
 
         Row(f32 itemSpacing=0.f, HAlign halign = HAlign::LEFT, VAlign valign = VAlign::TOP)
             : Widget("Row"), itemSpacing(itemSpacing * guiScale), halign(halign), valign(valign) {}
 
+        virtual u64 hashLayoutInputs(u64 h) const override
+        {
+            return hashValue(Widget::hashLayoutInputs(hashLayoutTag(h, "Row")), itemSpacing);
+        }
+
         virtual void computeSize(Constraints const& constraints) override
         {
             Constraints childConstraints;
@@ -474,11 +515,11 @@ namespace gui
             childConstraints.minHeight = 0.f;
             childConstraints.maxHeight = constraints.maxHeight;
 
-            totalWidthOfChildren = 0.f;
+            f32 totalWidthOfChildren = 0.f;
             f32 maxHeight = 0.f;
             for (Widget* child = childFirst; child; child = child->neighbor)
             {
-                child->computeSize(childConstraints);
+                child->updateSize(childConstraints);
                 totalWidthOfChildren += child->computedSize.x + itemSpacing;
                 maxHeight = max(maxHeight, child->computedSize.y);
                 assert(child->desiredSize.x != INFINITY);
@@ -494,6 +535,14 @@ namespace gui
 
         virtual void layout(GuiContext const& ctx) override
         {
+            // summed here rather than kept from computeSize(), which is skipped when the size
+            // is reused from the previous frame
+            f32 totalWidthOfChildren = 0.f;
+            for (Widget* child = childFirst; child; child = child->neighbor)
+            {
+                totalWidthOfChildren += child->computedSize.x + itemSpacing;
+            }
+
             f32 offset = 0;
             for (Widget* child = childFirst; child; child = child->neighbor)
             {
@@ -537,13 +586,17 @@ namespace gui
     struct Column : public Widget
     {
         f32 itemSpacing;
-        f32 totalHeightOfChildren;
         HAlign halign;
         VAlign valign;
 
         Column(f32 itemSpacing=0.f, HAlign halign=HAlign::LEFT, VAlign valign=VAlign::TOP)
             : Widget("Column"), itemSpacing(itemSpacing * guiScale), halign(halign), valign(valign) {}
 
+        virtual u64 hashLayoutInputs(u64 h) const override
+        {
+            return hashValue(Widget::hashLayoutInputs(hashLayoutTag(h, "Column")), itemSpacing);
+        }
+
         virtual void computeSize(Constraints const& constraints) override
         {
             Constraints childConstraints;
@@ -552,11 +605,11 @@ namespace gui
             childConstraints.minHeight = 0.f;
             childConstraints.maxHeight = constraints.maxHeight;
 
-            totalHeightOfChildren = 0.f;
+            f32 totalHeightOfChildren = 0.f;
             f32 maxWidth = 0.f;
             for (Widget* child = childFirst; child; child = child->neighbor)
             {
-                child->computeSize(childConstraints);
+                child->updateSize(childConstraints);
                 totalHeightOfChildren += child->computedSize.y + itemSpacing;
                 maxWidth = max(maxWidth, child->computedSize.x);
                 assert(child->desiredSize.y != INFINITY);
@@ -572,6 +625,12 @@ namespace gui
 
         virtual void layout(GuiContext const& ctx) override
         {
+            f32 totalHeightOfChildren = 0.f;
+            for (Widget* child = childFirst; child; child = child->neighbor)
+            {
+                totalHeightOfChildren += child->computedSize.y + itemSpacing;
+            }
+
             f32 offset = 0;
             for (Widget* child = childFirst; child; child = child->neighbor)
             {
@@ -626,6 +685,12 @@ namespace gui
             return this;
         }
 
+        virtual u64 hashLayoutInputs(u64 h) const override
+        {
+            h = Widget::hashLayoutInputs(hashLayoutTag(h, "Grid"));
+            return hashValue(hashValue(h, columns), itemSpacing);
+        }
+
         virtual void computeSize(Constraints const& constraints) override
         {
             computedSize.x = clamp(desiredSize.x, constraints.minWidth, constraints.maxWidth);
@@ -642,7 +707,7 @@ namespace gui
             u32 rowChildCount = 0;
             for (Widget* child = childFirst; child; child = child->neighbor)
             {
-                child->computeSize(childConstraints);
+                child->updateSize(childConstraints);
                 maxRowHeight = max(maxRowHeight, child->computedSize.y);
 
                 if (rowChildCount == 0)
@@ -1579,6 +1644,13 @@ namespace gui
             Widget::layout(ctx);
         }
 
+        virtual u64 hashLayoutInputs(u64 h) const override
+        {
+            // sizes the transform from the desired size and the gui scale
+            h = Widget::hashLayoutInputs(hashLayoutTag(h, "ScaleAnimation"));
+            return hashValue(h, guiScale);
+        }
+
         virtual void computeSize(Constraints const& constraints) override
         {
             transform->size(desiredSize);